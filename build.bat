@@ -1,3 +1,9 @@
 cls
-g++ -o app main.cpp rsc/app_res.o -Os -g -s -lwinmm -lgdi32 -mwindows -std=c++23
+g++ -o app main.cpp rsc/app_res.o -Os -g -s -lwinmm -lgdi32 -ldwmapi -lwsock32 -mwindows -std=c++23
+rem `build.bat embed` packs the sounds and default config into app.exe.
+if "%1"=="embed" (
+  app.exe --pack-assets rsc/assets.pak
+  windres -DEMBED_ASSETS --include-dir rsc --include-dir assets/icon rsc/app.rc -O coff -o rsc/app_res_embed.o
+  g++ -o app main.cpp rsc/app_res_embed.o -Os -g -s -lwinmm -lgdi32 -ldwmapi -lwsock32 -mwindows -std=c++23
+)
 app.exe
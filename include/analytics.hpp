@@ -0,0 +1,483 @@
+#pragma once
+
+#include "game.hpp"
+#include "hit_events.hpp"
+#include "tick_archive.hpp"
+
+// Paddle-hit heatmaps and rally-length distributions from the hit events of
+// played matches, of simulated AI-against-AI matches, or both:
+//   pingpong.exe --analytics                   every stats/hits/*.hits
+//   pingpong.exe --analytics --simulate 2000 [--difficulty hard]
+//                [--seconds 120] [--out analytics] [--ticks file.ticks]
+//                [file.hits ...]
+//
+// Simulations and the crunching both run on the thread pool. The events are
+// cut into chunks at rally boundaries, each chunk is summarised on its own
+// and the summaries are added up. The charts are drawn by the game's
+// renderer and saved as PNG.
+
+namespace game {
+namespace analytics {
+constexpr i32 OFFSET_BINS = 32;
+constexpr float OFFSET_RANGE = 1.2f;
+constexpr i32 DP_BINS = 48;
+constexpr float DP_RANGE = 320.0f;
+constexpr i32 MAX_RALLY = 40; // the last bin holds every longer rally
+constexpr size_t CHUNK_EVENTS = 1 << 16;
+
+struct Summary {
+  u64 matches = 0;
+  u64 hits[2] = {};
+  u64 goals[2] = {};
+  u64 centre_hits[2] = {};
+  double offset_sum[2] = {};
+  double speed_sum[2] = {};
+  // Rows are where on the paddle the ball landed, top first; columns are
+  // the paddle's speed, moving up on the left.
+  u64 heat[2][OFFSET_BINS][DP_BINS] = {};
+  u64 rallies[MAX_RALLY + 1] = {};
+  u64 rally_count = 0;
+  u64 rally_hits = 0;
+  u64 longest = 0;
+
+  void add_rally(u64 length) {
+    rallies[std::min<u64>(length, MAX_RALLY)]++;
+    rally_count++;
+    rally_hits += length;
+    longest = std::max(longest, length);
+  }
+
+  void add(const Summary &other) {
+    matches += other.matches;
+    for (i32 p = 0; p < 2; ++p) {
+      hits[p] += other.hits[p];
+      goals[p] += other.goals[p];
+      centre_hits[p] += other.centre_hits[p];
+      offset_sum[p] += other.offset_sum[p];
+      speed_sum[p] += other.speed_sum[p];
+      for (i32 y = 0; y < OFFSET_BINS; ++y)
+        for (i32 x = 0; x < DP_BINS; ++x)
+          heat[p][y][x] += other.heat[p][y][x];
+    }
+    for (i32 i = 0; i <= MAX_RALLY; ++i)
+      rallies[i] += other.rallies[i];
+    rally_count += other.rally_count;
+    rally_hits += other.rally_hits;
+    longest = std::max(longest, other.longest);
+  }
+
+  // The smallest length at least `fraction` of the rallies are as short as.
+  u64 rally_percentile(double fraction) const {
+    u64 target = static_cast<u64>(std::ceil(fraction * rally_count));
+    u64 seen = 0;
+    for (i32 i = 0; i <= MAX_RALLY; ++i) {
+      seen += rallies[i];
+      if (seen >= std::max<u64>(target, 1))
+        return i;
+    }
+    return MAX_RALLY;
+  }
+};
+
+inline i32 bin(float value, float range, i32 bins) {
+  i32 b = static_cast<i32>((value + range) / (2.0f * range) * bins);
+  return utils::clamp(0, b, bins - 1);
+}
+
+// A rally ends with a goal, or is cut short by the next match or the end of
+// the events, where it counts only if the ball was hit.
+inline void summarise(std::span<const HitEvent> events, Summary &out) {
+  u64 rally = 0;
+  for (const HitEvent &e : events) {
+    i32 p = e.paddle == 2 ? 1 : 0;
+    switch (e.kind) {
+    case EVENT_MATCH:
+      if (rally > 0)
+        out.add_rally(rally);
+      rally = 0;
+      out.matches++;
+      break;
+    case EVENT_GOAL:
+      out.add_rally(rally);
+      rally = 0;
+      out.goals[p]++;
+      break;
+    case EVENT_HIT: {
+      rally++;
+      float offset = e.hit_offset();
+      out.hits[p]++;
+      out.offset_sum[p] += offset;
+      out.speed_sum[p] += e.ball_speed();
+      if (std::fabs(offset) < 0.25f)
+        out.centre_hits[p]++;
+      out.heat[p][bin(offset, OFFSET_RANGE, OFFSET_BINS)]
+              [bin(e.paddle_speed(), DP_RANGE, DP_BINS)]++;
+    } break;
+    }
+  }
+  if (rally > 0)
+    out.add_rally(rally);
+}
+
+// Splits the events into chunks of about CHUNK_EVENTS that start at a rally
+// boundary: right after a goal or right at the start of a match.
+inline std::vector<std::span<const HitEvent>>
+chunk(const std::vector<std::vector<HitEvent>> &sources) {
+  std::vector<std::span<const HitEvent>> chunks;
+  for (const std::vector<HitEvent> &events : sources) {
+    size_t begin = 0;
+    size_t i = std::min(CHUNK_EVENTS, events.size());
+    while (i < events.size()) {
+      if (events[i].kind == EVENT_MATCH || events[i - 1].kind == EVENT_GOAL) {
+        chunks.emplace_back(events.data() + begin, i - begin);
+        begin = i;
+        i = std::min(i + CHUNK_EVENTS, events.size());
+      } else {
+        i++;
+      }
+    }
+    if (begin < events.size())
+      chunks.emplace_back(events.data() + begin, events.size() - begin);
+  }
+  return chunks;
+}
+
+// A task takes consecutive chunks until it has about CHUNK_EVENTS, so a
+// few thousand short simulated matches do not each need a summary.
+inline Summary crunch(const std::vector<std::vector<HitEvent>> &sources,
+                      utils::ThreadPool &pool) {
+  std::vector<std::span<const HitEvent>> chunks = chunk(sources);
+  std::vector<size_t> tasks = {0};
+  size_t events = 0;
+  for (size_t i = 0; i < chunks.size(); ++i) {
+    events += chunks[i].size();
+    if (events >= CHUNK_EVENTS || i + 1 == chunks.size()) {
+      tasks.push_back(i + 1);
+      events = 0;
+    }
+  }
+  std::vector<Summary> partial(tasks.size() - 1);
+  pool.parallel_for(partial.size(), [&](size_t t) {
+    for (size_t i = tasks[t]; i < tasks[t + 1]; ++i)
+      summarise(chunks[i], partial[t]);
+  });
+  Summary total;
+  for (const Summary &s : partial)
+    total.add(s);
+  return total;
+}
+
+// One match with the AI on both sides, as fast as it runs. A renderer
+// without a frame buffer makes the match only simulate. The easier AIs
+// never roll the dice, so the seed also picks ball and paddle speeds
+// within a tenth of the defaults; otherwise every match would be the same.
+// With `ticks`, the state after every tick is kept too.
+inline std::vector<HitEvent>
+simulate(u32 seed, objects::AIDifficulty level, float seconds,
+         std::vector<ticks::Tick> *ticks = nullptr) {
+  render::Renderer renderer;
+  Match match(renderer);
+  MatchSettings settings;
+  utils::Random random;
+  random.seed(seed);
+  settings.seed = seed;
+  settings.ball_speed *= 0.9f + 0.2f * random.unit();
+  settings.paddle_speed *= 0.9f + 0.2f * random.unit();
+  settings.ai_difficulty = level;
+  settings.duration_secs = seconds;
+  match.start(settings);
+  match.player1.ai_mode = true;
+
+  HitLog log;
+  log.begin_match(static_cast<u8>(level));
+  match.ball.controller.hit_log = &log;
+  const float dt = 1.0f / 60.0f;
+  const i32 max_ticks = static_cast<i32>((seconds + 60.0f) * 60.0f);
+  for (i32 t = 0; t < max_ticks; ++t) {
+    bool over = match.tick(dt);
+    if (ticks)
+      ticks->push_back(ticks::sample(match, seed, static_cast<u32>(t)));
+    if (over)
+      break;
+  }
+  return std::move(log.events);
+}
+
+struct Canvas {
+  std::vector<u32> pixels;
+  render::Renderer renderer;
+
+  Canvas(i32 width, i32 height)
+      : pixels(static_cast<size_t>(width) * height, 0x00181828) {
+    renderer.render_state.memory = pixels.data();
+    renderer.render_state.width = width;
+    renderer.render_state.height = height;
+    renderer.render_state.pitch = width;
+  }
+
+  bool save(const std::string &path) {
+    renderer.flush();
+    const render::RenderState &state = renderer.render_state;
+    std::vector<u8> png = capture::encode_image(
+        pixels.data(), state.width, state.height, state.pitch,
+        capture::IMAGE_PNG);
+    std::ofstream out(path, std::ios::binary | std::ios::trunc);
+    out.write(reinterpret_cast<const char *>(png.data()),
+              static_cast<std::streamsize>(png.size()));
+    return static_cast<bool>(out);
+  }
+};
+
+// Dark blue through red and orange to pale yellow.
+inline u32 heat_color(float t) {
+  static const u32 stops[] = {0x00141430, 0x002040B0, 0x00B02860,
+                              0x00F08830, 0x00FFF0A0};
+  const i32 last = static_cast<i32>(std::size(stops)) - 1;
+  float at = utils::clamp(0.0f, t, 1.0f) * last;
+  i32 i = std::min(static_cast<i32>(at), last - 1);
+  float f = at - i;
+  u32 color = 0;
+  for (i32 shift = 0; shift < 24; shift += 8) {
+    float a = static_cast<float>((stops[i] >> shift) & 0xFF);
+    float b = static_cast<float>((stops[i + 1] >> shift) & 0xFF);
+    color |= static_cast<u32>(a + (b - a) * f) << shift;
+  }
+  return color;
+}
+
+// Counts on a log scale, so the rare edge hits still show next to the
+// centre.
+inline void draw_heatmap(render::Renderer &r, const Summary &s, i32 p,
+                         float left, float top, float width, float height) {
+  u64 peak = 1;
+  for (i32 y = 0; y < OFFSET_BINS; ++y)
+    for (i32 x = 0; x < DP_BINS; ++x)
+      peak = std::max(peak, s.heat[p][y][x]);
+  float scale = 1.0f / std::log1p(static_cast<float>(peak));
+  float cell_w = width / DP_BINS;
+  float cell_h = height / OFFSET_BINS;
+  for (i32 y = 0; y < OFFSET_BINS; ++y)
+    for (i32 x = 0; x < DP_BINS; ++x) {
+      float t = std::log1p(static_cast<float>(s.heat[p][y][x])) * scale;
+      r.render_rect(left + (x + 0.5f) * cell_w, top + (y + 0.5f) * cell_h,
+                    cell_w * 0.5f, cell_h * 0.5f, heat_color(t));
+    }
+
+  r.render_text(std::format("PLAYER {}  {} HITS", p + 1, s.hits[p]),
+                left + width * 0.5f, top - 5.0f, 0.5f, 0.6f, 0x00FFFFFF);
+  r.render_text("TOP", left - 5.5f, top + 1.5f, 0.3f, 0.6f, 0x00A0A0B0);
+  r.render_text("BOTTOM", left - 7.5f, top + height - 1.5f, 0.3f, 0.6f,
+                0x00A0A0B0);
+  r.render_text(std::format("-{:.0f}", DP_RANGE), left + 3.0f,
+                top + height + 3.0f, 0.3f, 0.6f, 0x00A0A0B0);
+  r.render_text("0", left + width * 0.5f, top + height + 3.0f, 0.3f, 0.6f,
+                0x00A0A0B0);
+  r.render_text(std::format("{:.0f}", DP_RANGE), left + width - 3.0f,
+                top + height + 3.0f, 0.3f, 0.6f, 0x00A0A0B0);
+}
+
+inline void draw_heatmaps(render::Renderer &r, const Summary &s) {
+  draw_heatmap(r, s, 0, -75.0f, -36.0f, 70.0f, 70.0f);
+  draw_heatmap(r, s, 1, 11.0f, -36.0f, 70.0f, 70.0f);
+  r.render_text("DOWN: WHERE THE BALL MET THE PADDLE", 0.0f, 42.0f, 0.4f, 0.6f,
+                0x00FFFFFF);
+  r.render_text("ACROSS: PADDLE SPEED - MOVING UP TO MOVING DOWN", 0.0f,
+                46.0f, 0.4f, 0.6f, 0x00FFFFFF);
+}
+
+inline void draw_rallies(render::Renderer &r, const Summary &s) {
+  const float left = -80.0f;
+  const float width = 160.0f;
+  const float bottom = 34.0f;
+  const float height = 64.0f;
+  u64 peak = 1;
+  for (u64 count : s.rallies)
+    peak = std::max(peak, count);
+  float bar = width / (MAX_RALLY + 1);
+  for (i32 i = 0; i <= MAX_RALLY; ++i) {
+    float h = height * static_cast<float>(s.rallies[i]) / peak;
+    if (h > 0.0f)
+      r.render_rect(left + (i + 0.5f) * bar, bottom - h * 0.5f,
+                    bar * 0.4f, h * 0.5f,
+                    i == MAX_RALLY ? 0x00F08830 : 0x002F80D0);
+  }
+  r.render_rect(0.0f, bottom + 0.25f, width * 0.5f, 0.25f, 0x00A0A0B0);
+  for (i32 i = 0; i <= MAX_RALLY; i += 10)
+    r.render_text(i == MAX_RALLY ? std::format("{}+", i) : std::to_string(i),
+                  left + (i + 0.5f) * bar, bottom + 3.5f, 0.35f, 0.6f,
+                  0x00A0A0B0);
+
+  double mean = s.rally_count
+                    ? static_cast<double>(s.rally_hits) / s.rally_count
+                    : 0.0;
+  r.render_text(std::format("RALLY LENGTHS  {} RALLIES  MEAN {:.1f}  "
+                            "LONGEST {}",
+                            s.rally_count, mean, s.longest),
+                0.0f, -40.0f, 0.5f, 0.6f, 0x00FFFFFF);
+  r.render_text("PADDLE HITS BEFORE THE POINT ENDED", 0.0f, 44.0f, 0.4f, 0.6f,
+                0x00FFFFFF);
+}
+
+inline void print_summary(const Summary &s) {
+  double mean = s.rally_count
+                    ? static_cast<double>(s.rally_hits) / s.rally_count
+                    : 0.0;
+  auto length = [](u64 n) {
+    return n >= MAX_RALLY ? std::format("{}+", MAX_RALLY) : std::to_string(n);
+  };
+  std::printf("%llu matches, %llu rallies: mean %.2f hits, median %s, p90 "
+              "%s, longest %llu\n",
+              static_cast<unsigned long long>(s.matches),
+              static_cast<unsigned long long>(s.rally_count), mean,
+              length(s.rally_percentile(0.5)).c_str(),
+              length(s.rally_percentile(0.9)).c_str(),
+              static_cast<unsigned long long>(s.longest));
+  for (i32 p = 0; p < 2; ++p) {
+    double hits = static_cast<double>(std::max<u64>(s.hits[p], 1));
+    std::printf("player %d: %llu hits, %llu goals, mean offset %+.3f, "
+                "%.1f%% within a quarter of the centre, mean ball speed "
+                "%.1f\n",
+                p + 1, static_cast<unsigned long long>(s.hits[p]),
+                static_cast<unsigned long long>(s.goals[p]),
+                s.offset_sum[p] / hits, 100.0 * s.centre_hits[p] / hits,
+                s.speed_sum[p] / hits);
+  }
+}
+
+// --analytics [--simulate N] [--difficulty name] [--seconds S] [--out dir]
+//             [--ticks file] [file.hits ...]
+inline i32 run(const std::vector<std::string> &args) {
+  utils::attach_console();
+
+  size_t simulations = 0;
+  objects::AIDifficulty level = objects::Medium;
+  float seconds = 120.0f;
+  std::string out_dir = "analytics";
+  std::string ticks_path;
+  std::vector<std::string> files;
+  for (size_t i = 0; i < args.size(); ++i) {
+    bool has_value = i + 1 < args.size();
+    if (args[i] == "--simulate" && has_value) {
+      simulations = std::stoul(args[++i]);
+    } else if (args[i] == "--seconds" && has_value) {
+      seconds = std::max(1.0f, std::stof(args[++i]));
+    } else if (args[i] == "--out" && has_value) {
+      out_dir = args[++i];
+    } else if (args[i] == "--ticks" && has_value) {
+      ticks_path = args[++i];
+    } else if (args[i] == "--difficulty" && has_value) {
+      const std::string &name = args[++i];
+      bool found = false;
+      for (i32 m = objects::Easy; m <= objects::Unbeatable; ++m)
+        if (name == results::mode_names[m]) {
+          level = static_cast<objects::AIDifficulty>(m);
+          found = true;
+        }
+      if (!found) {
+        std::printf("unknown difficulty '%s'\n", name.c_str());
+        return 1;
+      }
+    } else {
+      files.push_back(args[i]);
+    }
+  }
+  if (files.empty() && simulations == 0 &&
+      std::filesystem::is_directory("stats/hits"))
+    for (const auto &entry : std::filesystem::directory_iterator("stats/hits"))
+      if (entry.path().extension() == ".hits")
+        files.push_back(entry.path().string());
+  std::sort(files.begin(), files.end());
+
+  std::vector<std::vector<HitEvent>> sources;
+  for (const std::string &file : files) {
+    sources.emplace_back();
+    if (!load(file, sources.back())) {
+      std::printf("%s is not a hit log\n", file.c_str());
+      sources.pop_back();
+    }
+  }
+
+  utils::ThreadPool pool;
+  if (simulations > 0) {
+    size_t first = sources.size();
+    sources.resize(first + simulations);
+    ticks::Writer archive;
+    if (!ticks_path.empty() && !archive.open(ticks_path)) {
+      std::printf("cannot write to %s\n", ticks_path.c_str());
+      return 1;
+    }
+    // Ticks take much more room than hit events, so they are simulated in
+    // batches and archived in match order between them.
+    size_t batch = ticks_path.empty() ? simulations : pool.concurrency() * 8;
+    std::vector<std::vector<ticks::Tick>> batch_ticks(batch);
+    i64 start = utils::query_counter();
+    for (size_t done = 0; done < simulations; done += batch) {
+      size_t count = std::min(batch, simulations - done);
+      pool.parallel_for(count, [&](size_t i) {
+        size_t match = done + i;
+        sources[first + match] =
+            simulate(static_cast<u32>(match + 1), level, seconds,
+                     ticks_path.empty() ? nullptr : &batch_ticks[i]);
+      });
+      if (ticks_path.empty())
+        continue;
+      for (size_t i = 0; i < count; ++i) {
+        for (const ticks::Tick &tick : batch_ticks[i])
+          archive.add(tick);
+        batch_ticks[i].clear();
+      }
+    }
+    if (!archive.close()) {
+      std::printf("cannot write to %s\n", ticks_path.c_str());
+      return 1;
+    }
+    double elapsed = static_cast<double>(utils::query_counter() - start) /
+                     utils::counter_frequency();
+    std::printf("simulated %zu %s matches of %.0f s in %.2f s on %zu "
+                "threads\n",
+                simulations, results::mode_names[level], seconds, elapsed,
+                pool.concurrency());
+    if (!ticks_path.empty())
+      std::printf("archived %llu ticks in %s, %.2f bytes each (%zu raw)\n",
+                  static_cast<unsigned long long>(archive.rows()),
+                  ticks_path.c_str(),
+                  static_cast<double>(archive.bytes()) /
+                      std::max<u64>(archive.rows(), 1),
+                  sizeof(ticks::Tick));
+  }
+
+  size_t events = 0;
+  for (const std::vector<HitEvent> &source : sources)
+    events += source.size();
+  if (events == 0) {
+    std::printf("no hit events: play a match, or add --simulate N\n");
+    return 1;
+  }
+
+  i64 start = utils::query_counter();
+  Summary summary = crunch(sources, pool);
+  double elapsed = static_cast<double>(utils::query_counter() - start) /
+                   utils::counter_frequency();
+  std::printf("%zu events from %zu logs and %zu simulations, crunched in "
+              "%.2f ms (%.1f M events/s)\n",
+              events, files.size(), simulations, elapsed * 1000.0,
+              events / std::max(elapsed, 1e-9) / 1e6);
+  print_summary(summary);
+
+  std::filesystem::create_directories(out_dir);
+  Canvas heatmaps(1280, 720);
+  draw_heatmaps(heatmaps.renderer, summary);
+  Canvas rallies(1280, 720);
+  draw_rallies(rallies.renderer, summary);
+  std::string heatmap_path = out_dir + "/heatmaps.png";
+  std::string rallies_path = out_dir + "/rallies.png";
+  if (!heatmaps.save(heatmap_path) || !rallies.save(rallies_path)) {
+    std::printf("cannot write to %s\n", out_dir.c_str());
+    return 1;
+  }
+  std::printf("wrote %s and %s\n", heatmap_path.c_str(),
+              rallies_path.c_str());
+  return 0;
+}
+} // namespace analytics
+} // namespace game
@@ -0,0 +1,389 @@
+#pragma once
+
+#include <algorithm>
+#include <chrono>
+#include <cstdint>
+#include <cstdio>
+#include <cstring>
+#include <fstream>
+#include <memory>
+#include <mutex>
+#include <span>
+#include <string>
+#include <string_view>
+#include <vector>
+
+#include <Windows.h>
+
+#include "../rsc/resource.h"
+
+// Sounds and the default config packed into one blob, so a single
+// executable can carry them as an RCDATA resource:
+//   pingpong.exe --pack-assets rsc/assets.pak
+// writes the blob that `build.bat embed` links in. Each file is stored
+// LZ4-compressed, or as is when that does not save at least an eighth
+// (the MP3s), and is only unpacked the first time it is asked for.
+// Without the resource every lookup misses and the files on disk are
+// used instead.
+
+namespace game {
+namespace assets {
+enum Codec : uint32_t { CODEC_RAW, CODEC_LZ4 };
+
+struct Header {
+  char magic[4];
+  uint32_t version;
+  uint32_t count;
+  uint32_t reserved;
+};
+
+struct Entry {
+  char name[64];
+  uint32_t offset;
+  uint32_t packed;
+  uint32_t size;
+  uint32_t codec;
+};
+
+constexpr char MAGIC[4] = {'P', 'P', 'A', 'K'};
+constexpr uint32_t VERSION = 1;
+
+const char *packed_files[] = {
+    "assets/sfx/button.mp3",         "assets/sfx/button_back.mp3",
+    "assets/sfx/countdown_tick.mp3", "assets/sfx/game_timer_tick.mp3",
+    "assets/sfx/go_tick.mp3",        "assets/sfx/navigation.mp3",
+    "assets/sfx/paddle_hit.mp3",     "assets/sfx/setting.mp3",
+    "assets/sfx/shine.mp3",          "assets/sfx/winner.mp3",
+    "assets/music/music.mp3",        "config/default.json"};
+
+// The LZ4 block format: each sequence is a token with the literal and match
+// lengths, the literals, and a 16-bit back offset. Greedy matching over a
+// hash of the next four bytes; the last sequence holds only literals.
+constexpr size_t MIN_MATCH = 4;
+constexpr uint32_t HASH_BITS = 16;
+
+inline std::vector<uint8_t> compress(const uint8_t *src, size_t size) {
+  std::vector<uint8_t> out;
+  out.reserve(size + size / 255 + 16);
+
+  auto put_length = [&](size_t length) {
+    for (; length >= 255; length -= 255)
+      out.push_back(255);
+    out.push_back(static_cast<uint8_t>(length));
+  };
+  auto emit = [&](size_t from, size_t to, size_t offset, size_t match) {
+    size_t literals = to - from;
+    uint8_t token = static_cast<uint8_t>(std::min<size_t>(literals, 15) << 4);
+    if (match > 0)
+      token |= static_cast<uint8_t>(std::min<size_t>(match - MIN_MATCH, 15));
+    out.push_back(token);
+    if (literals >= 15)
+      put_length(literals - 15);
+    out.insert(out.end(), src + from, src + to);
+    if (match == 0)
+      return;
+    out.push_back(static_cast<uint8_t>(offset));
+    out.push_back(static_cast<uint8_t>(offset >> 8));
+    if (match - MIN_MATCH >= 15)
+      put_length(match - MIN_MATCH - 15);
+  };
+
+  // Positions plus one, so zero means empty.
+  std::vector<uint32_t> table(size_t(1) << HASH_BITS, 0);
+  size_t anchor = 0;
+  size_t i = 0;
+  // Like LZ4, no match starts in the last 12 bytes or covers the last 5.
+  size_t limit = size > 12 ? size - 12 : 0;
+  while (i < limit) {
+    uint32_t next;
+    std::memcpy(&next, src + i, 4);
+    uint32_t hash = (next * 2654435761u) >> (32 - HASH_BITS);
+    size_t candidate = table[hash];
+    table[hash] = static_cast<uint32_t>(i + 1);
+    if (candidate == 0 || i - (candidate - 1) > 0xFFFF ||
+        std::memcmp(src + candidate - 1, src + i, 4) != 0) {
+      i++;
+      continue;
+    }
+    size_t from = candidate - 1;
+    size_t length = MIN_MATCH;
+    while (i + length < size - 5 && src[from + length] == src[i + length])
+      length++;
+    emit(anchor, i, i - from, length);
+    i += length;
+    anchor = i;
+  }
+  emit(anchor, size, 0, 0);
+  return out;
+}
+
+// False on malformed input or when the output is not exactly `size` bytes.
+inline bool decompress(const uint8_t *src, size_t packed, uint8_t *dst,
+                       size_t size) {
+  const uint8_t *in = src;
+  const uint8_t *in_end = src + packed;
+  uint8_t *out = dst;
+  uint8_t *out_end = dst + size;
+
+  auto read_length = [&](size_t &length) {
+    uint8_t byte;
+    do {
+      if (in == in_end)
+        return false;
+      byte = *in++;
+      length += byte;
+    } while (byte == 255);
+    return true;
+  };
+
+  while (in < in_end) {
+    uint8_t token = *in++;
+    size_t literals = token >> 4;
+    if (literals == 15 && !read_length(literals))
+      return false;
+    if (literals > static_cast<size_t>(in_end - in) ||
+        literals > static_cast<size_t>(out_end - out))
+      return false;
+    std::memcpy(out, in, literals);
+    in += literals;
+    out += literals;
+    if (in == in_end)
+      break;
+
+    if (in_end - in < 2)
+      return false;
+    size_t offset = in[0] | static_cast<size_t>(in[1]) << 8;
+    in += 2;
+    size_t match = token & 15;
+    if (match == 15 && !read_length(match))
+      return false;
+    match += MIN_MATCH;
+    if (offset == 0 || offset > static_cast<size_t>(out - dst) ||
+        match > static_cast<size_t>(out_end - out))
+      return false;
+    const uint8_t *from = out - offset;
+    if (offset >= match) {
+      std::memcpy(out, from, match);
+    } else {
+      for (size_t k = 0; k < match; ++k)
+        out[k] = from[k];
+    }
+    out += match;
+  }
+  return out == out_end;
+}
+
+// Builds a blob from `files`, read relative to the working directory.
+// Files that cannot be read are left out.
+inline std::vector<uint8_t> pack(const std::vector<std::string> &files) {
+  std::vector<Entry> entries;
+  std::vector<uint8_t> payload;
+  for (const std::string &file : files) {
+    if (file.size() >= sizeof(Entry::name))
+      continue;
+    std::ifstream in(file, std::ios::binary);
+    if (!in)
+      continue;
+    std::vector<uint8_t> bytes((std::istreambuf_iterator<char>(in)),
+                               std::istreambuf_iterator<char>());
+
+    Entry entry = {};
+    std::memcpy(entry.name, file.data(), file.size());
+    entry.offset = static_cast<uint32_t>(payload.size());
+    entry.size = static_cast<uint32_t>(bytes.size());
+    std::vector<uint8_t> compressed = compress(bytes.data(), bytes.size());
+    if (compressed.size() < bytes.size() - bytes.size() / 8) {
+      entry.codec = CODEC_LZ4;
+      bytes = std::move(compressed);
+    }
+    entry.packed = static_cast<uint32_t>(bytes.size());
+    payload.insert(payload.end(), bytes.begin(), bytes.end());
+    entries.push_back(entry);
+  }
+
+  Header header = {};
+  std::memcpy(header.magic, MAGIC, sizeof(MAGIC));
+  header.version = VERSION;
+  header.count = static_cast<uint32_t>(entries.size());
+
+  size_t table_size = entries.size() * sizeof(Entry);
+  std::vector<uint8_t> blob(sizeof(Header) + table_size + payload.size());
+  std::memcpy(blob.data(), &header, sizeof(Header));
+  if (!entries.empty())
+    std::memcpy(blob.data() + sizeof(Header), entries.data(), table_size);
+  if (!payload.empty())
+    std::memcpy(blob.data() + sizeof(Header) + table_size, payload.data(),
+                payload.size());
+  return blob;
+}
+
+struct Stats {
+  uint32_t unpacked = 0;
+  uint64_t packed_bytes = 0;
+  uint64_t bytes = 0;
+  double ms = 0.0;
+  uint64_t resident = 0;
+  uint64_t peak_resident = 0;
+};
+
+// A read-only view of a blob. Stored files are returned in place; packed
+// ones are unpacked on first use into a buffer that lives as long as the
+// Pack, since miniaudio reads the sounds from it while they play. Safe to
+// use from the audio and config threads at once.
+class Pack {
+public:
+  bool open(const uint8_t *data, size_t size) {
+    std::lock_guard<std::mutex> lock(mutex);
+    base = nullptr;
+    count = 0;
+    Header header;
+    if (!data || size < sizeof(Header))
+      return false;
+    std::memcpy(&header, data, sizeof(Header));
+    if (std::memcmp(header.magic, MAGIC, sizeof(MAGIC)) != 0 ||
+        header.version != VERSION ||
+        header.count > (size - sizeof(Header)) / sizeof(Entry))
+      return false;
+
+    size_t payload_start = sizeof(Header) + header.count * sizeof(Entry);
+    entries.resize(header.count);
+    if (header.count > 0)
+      std::memcpy(entries.data(), data + sizeof(Header),
+                  header.count * sizeof(Entry));
+    for (Entry &entry : entries) {
+      entry.name[sizeof(entry.name) - 1] = '\0';
+      if (entry.offset > size - payload_start ||
+          entry.packed > size - payload_start - entry.offset)
+        return false;
+      if (entry.codec == CODEC_RAW && entry.packed != entry.size)
+        return false;
+    }
+    base = data + payload_start;
+    count = header.count;
+    buffers.clear();
+    buffers.resize(count);
+    return true;
+  }
+
+  bool empty() const { return count == 0; }
+  const std::vector<Entry> &files() const { return entries; }
+
+  // Empty when the blob has no such file or it fails to unpack.
+  std::span<const uint8_t> get(std::string_view name) {
+    std::lock_guard<std::mutex> lock(mutex);
+    for (uint32_t i = 0; i < count; ++i) {
+      const Entry &entry = entries[i];
+      if (name != entry.name)
+        continue;
+      const uint8_t *packed = base + entry.offset;
+      if (entry.codec == CODEC_RAW)
+        return {packed, entry.size};
+      if (!buffers[i])
+        unpack(i);
+      if (!buffers[i])
+        return {};
+      return {buffers[i].get(), entry.size};
+    }
+    return {};
+  }
+
+  Stats stats() const {
+    std::lock_guard<std::mutex> lock(mutex);
+    return totals;
+  }
+
+private:
+  void unpack(uint32_t i) {
+    const Entry &entry = entries[i];
+    auto start = std::chrono::steady_clock::now();
+    auto buffer = std::make_unique<uint8_t[]>(entry.size);
+    if (!decompress(base + entry.offset, entry.packed, buffer.get(),
+                    entry.size))
+      return;
+    std::chrono::duration<double, std::milli> elapsed =
+        std::chrono::steady_clock::now() - start;
+    buffers[i] = std::move(buffer);
+
+    totals.unpacked++;
+    totals.packed_bytes += entry.packed;
+    totals.bytes += entry.size;
+    totals.ms += elapsed.count();
+    totals.resident += entry.size;
+    totals.peak_resident = std::max(totals.peak_resident, totals.resident);
+  }
+
+  const uint8_t *base = nullptr;
+  uint32_t count = 0;
+  std::vector<Entry> entries;
+  std::vector<std::unique_ptr<uint8_t[]>> buffers;
+  Stats totals;
+  mutable std::mutex mutex;
+};
+
+// The blob linked into the executable as the IDR_ASSETS resource, or an
+// empty pack when there is none.
+inline Pack &embedded() {
+  static Pack pack;
+  static std::once_flag opened;
+  std::call_once(opened, [] {
+    HRSRC resource =
+        FindResourceA(nullptr, MAKEINTRESOURCEA(IDR_ASSETS), RT_RCDATA);
+    if (!resource)
+      return;
+    HGLOBAL loaded = LoadResource(nullptr, resource);
+    if (!loaded)
+      return;
+    pack.open(static_cast<const uint8_t *>(LockResource(loaded)),
+              SizeofResource(nullptr, resource));
+  });
+  return pack;
+}
+
+// --pack-assets [output]
+inline int run(const std::vector<std::string> &args) {
+  std::string output = args.empty() ? "rsc/assets.pak" : args[0];
+  std::vector<uint8_t> blob =
+      pack({std::begin(packed_files), std::end(packed_files)});
+  std::ofstream out(output, std::ios::binary | std::ios::trunc);
+  out.write(reinterpret_cast<const char *>(blob.data()),
+            static_cast<std::streamsize>(blob.size()));
+  out.close();
+  if (!out) {
+    std::printf("cannot write %s\n", output.c_str());
+    return 1;
+  }
+
+  // Unpack everything once to check the blob and time it.
+  Pack check;
+  if (!check.open(blob.data(), blob.size())) {
+    std::printf("%s does not read back\n", output.c_str());
+    return 1;
+  }
+  std::printf("%-34s %10s %10s %7s\n", "file", "size", "packed", "ratio");
+  uint64_t size = 0;
+  for (const char *file : packed_files) {
+    std::span<const uint8_t> bytes = check.get(file);
+    if (bytes.empty()) {
+      std::printf("%-34s missing\n", file);
+      continue;
+    }
+    size += bytes.size();
+  }
+  for (const Entry &entry : check.files())
+    std::printf("%-34s %10u %10u %6.1f%% %s\n", entry.name, entry.size,
+                entry.packed, 100.0 * entry.packed / std::max(entry.size, 1u),
+                entry.codec == CODEC_LZ4 ? "lz4" : "stored");
+
+  Stats stats = check.stats();
+  std::printf("%s: %zu bytes for %llu bytes of files\n", output.c_str(),
+              blob.size(), static_cast<unsigned long long>(size));
+  std::printf("unpacked %u files, %llu bytes in %.3f ms (%.0f MB/s), peak "
+              "%llu KB\n",
+              stats.unpacked, static_cast<unsigned long long>(stats.bytes),
+              stats.ms,
+              stats.ms > 0.0 ? stats.bytes / 1e3 / stats.ms : 0.0,
+              static_cast<unsigned long long>(stats.peak_resident / 1024));
+  return 0;
+}
+} // namespace assets
+} // namespace game
@@ -0,0 +1,1272 @@
+#pragma once
+
+#include "analytics.hpp"
+#include "game.hpp"
+#include "headless.hpp"
+
+// Benchmarks run from the command line, e.g. `pingpong.exe --bench blend`.
+// Results are printed to stdout; redirect it to keep them, or add
+// `--json <file>` to also write them as JSON. With `--runs N` every
+// benchmark runs N times and the JSON keeps every sample, so it can serve
+// as the baseline for `--compare <file>`.
+
+namespace game {
+namespace bench {
+struct Measurement {
+  std::string name;
+  double value;
+  std::string unit;
+};
+
+std::vector<Measurement> results;
+bool echo = true;
+
+inline void report(const std::string &name, double value,
+                   const std::string &unit) {
+  results.push_back({name, value, unit});
+  if (!echo)
+    return;
+  std::printf("%-40s %14.2f %s\n", name.c_str(), value, unit.c_str());
+  std::fflush(stdout);
+}
+
+template <typename F> double seconds(F &&body) {
+  i64 begin = utils::query_counter();
+  body();
+  i64 end = utils::query_counter();
+  return static_cast<double>(end - begin) /
+         static_cast<double>(utils::counter_frequency());
+}
+
+struct Framebuffer {
+  std::vector<u32> pixels;
+  render::Renderer renderer;
+
+  Framebuffer(i32 width, i32 height, u32 fill = 0x00303050)
+      : pixels(static_cast<size_t>(width) * height, fill) {
+    renderer.render_state.memory = pixels.data();
+    renderer.render_state.width = width;
+    renderer.render_state.height = height;
+    renderer.render_state.pitch = width;
+  }
+};
+
+inline void run_blend() {
+  const i32 width = 3840;
+  const i32 height = 2160;
+  const i32 iterations = 30;
+  const double pixels = static_cast<double>(width) * height * iterations;
+
+  Framebuffer target(width, height);
+  u32 *memory = target.pixels.data();
+  size_t count = target.pixels.size();
+
+  const char *mode_names[] = {"alpha", "additive", "multiply"};
+  struct Kernel {
+    const char *name;
+    void (*row)(u32 *, size_t, const render::BlendConstants &);
+    bool supported;
+  };
+  const Kernel kernels[] = {
+      {"scalar", render::blend_row_scalar, true},
+      {"sse2", render::blend_row_sse2, true},
+      {"avx2", render::blend_row_avx2, utils::cpu_has_avx2()}};
+
+  for (i32 mode = render::BLEND_ALPHA; mode <= render::BLEND_MULTIPLY;
+       ++mode) {
+    render::BlendConstants k = render::make_blend(
+        0x00FFCC66, 160, static_cast<render::BlendMode>(mode));
+    for (const Kernel &kernel : kernels) {
+      if (!kernel.supported)
+        continue;
+      double elapsed = seconds([&] {
+        for (i32 i = 0; i < iterations; ++i)
+          kernel.row(memory, count, k);
+      });
+      std::string name =
+          std::format("blend_4k/{}/{}", mode_names[mode], kernel.name);
+      report(name + "/throughput", pixels / elapsed / 1e6, "Mpix/s");
+      report(name + "/bandwidth", pixels * 8.0 / elapsed / 1e9, "GB/s");
+    }
+  }
+
+  double elapsed = seconds([&] {
+    for (i32 i = 0; i < iterations; ++i)
+      target.renderer.blend_screen(0x00FFFFFF, 0.5f, render::BLEND_ALPHA);
+  });
+  report("blend_4k/flash_pass", elapsed * 1000.0 / iterations, "ms");
+}
+
+inline void run_postfx() {
+  const i32 sizes[][2] = {{1920, 1080}, {3840, 2160}};
+  const i32 iterations = 20;
+
+  for (const auto &size : sizes) {
+    Framebuffer target(size[0], size[1]);
+    World world(target.renderer);
+    world.draw(1.0f);
+    target.renderer.render_text("PING PONG", 0.0f, -22.0f, 1.5f, 0.8f,
+                                0x00FFFFFF);
+    std::vector<u32> scene = target.pixels;
+
+    for (bool threaded : {false, true}) {
+      render::PostProcess post;
+      post.bloom = post.scanlines = post.vignette = true;
+      post.pool = std::make_unique<utils::ThreadPool>(
+          threaded ? utils::ThreadPool::default_workers() : 0);
+
+      double totals[render::POST_STAGE_COUNT] = {};
+      for (i32 i = 0; i < iterations; ++i) {
+        target.pixels = scene;
+        post.apply(target.renderer.render_state);
+        for (i32 s = 0; s < render::POST_STAGE_COUNT; ++s)
+          totals[s] += post.last_ms[s];
+      }
+
+      std::string prefix = std::format("postfx_{}x{}/{}", size[0], size[1],
+                                       threaded ? "pooled" : "serial");
+      double sum = 0.0;
+      for (i32 s = 0; s < render::POST_STAGE_COUNT; ++s) {
+        std::string stage = render::post_stage_names[s];
+        std::replace(stage.begin(), stage.end(), ' ', '_');
+        std::transform(stage.begin(), stage.end(), stage.begin(), ::tolower);
+        report(prefix + "/" + stage, totals[s] / iterations, "ms");
+        sum += totals[s] / iterations;
+      }
+      report(prefix + "/total", sum, "ms");
+    }
+  }
+}
+
+// A gameplay frame drawn back to front versus resolved front to back.
+inline void run_overdraw() {
+  const i32 iterations = 30;
+  for (bool front_to_back : {false, true}) {
+    Framebuffer target(3840, 2160);
+    render::Renderer &renderer = target.renderer;
+    renderer.front_to_back = front_to_back;
+    renderer.count_overdraw = true;
+    World world(renderer);
+
+    auto draw = [&] {
+      renderer.begin_frame();
+      world.draw(1.0f / 60.0f);
+      renderer.render_rect(-70.0f, 0.0f, 2.0f, 12.0f, 0x00FF6B6B);
+      renderer.render_rect(70.0f, 10.0f, 2.0f, 12.0f, 0x004DABF7);
+      renderer.render_rect(5.0f, -3.0f, 1.2f, 1.2f, 0x0000FFFF);
+      renderer.render_text("12", -10.0f, 40.0f, 0.7f, 0.7f, 0xbbffbb);
+      renderer.render_text("09", 10.0f, 40.0f, 0.7f, 0.7f, 0xbbffbb);
+      renderer.render_text("00:27", 0.0f, -40.0f, 0.8f, 0.8f, 0x00FFFFFF);
+      renderer.flush();
+    };
+
+    draw();
+    u64 writes = 0;
+    for (u8 count : renderer.write_counts)
+      writes += count;
+    renderer.count_overdraw = false;
+
+    double elapsed = seconds([&] {
+      for (i32 i = 0; i < iterations; ++i)
+        draw();
+    });
+
+    std::string name = front_to_back ? "overdraw_4k/front_to_back"
+                                     : "overdraw_4k/back_to_front";
+    report(name + "/frame", elapsed * 1000.0 / iterations, "ms");
+    report(name + "/writes_per_pixel",
+           static_cast<double>(writes) / target.pixels.size(), "writes");
+  }
+}
+
+// Resizing by reallocation versus committing inside one reservation, and
+// 4K clears on regular versus large pages. Each resize is followed by one
+// clear, as the next frame would be.
+inline void run_framebuffer() {
+  const i32 sizes[][2] = {{1280, 720}, {1920, 1080}, {2560, 1440},
+                          {3840, 2160}, {2560, 1600}, {1600, 900}};
+  const i32 resizes = 60;
+  render::Renderer renderer;
+  render::RenderState &state = renderer.render_state;
+
+  double elapsed = seconds([&] {
+    for (i32 i = 0; i < resizes; ++i) {
+      state.width = sizes[i % 6][0];
+      state.height = sizes[i % 6][1];
+      state.pitch = state.width;
+      SIZE_T size = static_cast<SIZE_T>(state.width) * state.height * 4;
+      state.memory =
+          VirtualAlloc(nullptr, size, MEM_RESERVE | MEM_COMMIT, PAGE_READWRITE);
+      renderer.clear_screen(0x00303050);
+      VirtualFree(state.memory, 0, MEM_RELEASE);
+    }
+  });
+  report("framebuffer/resize/realloc", elapsed * 1000.0 / resizes, "ms");
+
+  render::FramebufferAllocator allocator;
+  allocator.reserve(3840, 2160, false);
+  elapsed = seconds([&] {
+    for (i32 i = 0; i < resizes; ++i) {
+      allocator.resize(sizes[i % 6][0], sizes[i % 6][1]);
+      state.memory = allocator.pixels();
+      state.width = sizes[i % 6][0];
+      state.height = sizes[i % 6][1];
+      state.pitch = allocator.pixel_pitch();
+      renderer.clear_screen(0x00303050);
+    }
+  });
+  report("framebuffer/resize/reserved", elapsed * 1000.0 / resizes, "ms");
+
+  const i32 iterations = 100;
+  for (bool large_pages : {false, true}) {
+    allocator.reserve(3840, 2160, large_pages);
+    allocator.resize(3840, 2160);
+    state.memory = allocator.pixels();
+    state.width = 3840;
+    state.height = 2160;
+    state.pitch = allocator.pixel_pitch();
+    renderer.clear_screen(0);
+
+    elapsed = seconds([&] {
+      for (i32 i = 0; i < iterations; ++i)
+        renderer.clear_screen(0x00303050 + i);
+    });
+    std::string name = large_pages ? "framebuffer/clear_4k/large_pages"
+                                   : "framebuffer/clear_4k/regular_pages";
+    report(name, elapsed * 1000.0 / iterations, "ms");
+    if (large_pages)
+      report("framebuffer/large_pages_granted", allocator.large_pages(), "");
+  }
+}
+
+// RGB to I420 conversion per luma kernel, and the game-thread cost of
+// handing a frame to the recorder.
+inline void run_capture() {
+  const i32 sizes[][2] = {{1920, 1080}, {3840, 2160}};
+  const i32 iterations = 20;
+
+  struct Kernel {
+    const char *name;
+    void (*row)(const u32 *, u8 *, size_t);
+    bool supported;
+  };
+  const Kernel kernels[] = {
+      {"scalar", capture::y_row_scalar, true},
+      {"sse2", capture::y_row_sse2, true},
+      {"avx2", capture::y_row_avx2, utils::cpu_has_avx2()}};
+
+  for (const auto &size : sizes) {
+    i32 width = size[0];
+    i32 height = size[1];
+    Framebuffer target(width, height);
+    std::vector<u8> yuv(static_cast<size_t>(width) * height * 3 / 2);
+    std::string prefix = std::format("capture_{}p", height);
+
+    for (const Kernel &kernel : kernels) {
+      if (!kernel.supported)
+        continue;
+      double elapsed = seconds([&] {
+        for (i32 i = 0; i < iterations; ++i)
+          for (i32 y = 0; y < height; ++y)
+            kernel.row(target.pixels.data() + static_cast<size_t>(y) * width,
+                       yuv.data() + static_cast<size_t>(y) * width, width);
+      });
+      report(prefix + "/luma/" + kernel.name, elapsed * 1000.0 / iterations,
+             "ms");
+    }
+
+    u8 *u = yuv.data() + static_cast<size_t>(width) * height;
+    u8 *v = u + static_cast<size_t>(width / 2) * (height / 2);
+    auto chroma = [&](auto row) {
+      for (i32 y = 0; y < height / 2; ++y) {
+        const u32 *row0 =
+            target.pixels.data() + static_cast<size_t>(2 * y) * width;
+        size_t offset = static_cast<size_t>(y) * (width / 2);
+        row(row0, row0 + width, u + offset, v + offset, width / 2);
+      }
+    };
+    double elapsed = seconds([&] {
+      for (i32 i = 0; i < iterations; ++i)
+        chroma(capture::uv_row_scalar);
+    });
+    report(prefix + "/chroma/scalar", elapsed * 1000.0 / iterations, "ms");
+    elapsed = seconds([&] {
+      for (i32 i = 0; i < iterations; ++i)
+        chroma(capture::uv_row_sse2);
+    });
+    report(prefix + "/chroma/sse2", elapsed * 1000.0 / iterations, "ms");
+
+    elapsed = seconds([&] {
+      for (i32 i = 0; i < iterations; ++i)
+        capture::rgb_to_i420(target.pixels.data(), width, width, height,
+                             yuv.data());
+    });
+    report(prefix + "/i420", elapsed * 1000.0 / iterations, "ms");
+  }
+}
+
+// Ten seconds of an AI rally at 1280x720, captured to the clip ring and
+// encoded to GIF serially, on the pool, and without frame differencing.
+inline void run_gif() {
+  const i32 ticks_per_frame = 60 / capture::ClipRecorder::FPS;
+  Framebuffer target(1280, 720);
+  Match match(target.renderer);
+  MatchSettings settings;
+  settings.duration_secs = 60.0f;
+  match.start(settings);
+
+  capture::ClipRecorder clips;
+  clips.configure(10);
+  size_t frames = 10 * capture::ClipRecorder::FPS;
+  i64 period = utils::counter_frequency() / capture::ClipRecorder::FPS;
+  double sampling = 0.0;
+  for (size_t f = 0; f < frames; ++f) {
+    for (i32 t = 0; t < ticks_per_frame; ++t) {
+      target.renderer.begin_frame();
+      match.tick(1.0f / 60.0f);
+      target.renderer.flush();
+    }
+    sampling += seconds(
+        [&] { clips.sample(target.renderer, static_cast<i64>(f) * period); });
+  }
+  report("gif/sample", sampling * 1000.0 / frames, "ms");
+
+  gif::Clip clip = clips.take();
+  struct Variant {
+    const char *name;
+    size_t workers;
+    bool diff_frames;
+  };
+  const Variant variants[] = {
+      {"serial", 0, true},
+      {"parallel", utils::ThreadPool::default_workers(), true},
+      {"parallel_full_frames", utils::ThreadPool::default_workers(), false}};
+  for (const Variant &variant : variants) {
+    utils::ThreadPool pool(variant.workers);
+    gif::Stats stats;
+    double elapsed = seconds([&] { gif::encode(clip, pool, &stats,
+                                               variant.diff_frames); });
+    std::string name = std::string("gif/") + variant.name;
+    report(name + "/encode", elapsed * 1000.0, "ms");
+    report(name + "/throughput", stats.frames / elapsed, "frames/s");
+    report(name + "/size", stats.bytes / 1024.0, "KB");
+    report(name + "/size_vs_raw", 100.0 * stats.bytes / stats.raw_bytes, "%");
+  }
+}
+
+// A 4K gameplay frame through the screenshot path: the game-thread copy,
+// BGRX to RGB per kernel, and PNG and QOI encoding.
+inline void run_screenshot() {
+  const i32 width = 3840;
+  const i32 height = 2160;
+  const i32 iterations = 5;
+  const double megabytes = static_cast<double>(width) * height * 4 / 1e6;
+
+  Framebuffer target(width, height);
+  Match match(target.renderer);
+  match.start(MatchSettings{});
+  for (i32 t = 0; t < 150; ++t) {
+    target.renderer.begin_frame();
+    match.tick(1.0f / 60.0f);
+    target.renderer.flush();
+  }
+  const u32 *pixels = target.pixels.data();
+
+  std::vector<u32> copy(target.pixels.size());
+  double elapsed = seconds([&] {
+    for (i32 i = 0; i < iterations; ++i)
+      std::memcpy(copy.data(), pixels, copy.size() * sizeof(u32));
+  });
+  report("screenshot_4k/snapshot", elapsed * 1000.0 / iterations, "ms");
+
+  struct Kernel {
+    const char *name;
+    void (*row)(const u32 *, u8 *, size_t);
+    bool supported;
+  };
+  const Kernel kernels[] = {
+      {"scalar", capture::bgrx_to_rgb_scalar, true},
+      {"avx2", capture::bgrx_to_rgb_avx2, utils::cpu_has_avx2()}};
+  std::vector<u8> rgb(static_cast<size_t>(width) * height * 3);
+  for (const Kernel &kernel : kernels) {
+    if (!kernel.supported)
+      continue;
+    elapsed = seconds([&] {
+      for (i32 i = 0; i < iterations; ++i)
+        for (i32 y = 0; y < height; ++y)
+          kernel.row(pixels + static_cast<size_t>(y) * width,
+                     rgb.data() + static_cast<size_t>(y) * width * 3, width);
+    });
+    report(std::string("screenshot_4k/to_rgb/") + kernel.name,
+           elapsed * 1000.0 / iterations, "ms");
+  }
+
+  for (i32 f = 0; f < capture::IMAGE_FORMAT_COUNT; ++f) {
+    capture::ImageFormat format = static_cast<capture::ImageFormat>(f);
+    size_t bytes = 0;
+    elapsed = seconds([&] {
+      for (i32 i = 0; i < iterations; ++i)
+        bytes = capture::encode_image(pixels, width, height, width, format)
+                    .size();
+    });
+    std::string name =
+        std::string("screenshot_4k/") + capture::image_format_names[f];
+    report(name + "/encode", elapsed * 1000.0 / iterations, "ms");
+    report(name + "/throughput", megabytes * iterations / elapsed, "MB/s");
+    report(name + "/size", bytes / 1024.0, "KB");
+  }
+}
+
+struct Benchmark {
+  const char *name;
+  void (*run)();
+};
+
+// Cost of recording one frame time, and of working out the summary the
+// overlay and the CSV show.
+inline void run_frametimes() {
+  const size_t frames = 10000000;
+  std::vector<i64> samples(4096);
+  i64 frequency = utils::counter_frequency();
+  u32 seed = 12345;
+  for (i64 &sample : samples) {
+    seed = seed * 1664525u + 1013904223u;
+    // 16.7 ms give or take 2 ms, with an occasional 50 ms hitch.
+    sample = frequency / 60 + (seed >> 8) % (frequency / 250) -
+             frequency / 500 + ((seed & 0xFF) == 0 ? frequency / 20 : 0);
+  }
+
+  telemetry::FrameTimes times;
+  double elapsed = seconds([&] {
+    for (size_t i = 0; i < frames; ++i)
+      times.record(telemetry::PHASE_GAMEPLAY, samples[i & 4095]);
+  });
+  report("frametimes/record", elapsed * 1e9 / frames, "ns");
+
+  telemetry::FrameTimes::Summary summary;
+  elapsed = seconds(
+      [&] { summary = times.summarize(telemetry::PHASE_GAMEPLAY); });
+  report("frametimes/summarize", elapsed * 1e6, "us");
+  report("frametimes/p50", summary.p50_ms, "ms");
+  report("frametimes/p99.9", summary.p999_ms, "ms");
+  report("frametimes/hitches", static_cast<double>(summary.hitches),
+         "frames");
+}
+
+// Hardware counters per zone over a simulated match drawn at 1080p, one
+// frame per tick. Only the Linux build can open the counters.
+inline void run_counters() {
+  if (!perf::counters.open()) {
+    std::printf("counters: %s\n", perf::counters.last_error().c_str());
+    return;
+  }
+
+  Framebuffer target(1920, 1080);
+  Match match(target.renderer);
+  MatchSettings settings;
+  settings.duration_secs = 60.0f;
+  match.start(settings);
+
+  const i32 ticks = 60 * 60;
+  perf::counters.reset();
+  perf::counters.start();
+  for (i32 t = 0; t < ticks; ++t) {
+    target.renderer.begin_frame();
+    match.tick(1.0f / 60.0f);
+    target.renderer.flush();
+  }
+  perf::counters.stop();
+
+  for (i32 z = 0; z < perf::ZONE_COUNT; ++z) {
+    const perf::Totals &totals =
+        perf::counters.totals(static_cast<perf::Zone>(z));
+    std::string name = std::string("counters/") + perf::zone_names[z];
+    report(name + "/calls", static_cast<double>(totals.calls) / ticks,
+           "per tick");
+    for (i32 e = 0; e < perf::EVENT_COUNT; ++e) {
+      if (perf::counters.has(static_cast<perf::Event>(e)))
+        report(name + "/" + perf::event_names[e],
+               static_cast<double>(totals.events[e]) / ticks, "per tick");
+    }
+    if (perf::counters.has(perf::EVENT_INSTRUCTIONS)) {
+      double cycles = static_cast<double>(
+          std::max<u64>(totals.events[perf::EVENT_CYCLES], 1));
+      report(name + "/ipc", totals.events[perf::EVENT_INSTRUCTIONS] / cycles,
+             "");
+    }
+  }
+  perf::counters.close();
+}
+
+// Packing and unpacking the embedded assets, read from the working
+// directory, and the LZ4 codec on a game frame, which compresses far better
+// than the MP3s.
+inline void run_assets() {
+  const i32 iterations = 20;
+  std::vector<std::string> files(std::begin(assets::packed_files),
+                                 std::end(assets::packed_files));
+  std::vector<u8> blob;
+  double elapsed = seconds([&] { blob = assets::pack(files); });
+  assets::Pack check;
+  if (!check.open(blob.data(), blob.size()) || check.empty()) {
+    std::printf("assets: no asset files in the working directory\n");
+    return;
+  }
+  report("assets/pack", elapsed * 1000.0, "ms");
+  report("assets/blob", blob.size() / 1024.0, "KB");
+
+  // Stored files are returned in place, so only the compressed ones count
+  // towards the throughput.
+  assets::Stats stats;
+  elapsed = seconds([&] {
+    for (i32 i = 0; i < iterations; ++i) {
+      assets::Pack pack;
+      pack.open(blob.data(), blob.size());
+      for (const std::string &file : files)
+        pack.get(file);
+      stats = pack.stats();
+    }
+  });
+  report("assets/get_all", elapsed * 1e6 / iterations, "us");
+  report("assets/unpacked", stats.bytes / 1024.0, "KB");
+  report("assets/unpack_throughput",
+         stats.ms > 0.0 ? stats.bytes / 1e3 / stats.ms : 0.0, "MB/s");
+  report("assets/peak", stats.peak_resident / 1024.0, "KB");
+
+  Framebuffer target(1920, 1080);
+  Match match(target.renderer);
+  match.start(MatchSettings{});
+  for (i32 t = 0; t < 150; ++t) {
+    target.renderer.begin_frame();
+    match.tick(1.0f / 60.0f);
+    target.renderer.flush();
+  }
+  const u8 *frame = reinterpret_cast<const u8 *>(target.pixels.data());
+  size_t size = target.pixels.size() * sizeof(u32);
+  std::vector<u8> packed;
+  elapsed = seconds([&] {
+    for (i32 i = 0; i < iterations; ++i)
+      packed = assets::compress(frame, size);
+  });
+  report("assets/lz4_frame/compress", size / 1e6 * iterations / elapsed,
+         "MB/s");
+  report("assets/lz4_frame/ratio", 100.0 * packed.size() / size, "%");
+
+  std::vector<u8> unpacked(size);
+  bool ok = true;
+  elapsed = seconds([&] {
+    for (i32 i = 0; i < iterations; ++i)
+      ok &= assets::decompress(packed.data(), packed.size(), unpacked.data(),
+                               size);
+  });
+  if (!ok || std::memcmp(unpacked.data(), frame, size) != 0)
+    std::printf("assets: LZ4 round trip does not match\n");
+  report("assets/lz4_frame/decompress", size / 1e6 * iterations / elapsed,
+         "MB/s");
+}
+
+// Two million matches spread over three years, written straight to a log
+// in a temporary directory: rebuilding the index from it, then one query
+// answered by a scan of the mapped log and by the index.
+inline void run_matches() {
+  const size_t count = 2000000;
+  std::filesystem::path directory =
+      std::filesystem::temp_directory_path() / "pingpong_bench_matches";
+  std::filesystem::remove_all(directory);
+  std::filesystem::create_directories(directory);
+
+  utils::Random random;
+  random.seed(7);
+  std::vector<results::Record> records(count);
+  i64 time = 1700000000;
+  for (results::Record &r : records) {
+    r = {};
+    time += 10 + random.next() % 80;
+    r.start_time = time;
+    r.end_time = time + 30;
+    r.mode = static_cast<u8>(random.next() % results::MODE_COUNT);
+    r.score1 = static_cast<u16>(random.next() % 8);
+    r.score2 = static_cast<u16>(random.next() % 8);
+    r.winner = r.score1 > r.score2 ? 1 : r.score2 > r.score1 ? 2 : 0;
+    r.rallies = static_cast<u16>(r.score1 + r.score2 + 1);
+    r.hits = r.rallies * (random.next() % 12);
+    r.longest_rally = static_cast<u16>(r.hits / r.rallies + 3);
+    r.played_secs = 30.0f;
+    r.checksum = results::checksum(r);
+  }
+  {
+    std::ofstream out(directory / "matches.log", std::ios::binary);
+    results::FileHeader header = {results::LOG_MAGIC, results::VERSION,
+                                  sizeof(results::Record), 0};
+    out.write(reinterpret_cast<const char *>(&header), sizeof(header));
+    out.write(reinterpret_cast<const char *>(records.data()),
+              static_cast<std::streamsize>(count * sizeof(results::Record)));
+  }
+  records = {};
+
+  results::Store store(directory.string());
+  double elapsed = seconds([&] { store.open(); });
+  report("matches/rebuild_index", elapsed * 1000.0, "ms");
+  report("matches/index_entries", static_cast<double>(store.entries().size()),
+         "");
+
+  // The hard matches of the second year.
+  results::Query query;
+  query.from_day = results::day_of(1700000000) + 365;
+  query.to_day = query.from_day + 364;
+  query.mode = results::MODE_HARD;
+
+  results::MappedLog log;
+  results::Totals scanned, indexed;
+  elapsed = seconds([&] {
+    log.open((directory / "matches.log").string());
+    scanned = results::scan(log.records(), query);
+  });
+  report("matches/scan", elapsed * 1000.0, "ms");
+  report("matches/scan_throughput",
+         log.records().size() / elapsed / 1e6, "Mrecords/s");
+
+  const i32 lookups = 1000;
+  elapsed = seconds([&] {
+    for (i32 i = 0; i < lookups; ++i)
+      indexed = results::lookup(store.entries(), query);
+  });
+  report("matches/index_query", elapsed * 1e6 / lookups, "us");
+  if (scanned.matches != indexed.matches || scanned.hits != indexed.hits)
+    std::printf("matches: scan and index disagree\n");
+  report("matches/selected", static_cast<double>(indexed.matches),
+         "matches");
+
+  log.close();
+  std::filesystem::remove_all(directory);
+}
+
+// The cost of a GAME_LOG call on the game thread while the writer drains
+// in the background. Bursts stay below a ring's capacity so nothing is
+// dropped, and the writer catches up between them.
+// Pushes records of every payload size up to 300 bytes through one ring,
+// many times its capacity over, so the padding before a wrap lands on every
+// offset. Returns how many records did not come back intact.
+inline u64 ring_wrap_errors() {
+  static constexpr events::Site site = {events::LEVEL_DEBUG, "wrap", __FILE__,
+                                        __LINE__, "", 0};
+  events::Ring ring;
+  u64 written = 0;
+  u64 read = 0;
+  u64 errors = 0;
+  auto check = [&](const events::RecordHeader &header, const u8 *payload) {
+    bool intact = header.site == &site && header.tsc == read &&
+                  header.size == events::record_size(header.payload);
+    for (u32 i = 0; intact && i < header.payload; ++i)
+      intact = payload[i] == static_cast<u8>(read + i);
+    errors += intact ? 0 : 1;
+    read++;
+  };
+
+  for (i32 i = 0; i < 256 * 1024; ++i) {
+    size_t payload = static_cast<size_t>(i) * 7 % 301;
+    size_t size = events::record_size(payload);
+    u8 *at = ring.reserve(size);
+    if (!at) {
+      ring.drain(check);
+      at = ring.reserve(size);
+    }
+    if (!at) {
+      errors++;
+      continue;
+    }
+    events::RecordHeader header = {static_cast<u32>(size),
+                                   static_cast<u32>(payload), &site, written};
+    std::memcpy(at, &header, sizeof(header));
+    for (size_t b = 0; b < payload; ++b)
+      at[sizeof(header) + b] = static_cast<u8>(written + b);
+    ring.commit(size);
+    written++;
+  }
+  ring.drain(check);
+  return errors + (written - read);
+}
+
+inline void run_eventlog() {
+  report("eventlog/wrap_errors", static_cast<double>(ring_wrap_errors()),
+         "records");
+
+  std::filesystem::path directory =
+      std::filesystem::temp_directory_path() / "pingpong_bench_eventlog";
+  std::filesystem::remove_all(directory);
+  if (!events::logger.start(directory.string())) {
+    std::printf("eventlog: cannot write to %s\n", directory.string().c_str());
+    return;
+  }
+
+  const i32 bursts = 200;
+  const i32 burst = 1000;
+  auto measure = [&](const char *name, auto &&log) {
+    double total = 0.0;
+    for (i32 b = 0; b < bursts; ++b) {
+      total += seconds([&] {
+        for (i32 i = 0; i < burst; ++i)
+          log(i);
+      });
+      events::logger.flush();
+    }
+    report(std::string("eventlog/") + name,
+           total * 1e9 / (static_cast<double>(bursts) * burst), "ns");
+  };
+  measure("no_args", [](i32) { GAME_LOG(DEBUG, "bench tick"); });
+  measure("three_ints", [](i32 i) {
+    GAME_LOG(INFO, "goal for player {}, {}-{}", i & 1, i, i + 1);
+  });
+  measure("float_and_string", [](i32 i) {
+    GAME_LOG(DEBUG, "{} at {:.2f}", "paddle_hit.mp3", i * 0.5f);
+  });
+  std::string path = events::logger.path();
+  events::logger.stop();
+  report("eventlog/bytes_per_event",
+         static_cast<double>(std::filesystem::file_size(path)) /
+             (3.0 * bursts * burst),
+         "B");
+
+  const i32 calls = 1000000;
+  double elapsed = seconds([&] {
+    for (i32 i = 0; i < calls; ++i)
+      GAME_LOG(INFO, "goal for player {}, {}-{}", i & 1, i, i + 1);
+  });
+  report("eventlog/disabled", elapsed * 1e9 / calls, "ns");
+  std::filesystem::remove_all(directory);
+}
+
+// What the crash flight recorder costs each frame, and how long writing a
+// dump of a full ring and a 1080p frame buffer takes.
+inline void run_flight() {
+  const i32 frames = 1000000;
+  flight::Frame frame = {};
+  double elapsed = seconds([&] {
+    for (i32 i = 0; i < frames; ++i) {
+      frame.ball_x = static_cast<float>(i);
+      flight::recorder.record(frame);
+    }
+  });
+  report("flight/record", elapsed * 1e9 / frames, "ns");
+
+  std::filesystem::path directory =
+      std::filesystem::temp_directory_path() / "pingpong_bench_flight";
+  std::filesystem::remove_all(directory);
+  std::vector<u32> pixels(static_cast<size_t>(1920) * 1080, 0x00336699);
+  flight::Screen screen;
+  screen.pixels = pixels.data();
+  screen.width = 1920;
+  screen.height = 1080;
+  screen.pitch = 1920;
+  flight::recorder.set_screen(screen);
+  flight::recorder.open(directory.string());
+  elapsed = seconds([] { flight::recorder.dump(0, 0); });
+  report("flight/dump", elapsed * 1000.0, "ms");
+  std::filesystem::remove_all(directory);
+}
+
+// Headless AI-against-AI matches for the analytics, then the summary of
+// four million of their events on one thread and on the worker pool.
+inline void run_analytics() {
+  utils::ThreadPool pool;
+  const size_t matches = 64;
+  const float match_seconds = 60.0f;
+  std::vector<std::vector<analytics::HitEvent>> sources(matches);
+  double elapsed = seconds([&] {
+    pool.parallel_for(matches, [&](size_t i) {
+      sources[i] = analytics::simulate(static_cast<u32>(i + 1),
+                                       objects::Hard, match_seconds);
+    });
+  });
+  report("analytics/simulate", matches * match_seconds / elapsed,
+         "game s/s");
+
+  size_t events = 0;
+  for (const std::vector<analytics::HitEvent> &source : sources)
+    events += source.size();
+  const size_t target = 4000000;
+  std::vector<std::vector<analytics::HitEvent>> copies;
+  for (size_t total = 0; events > 0 && total < target; total += events)
+    copies.insert(copies.end(), sources.begin(), sources.end());
+  size_t copied = events * (copies.size() / matches);
+
+  utils::ThreadPool serial(1);
+  for (auto [name, workers] :
+       {std::pair{"serial", &serial}, std::pair{"pooled", &pool}}) {
+    analytics::Summary summary;
+    elapsed = seconds([&] { summary = analytics::crunch(copies, *workers); });
+    report(std::string("analytics/crunch_") + name, copied / elapsed / 1e6,
+           "M events/s");
+  }
+}
+
+// The tick archive: writing simulated hard matches, its size per tick, the
+// filter kernels on decoded columns, and whole queries on the mapped file,
+// one that the chunk statistics mostly skip and one they cannot.
+inline void run_ticks() {
+  utils::ThreadPool pool;
+  const size_t matches = 32;
+  std::vector<std::vector<ticks::Tick>> simulated(matches);
+  pool.parallel_for(matches, [&](size_t i) {
+    analytics::simulate(static_cast<u32>(i + 1), objects::Hard, 60.0f,
+                        &simulated[i]);
+  });
+  std::vector<ticks::Tick> rows;
+  for (size_t copy = 0; rows.size() < 4000000; ++copy)
+    for (const std::vector<ticks::Tick> &match : simulated)
+      rows.insert(rows.end(), match.begin(), match.end());
+
+  std::filesystem::path path =
+      std::filesystem::temp_directory_path() / "pingpong_bench.ticks";
+  ticks::Writer writer;
+  writer.open(path.string());
+  double elapsed = seconds([&] {
+    for (const ticks::Tick &tick : rows)
+      writer.add(tick);
+    writer.close();
+  });
+  report("ticks/write", rows.size() / elapsed / 1e6, "M ticks/s");
+  report("ticks/bytes_per_tick",
+         static_cast<double>(writer.bytes()) / rows.size(), "B");
+
+  ticks::Query fast_ball;
+  fast_ball.min_speed = 300.0f;
+  fast_ball.near_paddle(8.0f);
+  std::vector<i32> decoded[ticks::COLUMN_COUNT];
+  const i32 *columns[ticks::COLUMN_COUNT];
+  for (i32 c = 0; c < ticks::COLUMN_COUNT; ++c) {
+    decoded[c].reserve(rows.size());
+    for (const ticks::Tick &tick : rows)
+      decoded[c].push_back(tick.values[c]);
+    columns[c] = decoded[c].data();
+  }
+  std::vector<u8> mask(rows.size() / 8 + 1);
+  struct Kernel {
+    const char *name;
+    ticks::FilterKernel filter;
+    bool supported;
+  };
+  const Kernel kernels[] = {
+      {"scalar", ticks::filter_scalar, true},
+      {"sse2", ticks::filter_sse2, true},
+      {"avx2", ticks::filter_avx2, utils::cpu_has_avx2()}};
+  for (const Kernel &kernel : kernels) {
+    if (!kernel.supported)
+      continue;
+    elapsed = seconds(
+        [&] { kernel.filter(fast_ball, columns, rows.size(), mask.data()); });
+    report(std::string("ticks/filter/") + kernel.name,
+           rows.size() * 3.0 * sizeof(i32) / elapsed / 1e9, "GB/s");
+  }
+
+  ticks::Archive archive;
+  archive.open(path.string());
+  ticks::Query p1_up;
+  p1_up.where(ticks::COLUMN_INPUTS, ticks::P1_UP, ticks::P1_UP);
+  utils::ThreadPool serial(1);
+  const double raw = static_cast<double>(archive.rows) * sizeof(ticks::Tick);
+  for (auto [name, query] :
+       {std::pair{"fast_ball", &fast_ball}, std::pair{"p1_up", &p1_up}})
+    for (auto [threads, workers] :
+         {std::pair{"serial", &serial}, std::pair{"pooled", &pool}}) {
+      elapsed = seconds([&] { ticks::scan(archive, *query, *workers); });
+      report(std::format("ticks/scan_{}/{}", name, threads),
+             raw / elapsed / 1e9, "GB/s");
+    }
+  std::filesystem::remove(path);
+}
+
+// End-to-end scenes: the real menus and match, headless at 1080p with a
+// fixed seed, scripted input and no frame pacing. Each reports its frame
+// rate and frame-time percentiles.
+constexpr u32 SCENE_SEED = 0x5EED;
+constexpr i32 SCENE_WIDTH = 1920;
+constexpr i32 SCENE_HEIGHT = 1080;
+
+inline void report_scene(const std::string &scene,
+                         const headless::Driver &driver) {
+  const telemetry::FrameHistogram &times = driver.times();
+  std::string name = "scene/" + scene;
+  auto ms = [](u64 ticks) { return headless::Driver::to_ms(ticks); };
+  report(name + "/frames", driver.frames(), "frames");
+  report(name + "/fps", driver.frames() / std::max(driver.seconds(), 1e-9),
+         "frames/s");
+  report(name + "/mean_ms", driver.mean_ms(), "ms");
+  report(name + "/p50_ms", ms(times.percentile(0.50)), "ms");
+  report(name + "/p90_ms", ms(times.percentile(0.90)), "ms");
+  report(name + "/p99_ms", ms(times.percentile(0.99)), "ms");
+  report(name + "/p99.9_ms", ms(times.percentile(0.999)), "ms");
+  report(name + "/max_ms", ms(times.max), "ms");
+}
+
+// Every main menu entry, every setting stepped down and back up, a match
+// started, paused and left through each pause menu entry, over and over.
+inline void run_scene_menus() {
+  headless::Driver d(SCENE_WIDTH, SCENE_HEIGHT, SCENE_SEED, 3000);
+  auto taps = [&](input::Key key, i32 count) {
+    for (i32 i = 0; i < count; ++i)
+      d.tap(key);
+  };
+
+  // Both menus remember their cursor, so only the first round starts at
+  // the top of the settings and pause menus.
+  bool first = true;
+  while (!d.done()) {
+    taps(input::BUTTON_DOWN_ARROW, 3);
+    taps(input::BUTTON_UP_ARROW, 3);
+    taps(input::BUTTON_DOWN_ARROW, 2);
+    d.tap(input::BUTTON_ENTER);
+
+    for (i32 i = 0; i < 10; ++i) {
+      d.tap(input::BUTTON_LEFT_ARROW);
+      d.tap(input::BUTTON_RIGHT_ARROW);
+      d.tap(input::BUTTON_DOWN_ARROW);
+    }
+    if (first)
+      d.tap(input::BUTTON_UP_ARROW);
+    d.tap(input::BUTTON_ENTER);
+
+    taps(input::BUTTON_UP_ARROW, 2);
+    d.tap(input::BUTTON_ENTER);
+    d.until(telemetry::PHASE_GAMEPLAY, 10 * headless::TICKS_PER_SECOND);
+    d.step(30);
+    d.tap(input::BUTTON_ESC);
+    taps(input::BUTTON_DOWN_ARROW, 3);
+    if (first)
+      taps(input::BUTTON_DOWN_ARROW, 2);
+    d.tap(input::BUTTON_ENTER);
+    first = false;
+  }
+  report_scene("menus", d);
+}
+
+// A whole match against each AI difficulty, player 1 sweeping up and down.
+inline void run_scene_match() {
+  const char *names[] = {"easy", "medium", "hard", "very_hard", "unbeatable"};
+  for (i32 level = objects::Easy; level <= objects::Unbeatable; ++level) {
+    headless::Driver d(SCENE_WIDTH, SCENE_HEIGHT, SCENE_SEED,
+                       600 * headless::TICKS_PER_SECOND);
+    d.window().config().ai_difficulty =
+        static_cast<objects::AIDifficulty>(level);
+    d.tap(input::BUTTON_ENTER);
+    while (!d.done() && d.phase() != telemetry::PHASE_MENU) {
+      d.hold(input::BUTTON_UP, 25);
+      d.hold(input::BUTTON_DOWN, 25);
+    }
+    report_scene(std::string("match_") + names[level], d);
+  }
+}
+
+// A long match with player 1 standing still until 50 goals, each with its
+// celebration, have been scored.
+inline void run_scene_goals() {
+  const i32 goals = 50;
+  headless::Driver d(SCENE_WIDTH, SCENE_HEIGHT, SCENE_SEED,
+                     1800 * headless::TICKS_PER_SECOND);
+  d.window().config().game_duration_secs = 1800.0f;
+  d.tap(input::BUTTON_ENTER);
+  i32 scored = 0;
+  while (scored < goals &&
+         d.until(telemetry::PHASE_CELEBRATION,
+                 120 * headless::TICKS_PER_SECOND)) {
+    d.until(telemetry::PHASE_GAMEPLAY, 10 * headless::TICKS_PER_SECOND);
+    scored++;
+  }
+  report("scene/goals/goals", scored, "goals");
+  report_scene("goals", d);
+}
+
+// F11 every half second during a match, so the frame buffer keeps
+// switching between a 720p window and a 1080p screen.
+inline void run_scene_fullscreen() {
+  headless::Driver d(1280, 720, SCENE_SEED, 3000);
+  d.tap(input::BUTTON_ENTER);
+  while (!d.done()) {
+    d.step(29);
+    d.tap(input::BUTTON_F11);
+  }
+  report_scene("fullscreen", d);
+}
+
+const Benchmark benchmarks[] = {{"blend", run_blend},
+                                {"postfx", run_postfx},
+                                {"overdraw", run_overdraw},
+                                {"framebuffer", run_framebuffer},
+                                {"capture", run_capture},
+                                {"gif", run_gif},
+                                {"screenshot", run_screenshot},
+                                {"frametimes", run_frametimes},
+                                {"counters", run_counters},
+                                {"assets", run_assets},
+                                {"matches", run_matches},
+                                {"eventlog", run_eventlog},
+                                {"flight", run_flight},
+                                {"analytics", run_analytics},
+                                {"ticks", run_ticks},
+                                {"scene_menus", run_scene_menus},
+                                {"scene_match", run_scene_match},
+                                {"scene_goals", run_scene_goals},
+                                {"scene_fullscreen", run_scene_fullscreen}};
+
+// Every value a measurement took over the runs, in the order reported.
+struct Series {
+  std::string name;
+  std::string unit;
+  std::vector<double> samples;
+};
+
+inline std::vector<Series> collect(const std::vector<Measurement> &list) {
+  std::vector<Series> series;
+  std::unordered_map<std::string, size_t> index;
+  for (const Measurement &m : list) {
+    auto [it, added] = index.try_emplace(m.name, series.size());
+    if (added)
+      series.push_back({m.name, m.unit, {}});
+    series[it->second].samples.push_back(m.value);
+  }
+  return series;
+}
+
+inline double median(std::vector<double> values) {
+  if (values.empty())
+    return 0.0;
+  size_t middle = values.size() / 2;
+  std::nth_element(values.begin(), values.begin() + middle, values.end());
+  double upper = values[middle];
+  if (values.size() % 2 == 1)
+    return upper;
+  return (upper + *std::max_element(values.begin(),
+                                    values.begin() + middle)) *
+         0.5;
+}
+
+// Two-sided p-value of the Mann-Whitney U test, from the normal
+// approximation with tie and continuity corrections.
+inline double mann_whitney_p(const std::vector<double> &a,
+                             const std::vector<double> &b) {
+  size_t n1 = a.size(), n2 = b.size(), n = n1 + n2;
+  if (n1 == 0 || n2 == 0)
+    return 1.0;
+  std::vector<std::pair<double, bool>> all;
+  for (double v : a)
+    all.push_back({v, true});
+  for (double v : b)
+    all.push_back({v, false});
+  std::sort(all.begin(), all.end());
+
+  double rank_sum = 0.0;
+  double ties = 0.0;
+  for (size_t i = 0; i < n;) {
+    size_t j = i;
+    while (j < n && all[j].first == all[i].first)
+      j++;
+    double rank = (i + 1 + j) * 0.5;
+    for (size_t k = i; k < j; ++k)
+      if (all[k].second)
+        rank_sum += rank;
+    double t = static_cast<double>(j - i);
+    ties += t * t * t - t;
+    i = j;
+  }
+
+  double u = rank_sum - n1 * (n1 + 1) * 0.5;
+  double mean = n1 * n2 * 0.5;
+  double variance =
+      n1 * n2 / 12.0 * ((n + 1) - ties / (static_cast<double>(n) * (n - 1)));
+  if (variance <= 0.0)
+    return 1.0;
+  double z = std::max(0.0, std::abs(u - mean) - 0.5) / std::sqrt(variance);
+  return std::erfc(z / std::sqrt(2.0));
+}
+
+// 95% bootstrap interval of median(after) / median(before).
+inline std::pair<double, double>
+bootstrap_ratio(const std::vector<double> &before,
+                const std::vector<double> &after, i32 resamples = 2000) {
+  utils::Random random;
+  random.seed(0xB007);
+  auto resample = [&](const std::vector<double> &values) {
+    std::vector<double> out(values.size());
+    for (double &v : out)
+      v = values[random.next() % values.size()];
+    return median(out);
+  };
+  std::vector<double> ratios(resamples);
+  for (double &ratio : ratios)
+    ratio = resample(after) / std::max(resample(before), 1e-12);
+  std::sort(ratios.begin(), ratios.end());
+  return {ratios[resamples * 25 / 1000], ratios[resamples * 975 / 1000]};
+}
+
+// -1 when smaller values are better (times), +1 when larger ones are
+// (throughput), 0 for sizes and counts that are only informative.
+inline i32 direction(const std::string &unit) {
+  if (unit == "ms" || unit == "us" || unit == "ns" || unit == "s")
+    return -1;
+  if (unit.ends_with("/s"))
+    return 1;
+  return 0;
+}
+
+inline std::vector<Series> load_baseline(const std::string &path) {
+  std::vector<Series> series;
+  std::ifstream file(path);
+  if (!file)
+    return series;
+  json data = json::parse(file, nullptr, false);
+  if (data.is_discarded() || !data.contains("results"))
+    return series;
+  for (const json &entry : data["results"]) {
+    Series s{entry.value("name", ""), entry.value("unit", ""), {}};
+    if (entry.contains("samples"))
+      s.samples = entry["samples"].get<std::vector<double>>();
+    else
+      s.samples.push_back(entry.value("value", 0.0));
+    series.push_back(std::move(s));
+  }
+  return series;
+}
+
+// Prints how every measurement moved against the baseline and returns the
+// number of significant regressions beyond `threshold` percent.
+inline i32 compare(const std::vector<Series> &baseline,
+                   const std::vector<Series> &current, double threshold,
+                   double alpha) {
+  std::unordered_map<std::string, const Series *> before;
+  for (const Series &s : baseline)
+    before[s.name] = &s;
+
+  std::printf("\n%-40s %12s %12s %8s %17s %7s  %s\n", "benchmark",
+              "baseline", "current", "change", "95% interval", "p",
+              "verdict");
+  i32 regressions = 0;
+  for (const Series &after : current) {
+    auto it = before.find(after.name);
+    if (it == before.end())
+      continue;
+    const Series &base = *it->second;
+    double a = median(base.samples);
+    double b = median(after.samples);
+    double change = 100.0 * (b / std::max(std::abs(a), 1e-12) - 1.0);
+    auto [low, high] = bootstrap_ratio(base.samples, after.samples);
+    double p = mann_whitney_p(base.samples, after.samples);
+
+    i32 better = direction(after.unit);
+    const char *verdict = "";
+    if (better != 0 && p < alpha) {
+      bool worse = change * better < 0.0;
+      if (!worse)
+        verdict = "faster";
+      else if (std::abs(change) > threshold) {
+        verdict = "REGRESSION";
+        regressions++;
+      } else {
+        verdict = "slower";
+      }
+    }
+    std::printf("%-40s %12.4g %12.4g %+7.1f%% [%+6.1f%%,%+6.1f%%] %7.4f  %s\n",
+                after.name.c_str(), a, b, change, 100.0 * (low - 1.0),
+                100.0 * (high - 1.0), p, verdict);
+  }
+  return regressions;
+}
+
+inline i32 run(const std::vector<std::string> &args) {
+  utils::attach_console();
+
+  std::string selected = "all";
+  std::string json_path;
+  std::string baseline_path;
+  i32 runs = 0;
+  double threshold = 5.0;
+  double alpha = 0.05;
+  for (size_t i = 0; i < args.size(); ++i) {
+    bool has_value = i + 1 < args.size();
+    if (args[i] == "--json" && has_value)
+      json_path = args[++i];
+    else if (args[i] == "--compare" && has_value)
+      baseline_path = args[++i];
+    else if (args[i] == "--runs" && has_value)
+      runs = std::max(1, std::atoi(args[++i].c_str()));
+    else if (args[i] == "--threshold" && has_value)
+      threshold = std::atof(args[++i].c_str());
+    else if (args[i] == "--alpha" && has_value)
+      alpha = std::atof(args[++i].c_str());
+    else
+      selected = args[i];
+  }
+
+  std::vector<Series> baseline;
+  if (!baseline_path.empty()) {
+    baseline = load_baseline(baseline_path);
+    if (baseline.empty()) {
+      std::printf("cannot read baseline %s\n", baseline_path.c_str());
+      return 1;
+    }
+  }
+  // A comparison needs several samples on both sides to mean anything.
+  if (runs == 0)
+    runs = baseline.empty() ? 1 : 5;
+  echo = runs == 1;
+
+  bool found = false;
+  for (i32 run = 0; run < runs; ++run) {
+    for (const Benchmark &benchmark : benchmarks) {
+      std::string_view name = benchmark.name;
+      bool scene = name.starts_with("scene_");
+      if (selected != "all" && selected != name &&
+          !(selected == "scenes" && scene))
+        continue;
+      found = true;
+      if (!echo)
+        std::printf("run %d/%d: %s\n", run + 1, runs, benchmark.name);
+      benchmark.run();
+    }
+    if (!found)
+      break;
+  }
+
+  if (!found) {
+    std::printf("unknown benchmark '%s'; available:", selected.c_str());
+    for (const Benchmark &benchmark : benchmarks)
+      std::printf(" %s", benchmark.name);
+    std::printf(" scenes all\n");
+    return 1;
+  }
+
+  std::vector<Series> current = collect(results);
+  if (!echo) {
+    for (const Series &series : current)
+      std::printf("%-40s %14.2f %s (median of %zu)\n", series.name.c_str(),
+                  median(series.samples), series.unit.c_str(),
+                  series.samples.size());
+  }
+
+  if (!json_path.empty()) {
+    json out = {{"benchmark", selected},
+                {"runs", runs},
+                {"results", json::array()}};
+    for (const Series &series : current)
+      out["results"].push_back({{"name", series.name},
+                                {"value", median(series.samples)},
+                                {"unit", series.unit},
+                                {"samples", series.samples}});
+    std::ofstream file(json_path, std::ios::trunc);
+    file << out.dump(2) << "\n";
+    if (!file) {
+      std::printf("cannot write %s\n", json_path.c_str());
+      return 1;
+    }
+  }
+
+  if (!baseline.empty()) {
+    i32 regressions = compare(baseline, current, threshold, alpha);
+    std::printf("\n%d regression(s) beyond %.1f%% at p < %.3g\n",
+                regressions, threshold, alpha);
+    if (regressions > 0)
+      return 2;
+  }
+  return 0;
+}
+} // namespace bench
+} // namespace game
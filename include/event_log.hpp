@@ -0,0 +1,631 @@
+#pragma once
+
+#include <algorithm>
+#include <atomic>
+#include <cctype>
+#include <chrono>
+#include <condition_variable>
+#include <cstdint>
+#include <cstdio>
+#include <cstring>
+#include <ctime>
+#include <filesystem>
+#include <format>
+#include <fstream>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <string_view>
+#include <thread>
+#include <type_traits>
+#include <unordered_map>
+#include <unordered_set>
+#include <vector>
+
+#if defined(_MSC_VER)
+#include <intrin.h>
+#else
+#include <x86intrin.h>
+#endif
+
+// Structured binary event log. A call site
+//   GAME_LOG(INFO, "goal for player {}, {}-{}", winner, score1, score2);
+// copies a pointer to its constant call-site description, a TSC timestamp
+// and the raw argument values into a ring owned by the calling thread. A
+// background thread drains the rings into logs/<session>.blog; nothing is
+// formatted until
+//   pingpong.exe --decode-log logs/<session>.blog [--level warn]
+// turns the file back into text. A full ring drops events and counts them
+// rather than block the game.
+
+namespace game {
+namespace events {
+enum Level : uint8_t { LEVEL_DEBUG, LEVEL_INFO, LEVEL_WARN, LEVEL_ERROR };
+
+const char *level_names[] = {"DEBUG", "INFO", "WARN", "ERROR"};
+
+// Everything about a call site that is known at compile time. `types` has
+// one letter per argument: i, u, f, b or s.
+struct Site {
+  Level level;
+  const char *format;
+  const char *file;
+  uint32_t line;
+  const char *types;
+  uint32_t id;
+};
+
+constexpr uint32_t site_id(const char *format, const char *file,
+                           uint32_t line) {
+  uint32_t hash = 2166136261u;
+  for (const char *c = format; *c; ++c)
+    hash = (hash ^ static_cast<uint8_t>(*c)) * 16777619u;
+  for (const char *c = file; *c; ++c)
+    hash = (hash ^ static_cast<uint8_t>(*c)) * 16777619u;
+  for (uint32_t i = 0; i < 4; ++i)
+    hash = (hash ^ ((line >> (8 * i)) & 0xFF)) * 16777619u;
+  return hash;
+}
+
+template <typename T> constexpr char type_code() {
+  using U = std::decay_t<T>;
+  if constexpr (std::is_same_v<U, bool>)
+    return 'b';
+  else if constexpr (std::is_enum_v<U>)
+    return std::is_signed_v<std::underlying_type_t<U>> ? 'i' : 'u';
+  else if constexpr (std::is_integral_v<U>)
+    return std::is_signed_v<U> ? 'i' : 'u';
+  else if constexpr (std::is_floating_point_v<U>)
+    return 'f';
+  else {
+    static_assert(std::is_convertible_v<U, std::string_view>,
+                  "GAME_LOG takes numbers, bools, enums and strings");
+    return 's';
+  }
+}
+
+template <typename... Args> struct Signature {
+  static constexpr char value[] = {type_code<Args>()..., '\0'};
+};
+
+template <typename... Args>
+Signature<std::decay_t<Args>...> signature_of(const Args &...);
+
+// Strings longer than this are cut short.
+constexpr size_t MAX_STRING = 256;
+
+template <typename T> inline size_t encoded_size(const T &value) {
+  if constexpr (type_code<T>() == 's')
+    return 2 + std::min(std::string_view(value).size(), MAX_STRING);
+  else if constexpr (type_code<T>() == 'b')
+    return 1;
+  else
+    return 8;
+}
+
+template <typename T> inline uint8_t *encode(uint8_t *at, const T &value) {
+  constexpr char code = type_code<T>();
+  if constexpr (code == 's') {
+    std::string_view text(value);
+    uint16_t length = static_cast<uint16_t>(std::min(text.size(), MAX_STRING));
+    std::memcpy(at, &length, 2);
+    std::memcpy(at + 2, text.data(), length);
+    return at + 2 + length;
+  } else if constexpr (code == 'b') {
+    *at = value ? 1 : 0;
+    return at + 1;
+  } else if constexpr (code == 'f') {
+    double number = static_cast<double>(value);
+    std::memcpy(at, &number, 8);
+    return at + 8;
+  } else if constexpr (code == 'i') {
+    int64_t number = static_cast<int64_t>(value);
+    std::memcpy(at, &number, 8);
+    return at + 8;
+  } else {
+    uint64_t number = static_cast<uint64_t>(value);
+    std::memcpy(at, &number, 8);
+    return at + 8;
+  }
+}
+
+struct RecordHeader {
+  uint32_t size; // of the whole record, a multiple of RECORD_ALIGN
+  uint32_t payload;
+  const Site *site; // null for the padding before a wrap
+  uint64_t tsc;
+};
+
+// Records start and end on this boundary, so the space left before the end
+// of a ring is either none or room for a whole padding header.
+constexpr size_t RECORD_ALIGN = 32;
+static_assert(sizeof(RecordHeader) <= RECORD_ALIGN);
+
+inline size_t record_size(size_t payload) {
+  return (sizeof(RecordHeader) + payload + RECORD_ALIGN - 1) &
+         ~(RECORD_ALIGN - 1);
+}
+
+// Single producer, single consumer. Records never wrap: when one does not
+// fit before the end, the rest of the buffer becomes padding.
+class Ring {
+public:
+  static constexpr size_t CAPACITY = 64 * 1024;
+  static constexpr size_t MASK = CAPACITY - 1;
+  static_assert(CAPACITY % RECORD_ALIGN == 0);
+
+  uint8_t *reserve(size_t size) {
+    uint64_t used = head - tail.load(std::memory_order_acquire);
+    size_t offset = static_cast<size_t>(head & MASK);
+    size_t contiguous = CAPACITY - offset;
+    if (contiguous < size) {
+      if (used + contiguous + size > CAPACITY)
+        return nullptr;
+      RecordHeader padding = {static_cast<uint32_t>(contiguous), 0, nullptr,
+                              0};
+      std::memcpy(buffer.get() + offset, &padding, sizeof(padding));
+      head += contiguous;
+      published.store(head, std::memory_order_release);
+      offset = 0;
+    } else if (used + size > CAPACITY) {
+      return nullptr;
+    }
+    return buffer.get() + offset;
+  }
+
+  void commit(size_t size) {
+    head += size;
+    published.store(head, std::memory_order_release);
+  }
+
+  // Hands every record published so far to `consume`, oldest first.
+  template <typename F> void drain(F &&consume) {
+    uint64_t end = published.load(std::memory_order_acquire);
+    uint64_t at = tail.load(std::memory_order_relaxed);
+    while (at < end) {
+      const uint8_t *record = buffer.get() + (at & MASK);
+      RecordHeader header;
+      std::memcpy(&header, record, sizeof(header));
+      if (header.site)
+        consume(header, record + sizeof(RecordHeader));
+      at += header.size;
+    }
+    tail.store(at, std::memory_order_release);
+  }
+
+  std::atomic<uint64_t> dropped = 0;
+  uint16_t thread = 0;
+
+private:
+  std::unique_ptr<uint8_t[]> buffer = std::make_unique<uint8_t[]>(CAPACITY);
+  uint64_t head = 0; // only the producer touches it
+  alignas(64) std::atomic<uint64_t> published = 0;
+  alignas(64) std::atomic<uint64_t> tail = 0;
+};
+
+constexpr uint32_t MAGIC = 0x474C5050; // "PPLG"
+constexpr uint32_t VERSION = 1;
+
+enum Tag : uint8_t {
+  TAG_SITE = 'S',
+  TAG_EVENT = 'E',
+  TAG_DROPPED = 'D',
+  TAG_CLOCK = 'C'
+};
+
+// Drains every thread's ring on its own thread, writes each call site's
+// description the first time one of its events is written, and pairs the
+// TSC with the steady clock now and then so the decoder can turn
+// timestamps into seconds.
+class Logger {
+public:
+  std::atomic<bool> enabled = false;
+
+  Logger() = default;
+  Logger(const Logger &) = delete;
+  Logger &operator=(const Logger &) = delete;
+  ~Logger() { stop(); }
+
+  bool start(const std::string &directory) {
+    if (writer.joinable())
+      return true;
+    std::filesystem::create_directories(directory);
+    std::time_t now = std::time(nullptr);
+    char name[32];
+    std::strftime(name, sizeof(name), "%Y%m%d_%H%M%S",
+                  std::localtime(&now));
+    file_path = directory + "/" + name + ".blog";
+    out.open(file_path, std::ios::binary | std::ios::trunc);
+    if (!out)
+      return false;
+    put(MAGIC);
+    put(VERSION);
+    put(static_cast<int64_t>(now));
+    write_clock();
+    written.clear();
+    stopping = false;
+    enabled.store(true, std::memory_order_relaxed);
+    writer = std::thread([this] { work(); });
+    return true;
+  }
+
+  // Writes out what is left and closes the file.
+  void stop() {
+    if (!writer.joinable())
+      return;
+    enabled.store(false, std::memory_order_relaxed);
+    {
+      std::lock_guard<std::mutex> lock(mutex);
+      stopping = true;
+    }
+    wake.notify_one();
+    writer.join();
+    out.close();
+  }
+
+  // Returns once everything logged before the call is in the file.
+  void flush() {
+    if (!writer.joinable())
+      return;
+    std::unique_lock<std::mutex> lock(mutex);
+    uint64_t target = passes + (busy ? 2 : 1);
+    flush_requested = true;
+    wake.notify_one();
+    drained.wait(lock, [&] { return passes >= target; });
+  }
+
+  const std::string &path() const { return file_path; }
+
+  Ring &local_ring() {
+    thread_local Ring *ring = nullptr;
+    if (!ring) {
+      std::lock_guard<std::mutex> lock(mutex);
+      rings.push_back(std::make_unique<Ring>());
+      ring = rings.back().get();
+      ring->thread = static_cast<uint16_t>(rings.size() - 1);
+    }
+    return *ring;
+  }
+
+private:
+  template <typename T> void put(const T &value) {
+    out.write(reinterpret_cast<const char *>(&value), sizeof(value));
+  }
+
+  void put_string(const char *text) {
+    uint16_t length = static_cast<uint16_t>(std::strlen(text));
+    put(length);
+    out.write(text, length);
+  }
+
+  void write_clock() {
+    put(TAG_CLOCK);
+    put(static_cast<uint64_t>(__rdtsc()));
+    put(static_cast<int64_t>(
+        std::chrono::duration_cast<std::chrono::nanoseconds>(
+            std::chrono::steady_clock::now().time_since_epoch())
+            .count()));
+  }
+
+  void flush_rings() {
+    std::vector<Ring *> current;
+    {
+      std::lock_guard<std::mutex> lock(mutex);
+      for (auto &ring : rings)
+        current.push_back(ring.get());
+    }
+    for (Ring *ring : current) {
+      ring->drain([&](const RecordHeader &header, const uint8_t *payload) {
+        const Site &site = *header.site;
+        if (written.insert(site.id).second) {
+          put(TAG_SITE);
+          put(site.id);
+          put(static_cast<uint8_t>(site.level));
+          put(site.line);
+          put_string(site.file);
+          put_string(site.format);
+          put_string(site.types);
+        }
+        put(TAG_EVENT);
+        put(site.id);
+        put(ring->thread);
+        put(header.tsc);
+        put(static_cast<uint16_t>(header.payload));
+        out.write(reinterpret_cast<const char *>(payload), header.payload);
+      });
+      uint64_t dropped = ring->dropped.exchange(0);
+      if (dropped > 0) {
+        put(TAG_DROPPED);
+        put(ring->thread);
+        put(dropped);
+      }
+    }
+  }
+
+  void work() {
+    auto last_clock = std::chrono::steady_clock::now();
+    for (;;) {
+      bool last;
+      {
+        std::unique_lock<std::mutex> lock(mutex);
+        wake.wait_for(lock, std::chrono::milliseconds(50),
+                      [this] { return stopping || flush_requested; });
+        last = stopping;
+        flush_requested = false;
+        busy = true;
+      }
+      flush_rings();
+      auto now = std::chrono::steady_clock::now();
+      if (last || now - last_clock > std::chrono::seconds(1)) {
+        write_clock();
+        last_clock = now;
+      }
+      out.flush();
+      {
+        std::lock_guard<std::mutex> lock(mutex);
+        busy = false;
+        passes++;
+      }
+      drained.notify_all();
+      if (last)
+        return;
+    }
+  }
+
+  std::vector<std::unique_ptr<Ring>> rings;
+  std::unordered_set<uint32_t> written;
+  std::ofstream out;
+  std::string file_path;
+  bool stopping = false;
+  bool flush_requested = false;
+  bool busy = false;
+  uint64_t passes = 0;
+  std::mutex mutex;
+  std::condition_variable wake;
+  std::condition_variable drained;
+  std::thread writer;
+};
+
+Logger logger;
+
+template <typename... Args>
+inline void write(const Site &site, const Args &...args) {
+  if (!logger.enabled.load(std::memory_order_relaxed))
+    return;
+  size_t payload = (size_t(0) + ... + encoded_size(args));
+  size_t size = record_size(payload);
+  Ring &ring = logger.local_ring();
+  uint8_t *at = ring.reserve(size);
+  if (!at) {
+    ring.dropped.fetch_add(1, std::memory_order_relaxed);
+    return;
+  }
+  RecordHeader header = {static_cast<uint32_t>(size),
+                         static_cast<uint32_t>(payload), &site, __rdtsc()};
+  std::memcpy(at, &header, sizeof(header));
+  [[maybe_unused]] uint8_t *cursor = at + sizeof(RecordHeader);
+  ((cursor = encode(cursor, args)), ...);
+  ring.commit(size);
+}
+
+// Decoding -----------------------------------------------------------------
+
+struct Reader {
+  const std::vector<uint8_t> &bytes;
+  size_t at = 0;
+  bool ok = true;
+
+  template <typename T> T get() {
+    T value{};
+    if (at + sizeof(T) > bytes.size()) {
+      ok = false;
+      return value;
+    }
+    std::memcpy(&value, bytes.data() + at, sizeof(T));
+    at += sizeof(T);
+    return value;
+  }
+
+  std::string get_string() {
+    uint16_t length = get<uint16_t>();
+    if (!ok || at + length > bytes.size()) {
+      ok = false;
+      return {};
+    }
+    std::string text(reinterpret_cast<const char *>(bytes.data() + at),
+                     length);
+    at += length;
+    return text;
+  }
+};
+
+struct DecodedSite {
+  Level level;
+  uint32_t line;
+  std::string file;
+  std::string format;
+  std::string types;
+};
+
+// Substitutes each {} or {:spec} of `format` with the next argument.
+inline std::string format_event(const DecodedSite &site, Reader &payload) {
+  std::string text;
+  size_t next = 0;
+  const std::string &format = site.format;
+  for (size_t i = 0; i < format.size(); ++i) {
+    char c = format[i];
+    if (c == '{' && i + 1 < format.size() && format[i + 1] == '{') {
+      text += '{';
+      i++;
+      continue;
+    }
+    if (c == '}' && i + 1 < format.size() && format[i + 1] == '}') {
+      text += '}';
+      i++;
+      continue;
+    }
+    size_t close = format.find('}', i);
+    if (c != '{' || close == std::string::npos || next >= site.types.size()) {
+      text += c;
+      continue;
+    }
+    std::string spec = "{" + format.substr(i + 1, close - i - 1) + "}";
+    i = close;
+    try {
+      switch (site.types[next++]) {
+      case 'i': {
+        int64_t value = payload.get<int64_t>();
+        text += std::vformat(spec, std::make_format_args(value));
+      } break;
+      case 'u': {
+        uint64_t value = payload.get<uint64_t>();
+        text += std::vformat(spec, std::make_format_args(value));
+      } break;
+      case 'f': {
+        double value = payload.get<double>();
+        text += std::vformat(spec, std::make_format_args(value));
+      } break;
+      case 'b': {
+        bool value = payload.get<uint8_t>() != 0;
+        text += std::vformat(spec, std::make_format_args(value));
+      } break;
+      default: {
+        std::string value = payload.get_string();
+        text += std::vformat(spec, std::make_format_args(value));
+      } break;
+      }
+    } catch (const std::format_error &) {
+      text += "<bad format>";
+    }
+  }
+  return text;
+}
+
+// --decode-log file [--level debug|info|warn|error]
+inline int run(const std::vector<std::string> &args) {
+  if (args.empty()) {
+    std::printf("usage: --decode-log <file.blog> [--level warn]\n");
+    return 1;
+  }
+  Level min_level = LEVEL_DEBUG;
+  for (size_t i = 1; i + 1 < args.size(); ++i)
+    if (args[i] == "--level")
+      for (uint8_t l = 0; l < std::size(level_names); ++l)
+        if (std::string_view(level_names[l]).size() == args[i + 1].size() &&
+            std::equal(args[i + 1].begin(), args[i + 1].end(),
+                       level_names[l], [](char a, char b) {
+                         return std::toupper(static_cast<uint8_t>(a)) == b;
+                       }))
+          min_level = static_cast<Level>(l);
+
+  std::ifstream in(args[0], std::ios::binary);
+  std::vector<uint8_t> bytes((std::istreambuf_iterator<char>(in)),
+                             std::istreambuf_iterator<char>());
+  Reader reader{bytes};
+  if (reader.get<uint32_t>() != MAGIC || reader.get<uint32_t>() != VERSION) {
+    std::printf("%s is not an event log\n", args[0].c_str());
+    return 1;
+  }
+  std::time_t started = static_cast<std::time_t>(reader.get<int64_t>());
+
+  // The first and last clock pairs give the TSC rate.
+  struct Clock {
+    uint64_t tsc;
+    int64_t ns;
+  };
+  std::vector<Clock> clocks;
+  size_t body = reader.at;
+  while (reader.ok && reader.at < bytes.size()) {
+    uint8_t tag = reader.get<uint8_t>();
+    if (tag == TAG_CLOCK) {
+      uint64_t tsc = reader.get<uint64_t>();
+      clocks.push_back({tsc, reader.get<int64_t>()});
+    } else if (tag == TAG_SITE) {
+      reader.at += 4 + 1 + 4;
+      reader.get_string();
+      reader.get_string();
+      reader.get_string();
+    } else if (tag == TAG_EVENT) {
+      reader.at += 4 + 2 + 8;
+      reader.at += reader.get<uint16_t>();
+    } else if (tag == TAG_DROPPED) {
+      reader.at += 2 + 8;
+    } else {
+      break;
+    }
+  }
+  double tsc_per_ns = 1.0;
+  if (clocks.size() >= 2 && clocks.back().ns > clocks.front().ns)
+    tsc_per_ns = static_cast<double>(clocks.back().tsc - clocks.front().tsc) /
+                 static_cast<double>(clocks.back().ns - clocks.front().ns);
+  uint64_t origin = clocks.empty() ? 0 : clocks.front().tsc;
+
+  char date[32];
+  std::strftime(date, sizeof(date), "%Y-%m-%d %H:%M:%S",
+                std::localtime(&started));
+  std::printf("# %s, started %s\n", args[0].c_str(), date);
+
+  std::unordered_map<uint32_t, DecodedSite> sites;
+  reader.at = body;
+  reader.ok = true;
+  uint64_t events = 0;
+  while (reader.ok && reader.at < bytes.size()) {
+    uint8_t tag = reader.get<uint8_t>();
+    if (tag == TAG_CLOCK) {
+      reader.at += 8 + 8;
+    } else if (tag == TAG_SITE) {
+      uint32_t id = reader.get<uint32_t>();
+      DecodedSite site;
+      site.level = static_cast<Level>(reader.get<uint8_t>());
+      site.line = reader.get<uint32_t>();
+      site.file = reader.get_string();
+      site.format = reader.get_string();
+      site.types = reader.get_string();
+      size_t slash = site.file.find_last_of("/\\");
+      if (slash != std::string::npos)
+        site.file = site.file.substr(slash + 1);
+      sites[id] = std::move(site);
+    } else if (tag == TAG_EVENT) {
+      uint32_t id = reader.get<uint32_t>();
+      uint16_t thread = reader.get<uint16_t>();
+      uint64_t tsc = reader.get<uint64_t>();
+      uint16_t length = reader.get<uint16_t>();
+      if (!reader.ok || reader.at + length > bytes.size())
+        break;
+      std::vector<uint8_t> payload(bytes.begin() + reader.at,
+                                   bytes.begin() + reader.at + length);
+      reader.at += length;
+      auto it = sites.find(id);
+      if (it == sites.end() || it->second.level < min_level)
+        continue;
+      Reader arguments{payload};
+      double seconds = static_cast<double>(tsc - origin) / tsc_per_ns / 1e9;
+      std::printf("[%12.6f] %-5s t%-2u %s:%u  %s\n", seconds,
+                  level_names[std::min<uint8_t>(it->second.level, 3)], thread,
+                  it->second.file.c_str(), it->second.line,
+                  format_event(it->second, arguments).c_str());
+      events++;
+    } else if (tag == TAG_DROPPED) {
+      uint16_t thread = reader.get<uint16_t>();
+      uint64_t dropped = reader.get<uint64_t>();
+      std::printf("# thread %u dropped %llu events\n", thread,
+                  static_cast<unsigned long long>(dropped));
+    } else {
+      std::printf("# unknown record at byte %zu\n", reader.at - 1);
+      return 1;
+    }
+  }
+  std::printf("# %llu events\n", static_cast<unsigned long long>(events));
+  return 0;
+}
+} // namespace events
+} // namespace game
+
+#define GAME_LOG(level, format, ...)                                          \
+  do {                                                                        \
+    static constexpr ::game::events::Site game_log_site = {                   \
+        ::game::events::LEVEL_##level, format, __FILE__, __LINE__,            \
+        decltype(::game::events::signature_of(__VA_ARGS__))::value,           \
+        ::game::events::site_id(format, __FILE__, __LINE__)};                 \
+    ::game::events::write(game_log_site __VA_OPT__(, ) __VA_ARGS__);          \
+  } while (0)
@@ -0,0 +1,343 @@
+#pragma once
+
+#include <algorithm>
+#include <atomic>
+#include <cstdint>
+#include <cstdio>
+#include <cstring>
+#include <ctime>
+#include <filesystem>
+#include <fstream>
+#include <string>
+#include <string_view>
+#include <vector>
+
+#include <Windows.h>
+
+#include "assets.hpp"
+
+// The last couple of thousand frames are kept in a fixed ring, so a crash
+// can be written out without allocating or taking a lock. On a crash (an
+// unhandled SEH exception) the ring goes to crashes/crash_<session>.bin and
+// the frame buffer as it was at that moment to crashes/crash_<session>.bmp,
+// with nothing but raw file writes. A dump is read back with
+//   pingpong.exe --crash-report crashes/crash_<session>.bin [--last N]
+
+namespace game {
+namespace flight {
+// One frame: what was held, where everything was and what started playing.
+struct Frame {
+  uint32_t index;
+  float dt_ms;
+  int64_t counter;
+  uint32_t buttons; // a bit per input::Key held down
+  uint16_t sounds;  // a bit per sound effect, by its place in packed_files
+  uint8_t menu;
+  uint8_t phase;
+  uint16_t score1;
+  uint16_t score2;
+  float ball_x, ball_y;
+  float ball_vx, ball_vy;
+  float paddle1_y, paddle1_dp;
+  float paddle2_y, paddle2_dp;
+  uint32_t reserved;
+};
+static_assert(sizeof(Frame) == 64);
+
+constexpr uint32_t MAGIC = 0x52435050; // "PPCR"
+constexpr uint32_t VERSION = 1;
+
+struct DumpHeader {
+  uint32_t magic;
+  uint32_t version;
+  uint32_t frame_size;
+  uint32_t count;
+  uint64_t code;    // the exception code
+  uint64_t address; // of the fault
+  int64_t started;  // the session's start, unix time
+};
+
+// The frame buffer being drawn into. In indexed mode `indices` is set and
+// `palette` points at the 256 BGRX entries the blit uses.
+struct Screen {
+  const uint32_t *pixels = nullptr;
+  const uint8_t *indices = nullptr;
+  const void *palette = nullptr;
+  int32_t width = 0;
+  int32_t height = 0;
+  int32_t pitch = 0; // in pixels
+  int32_t index_pitch = 0;
+};
+
+// The sound effect's bit in Frame::sounds.
+constexpr size_t SOUND_BITS =
+    std::min<size_t>(std::size(assets::packed_files), 16);
+
+inline uint16_t sound_bit(std::string_view filename) {
+  for (size_t i = 0; i < SOUND_BITS; ++i) {
+    std::string_view path = assets::packed_files[i];
+    if (path.size() > filename.size() && path.ends_with(filename) &&
+        path[path.size() - filename.size() - 1] == '/')
+      return static_cast<uint16_t>(1u << i);
+  }
+  return 0;
+}
+
+// Only open, write and close, which are safe in an exception filter.
+class RawFile {
+public:
+  explicit RawFile(const char *path) {
+    handle = CreateFileA(path, GENERIC_WRITE, 0, nullptr, CREATE_ALWAYS,
+                         FILE_ATTRIBUTE_NORMAL, nullptr);
+  }
+  RawFile(const RawFile &) = delete;
+  RawFile &operator=(const RawFile &) = delete;
+
+  ~RawFile() {
+    if (handle != INVALID_HANDLE_VALUE)
+      CloseHandle(handle);
+  }
+
+  bool ok() const {
+    return handle != INVALID_HANDLE_VALUE;
+  }
+
+  void write(const void *data, size_t size) {
+    const uint8_t *at = static_cast<const uint8_t *>(data);
+    while (ok() && size > 0) {
+      DWORD done = 0;
+      if (!WriteFile(handle, at, static_cast<DWORD>(size), &done, nullptr) ||
+          done == 0)
+        return;
+      at += done;
+      size -= static_cast<size_t>(done);
+    }
+  }
+
+private:
+  HANDLE handle = INVALID_HANDLE_VALUE;
+};
+
+class Recorder {
+public:
+  static constexpr uint32_t CAPACITY = 2048;
+  static constexpr uint32_t MASK = CAPACITY - 1;
+
+  // Called once per frame on the game thread.
+  void record(Frame frame) {
+    uint64_t at = written.load(std::memory_order_relaxed);
+    frame.index = static_cast<uint32_t>(at);
+    frame.sounds = sounds.exchange(0, std::memory_order_relaxed);
+    frames[at & MASK] = frame;
+    written.store(at + 1, std::memory_order_release);
+  }
+
+  // Simulations on other threads start sounds too.
+  void sound(std::string_view filename) {
+    sounds.fetch_or(sound_bit(filename), std::memory_order_relaxed);
+  }
+
+  void set_screen(const Screen &current) { screen = current; }
+
+  uint64_t recorded() const { return written.load(); }
+
+  // Picks the dump file names; nothing is written until a crash.
+  void open(const std::string &directory) {
+    std::filesystem::create_directories(directory);
+    started = static_cast<int64_t>(std::time(nullptr));
+    std::time_t now = static_cast<std::time_t>(started);
+    char stamp[32];
+    std::strftime(stamp, sizeof(stamp), "%Y%m%d_%H%M%S", std::localtime(&now));
+    std::snprintf(frames_path, sizeof(frames_path), "%s/crash_%s.bin",
+                  directory.c_str(), stamp);
+    std::snprintf(screen_path, sizeof(screen_path), "%s/crash_%s.bmp",
+                  directory.c_str(), stamp);
+  }
+
+  // Writes the ring and the frame buffer. Safe in an exception filter: no
+  // allocation, no locks and no stdio. The slot after the newest frame is
+  // left out, since the game thread may have been writing it.
+  void dump(uint64_t code, uint64_t address) {
+    if (!frames_path[0])
+      return;
+    uint64_t end = written.load(std::memory_order_acquire);
+    uint64_t count = std::min<uint64_t>(end, CAPACITY - 1);
+    DumpHeader header = {MAGIC, VERSION, sizeof(Frame),
+                         static_cast<uint32_t>(count), code, address, started};
+    RawFile out(frames_path);
+    out.write(&header, sizeof(header));
+    uint64_t first = end - count;
+    uint64_t split = std::min<uint64_t>(count, CAPACITY - (first & MASK));
+    out.write(&frames[first & MASK], split * sizeof(Frame));
+    out.write(&frames[0], (count - split) * sizeof(Frame));
+    write_screen();
+  }
+
+  // The first crash is written, anything that goes wrong while writing it
+  // is not.
+  void crash(uint64_t code, uint64_t address) {
+    if (!crashed.exchange(true))
+      dump(code, address);
+  }
+
+private:
+  static void put16(uint8_t *at, uint32_t value) {
+    at[0] = static_cast<uint8_t>(value);
+    at[1] = static_cast<uint8_t>(value >> 8);
+  }
+
+  static void put32(uint8_t *at, uint32_t value) {
+    put16(at, value);
+    put16(at + 2, value >> 16);
+  }
+
+  // A top-down BMP: 32-bit, or 8-bit with the palette in indexed mode.
+  void write_screen() {
+    Screen s = screen;
+    bool indexed = s.indices != nullptr && s.palette != nullptr;
+    if (s.width <= 0 || s.height <= 0 || (!indexed && !s.pixels))
+      return;
+    uint32_t row = indexed ? (static_cast<uint32_t>(s.width) + 3) & ~3u
+                           : static_cast<uint32_t>(s.width) * 4;
+    uint32_t offset = 14 + 40 + (indexed ? 256 * 4 : 0);
+    uint32_t image = row * static_cast<uint32_t>(s.height);
+
+    uint8_t bmp[54] = {'B', 'M'};
+    put32(bmp + 2, offset + image);
+    put32(bmp + 10, offset);
+    put32(bmp + 14, 40);
+    put32(bmp + 18, static_cast<uint32_t>(s.width));
+    put32(bmp + 22, static_cast<uint32_t>(-s.height));
+    put16(bmp + 26, 1);
+    put16(bmp + 28, indexed ? 8 : 32);
+    put32(bmp + 34, image);
+    put32(bmp + 46, indexed ? 256 : 0);
+
+    RawFile out(screen_path);
+    out.write(bmp, sizeof(bmp));
+    if (indexed) {
+      static const uint8_t padding[4] = {};
+      out.write(s.palette, 256 * 4);
+      for (int32_t y = 0; y < s.height; ++y) {
+        out.write(s.indices + static_cast<size_t>(y) * s.index_pitch,
+                  static_cast<size_t>(s.width));
+        out.write(padding, row - static_cast<uint32_t>(s.width));
+      }
+    } else {
+      for (int32_t y = 0; y < s.height; ++y)
+        out.write(s.pixels + static_cast<size_t>(y) * s.pitch, row);
+    }
+  }
+
+  Frame frames[CAPACITY] = {};
+  std::atomic<uint64_t> written = 0;
+  std::atomic<uint16_t> sounds = 0;
+  Screen screen;
+  int64_t started = 0;
+  char frames_path[512] = {};
+  char screen_path[512] = {};
+  std::atomic<bool> crashed = false;
+};
+
+Recorder recorder;
+
+inline LONG WINAPI on_exception(EXCEPTION_POINTERS *info) {
+  const EXCEPTION_RECORD *record = info->ExceptionRecord;
+  recorder.crash(record->ExceptionCode,
+                 reinterpret_cast<uint64_t>(record->ExceptionAddress));
+  return EXCEPTION_CONTINUE_SEARCH;
+}
+
+// Hooks the crash handlers for the rest of the process. The handler gets
+// its own stack so a stack overflow is dumped too.
+inline void install(const std::string &directory) {
+  recorder.open(directory);
+  ULONG guarantee = 64 * 1024;
+  SetThreadStackGuarantee(&guarantee);
+  SetUnhandledExceptionFilter(on_exception);
+}
+
+// In the order of input::Key, Window's menu states and telemetry::Phase.
+const char *key_names[] = {"left", "up", "right", "down", "q",  "z",  "d",
+                           "s",    "enter", "f2", "f3", "f4",  "f5", "f6",
+                           "f7",   "f8",  "f9",    "f11",  "p",  "esc", "f12"};
+const char *menu_names[] = {"main", "settings", "playing", "back"};
+const char *phase_names[] = {"menu", "countdown", "gameplay", "celebration"};
+
+inline std::string flag_names(uint32_t bits, const char *const *names,
+                              size_t count) {
+  std::string text;
+  for (size_t i = 0; i < count; ++i)
+    if (bits & (1u << i)) {
+      if (!text.empty())
+        text += '+';
+      text += names[i];
+    }
+  return text.empty() ? "-" : text;
+}
+
+// --crash-report file.bin [--last N]
+inline int run(const std::vector<std::string> &args) {
+  if (args.empty()) {
+    std::printf("usage: --crash-report <crash.bin> [--last frames]\n");
+    return 1;
+  }
+  size_t last = 180;
+  for (size_t i = 1; i + 1 < args.size(); ++i)
+    if (args[i] == "--last")
+      last = static_cast<size_t>(std::stoul(args[i + 1]));
+
+  std::ifstream in(args[0], std::ios::binary);
+  DumpHeader header = {};
+  in.read(reinterpret_cast<char *>(&header), sizeof(header));
+  if (!in || header.magic != MAGIC || header.version != VERSION ||
+      header.frame_size != sizeof(Frame)) {
+    std::printf("%s is not a crash dump\n", args[0].c_str());
+    return 1;
+  }
+  std::vector<Frame> frames(header.count);
+  in.read(reinterpret_cast<char *>(frames.data()),
+          static_cast<std::streamsize>(frames.size() * sizeof(Frame)));
+  frames.resize(static_cast<size_t>(in.gcount()) / sizeof(Frame));
+
+  std::time_t started = static_cast<std::time_t>(header.started);
+  char date[32];
+  std::strftime(date, sizeof(date), "%Y-%m-%d %H:%M:%S",
+                std::localtime(&started));
+  std::printf("session started %s, crashed with code 0x%llx at 0x%llx\n",
+              date, static_cast<unsigned long long>(header.code),
+              static_cast<unsigned long long>(header.address));
+  if (frames.empty()) {
+    std::printf("no frames were recorded\n");
+    return 0;
+  }
+  double seconds = 0.0;
+  for (const Frame &f : frames)
+    seconds += f.dt_ms / 1000.0;
+  std::printf("%zu frames, %.2f s\n\n", frames.size(), seconds);
+
+  std::vector<const char *> sounds;
+  for (const char *path : assets::packed_files) {
+    const char *slash = std::strrchr(path, '/');
+    sounds.push_back(slash ? slash + 1 : path);
+  }
+  std::printf("%8s %7s %-9s %-12s %5s %15s %15s %13s %13s  %s\n", "frame",
+              "dt ms", "menu", "phase", "score", "ball", "velocity",
+              "paddle 1", "paddle 2", "keys / sounds");
+  size_t first = frames.size() > last ? frames.size() - last : 0;
+  for (size_t i = first; i < frames.size(); ++i) {
+    const Frame &f = frames[i];
+    std::printf("%8u %7.2f %-9s %-12s %2u-%-2u %7.2f,%7.2f %7.1f,%7.1f "
+                "%6.2f,%6.1f %6.2f,%6.1f  %s / %s\n",
+                f.index, f.dt_ms,
+                f.menu < std::size(menu_names) ? menu_names[f.menu] : "?",
+                f.phase < std::size(phase_names) ? phase_names[f.phase] : "?",
+                f.score1, f.score2, f.ball_x, f.ball_y, f.ball_vx, f.ball_vy,
+                f.paddle1_y, f.paddle1_dp, f.paddle2_y, f.paddle2_dp,
+                flag_names(f.buttons, key_names, std::size(key_names)).c_str(),
+                flag_names(f.sounds, sounds.data(), SOUND_BITS).c_str());
+  }
+  return 0;
+}
+} // namespace flight
+} // namespace game
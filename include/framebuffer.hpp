@@ -0,0 +1,203 @@
+#pragma once
+
+#ifndef NOMINMAX
+#define NOMINMAX
+#endif
+#include <Windows.h>
+
+#include <algorithm>
+#include <cstddef>
+#include <cstdint>
+
+#pragma comment(lib, "advapi32.lib")
+
+namespace game {
+namespace render {
+// Backing store for the 32-bit and 8-bit frame buffers. Address space for
+// the largest desktop is reserved once and resizes only commit or decommit
+// pages inside it, so dragging the window edge does not free and re-fault
+// the whole frame on every WM_SIZE. Shrinking is trimmed lazily, once the
+// size has settled.
+class FramebufferAllocator {
+public:
+  static constexpr size_t ROW_ALIGNMENT = 64;
+  static constexpr DWORD TRIM_DELAY_MS = 500;
+
+  FramebufferAllocator() = default;
+  ~FramebufferAllocator() { release(); }
+
+  FramebufferAllocator(const FramebufferAllocator &) = delete;
+  FramebufferAllocator &operator=(const FramebufferAllocator &) = delete;
+
+  static size_t pitch_for(int32_t width, size_t element_size) {
+    size_t bytes = static_cast<size_t>(width) * element_size;
+    return (bytes + ROW_ALIGNMENT - 1) & ~(ROW_ALIGNMENT - 1);
+  }
+
+  // Reserves room for a max_width x max_height frame. Large pages need the
+  // "Lock pages in memory" privilege and are committed up front; without
+  // it the regular path is used.
+  bool reserve(int32_t max_width, int32_t max_height, bool large_pages) {
+    release();
+
+    size_t page = page_size();
+    color.reserved =
+        round_up(pitch_for(max_width, sizeof(uint32_t)) * max_height, page);
+    index.reserved = round_up(pitch_for(max_width, 1) * max_height, page);
+    index.offset = color.reserved;
+    reserved_width = max_width;
+    reserved_height = max_height;
+    size_t total = color.reserved + index.reserved;
+
+    if (large_pages) {
+      size_t large_page = GetLargePageMinimum();
+      if (large_page && enable_lock_memory_privilege()) {
+        color.reserved = round_up(color.reserved, large_page);
+        index.reserved = round_up(index.reserved, large_page);
+        index.offset = color.reserved;
+        total = color.reserved + index.reserved;
+        base = static_cast<uint8_t *>(
+            VirtualAlloc(nullptr, total,
+                         MEM_RESERVE | MEM_COMMIT | MEM_LARGE_PAGES,
+                         PAGE_READWRITE));
+        if (base) {
+          uses_large_pages = true;
+          color.committed = color.reserved;
+          index.committed = index.reserved;
+          return true;
+        }
+      }
+      // Fall back to regular pages with the regular layout.
+      return reserve(max_width, max_height, false);
+    }
+
+    base = static_cast<uint8_t *>(
+        VirtualAlloc(nullptr, total, MEM_RESERVE, PAGE_NOACCESS));
+    return base != nullptr;
+  }
+
+  // Commits the pages a width x height frame needs. A frame larger than the
+  // reservation (a monitor was attached) grows the reservation, which moves
+  // the buffers, so callers re-read pixels() and indices() afterwards.
+  bool resize(int32_t new_width, int32_t new_height) {
+    if (new_width > reserved_width || new_height > reserved_height) {
+      if (!reserve(std::max(new_width, reserved_width),
+                   std::max(new_height, reserved_height), uses_large_pages))
+        return false;
+    }
+    if (!base)
+      return false;
+
+    width = new_width;
+    height = new_height;
+    color.needed = pitch_for(width, sizeof(uint32_t)) * height;
+    index.needed = pitch_for(width, 1) * height;
+    resized_at = GetTickCount();
+
+    return commit(color) && commit(index);
+  }
+
+  // Decommits pages past the current size once no resize has happened for
+  // TRIM_DELAY_MS. Call it once per frame.
+  void trim() {
+    if (!base || uses_large_pages ||
+        GetTickCount() - resized_at < TRIM_DELAY_MS)
+      return;
+    decommit(color);
+    decommit(index);
+  }
+
+  void release() {
+    if (base)
+      VirtualFree(base, 0, MEM_RELEASE);
+    base = nullptr;
+    uses_large_pages = false;
+    color = {};
+    index = {};
+    reserved_width = reserved_height = 0;
+  }
+
+  uint32_t *pixels() const {
+    return base ? reinterpret_cast<uint32_t *>(base + color.offset) : nullptr;
+  }
+  uint8_t *indices() const { return base ? base + index.offset : nullptr; }
+
+  int32_t pixel_pitch() const {
+    return static_cast<int32_t>(pitch_for(width, sizeof(uint32_t)) /
+                                sizeof(uint32_t));
+  }
+  int32_t index_pitch() const {
+    return static_cast<int32_t>(pitch_for(width, 1));
+  }
+
+  bool large_pages() const { return uses_large_pages; }
+  size_t committed_bytes() const { return color.committed + index.committed; }
+
+private:
+  struct Region {
+    size_t offset = 0;
+    size_t reserved = 0;
+    size_t committed = 0;
+    size_t needed = 0;
+  };
+
+  static size_t round_up(size_t value, size_t alignment) {
+    return (value + alignment - 1) / alignment * alignment;
+  }
+
+  static size_t page_size() {
+    SYSTEM_INFO info;
+    GetSystemInfo(&info);
+    return info.dwPageSize;
+  }
+
+  static bool enable_lock_memory_privilege() {
+    HANDLE token;
+    if (!OpenProcessToken(GetCurrentProcess(),
+                          TOKEN_ADJUST_PRIVILEGES | TOKEN_QUERY, &token))
+      return false;
+
+    TOKEN_PRIVILEGES privileges = {};
+    privileges.PrivilegeCount = 1;
+    privileges.Privileges[0].Attributes = SE_PRIVILEGE_ENABLED;
+    bool enabled = LookupPrivilegeValueA(nullptr, "SeLockMemoryPrivilege",
+                                         &privileges.Privileges[0].Luid) &&
+                   AdjustTokenPrivileges(token, FALSE, &privileges, 0,
+                                         nullptr, nullptr) &&
+                   GetLastError() == ERROR_SUCCESS;
+    CloseHandle(token);
+    return enabled;
+  }
+
+  bool commit(Region &region) {
+    size_t target = round_up(region.needed, page_size());
+    if (target <= region.committed)
+      return true;
+    if (!VirtualAlloc(base + region.offset + region.committed,
+                      target - region.committed, MEM_COMMIT, PAGE_READWRITE))
+      return false;
+    region.committed = target;
+    return true;
+  }
+
+  void decommit(Region &region) {
+    size_t target = round_up(region.needed, page_size());
+    if (target >= region.committed)
+      return;
+    VirtualFree(base + region.offset + target, region.committed - target,
+                MEM_DECOMMIT);
+    region.committed = target;
+  }
+
+  uint8_t *base = nullptr;
+  bool uses_large_pages = false;
+  Region color;
+  Region index;
+  int32_t reserved_width = 0;
+  int32_t reserved_height = 0;
+  int32_t width = 0;
+  int32_t height = 0;
+  DWORD resized_at = 0;
+};
+} // namespace render
+} // namespace game
@@ -1,19 +1,34 @@
+#pragma once
+
 #define NOMINMAX
 #include <Windows.h>
+#include <dwmapi.h>
 #include <mmsystem.h>
 
+#include <immintrin.h>
+
 #include <algorithm>
 #include <array>
+#include <atomic>
+#include <bit>
+#include <cctype>
+#include <chrono>
 #include <cmath>
+#include <condition_variable>
 #include <cstdint>
 #include <cstdio>
 #include <cstdlib>
+#include <cstring>
 #include <ctime>
 #include <filesystem>
 #include <format>
 #include <fstream>
+#include <future>
 #include <iomanip>
 #include <limits>
+#include <memory>
+#include <mutex>
+#include <sstream>
 #include <string>
 #include <thread>
 #include <unordered_map>
@@ -21,8 +36,20 @@
 
 #include "../rsc/resource.h"
 #include "../third_party/json.hpp"
+#include "assets.hpp"
+#include "event_log.hpp"
+#include "flight_recorder.hpp"
+#include "framebuffer.hpp"
+#include "gif.hpp"
+#include "hit_events.hpp"
+#include "image.hpp"
+#include "match_store.hpp"
+#include "metrics.hpp"
+#include "perf_counters.hpp"
+#include "thread_pool.hpp"
 
 #pragma comment(lib, "winmm.lib")
+#pragma comment(lib, "dwmapi.lib")
 
 using u8 = uint8_t;
 using u16 = uint16_t;
@@ -52,26 +79,431 @@ static inline T clamp(T min, T value, T max) {
     return max;
   return value;
 }
+
+#if defined(__GNUC__)
+#define GAME_TARGET_AVX2 __attribute__((target("avx2")))
+#else
+#define GAME_TARGET_AVX2
+#endif
+
+inline bool cpu_has_avx2() {
+#if defined(__GNUC__)
+  static const bool supported = __builtin_cpu_supports("avx2");
+  return supported;
+#else
+  return false;
+#endif
+}
+
+inline std::vector<std::string> split_command_line(const char *line) {
+  std::vector<std::string> args;
+  std::string current;
+  bool quoted = false;
+  for (const char *c = line ? line : ""; *c; ++c) {
+    if (*c == '"') {
+      quoted = !quoted;
+    } else if (*c == ' ' && !quoted) {
+      if (!current.empty())
+        args.push_back(std::move(current));
+      current.clear();
+    } else {
+      current += *c;
+    }
+  }
+  if (!current.empty())
+    args.push_back(std::move(current));
+  return args;
+}
+
+inline i64 query_counter() {
+  LARGE_INTEGER counter;
+  QueryPerformanceCounter(&counter);
+  return counter.QuadPart;
+}
+
+inline i64 counter_frequency() {
+  static const i64 frequency = [] {
+    LARGE_INTEGER f;
+    QueryPerformanceFrequency(&f);
+    return f.QuadPart;
+  }();
+  return frequency;
+}
+
+// A -mwindows executable has no console; command line modes borrow the
+// parent's unless the output was redirected.
+inline void attach_console() {
+  if (GetFileType(GetStdHandle(STD_OUTPUT_HANDLE)) != FILE_TYPE_UNKNOWN)
+    return;
+  if (AttachConsole(ATTACH_PARENT_PROCESS))
+    std::freopen("CONOUT$", "w", stdout);
+}
+
+// PCG32. Gameplay draws from a generator owned by the match, so a replay
+// seeded the same way makes the same choices.
+struct Random {
+  u64 state = 0x853c49e6748fea9bULL;
+
+  void seed(u64 value) {
+    state = 0;
+    next();
+    state += value;
+    next();
+  }
+
+  u32 next() {
+    u64 old = state;
+    state = old * 6364136223846793005ULL + 1442695040888963407ULL;
+    u32 xorshifted = static_cast<u32>(((old >> 18) ^ old) >> 27);
+    u32 rot = static_cast<u32>(old >> 59);
+    return (xorshifted >> rot) | (xorshifted << ((32 - rot) & 31));
+  }
+
+  // Uniform in [0, 1).
+  float unit() {
+    return static_cast<float>(next() >> 8) * (1.0f / 16777216.0f);
+  }
+};
 } // namespace utils
 
 namespace render {
+enum PixelFormat { PIXEL_FORMAT_RGB32 = 0, PIXEL_FORMAT_INDEXED8 = 1 };
+
+enum Theme {
+  THEME_CLASSIC = 0,
+  THEME_RETRO_NEON = 1,
+  THEME_DARK = 2,
+  THEME_LIGHT = 3,
+
+  THEME_COUNT
+};
+
+const char *theme_names[THEME_COUNT] = {"CLASSIC", "NEON", "DARK", "LIGHT"};
+
+inline u32 apply_theme(u32 color, Theme theme) {
+  i32 r = (color >> 16) & 0xFF;
+  i32 g = (color >> 8) & 0xFF;
+  i32 b = color & 0xFF;
+
+  switch (theme) {
+  case THEME_RETRO_NEON: {
+    // Double the saturation and sink the darks towards deep violet.
+    i32 l = (r * 77 + g * 150 + b * 29) >> 8;
+    r = utils::clamp(0, l + (r - l) * 2, 255);
+    g = utils::clamp(0, l + (g - l) * 2, 255);
+    b = utils::clamp(0, l + (b - l) * 2 + ((255 - l) >> 3), 255);
+    break;
+  }
+  case THEME_DARK: {
+    r = r * 5 / 8;
+    g = g * 5 / 8;
+    b = b * 5 / 8;
+    break;
+  }
+  case THEME_LIGHT: {
+    // Invert HSL lightness while keeping the hue and saturation.
+    i32 shift = 255 - std::max({r, g, b}) - std::min({r, g, b});
+    r += shift;
+    g += shift;
+    b += shift;
+    break;
+  }
+  default:
+    break;
+  }
+  return (static_cast<u32>(r) << 16) | (static_cast<u32>(g) << 8) |
+         static_cast<u32>(b);
+}
+
+// Colours interned by the indexed framebuffer. The palette is rebuilt every
+// frame; once all 256 entries are taken, new colours map to the nearest one.
+struct Palette {
+  static constexpr size_t SLOTS = 1024;
+  static constexpr u32 EMPTY = 0xFFFFFFFF;
+
+  std::array<u32, 256> colors = {};
+  u32 count = 0;
+
+  std::array<u32, SLOTS> keys = {};
+  std::array<u8, SLOTS> values = {};
+  u32 cached = 0;
+
+  Palette() { reset(); }
+
+  void reset() {
+    keys.fill(EMPTY);
+    count = 0;
+    cached = 0;
+  }
+
+  u8 index_of(u32 color) {
+    color &= 0x00FFFFFF;
+    size_t slot = (color * 0x9E3779B1u) >> 22;
+    while (keys[slot] != EMPTY) {
+      if (keys[slot] == color)
+        return values[slot];
+      slot = (slot + 1) & (SLOTS - 1);
+    }
+
+    u8 index = count < colors.size() ? static_cast<u8>(count) : nearest(color);
+    if (count < colors.size())
+      colors[count++] = color;
+
+    if (cached < SLOTS * 3 / 4) {
+      keys[slot] = color;
+      values[slot] = index;
+      cached++;
+    }
+    return index;
+  }
+
+  u8 nearest(u32 color) const {
+    i32 r = (color >> 16) & 0xFF;
+    i32 g = (color >> 8) & 0xFF;
+    i32 b = color & 0xFF;
+    u8 best = 0;
+    i32 best_distance = std::numeric_limits<i32>::max();
+    for (u32 i = 0; i < count; ++i) {
+      i32 dr = r - static_cast<i32>((colors[i] >> 16) & 0xFF);
+      i32 dg = g - static_cast<i32>((colors[i] >> 8) & 0xFF);
+      i32 db = b - static_cast<i32>(colors[i] & 0xFF);
+      i32 distance = dr * dr + dg * dg + db * db;
+      if (distance < best_distance) {
+        best_distance = distance;
+        best = static_cast<u8>(i);
+      }
+    }
+    return best;
+  }
+};
+
+GAME_TARGET_AVX2 inline void expand_indices_avx2(const u8 *src, u32 *dst,
+                                                 size_t count,
+                                                 const u32 *palette) {
+  size_t i = 0;
+  for (; i + 8 <= count; i += 8) {
+    __m128i packed =
+        _mm_loadl_epi64(reinterpret_cast<const __m128i *>(src + i));
+    __m256i indices = _mm256_cvtepu8_epi32(packed);
+    __m256i pixels = _mm256_i32gather_epi32(
+        reinterpret_cast<const int *>(palette), indices, 4);
+    _mm256_storeu_si256(reinterpret_cast<__m256i *>(dst + i), pixels);
+  }
+  for (; i < count; ++i)
+    dst[i] = palette[src[i]];
+}
+
+inline void expand_indices(const u8 *src, u32 *dst, size_t count,
+                           const u32 *palette) {
+  if (utils::cpu_has_avx2()) {
+    expand_indices_avx2(src, dst, count, palette);
+    return;
+  }
+  for (size_t i = 0; i < count; ++i)
+    dst[i] = palette[src[i]];
+}
+
+enum BlendMode { BLEND_ALPHA = 0, BLEND_ADDITIVE = 1, BLEND_MULTIPLY = 2 };
+
+// Per-channel constants of a blend against a fixed source colour, in BGRA
+// byte order. Alpha and multiply reduce to div255(dst * weight + bias);
+// additive is a saturating add of the pre-scaled source.
+struct BlendConstants {
+  BlendMode mode = BLEND_ALPHA;
+  u16 weight[4] = {};
+  u16 bias[4] = {};
+  u8 add[4] = {};
+};
+
+inline BlendConstants make_blend(u32 color, u8 alpha, BlendMode mode) {
+  BlendConstants k;
+  k.mode = mode;
+  for (i32 c = 0; c < 4; ++c) {
+    u32 src = c < 3 ? (color >> (8 * c)) & 0xFF : 0;
+    u32 a = c < 3 ? alpha : 0;
+    switch (mode) {
+    case BLEND_ALPHA:
+      k.weight[c] = static_cast<u16>(255 - a);
+      k.bias[c] = static_cast<u16>(src * a + 128);
+      break;
+    case BLEND_ADDITIVE:
+      k.add[c] = static_cast<u8>((src * a + 127) / 255);
+      break;
+    case BLEND_MULTIPLY: {
+      u32 m = c < 3 ? 255 - ((255 - src) * a + 127) / 255 : 255;
+      k.weight[c] = static_cast<u16>(m);
+      k.bias[c] = 128;
+      break;
+    }
+    }
+  }
+  return k;
+}
+
+inline void blend_row_scalar(u32 *dst, size_t count, const BlendConstants &k) {
+  u8 *bytes = reinterpret_cast<u8 *>(dst);
+  for (size_t i = 0; i < count * 4; i += 4) {
+    for (i32 c = 0; c < 4; ++c) {
+      u32 d = bytes[i + c];
+      if (k.mode == BLEND_ADDITIVE) {
+        bytes[i + c] = static_cast<u8>(std::min<u32>(255, d + k.add[c]));
+      } else {
+        u32 t = d * k.weight[c] + k.bias[c];
+        bytes[i + c] = static_cast<u8>((t + (t >> 8)) >> 8);
+      }
+    }
+  }
+}
+
+inline void blend_row_sse2(u32 *dst, size_t count, const BlendConstants &k) {
+  size_t i = 0;
+  if (k.mode == BLEND_ADDITIVE) {
+    __m128i add = _mm_set1_epi32(static_cast<i32>(
+        k.add[0] | (k.add[1] << 8) | (k.add[2] << 16) | (k.add[3] << 24)));
+    for (; i + 4 <= count; i += 4) {
+      __m128i *p = reinterpret_cast<__m128i *>(dst + i);
+      _mm_storeu_si128(p, _mm_adds_epu8(_mm_loadu_si128(p), add));
+    }
+  } else {
+    __m128i zero = _mm_setzero_si128();
+    __m128i weight =
+        _mm_setr_epi16(k.weight[0], k.weight[1], k.weight[2], k.weight[3],
+                       k.weight[0], k.weight[1], k.weight[2], k.weight[3]);
+    __m128i bias = _mm_setr_epi16(k.bias[0], k.bias[1], k.bias[2], k.bias[3],
+                                  k.bias[0], k.bias[1], k.bias[2], k.bias[3]);
+    auto blend_half = [&](__m128i d) {
+      __m128i t = _mm_add_epi16(_mm_mullo_epi16(d, weight), bias);
+      return _mm_srli_epi16(_mm_add_epi16(t, _mm_srli_epi16(t, 8)), 8);
+    };
+    for (; i + 4 <= count; i += 4) {
+      __m128i *p = reinterpret_cast<__m128i *>(dst + i);
+      __m128i d = _mm_loadu_si128(p);
+      __m128i lo = blend_half(_mm_unpacklo_epi8(d, zero));
+      __m128i hi = blend_half(_mm_unpackhi_epi8(d, zero));
+      _mm_storeu_si128(p, _mm_packus_epi16(lo, hi));
+    }
+  }
+  blend_row_scalar(dst + i, count - i, k);
+}
+
+GAME_TARGET_AVX2 inline void blend_row_avx2(u32 *dst, size_t count,
+                                            const BlendConstants &k) {
+  size_t i = 0;
+  if (k.mode == BLEND_ADDITIVE) {
+    __m256i add = _mm256_set1_epi32(static_cast<i32>(
+        k.add[0] | (k.add[1] << 8) | (k.add[2] << 16) | (k.add[3] << 24)));
+    for (; i + 8 <= count; i += 8) {
+      __m256i *p = reinterpret_cast<__m256i *>(dst + i);
+      _mm256_storeu_si256(p, _mm256_adds_epu8(_mm256_loadu_si256(p), add));
+    }
+  } else {
+    __m256i zero = _mm256_setzero_si256();
+    __m256i weight = _mm256_setr_epi16(
+        k.weight[0], k.weight[1], k.weight[2], k.weight[3], k.weight[0],
+        k.weight[1], k.weight[2], k.weight[3], k.weight[0], k.weight[1],
+        k.weight[2], k.weight[3], k.weight[0], k.weight[1], k.weight[2],
+        k.weight[3]);
+    __m256i bias = _mm256_setr_epi16(
+        k.bias[0], k.bias[1], k.bias[2], k.bias[3], k.bias[0], k.bias[1],
+        k.bias[2], k.bias[3], k.bias[0], k.bias[1], k.bias[2], k.bias[3],
+        k.bias[0], k.bias[1], k.bias[2], k.bias[3]);
+    for (; i + 8 <= count; i += 8) {
+      __m256i *p = reinterpret_cast<__m256i *>(dst + i);
+      __m256i d = _mm256_loadu_si256(p);
+      __m256i lo = _mm256_add_epi16(
+          _mm256_mullo_epi16(_mm256_unpacklo_epi8(d, zero), weight), bias);
+      __m256i hi = _mm256_add_epi16(
+          _mm256_mullo_epi16(_mm256_unpackhi_epi8(d, zero), weight), bias);
+      lo = _mm256_srli_epi16(_mm256_add_epi16(lo, _mm256_srli_epi16(lo, 8)),
+                             8);
+      hi = _mm256_srli_epi16(_mm256_add_epi16(hi, _mm256_srli_epi16(hi, 8)),
+                             8);
+      _mm256_storeu_si256(p, _mm256_packus_epi16(lo, hi));
+    }
+  }
+  blend_row_sse2(dst + i, count - i, k);
+}
+
+inline void blend_row(u32 *dst, size_t count, const BlendConstants &k) {
+  if (utils::cpu_has_avx2())
+    blend_row_avx2(dst, count, k);
+  else
+    blend_row_sse2(dst, count, k);
+}
+
+// 4x4 ordered dither thresholds, used to stipple blends in indexed mode.
+constexpr u8 BAYER_4x4[4][4] = {{0, 128, 32, 160},
+                                {192, 64, 224, 96},
+                                {48, 176, 16, 144},
+                                {240, 112, 208, 80}};
+
+struct IndexedBitmapInfo {
+  BITMAPINFOHEADER header = {};
+  RGBQUAD colors[256] = {};
+};
+
+// Rows start on 64-byte boundaries, so the pitch of both buffers may be
+// wider than the frame. Full-row fills may write the padding.
 struct RenderState {
   void *memory = nullptr;
   i32 width = 0;
   i32 height = 0;
+  i32 pitch = 0; // in pixels
   BITMAPINFO bitmap_info = {};
+
+  u8 *indices = nullptr;
+  i32 index_pitch = 0;
+  IndexedBitmapInfo indexed_bitmap_info = {};
 };
 
 struct Renderer {
   RenderState render_state;
+  PixelFormat pixel_format = PIXEL_FORMAT_RGB32;
+  Theme theme = THEME_CLASSIC;
+  Palette palette;
+  bool frame_resolved = false;
+
+  struct RectCommand {
+    i32 x0, y0, x1, y1;
+    u32 value;
+  };
+  struct Span {
+    i32 x0, x1;
+  };
+
+  // Opaque rects are recorded and resolved by flush() instead of being
+  // painted back to front.
+  bool front_to_back = false;
+  std::vector<RectCommand> commands;
+  std::vector<std::vector<Span>> coverage;
+
+  bool count_overdraw = false;
+  std::vector<u8> write_counts;
+  float overdraw_average = 0.0f;
+
+  // Once a frame has been expanded to RGB, the rest of it is drawn in RGB.
+  bool indexed() const {
+    return pixel_format == PIXEL_FORMAT_INDEXED8 && render_state.indices &&
+           !frame_resolved;
+  }
+
+  // In indexed mode the theme is applied to the 256 palette entries at
+  // present time; otherwise it is applied to each fill colour.
+  u32 fill_color(u32 color) const {
+    return theme == THEME_CLASSIC ? color : apply_theme(color, theme);
+  }
+
+  void begin_frame() {
+    frame_resolved = false;
+    if (indexed())
+      palette.reset();
+    if (count_overdraw)
+      write_counts.assign(
+          static_cast<size_t>(render_state.width) * render_state.height, 0);
+  }
 
   void clear_screen(u32 color) {
-    if (!render_state.memory)
-      return;
-    u32 *pixels = static_cast<u32 *>(render_state.memory);
-    std::fill_n(pixels,
-                static_cast<size_t>(render_state.width * render_state.height),
-                color);
+    render_rect_pixels(0, 0, render_state.width, render_state.height, color);
   }
 
   void render_rect_pixels(i32 x0, i32 y0, i32 x1, i32 y1, u32 color) {
@@ -80,15 +512,232 @@ struct Renderer {
     y0 = utils::clamp(0, y0, render_state.height);
     y1 = utils::clamp(0, y1, render_state.height);
 
-    if (!render_state.memory)
+    if (x0 >= x1 || y0 >= y1)
+      return;
+    if (!indexed() && !render_state.memory)
+      return;
+
+    u32 value = indexed() ? palette.index_of(color) : fill_color(color);
+    if (front_to_back) {
+      commands.push_back({x0, y0, x1, y1, value});
+      return;
+    }
+    fill_pixels(x0, y0, x1, y1, value);
+  }
+
+  // Writes an already resolved colour (or palette index) to clamped pixels.
+  void fill_pixels(i32 x0, i32 y0, i32 x1, i32 y1, u32 value) {
+    perf::Scope zone(perf::ZONE_CLEAR_FILL);
+    count_writes(x0, y0, x1, y1);
+
+    bool full_rows = (x0 == 0 && x1 == render_state.width);
+    if (indexed()) {
+      if (full_rows) {
+        std::memset(render_state.indices + y0 * render_state.index_pitch,
+                    static_cast<u8>(value),
+                    static_cast<size_t>(render_state.index_pitch) * (y1 - y0));
+        return;
+      }
+      for (i32 y = y0; y < y1; y++)
+        std::memset(render_state.indices + x0 + y * render_state.index_pitch,
+                    static_cast<u8>(value), static_cast<size_t>(x1 - x0));
       return;
+    }
 
+    u32 *pixels = static_cast<u32 *>(render_state.memory);
+    if (full_rows) {
+      std::fill_n(pixels + y0 * render_state.pitch,
+                  static_cast<size_t>(render_state.pitch) * (y1 - y0), value);
+      return;
+    }
     for (i32 y = y0; y < y1; y++) {
-      u32 *pixel =
-          static_cast<u32 *>(render_state.memory) + x0 + y * render_state.width;
+      u32 *pixel = pixels + x0 + y * render_state.pitch;
       for (i32 x = x0; x < x1; x++)
-        *pixel++ = color;
+        *pixel++ = value;
+    }
+  }
+
+  // Resolves the recorded opaque rects front to back. Each row keeps a
+  // sorted list of covered spans, so every pixel is written at most once.
+  void flush() {
+    if (commands.empty())
+      return;
+    coverage.resize(render_state.height);
+    for (std::vector<Span> &row : coverage)
+      row.clear();
+
+    for (auto it = commands.rbegin(); it != commands.rend(); ++it)
+      for (i32 y = it->y0; y < it->y1; ++y)
+        cover_span(y, it->x0, it->x1, it->value);
+    commands.clear();
+  }
+
+  void cover_span(i32 y, i32 x0, i32 x1, u32 value) {
+    std::vector<Span> &spans = coverage[y];
+    auto first = std::lower_bound(
+        spans.begin(), spans.end(), x0,
+        [](const Span &span, i32 x) { return span.x1 < x; });
+
+    i32 cursor = x0;
+    Span merged = {x0, x1};
+    auto last = first;
+    for (; last != spans.end() && last->x0 <= x1; ++last) {
+      if (last->x0 > cursor)
+        fill_pixels(cursor, y, last->x0, y + 1, value);
+      cursor = std::max(cursor, last->x1);
+      merged.x0 = std::min(merged.x0, last->x0);
+      merged.x1 = std::max(merged.x1, last->x1);
+    }
+    if (cursor < x1)
+      fill_pixels(cursor, y, x1, y + 1, value);
+
+    if (first == last) {
+      spans.insert(first, merged);
+    } else {
+      *first = merged;
+      spans.erase(first + 1, last);
+    }
+  }
+
+  void count_writes(i32 x0, i32 y0, i32 x1, i32 y1) {
+    if (!count_overdraw || write_counts.empty())
+      return;
+    for (i32 y = y0; y < y1; y++) {
+      u8 *count = write_counts.data() + y * render_state.width + x0;
+      for (i32 x = x0; x < x1; x++, count++)
+        if (*count < 255)
+          (*count)++;
+    }
+  }
+
+  // Replaces the frame with how many times each pixel was written.
+  void render_overdraw_heatmap() {
+    if (!count_overdraw || write_counts.empty() || !render_state.memory)
+      return;
+    flush();
+    resolve_indexed();
+
+    static const u32 heat[] = {0x00000000, 0x00102080, 0x0020A040,
+                               0x00E0D020, 0x00F08020, 0x00E02020};
+    u64 total = 0;
+    const u8 *count = write_counts.data();
+    for (i32 y = 0; y < render_state.height; ++y) {
+      u32 *pixel = static_cast<u32 *>(render_state.memory) +
+                   static_cast<size_t>(y) * render_state.pitch;
+      for (i32 x = 0; x < render_state.width; ++x, ++count) {
+        total += *count;
+        pixel[x] = heat[std::min<u8>(*count, 5)];
+      }
+    }
+    overdraw_average =
+        static_cast<float>(total) / static_cast<float>(write_counts.size());
+  }
+
+  // Palette indices cannot be mixed, so in indexed mode every blend mode
+  // becomes an ordered-dither stipple of the source colour.
+  void blend_rect_pixels(i32 x0, i32 y0, i32 x1, i32 y1, u32 color, u8 alpha,
+                         BlendMode mode) {
+    x0 = utils::clamp(0, x0, render_state.width);
+    x1 = utils::clamp(0, x1, render_state.width);
+    y0 = utils::clamp(0, y0, render_state.height);
+    y1 = utils::clamp(0, y1, render_state.height);
+
+    if (x0 >= x1 || y0 >= y1 || alpha == 0)
+      return;
+
+    flush();
+    count_writes(x0, y0, x1, y1);
+
+    if (indexed()) {
+      u8 index = palette.index_of(color);
+      for (i32 y = y0; y < y1; y++) {
+        u8 *row = render_state.indices + y * render_state.index_pitch;
+        for (i32 x = x0; x < x1; x++)
+          if (BAYER_4x4[y & 3][x & 3] < alpha)
+            row[x] = index;
+      }
+      return;
+    }
+
+    if (!render_state.memory)
+      return;
+
+    BlendConstants k = make_blend(fill_color(color), alpha, mode);
+    u32 *pixels = static_cast<u32 *>(render_state.memory);
+    if (x0 == 0 && x1 == render_state.width) {
+      blend_row(pixels + y0 * render_state.pitch,
+                static_cast<size_t>(render_state.pitch) * (y1 - y0), k);
+      return;
+    }
+    for (i32 y = y0; y < y1; y++)
+      blend_row(pixels + x0 + y * render_state.pitch,
+                static_cast<size_t>(x1 - x0), k);
+  }
+
+  void blend_rect(float x, float y, float half_x, float half_y, u32 color,
+                  float alpha, BlendMode mode) {
+    if (render_state.height == 0 || render_state.width == 0)
+      return;
+    float scale = render_state.height * 0.01f;
+    x = x * scale + render_state.width * 0.5f;
+    y = y * scale + render_state.height * 0.5f;
+    half_x *= scale;
+    half_y *= scale;
+
+    blend_rect_pixels(static_cast<i32>(std::lroundf(x - half_x)),
+                      static_cast<i32>(std::lroundf(y - half_y)),
+                      static_cast<i32>(std::lroundf(x + half_x)),
+                      static_cast<i32>(std::lroundf(y + half_y)), color,
+                      static_cast<u8>(utils::clamp(0.0f, alpha, 1.0f) * 255.0f),
+                      mode);
+  }
+
+  // One fused pass over the whole framebuffer.
+  void blend_screen(u32 color, float alpha, BlendMode mode) {
+    blend_rect_pixels(0, 0, render_state.width, render_state.height, color,
+                      static_cast<u8>(utils::clamp(0.0f, alpha, 1.0f) * 255.0f),
+                      mode);
+  }
+
+  // Loads the themed palette into the 8bpp DIB colour table so the blit
+  // expands indices to RGB. The DIB is as wide as the pitch; only the
+  // visible columns are blitted.
+  BITMAPINFO *indexed_bitmap_info() {
+    IndexedBitmapInfo &info = render_state.indexed_bitmap_info;
+    info.header.biSize = sizeof(info.header);
+    info.header.biWidth = render_state.index_pitch;
+    info.header.biHeight = -render_state.height;
+    info.header.biPlanes = 1;
+    info.header.biBitCount = 8;
+    info.header.biCompression = BI_RGB;
+    info.header.biSizeImage =
+        static_cast<DWORD>(render_state.index_pitch * render_state.height);
+    info.header.biClrUsed = 256;
+    for (u32 i = 0; i < palette.count; ++i) {
+      u32 c = apply_theme(palette.colors[i], theme);
+      info.colors[i] = {static_cast<BYTE>(c & 0xFF),
+                        static_cast<BYTE>((c >> 8) & 0xFF),
+                        static_cast<BYTE>((c >> 16) & 0xFF), 0};
     }
+    return reinterpret_cast<BITMAPINFO *>(&info);
+  }
+
+  // Expands the indexed frame into the 32-bit buffer, for consumers that
+  // need RGB pixels.
+  void resolve_indexed() {
+    if (!indexed() || !render_state.memory)
+      return;
+    flush();
+    std::array<u32, 256> themed = {};
+    for (u32 i = 0; i < palette.count; ++i)
+      themed[i] = apply_theme(palette.colors[i], theme);
+
+    u32 *pixels = static_cast<u32 *>(render_state.memory);
+    for (i32 y = 0; y < render_state.height; ++y)
+      expand_indices(render_state.indices + y * render_state.index_pitch,
+                     pixels + y * render_state.pitch,
+                     static_cast<size_t>(render_state.width), themed.data());
+    frame_resolved = true;
   }
 
   void render_rect(float x, float y, float half_x, float half_y, u32 color) {
@@ -131,6 +780,10 @@ struct Renderer {
       idx = 39;
     } else if (c == '!') {
       idx = 40;
+    } else if (c == '.') {
+      idx = 41;
+    } else if (c == '+') {
+      idx = 42;
     } else {
       idx = 36;
     }
@@ -160,6 +813,7 @@ struct Renderer {
                    float spacing, u32 color) {
     if (s.empty())
       return;
+    perf::Scope zone(perf::ZONE_GLYPHS);
     float glyph_w = 5.0f * pixel_size;
     float total = static_cast<float>(s.size()) * glyph_w +
                   (static_cast<float>(s.size() - 1) * spacing);
@@ -225,15 +879,382 @@ const u8 Renderer::FONT_5x7[][7] = {
     {0x00, 0x00, 0x00, 0x0E, 0x00, 0x00, 0x00},
 
     // '!'
-    {0x04, 0x04, 0x04, 0x04, 0x00, 0x04, 0x00}};
+    {0x04, 0x04, 0x04, 0x04, 0x00, 0x04, 0x00},
+
+    // '.'
+    {0x00, 0x00, 0x00, 0x00, 0x00, 0x0C, 0x0C},
+
+    // '+'
+    {0x00, 0x04, 0x04, 0x1F, 0x04, 0x04, 0x00}};
+
+enum PostStage {
+  POST_BLOOM_DOWNSAMPLE,
+  POST_BLOOM_BLUR,
+  POST_BLOOM_COMPOSITE,
+  POST_SCANLINES,
+  POST_VIGNETTE,
+
+  POST_STAGE_COUNT
+};
+
+const char *post_stage_names[POST_STAGE_COUNT] = {
+    "BLOOM DOWNSAMPLE", "BLOOM BLUR", "BLOOM COMPOSITE", "SCANLINES",
+    "VIGNETTE"};
+
+// Optional effects over the finished 32-bit frame. Every stage is an SSE2
+// pass over bands of TILE_ROWS rows (or column strips for the vertical
+// blur) that are spread over the worker pool, which is only started the
+// first time a pass actually runs.
+struct PostProcess {
+  static constexpr i32 TILE_ROWS = 32;
+  static constexpr i32 STRIP_COLUMNS = 16;
+
+  bool bloom = false;
+  bool scanlines = false;
+  bool vignette = false;
+
+  u8 bloom_threshold = 150;
+  i32 bloom_radius = 4;
+  float vignette_strength = 0.35f;
+
+  std::unique_ptr<utils::ThreadPool> pool;
+  float last_ms[POST_STAGE_COUNT] = {};
+  float stage_ms[POST_STAGE_COUNT] = {};
+
+  bool enabled() const { return bloom || scanlines || vignette; }
+
+  void apply(RenderState &state) {
+    if (!enabled() || !state.memory || state.width < 2 || state.height < 2)
+      return;
+    if (!pool)
+      pool = std::make_unique<utils::ThreadPool>();
+    resize(state.width, state.height);
+    pitch = state.pitch;
+    u32 *pixels = static_cast<u32 *>(state.memory);
+
+    if (bloom) {
+      timed(POST_BLOOM_DOWNSAMPLE, [&] { downsample(pixels); });
+      timed(POST_BLOOM_BLUR, [&] {
+        for (i32 pass = 0; pass < 2; ++pass) {
+          blur_rows(bloom_a.data(), bloom_b.data());
+          blur_columns(bloom_b.data(), bloom_a.data());
+        }
+      });
+      timed(POST_BLOOM_COMPOSITE, [&] { composite(pixels); });
+    }
+    if (scanlines)
+      timed(POST_SCANLINES, [&] { darken_scanlines(pixels); });
+    if (vignette)
+      timed(POST_VIGNETTE, [&] { apply_vignette(pixels); });
+  }
+
+  void render_timings(Renderer &renderer) const {
+    float y = -44.0f;
+    for (i32 s = 0; s < POST_STAGE_COUNT; ++s) {
+      renderer.render_text(
+          std::format("{} {:.2f}MS", post_stage_names[s], stage_ms[s]), 0.0f,
+          y, 0.35f, 0.35f, 0x00AAAAAA);
+      y += 3.0f;
+    }
+  }
+
+private:
+  i32 width = 0;
+  i32 height = 0;
+  i32 pitch = 0;
+  i32 bloom_width = 0;
+  i32 bloom_height = 0;
+
+  std::vector<u32> bloom_a;
+  std::vector<u32> bloom_b;
+  std::vector<u16> vignette_x;
+  std::vector<u16> vignette_y;
+
+  template <typename F> void timed(PostStage stage, F &&pass) {
+    i64 begin = utils::query_counter();
+    pass();
+    float ms = static_cast<float>(utils::query_counter() - begin) * 1000.0f /
+               static_cast<float>(utils::counter_frequency());
+    last_ms[stage] = ms;
+    stage_ms[stage] = stage_ms[stage] * 0.9f + ms * 0.1f;
+  }
+
+  template <typename F> void for_tiles(i32 count, i32 tile, F &&body) {
+    size_t tiles = static_cast<size_t>((count + tile - 1) / tile);
+    auto run = [&](size_t t) {
+      i32 begin = static_cast<i32>(t) * tile;
+      body(begin, std::min(count, begin + tile));
+    };
+    if (pool) {
+      pool->parallel_for(tiles, run);
+      return;
+    }
+    for (size_t t = 0; t < tiles; ++t)
+      run(t);
+  }
+
+  void resize(i32 new_width, i32 new_height) {
+    if (new_width == width && new_height == height)
+      return;
+    width = new_width;
+    height = new_height;
+    bloom_width = width / 2;
+    bloom_height = height / 2;
+    bloom_a.assign(static_cast<size_t>(bloom_width) * bloom_height, 0);
+    bloom_b.assign(bloom_a.size(), 0);
+
+    // Separable falloff; the product of the two axes approximates a radial
+    // vignette. X weights are stored per channel, scaled to 256.
+    auto falloff = [&](i32 i, i32 n) {
+      float t = (2.0f * static_cast<float>(i) + 1.0f) / n - 1.0f;
+      return 1.0f - vignette_strength * t * t;
+    };
+    vignette_x.resize(static_cast<size_t>(width) * 4);
+    for (i32 x = 0; x < width; ++x) {
+      u16 w = static_cast<u16>(std::lround(falloff(x, width) * 256.0f));
+      for (i32 c = 0; c < 4; ++c)
+        vignette_x[x * 4 + c] = c < 3 ? w : 256;
+    }
+    vignette_y.resize(height);
+    for (i32 y = 0; y < height; ++y)
+      vignette_y[y] = static_cast<u16>(std::lround(falloff(y, height) * 255.0f)
+                                        << 8);
+  }
+
+  static __m128i unpack_pixel(u32 pixel) {
+    return _mm_unpacklo_epi8(_mm_cvtsi32_si128(static_cast<i32>(pixel)),
+                             _mm_setzero_si128());
+  }
+
+  __m128i blur_reciprocal() const {
+    return _mm_set1_epi16(
+        static_cast<i16>((65536 + bloom_radius) / (2 * bloom_radius + 1)));
+  }
+
+  // 2x2 box average into the quarter-resolution buffer, keeping only what
+  // exceeds the bright-pass threshold.
+  void downsample(const u32 *pixels) {
+    __m128i threshold = _mm_set1_epi32(
+        bloom_threshold | (bloom_threshold << 8) | (bloom_threshold << 16));
+    for_tiles(bloom_height, TILE_ROWS, [&](i32 y0, i32 y1) {
+      for (i32 by = y0; by < y1; ++by) {
+        const u32 *row0 = pixels + (2 * by) * pitch;
+        const u32 *row1 = row0 + pitch;
+        u32 *out = bloom_a.data() + by * bloom_width;
+        i32 bx = 0;
+        for (; bx + 4 <= bloom_width; bx += 4) {
+          const __m128i *p0 = reinterpret_cast<const __m128i *>(row0 + 2 * bx);
+          const __m128i *p1 = reinterpret_cast<const __m128i *>(row1 + 2 * bx);
+          __m128 a = _mm_castsi128_ps(
+              _mm_avg_epu8(_mm_loadu_si128(p0), _mm_loadu_si128(p1)));
+          __m128 b = _mm_castsi128_ps(
+              _mm_avg_epu8(_mm_loadu_si128(p0 + 1), _mm_loadu_si128(p1 + 1)));
+          __m128i even = _mm_castps_si128(
+              _mm_shuffle_ps(a, b, _MM_SHUFFLE(2, 0, 2, 0)));
+          __m128i odd = _mm_castps_si128(
+              _mm_shuffle_ps(a, b, _MM_SHUFFLE(3, 1, 3, 1)));
+          _mm_storeu_si128(
+              reinterpret_cast<__m128i *>(out + bx),
+              _mm_subs_epu8(_mm_avg_epu8(even, odd), threshold));
+        }
+        for (; bx < bloom_width; ++bx) {
+          u32 result = 0;
+          for (i32 c = 0; c < 24; c += 8) {
+            u32 sum = ((row0[2 * bx] >> c) & 0xFF) +
+                      ((row0[2 * bx + 1] >> c) & 0xFF) +
+                      ((row1[2 * bx] >> c) & 0xFF) +
+                      ((row1[2 * bx + 1] >> c) & 0xFF);
+            u32 avg = (sum + 2) / 4;
+            result |= (avg > bloom_threshold ? avg - bloom_threshold : 0) << c;
+          }
+          out[bx] = result;
+        }
+      }
+    });
+  }
+
+  // Running-sum box blur on 16-bit channel sums; two horizontal+vertical
+  // rounds approximate a Gaussian at constant cost per pixel.
+  void blur_rows(const u32 *src, u32 *dst) {
+    const i32 r = bloom_radius;
+    const __m128i reciprocal = blur_reciprocal();
+    for_tiles(bloom_height, TILE_ROWS, [&](i32 y0, i32 y1) {
+      for (i32 y = y0; y < y1; ++y) {
+        const u32 *in = src + y * bloom_width;
+        u32 *out = dst + y * bloom_width;
+        __m128i sum = _mm_setzero_si128();
+        for (i32 k = -r; k <= r; ++k)
+          sum = _mm_add_epi16(
+              sum, unpack_pixel(in[utils::clamp(0, k, bloom_width - 1)]));
+        for (i32 x = 0; x < bloom_width; ++x) {
+          __m128i avg = _mm_mulhi_epu16(sum, reciprocal);
+          out[x] = static_cast<u32>(
+              _mm_cvtsi128_si32(_mm_packus_epi16(avg, avg)));
+          sum = _mm_add_epi16(
+              sum, unpack_pixel(in[std::min(x + r + 1, bloom_width - 1)]));
+          sum = _mm_sub_epi16(sum, unpack_pixel(in[std::max(x - r, 0)]));
+        }
+      }
+    });
+  }
+
+  // Column strips keep their running sums in registers-sized chunks of
+  // four pixels while walking down the rows.
+  void blur_columns(const u32 *src, u32 *dst) {
+    const i32 r = bloom_radius;
+    const __m128i reciprocal = blur_reciprocal();
+    const __m128i zero = _mm_setzero_si128();
+    for_tiles(bloom_width, STRIP_COLUMNS, [&](i32 x0, i32 x1) {
+      if (x1 - x0 < STRIP_COLUMNS) {
+        blur_columns_scalar(src, dst, x0, x1);
+        return;
+      }
+      __m128i sums[STRIP_COLUMNS / 2];
+      auto row = [&](i32 y) {
+        return src + utils::clamp(0, y, bloom_height - 1) * bloom_width + x0;
+      };
+      auto accumulate = [&](const u32 *in, bool add) {
+        for (i32 i = 0; i < STRIP_COLUMNS / 4; ++i) {
+          __m128i v =
+              _mm_loadu_si128(reinterpret_cast<const __m128i *>(in + i * 4));
+          __m128i lo = _mm_unpacklo_epi8(v, zero);
+          __m128i hi = _mm_unpackhi_epi8(v, zero);
+          sums[2 * i] = add ? _mm_add_epi16(sums[2 * i], lo)
+                            : _mm_sub_epi16(sums[2 * i], lo);
+          sums[2 * i + 1] = add ? _mm_add_epi16(sums[2 * i + 1], hi)
+                                : _mm_sub_epi16(sums[2 * i + 1], hi);
+        }
+      };
+
+      for (__m128i &sum : sums)
+        sum = zero;
+      for (i32 k = -r; k <= r; ++k)
+        accumulate(row(k), true);
+      for (i32 y = 0; y < bloom_height; ++y) {
+        u32 *out = dst + y * bloom_width + x0;
+        for (i32 i = 0; i < STRIP_COLUMNS / 4; ++i) {
+          __m128i lo = _mm_mulhi_epu16(sums[2 * i], reciprocal);
+          __m128i hi = _mm_mulhi_epu16(sums[2 * i + 1], reciprocal);
+          _mm_storeu_si128(reinterpret_cast<__m128i *>(out + i * 4),
+                           _mm_packus_epi16(lo, hi));
+        }
+        accumulate(row(y + r + 1), true);
+        accumulate(row(y - r), false);
+      }
+    });
+  }
+
+  void blur_columns_scalar(const u32 *src, u32 *dst, i32 x0, i32 x1) {
+    const i32 r = bloom_radius;
+    const __m128i reciprocal = blur_reciprocal();
+    for (i32 x = x0; x < x1; ++x) {
+      auto at = [&](i32 y) {
+        return unpack_pixel(
+            src[utils::clamp(0, y, bloom_height - 1) * bloom_width + x]);
+      };
+      __m128i sum = _mm_setzero_si128();
+      for (i32 k = -r; k <= r; ++k)
+        sum = _mm_add_epi16(sum, at(k));
+      for (i32 y = 0; y < bloom_height; ++y) {
+        __m128i avg = _mm_mulhi_epu16(sum, reciprocal);
+        dst[y * bloom_width + x] =
+            static_cast<u32>(_mm_cvtsi128_si32(_mm_packus_epi16(avg, avg)));
+        sum = _mm_add_epi16(sum, at(y + r + 1));
+        sum = _mm_sub_epi16(sum, at(y - r));
+      }
+    }
+  }
+
+  // Nearest-neighbour upsample of the blurred highlights, added with
+  // saturation.
+  void composite(u32 *pixels) {
+    for_tiles(height, TILE_ROWS, [&](i32 y0, i32 y1) {
+      for (i32 y = y0; y < y1; ++y) {
+        const u32 *glow =
+            bloom_a.data() + std::min(y / 2, bloom_height - 1) * bloom_width;
+        u32 *row = pixels + y * pitch;
+        i32 x = 0;
+        for (; x + 4 <= 2 * bloom_width; x += 4) {
+          __m128i pair = _mm_loadl_epi64(
+              reinterpret_cast<const __m128i *>(glow + x / 2));
+          __m128i *p = reinterpret_cast<__m128i *>(row + x);
+          _mm_storeu_si128(p, _mm_adds_epu8(_mm_loadu_si128(p),
+                                            _mm_unpacklo_epi32(pair, pair)));
+        }
+        for (; x < width; ++x) {
+          __m128i d = _mm_cvtsi32_si128(static_cast<i32>(row[x]));
+          __m128i g = _mm_cvtsi32_si128(
+              static_cast<i32>(glow[std::min(x / 2, bloom_width - 1)]));
+          row[x] = static_cast<u32>(_mm_cvtsi128_si32(_mm_adds_epu8(d, g)));
+        }
+      }
+    });
+  }
+
+  // Every other row loses a quarter of its brightness.
+  void darken_scanlines(u32 *pixels) {
+    const __m128i mask = _mm_set1_epi32(0x3F3F3F3F);
+    for_tiles(height, TILE_ROWS, [&](i32 y0, i32 y1) {
+      for (i32 y = y0 | 1; y < y1; y += 2) {
+        u32 *row = pixels + y * pitch;
+        i32 x = 0;
+        for (; x + 4 <= width; x += 4) {
+          __m128i *p = reinterpret_cast<__m128i *>(row + x);
+          __m128i v = _mm_loadu_si128(p);
+          __m128i quarter = _mm_and_si128(_mm_srli_epi32(v, 2), mask);
+          _mm_storeu_si128(p, _mm_sub_epi8(v, quarter));
+        }
+        for (; x < width; ++x)
+          row[x] -= (row[x] >> 2) & 0x3F3F3F3F;
+      }
+    });
+  }
+
+  void apply_vignette(u32 *pixels) {
+    const __m128i zero = _mm_setzero_si128();
+    for_tiles(height, TILE_ROWS, [&](i32 y0, i32 y1) {
+      for (i32 y = y0; y < y1; ++y) {
+        u32 *row = pixels + y * pitch;
+        const u16 *wx = vignette_x.data();
+        __m128i wy = _mm_set1_epi16(static_cast<i16>(vignette_y[y]));
+        i32 x = 0;
+        for (; x + 4 <= width; x += 4) {
+          __m128i *p = reinterpret_cast<__m128i *>(row + x);
+          __m128i v = _mm_loadu_si128(p);
+          __m128i lo = _mm_mullo_epi16(
+              _mm_unpacklo_epi8(v, zero),
+              _mm_loadu_si128(reinterpret_cast<const __m128i *>(wx + x * 4)));
+          __m128i hi = _mm_mullo_epi16(
+              _mm_unpackhi_epi8(v, zero),
+              _mm_loadu_si128(
+                  reinterpret_cast<const __m128i *>(wx + x * 4 + 8)));
+          _mm_storeu_si128(p, _mm_packus_epi16(_mm_mulhi_epu16(lo, wy),
+                                               _mm_mulhi_epu16(hi, wy)));
+        }
+        for (; x < width; ++x) {
+          u32 result = 0;
+          for (i32 c = 0; c < 32; c += 8) {
+            u32 t = ((row[x] >> c) & 0xFF) * wx[x * 4 + c / 8];
+            result |= ((t * vignette_y[y]) >> 16) << c;
+          }
+          row[x] = result;
+        }
+      }
+    });
+  }
+};
 } // namespace render
 
 namespace input {
 struct ButtonState {
   bool is_down = false;
   bool changed = false;
+  u8 presses = 0;
+  u8 releases = 0;
 };
 
+// Crash dumps keep a bit per Key held (flight::Frame::buttons), so a new
+// key goes last, before BUTTON_COUNT, and flight::key_names follows.
 enum Key {
   BUTTON_LEFT_ARROW,
   BUTTON_UP_ARROW,
@@ -246,44 +1267,1584 @@ enum Key {
   BUTTON_DOWN,
 
   BUTTON_ENTER,
+  BUTTON_F2,
+  BUTTON_F3,
+  BUTTON_F4,
+  BUTTON_F5,
+  BUTTON_F6,
+  BUTTON_F7,
+  BUTTON_F8,
+  BUTTON_F9,
   BUTTON_F11,
   BUTTON_PAUSE,
   BUTTON_ESC,
+  BUTTON_F12,
 
   BUTTON_COUNT
 };
 
-ButtonState buttons[BUTTON_COUNT] = {};
-std::unordered_map<i32, Key> kb = {
-    {0x25, BUTTON_LEFT_ARROW},  {0x26, BUTTON_UP_ARROW},
-    {0x27, BUTTON_RIGHT_ARROW}, {0x28, BUTTON_DOWN_ARROW},
+struct InputEvent {
+  u32 id = 0;
+  i64 timestamp = 0;
+  Key key = BUTTON_COUNT;
+  bool is_down = false;
+};
 
-    {0x5A, input::BUTTON_UP},   {0x53, input::BUTTON_DOWN},
-    {0x51, input::BUTTON_LEFT}, {0x44, input::BUTTON_RIGHT},
+// Every key transition of the current frame, in arrival order, so the
+// simulation can apply them at the sub-step they actually happened.
+struct FrameEvents {
+  static constexpr size_t CAPACITY = 64;
 
-    {0x0D, BUTTON_ENTER},       {0x7A, BUTTON_F11},
-    {0x50, BUTTON_PAUSE},       {0x1B, BUTTON_ESC}};
+  std::array<InputEvent, CAPACITY> events = {};
+  size_t count = 0;
 
-inline bool is_changed(Key key) { return buttons[key].changed; }
-inline bool is_down(Key key) { return buttons[key].is_down; }
-inline bool is_pressed(Key key) { return is_down(key) && is_changed(key); }
-inline bool is_released(Key key) { return !is_down(key) && is_changed(key); }
+  i64 frame_begin = 0;
+  i64 frame_end = 0;
+  bool down_at_begin[BUTTON_COUNT] = {};
 
-inline void process_button(MSG message) {
-  auto it = kb.find(static_cast<i32>(message.wParam));
-  if (it != kb.end()) {
-    Key k = it->second;
-    buttons[k].is_down = (message.message == WM_KEYDOWN);
-    buttons[k].changed = true;
+  float fraction(const InputEvent &event) const {
+    if (frame_end <= frame_begin)
+      return 1.0f;
+    float t = static_cast<float>(event.timestamp - frame_begin) /
+              static_cast<float>(frame_end - frame_begin);
+    return utils::clamp(0.0f, t, 1.0f);
   }
+};
+
+constexpr std::array<Key, 256> make_keyboard_table() {
+  std::array<Key, 256> table = {};
+  table.fill(BUTTON_COUNT);
+
+  table[0x25] = BUTTON_LEFT_ARROW;
+  table[0x26] = BUTTON_UP_ARROW;
+  table[0x27] = BUTTON_RIGHT_ARROW;
+  table[0x28] = BUTTON_DOWN_ARROW;
+
+  table[0x5A] = BUTTON_UP;
+  table[0x53] = BUTTON_DOWN;
+  table[0x51] = BUTTON_LEFT;
+  table[0x44] = BUTTON_RIGHT;
+
+  table[0x0D] = BUTTON_ENTER;
+  table[0x71] = BUTTON_F2;
+  table[0x72] = BUTTON_F3;
+  table[0x73] = BUTTON_F4;
+  table[0x74] = BUTTON_F5;
+  table[0x75] = BUTTON_F6;
+  table[0x76] = BUTTON_F7;
+  table[0x77] = BUTTON_F8;
+  table[0x78] = BUTTON_F9;
+  table[0x7A] = BUTTON_F11;
+  table[0x50] = BUTTON_PAUSE;
+  table[0x1B] = BUTTON_ESC;
+  table[0x7B] = BUTTON_F12;
+  return table;
+}
+
+ButtonState buttons[BUTTON_COUNT] = {};
+// Thread local so offline replay workers can each feed their own match.
+thread_local FrameEvents frame_events = {};
+u32 next_event_id = 1;
+constexpr std::array<Key, 256> kb = make_keyboard_table();
+
+inline bool is_changed(Key key) { return buttons[key].changed; }
+inline bool is_down(Key key) { return buttons[key].is_down; }
+inline bool is_pressed(Key key) { return buttons[key].presses > 0; }
+inline bool is_released(Key key) { return buttons[key].releases > 0; }
+
+inline void begin_frame() {
+  for (i32 i = 0; i < BUTTON_COUNT; i++) {
+    buttons[i].changed = false;
+    buttons[i].presses = 0;
+    buttons[i].releases = 0;
+    frame_events.down_at_begin[i] = buttons[i].is_down;
+  }
+  frame_events.count = 0;
+}
+
+inline void set_frame_interval(i64 frame_begin, i64 frame_end) {
+  frame_events.frame_begin = frame_begin;
+  frame_events.frame_end = frame_end;
+}
+
+// The fallback when raw input is unavailable. MSG::time is a millisecond
+// tick stamped when the message was posted; back-date the current counter
+// by the time the message spent queued. Both ticks only advance every 10 to
+// 16 ms, so only messages older than one tick are placed within the frame.
+// An age of 0 says nothing: the message arrived at some point since the
+// previous pump at `since`, and is taken to have arrived then, so a new
+// press counts for the whole frame rather than almost none of it.
+inline i64 message_timestamp(const MSG &message, i64 since) {
+  DWORD age_ms = GetTickCount() - static_cast<DWORD>(message.time);
+  if (age_ms == 0 || age_ms > 1000)
+    return since;
+  i64 now = utils::query_counter();
+  return std::max(since, now - static_cast<i64>(age_ms) *
+                                   utils::counter_frequency() / 1000);
+}
+
+inline void set_key(Key k, bool down, i64 timestamp) {
+  ButtonState &button = buttons[k];
+  button.is_down = down;
+  button.changed = true;
+  if (down && button.presses < 255)
+    button.presses++;
+  if (!down && button.releases < 255)
+    button.releases++;
+
+  if (frame_events.count < FrameEvents::CAPACITY)
+    frame_events.events[frame_events.count++] = {next_event_id++, timestamp,
+                                                 k, down};
+}
+
+inline void process_button(MSG message, i64 timestamp) {
+  if (message.wParam >= kb.size())
+    return;
+  Key k = kb[message.wParam];
+  if (k == BUTTON_COUNT)
+    return;
+  set_key(k, message.message == WM_KEYDOWN, timestamp);
 }
+
+// Keyboard raw input read on a thread of its own. The thread blocks in
+// GetMessage, so it wakes for each key and stamps it with the performance
+// counter as it arrives rather than when the game loop next pumps; the
+// loop picks the keys up once per frame with drain().
+class RawKeyboard {
+public:
+  RawKeyboard() = default;
+  RawKeyboard(const RawKeyboard &) = delete;
+  RawKeyboard &operator=(const RawKeyboard &) = delete;
+  ~RawKeyboard() { stop(); }
+
+  // Returns false when the device cannot be registered; the caller then
+  // reads WM_KEYDOWN and WM_KEYUP instead.
+  bool start() {
+    if (worker.joinable())
+      return true;
+    std::promise<bool> ready;
+    std::future<bool> started = ready.get_future();
+    worker = std::thread([this, &ready] { work(ready); });
+    if (started.get())
+      return true;
+    worker.join();
+    return false;
+  }
+
+  void stop() {
+    if (!worker.joinable())
+      return;
+    PostThreadMessageA(thread_id, WM_QUIT, 0, 0);
+    worker.join();
+  }
+
+  bool running() const { return worker.joinable(); }
+
+  // Hands every key that arrived since the previous call to `key`, oldest
+  // first.
+  template <typename F> void drain(F &&key) {
+    {
+      std::lock_guard<std::mutex> lock(mutex);
+      draining.swap(pending);
+    }
+    for (const Pending &p : draining)
+      key(p.key, p.down, p.timestamp);
+    draining.clear();
+  }
+
+private:
+  struct Pending {
+    Key key;
+    bool down;
+    i64 timestamp;
+  };
+
+  void work(std::promise<bool> &ready) {
+    thread_id = GetCurrentThreadId();
+    WNDCLASSA window_class = {};
+    window_class.lpfnWndProc = DefWindowProcA;
+    window_class.hInstance = GetModuleHandle(nullptr);
+    window_class.lpszClassName = "Game Raw Input";
+    RegisterClassA(&window_class);
+    // A message-only window; INPUTSINK keeps keys coming while the game
+    // window has focus, which is not this window.
+    HWND sink = CreateWindowA(window_class.lpszClassName, "", 0, 0, 0, 0, 0,
+                              HWND_MESSAGE, nullptr, window_class.hInstance,
+                              nullptr);
+    RAWINPUTDEVICE device = {0x01, 0x06, RIDEV_INPUTSINK, sink};
+    bool registered =
+        sink && RegisterRawInputDevices(&device, 1, sizeof(device));
+    ready.set_value(registered);
+
+    MSG message;
+    while (registered && GetMessageA(&message, nullptr, 0, 0) > 0) {
+      if (message.message == WM_INPUT)
+        read(reinterpret_cast<HRAWINPUT>(message.lParam));
+      DispatchMessageA(&message);
+    }
+
+    if (sink)
+      DestroyWindow(sink);
+    UnregisterClassA(window_class.lpszClassName, window_class.hInstance);
+  }
+
+  void read(HRAWINPUT handle) {
+    i64 now = utils::query_counter();
+    RAWINPUT raw;
+    UINT size = sizeof(raw);
+    if (GetRawInputData(handle, RID_INPUT, &raw, &size,
+                        sizeof(RAWINPUTHEADER)) == static_cast<UINT>(-1) ||
+        raw.header.dwType != RIM_TYPEKEYBOARD)
+      return;
+    USHORT vk = raw.data.keyboard.VKey;
+    if (vk >= kb.size() || kb[vk] == BUTTON_COUNT)
+      return;
+    bool down = !(raw.data.keyboard.Flags & RI_KEY_BREAK);
+    std::lock_guard<std::mutex> lock(mutex);
+    pending.push_back({kb[vk], down, now});
+  }
+
+  std::thread worker;
+  DWORD thread_id = 0;
+  std::mutex mutex;
+  std::vector<Pending> pending;
+  std::vector<Pending> draining;
+};
+
+RawKeyboard raw_keyboard;
 } // namespace input
 
+namespace trace {
+enum Stage {
+  STAGE_INPUT,
+  STAGE_SIMULATE,
+  STAGE_RENDER,
+  STAGE_PRESENT,
+
+  STAGE_COUNT
+};
+
+const char *stage_names[STAGE_COUNT] = {"input", "simulate", "render",
+                                        "present"};
+
+struct LatencyHistogram {
+  static constexpr i64 BUCKET_US = 50;
+  static constexpr size_t BUCKETS = 2000;
+
+  std::array<u32, BUCKETS + 1> counts = {};
+  u64 total = 0;
+
+  void record(i64 micros) {
+    size_t bucket = static_cast<size_t>(std::max<i64>(0, micros) / BUCKET_US);
+    counts[std::min(bucket, BUCKETS)]++;
+    total++;
+  }
+
+  float percentile_ms(float p) const {
+    if (total == 0)
+      return 0.0f;
+    u64 rank = static_cast<u64>(std::ceil(p * static_cast<float>(total)));
+    u64 seen = 0;
+    for (size_t i = 0; i <= BUCKETS; ++i) {
+      seen += counts[i];
+      if (seen >= rank)
+        return static_cast<float>((i + 1) * BUCKET_US) / 1000.0f;
+    }
+    return static_cast<float>(BUCKETS * BUCKET_US) / 1000.0f;
+  }
+};
+
+struct TracedEvent {
+  input::InputEvent event;
+  i64 stamps[STAGE_COUNT] = {};
+};
+
+// Follows key events from arrival to the first present that reflects them.
+// Stage stamps are taken the first time each stage runs after the event
+// was pumped; latencies are measured from the event timestamp.
+struct LatencyTracer {
+  static constexpr size_t MAX_ROWS = 1 << 16;
+
+  bool enabled = false;
+
+  std::array<TracedEvent, input::FrameEvents::CAPACITY> pending = {};
+  size_t pending_count = 0;
+
+  LatencyHistogram stages[STAGE_COUNT];
+  std::vector<TracedEvent> rows;
+
+  void toggle() {
+    enabled = !enabled;
+    if (enabled && rows.capacity() == 0)
+      rows.reserve(MAX_ROWS);
+    pending_count = 0;
+  }
+
+  void begin_frame(const input::FrameEvents &events) {
+    if (!enabled)
+      return;
+    for (size_t i = 0; i < events.count && pending_count < pending.size();
+         ++i)
+      pending[pending_count++] = {events.events[i]};
+  }
+
+  void mark(Stage stage, input::Key key) {
+    if (!enabled)
+      return;
+    i64 now = utils::query_counter();
+    for (size_t i = 0; i < pending_count; ++i) {
+      TracedEvent &traced = pending[i];
+      if (traced.event.key == key && traced.stamps[stage] == 0)
+        traced.stamps[stage] = now;
+    }
+  }
+
+  // Draws are deferred until the renderer flushes, so the paddles' pixels
+  // exist only after that.
+  void mark_rendered() {
+    if (!enabled)
+      return;
+    i64 now = utils::query_counter();
+    for (size_t i = 0; i < pending_count; ++i) {
+      TracedEvent &traced = pending[i];
+      if (traced.stamps[STAGE_SIMULATE] != 0 &&
+          traced.stamps[STAGE_RENDER] == 0)
+        traced.stamps[STAGE_RENDER] = now;
+    }
+  }
+
+  // Only events a paddle simulated are traced to the present; menu keys and
+  // keys pressed outside a match are dropped.
+  void end_frame() {
+    if (!enabled || pending_count == 0)
+      return;
+    i64 now = utils::query_counter();
+    i64 frequency = utils::counter_frequency();
+    for (size_t i = 0; i < pending_count; ++i) {
+      TracedEvent &traced = pending[i];
+      if (traced.stamps[STAGE_SIMULATE] == 0)
+        continue;
+      traced.stamps[STAGE_PRESENT] = now;
+      for (i32 s = 0; s < STAGE_COUNT; ++s) {
+        if (traced.stamps[s] == 0)
+          continue;
+        stages[s].record((traced.stamps[s] - traced.event.timestamp) *
+                         1000000 / frequency);
+      }
+      if (rows.size() < MAX_ROWS)
+        rows.push_back(traced);
+    }
+    pending_count = 0;
+  }
+
+  void render_overlay(render::Renderer &renderer) const {
+    if (!enabled)
+      return;
+    const LatencyHistogram &total = stages[STAGE_PRESENT];
+    renderer.render_text(
+        std::format("INPUT TO PRESENT  N {}  P50 {:.2f}MS  P95 {:.2f}MS  "
+                    "P99 {:.2f}MS",
+                    total.total, total.percentile_ms(0.50f),
+                    total.percentile_ms(0.95f), total.percentile_ms(0.99f)),
+        0.0f, -48.0f, 0.35f, 0.35f, 0x00FFCC66);
+  }
+
+  void write_csv(const std::string &directory) const {
+    if (rows.empty())
+      return;
+    std::filesystem::create_directories(directory);
+
+    std::ofstream events(directory + "/latency_events.csv", std::ios::trunc);
+    if (events) {
+      events << "id,key,down";
+      for (i32 s = 0; s < STAGE_COUNT; ++s)
+        events << "," << stage_names[s] << "_ms";
+      events << "\n";
+
+      double ms_per_tick =
+          1000.0 / static_cast<double>(utils::counter_frequency());
+      for (const TracedEvent &traced : rows) {
+        events << traced.event.id << "," << traced.event.key << ","
+               << traced.event.is_down;
+        for (i32 s = 0; s < STAGE_COUNT; ++s) {
+          events << ",";
+          if (traced.stamps[s] != 0)
+            events << (traced.stamps[s] - traced.event.timestamp) * ms_per_tick;
+        }
+        events << "\n";
+      }
+    }
+
+    std::ofstream summary(directory + "/latency_summary.csv", std::ios::trunc);
+    if (summary) {
+      summary << "stage,count,p50_ms,p95_ms,p99_ms\n";
+      for (i32 s = 0; s < STAGE_COUNT; ++s)
+        summary << stage_names[s] << "," << stages[s].total << ","
+                << stages[s].percentile_ms(0.50f) << ","
+                << stages[s].percentile_ms(0.95f) << ","
+                << stages[s].percentile_ms(0.99f) << "\n";
+    }
+  }
+};
+
+LatencyTracer latency = {};
+} // namespace trace
+
+namespace power {
+enum Activity {
+  ACTIVITY_FOREGROUND,
+  ACTIVITY_BACKGROUND,
+  ACTIVITY_OCCLUDED,
+  ACTIVITY_MINIMIZED,
+  ACTIVITY_COUNT
+};
+
+const char *activity_names[ACTIVITY_COUNT] = {"foreground", "background",
+                                              "occluded", "minimized"};
+// The overlay font has capitals only.
+const char *activity_labels[ACTIVITY_COUNT] = {"FOREGROUND", "BACKGROUND",
+                                               "OCCLUDED", "MINIMIZED"};
+
+// How long the loop may sleep between wakeups. A background window still
+// renders at 10 FPS, an occluded one only polls for becoming visible and a
+// minimized one sleeps until a message arrives.
+constexpr DWORD wait_ms[ACTIVITY_COUNT] = {0, 100, 250, INFINITE};
+
+inline u64 process_cpu_time() {
+  FILETIME created, exited, kernel, user;
+  if (!GetProcessTimes(GetCurrentProcess(), &created, &exited, &kernel, &user))
+    return 0;
+  auto ticks = [](const FILETIME &t) {
+    return (static_cast<u64>(t.dwHighDateTime) << 32) | t.dwLowDateTime;
+  };
+  return ticks(kernel) + ticks(user);
+}
+
+// Wall time, process CPU time, loop wakeups and presented frames, split by
+// the activity the loop was in.
+struct PowerStats {
+  struct Totals {
+    double wall_s = 0.0;
+    double cpu_s = 0.0;
+    u64 wakeups = 0;
+    u64 frames = 0;
+  };
+
+  bool show = false;
+  Totals totals[ACTIVITY_COUNT] = {};
+
+  // Charges the time since the previous wakeup to `activity`.
+  void wakeup(Activity activity) {
+    i64 now = utils::query_counter();
+    u64 cpu = process_cpu_time();
+    if (last_counter != 0) {
+      Totals &t = totals[activity];
+      t.wall_s += static_cast<double>(now - last_counter) /
+                  static_cast<double>(utils::counter_frequency());
+      t.cpu_s += static_cast<double>(cpu - last_cpu) / 1e7;
+      t.wakeups++;
+    }
+    last_counter = now;
+    last_cpu = cpu;
+    current = activity;
+  }
+
+  void frame() { totals[current].frames++; }
+
+  void render_overlay(render::Renderer &renderer) const {
+    if (!show)
+      return;
+    float y = 30.0f;
+    for (i32 a = 0; a < ACTIVITY_COUNT; ++a) {
+      const Totals &t = totals[a];
+      double wall = std::max(t.wall_s, 1e-9);
+      renderer.render_text(
+          std::format(
+              "{} {:.1f}S  CPU {:.1f}%  {:.0f} WAKEUPS PER S  {:.0f} FPS",
+              activity_labels[a], t.wall_s, 100.0 * t.cpu_s / wall,
+              t.wakeups / wall, t.frames / wall),
+          0.0f, y, 0.35f, 0.35f, 0x00AAAAAA);
+      y += 3.0f;
+    }
+  }
+
+  void write_csv(const std::string &directory) const {
+    std::filesystem::create_directories(directory);
+    std::ofstream out(directory + "/power.csv", std::ios::trunc);
+    if (!out)
+      return;
+    out << "activity,wall_s,cpu_s,cpu_percent,wakeups,wakeups_per_s,frames,"
+           "fps\n";
+    for (i32 a = 0; a < ACTIVITY_COUNT; ++a) {
+      const Totals &t = totals[a];
+      double wall = std::max(t.wall_s, 1e-9);
+      out << activity_names[a] << "," << t.wall_s << "," << t.cpu_s << ","
+          << 100.0 * t.cpu_s / wall << "," << t.wakeups << ","
+          << t.wakeups / wall << "," << t.frames << "," << t.frames / wall
+          << "\n";
+    }
+  }
+
+private:
+  i64 last_counter = 0;
+  u64 last_cpu = 0;
+  Activity current = ACTIVITY_FOREGROUND;
+};
+
+PowerStats stats = {};
+} // namespace power
+
+namespace telemetry {
+enum Phase {
+  PHASE_MENU,
+  PHASE_COUNTDOWN,
+  PHASE_GAMEPLAY,
+  PHASE_CELEBRATION,
+  PHASE_COUNT
+};
+
+const char *phase_names[PHASE_COUNT] = {"menu", "countdown", "gameplay",
+                                        "celebration"};
+// The overlay font has capitals only.
+const char *phase_labels[PHASE_COUNT] = {"MENU", "COUNTDOWN", "GAMEPLAY",
+                                         "CELEBRATION"};
+
+inline std::string session_name() {
+  std::time_t now = std::time(nullptr);
+  std::ostringstream name;
+  name << std::put_time(std::localtime(&now), "%Y%m%d_%H%M%S");
+  return name.str();
+}
+
+// Log-linear buckets over performance counter ticks, as in HdrHistogram:
+// values below 64 get a bucket each, and every power of two above that is
+// split into 32 buckets, so any value is known to within about 3%. Up to
+// 2^32 ticks (seven minutes at 10 MHz) fits in a fixed array.
+struct FrameHistogram {
+  static constexpr u32 SUB_BITS = 5;
+  static constexpr u32 SUB_BUCKETS = 1u << SUB_BITS;
+  static constexpr u64 MAX_TICKS = 0xFFFFFFFFull;
+  static constexpr size_t BUCKETS = (33 - SUB_BITS) * SUB_BUCKETS;
+
+  std::array<u32, BUCKETS> counts = {};
+  u64 total = 0;
+  u64 sum = 0;
+  u64 max = 0;
+
+  static size_t bucket_of(u64 ticks) {
+    if (ticks < 2 * SUB_BUCKETS)
+      return static_cast<size_t>(ticks);
+    u32 shift = static_cast<u32>(std::bit_width(ticks)) - 1 - SUB_BITS;
+    return shift * SUB_BUCKETS + static_cast<size_t>(ticks >> shift);
+  }
+
+  // The largest value that falls into `bucket`.
+  static u64 bucket_limit(size_t bucket) {
+    if (bucket < 2 * SUB_BUCKETS)
+      return bucket;
+    u32 shift = static_cast<u32>(bucket / SUB_BUCKETS) - 1;
+    u64 sub = bucket - shift * SUB_BUCKETS;
+    return ((sub + 1) << shift) - 1;
+  }
+
+  void record(u64 ticks) {
+    ticks = std::min(ticks, MAX_TICKS);
+    counts[bucket_of(ticks)]++;
+    total++;
+    sum += ticks;
+    max = std::max(max, ticks);
+  }
+
+  u64 percentile(double p) const {
+    if (total == 0)
+      return 0;
+    u64 rank = std::max<u64>(
+        1, static_cast<u64>(std::ceil(p * static_cast<double>(total))));
+    u64 seen = 0;
+    for (size_t i = 0; i < BUCKETS; ++i) {
+      seen += counts[i];
+      if (seen >= rank)
+        return std::min(bucket_limit(i), max);
+    }
+    return max;
+  }
+
+  // Frames whose bucket lies wholly above `ticks`.
+  u64 count_above(u64 ticks) const {
+    u64 above = 0;
+    for (size_t i = bucket_of(std::min(ticks, MAX_TICKS)) + 1; i < BUCKETS;
+         ++i)
+      above += counts[i];
+    return above;
+  }
+};
+
+// Frame times of this run, one histogram per phase of the game. Recording
+// is a few adds and a bit scan into fixed arrays; percentiles and hitches
+// are only worked out for the overlay and the CSV.
+struct FrameTimes {
+  static constexpr double HITCH_MS = 33.3;
+
+  bool show = false;
+  FrameHistogram phases[PHASE_COUNT];
+
+  void record(Phase phase, i64 ticks) {
+    phases[phase].record(static_cast<u64>(std::max<i64>(ticks, 0)));
+  }
+
+  struct Summary {
+    u64 frames = 0;
+    double mean_ms = 0.0;
+    double p50_ms = 0.0;
+    double p90_ms = 0.0;
+    double p99_ms = 0.0;
+    double p999_ms = 0.0;
+    double max_ms = 0.0;
+    u64 over_33ms = 0; // missed 30 FPS
+    u64 hitches = 0;   // over twice the median
+  };
+
+  Summary summarize(Phase phase) const {
+    const FrameHistogram &h = phases[phase];
+    double ms_per_tick =
+        1000.0 / static_cast<double>(utils::counter_frequency());
+    Summary s;
+    s.frames = h.total;
+    if (h.total == 0)
+      return s;
+    u64 p50 = h.percentile(0.50);
+    s.mean_ms = static_cast<double>(h.sum) / h.total * ms_per_tick;
+    s.p50_ms = p50 * ms_per_tick;
+    s.p90_ms = h.percentile(0.90) * ms_per_tick;
+    s.p99_ms = h.percentile(0.99) * ms_per_tick;
+    s.p999_ms = h.percentile(0.999) * ms_per_tick;
+    s.max_ms = h.max * ms_per_tick;
+    s.over_33ms = h.count_above(static_cast<u64>(HITCH_MS / ms_per_tick));
+    s.hitches = h.count_above(2 * p50);
+    return s;
+  }
+
+  void render_overlay(render::Renderer &renderer, Phase current) const {
+    if (!show)
+      return;
+    float y = -20.0f;
+    for (i32 p = 0; p < PHASE_COUNT; ++p) {
+      Summary s = summarize(static_cast<Phase>(p));
+      renderer.render_text(
+          std::format("{} N {}  P50 {:.2f}  P99 {:.2f}  P99.9 {:.2f}  MAX "
+                      "{:.1f}MS  HITCHES {}",
+                      phase_labels[p], s.frames, s.p50_ms, s.p99_ms, s.p999_ms,
+                      s.max_ms, s.hitches),
+          0.0f, y, 0.35f, 0.35f, p == current ? 0x00FFCC66 : 0x00AAAAAA);
+      y -= 3.0f;
+    }
+  }
+
+  // One row per phase and run, appended to stats/frametimes.csv.
+  void write_csv(const std::string &directory) const {
+    std::filesystem::create_directories(directory);
+    std::string path = directory + "/frametimes.csv";
+    bool exists = std::filesystem::exists(path);
+    std::ofstream out(path, std::ios::app);
+    if (!out)
+      return;
+    if (!exists)
+      out << "session,phase,frames,mean_ms,p50_ms,p90_ms,p99_ms,p999_ms,"
+             "max_ms,over_33ms,hitches\n";
+    for (i32 p = 0; p < PHASE_COUNT; ++p) {
+      Summary s = summarize(static_cast<Phase>(p));
+      if (s.frames == 0)
+        continue;
+      out << session << "," << phase_names[p] << "," << s.frames << ","
+          << s.mean_ms << "," << s.p50_ms << "," << s.p90_ms << ","
+          << s.p99_ms << "," << s.p999_ms << "," << s.max_ms << ","
+          << s.over_33ms << "," << s.hitches << "\n";
+    }
+  }
+
+  void begin_session() { session = session_name(); }
+
+private:
+  std::string session;
+};
+
+FrameTimes frame_times = {};
+
+// Where the time before the first frame goes. Steps on the main thread
+// follow one another from begin() on; work handed to other threads is added
+// with its own start and end, so the CSV shows what overlapped.
+struct Startup {
+  static constexpr double TARGET_MS = 50.0;
+
+  struct Span {
+    const char *name;
+    double start_ms;
+    double end_ms;
+    bool background;
+  };
+
+  void begin() {
+    origin = last = utils::query_counter();
+    first_frame_ms = 0.0;
+    session = session_name();
+    std::lock_guard<std::mutex> lock(mutex);
+    spans.clear();
+  }
+
+  // Ends the main thread step that started at the previous mark.
+  void mark(const char *name) {
+    i64 now = utils::query_counter();
+    add(name, last, now, false);
+    last = now;
+  }
+
+  void add(const char *name, i64 start, i64 end, bool background) {
+    std::lock_guard<std::mutex> lock(mutex);
+    spans.push_back({name, to_ms(start), to_ms(end), background});
+  }
+
+  // Called once the first frame is on screen.
+  void first_frame() {
+    if (origin == 0 || first_frame_ms > 0.0)
+      return;
+    mark("first_frame");
+    first_frame_ms = to_ms(last);
+  }
+
+  void render_overlay(render::Renderer &renderer) {
+    if (first_frame_ms <= 0.0)
+      return;
+    std::string text = std::format("STARTUP {:.1f}MS", first_frame_ms);
+    {
+      std::lock_guard<std::mutex> lock(mutex);
+      for (const Span &span : spans)
+        text += std::format("  {}{} {:.1f}", label(span.name),
+                            span.background ? " BG" : "",
+                            span.end_ms - span.start_ms);
+    }
+    // Below the frame time lines.
+    float y = -20.0f - 3.0f * static_cast<float>(PHASE_COUNT);
+    renderer.render_text(text, 0.0f, y, 0.35f, 0.35f,
+                         first_frame_ms > TARGET_MS ? 0x00FF6666 : 0x00AAAAAA);
+  }
+
+  // One row per step, appended to stats/startup.csv.
+  void write_csv(const std::string &directory) {
+    if (first_frame_ms <= 0.0)
+      return;
+    std::filesystem::create_directories(directory);
+    std::string path = directory + "/startup.csv";
+    bool exists = std::filesystem::exists(path);
+    std::ofstream out(path, std::ios::app);
+    if (!out)
+      return;
+    if (!exists)
+      out << "session,step,thread,start_ms,duration_ms,first_frame_ms\n";
+    std::lock_guard<std::mutex> lock(mutex);
+    for (const Span &span : spans)
+      out << session << "," << span.name << ","
+          << (span.background ? "background" : "main") << ","
+          << span.start_ms << "," << span.end_ms - span.start_ms << ","
+          << first_frame_ms << "\n";
+  }
+
+private:
+  // "config_wait" as CONFIG WAIT; the overlay font has capitals only.
+  static std::string label(const char *name) {
+    std::string text = name;
+    for (char &c : text)
+      c = c == '_' ? ' ' : static_cast<char>(std::toupper(static_cast<u8>(c)));
+    return text;
+  }
+
+  double to_ms(i64 counter) const {
+    return static_cast<double>(counter - origin) * 1000.0 /
+           static_cast<double>(utils::counter_frequency());
+  }
+
+  i64 origin = 0;
+  i64 last = 0;
+  double first_frame_ms = 0.0;
+  std::string session;
+  std::mutex mutex;
+  std::vector<Span> spans;
+};
+
+Startup startup;
+} // namespace telemetry
+
+namespace capture {
+enum Format { FORMAT_Y4M, FORMAT_RAW_BGRA, FORMAT_COUNT };
+
+const char *format_names[FORMAT_COUNT] = {"y4m", "raw"};
+const char *format_extensions[FORMAT_COUNT] = {".y4m", ".bgra"};
+
+// BT.601 limited range, in 8.8 fixed point. Pixels are B, G, R, X in memory.
+inline u8 rgb_to_y(u32 c) {
+  i32 r = (c >> 16) & 0xFF, g = (c >> 8) & 0xFF, b = c & 0xFF;
+  return static_cast<u8>(((66 * r + 129 * g + 25 * b + 128) >> 8) + 16);
+}
+
+inline u8 average(u32 a, u32 b, i32 shift) {
+  return static_cast<u8>((((a >> shift) & 0xFF) + ((b >> shift) & 0xFF) + 1) >>
+                         1);
+}
+
+// Averages a 2x2 block the way _mm_avg_epu8 does (vertically, then
+// horizontally) so every kernel produces the same bytes.
+inline void rgb_to_uv(u32 p00, u32 p01, u32 p10, u32 p11, u8 *u, u8 *v) {
+  i32 c[3];
+  for (i32 i = 0; i < 3; ++i)
+    c[i] = (average(p00, p10, i * 8) + average(p01, p11, i * 8) + 1) >> 1;
+  i32 b = c[0], g = c[1], r = c[2];
+  *u = static_cast<u8>(((-38 * r - 74 * g + 112 * b + 128) >> 8) + 128);
+  *v = static_cast<u8>(((112 * r - 94 * g - 18 * b + 128) >> 8) + 128);
+}
+
+inline void y_row_scalar(const u32 *src, u8 *dst, size_t count) {
+  for (size_t i = 0; i < count; ++i)
+    dst[i] = rgb_to_y(src[i]);
+}
+
+// madd leaves (B*cb + G*cg, R*cr) per pixel; adding the odd lanes to the
+// even ones gives the weighted sum for four pixels.
+inline __m128i weighted_sums_sse2(__m128i pixels, __m128i coefficients) {
+  __m128i zero = _mm_setzero_si128();
+  __m128 lo = _mm_castsi128_ps(
+      _mm_madd_epi16(_mm_unpacklo_epi8(pixels, zero), coefficients));
+  __m128 hi = _mm_castsi128_ps(
+      _mm_madd_epi16(_mm_unpackhi_epi8(pixels, zero), coefficients));
+  return _mm_add_epi32(
+      _mm_castps_si128(_mm_shuffle_ps(lo, hi, _MM_SHUFFLE(2, 0, 2, 0))),
+      _mm_castps_si128(_mm_shuffle_ps(lo, hi, _MM_SHUFFLE(3, 1, 3, 1))));
+}
+
+inline void y_row_sse2(const u32 *src, u8 *dst, size_t count) {
+  __m128i coefficients = _mm_setr_epi16(25, 129, 66, 0, 25, 129, 66, 0);
+  __m128i round = _mm_set1_epi32(128);
+  __m128i offset = _mm_set1_epi16(16);
+  size_t i = 0;
+  for (; i + 8 <= count; i += 8) {
+    __m128i a = weighted_sums_sse2(
+        _mm_loadu_si128(reinterpret_cast<const __m128i *>(src + i)),
+        coefficients);
+    __m128i b = weighted_sums_sse2(
+        _mm_loadu_si128(reinterpret_cast<const __m128i *>(src + i + 4)),
+        coefficients);
+    a = _mm_srai_epi32(_mm_add_epi32(a, round), 8);
+    b = _mm_srai_epi32(_mm_add_epi32(b, round), 8);
+    __m128i y = _mm_add_epi16(_mm_packs_epi32(a, b), offset);
+    _mm_storel_epi64(reinterpret_cast<__m128i *>(dst + i),
+                     _mm_packus_epi16(y, y));
+  }
+  y_row_scalar(src + i, dst + i, count - i);
+}
+
+GAME_TARGET_AVX2 inline void y_row_avx2(const u32 *src, u8 *dst,
+                                        size_t count) {
+  __m256i zero = _mm256_setzero_si256();
+  __m256i coefficients = _mm256_setr_epi16(25, 129, 66, 0, 25, 129, 66, 0, 25,
+                                           129, 66, 0, 25, 129, 66, 0);
+  __m256i round = _mm256_set1_epi32(128);
+  __m256i offset = _mm256_set1_epi16(16);
+  size_t i = 0;
+  for (; i + 8 <= count; i += 8) {
+    __m256i d = _mm256_loadu_si256(reinterpret_cast<const __m256i *>(src + i));
+    // Lanes hold pixels {0, 1 | 4, 5} and {2, 3 | 6, 7}; hadd restores the
+    // order.
+    __m256i lo = _mm256_madd_epi16(_mm256_unpacklo_epi8(d, zero), coefficients);
+    __m256i hi = _mm256_madd_epi16(_mm256_unpackhi_epi8(d, zero), coefficients);
+    __m256i y = _mm256_srai_epi32(
+        _mm256_add_epi32(_mm256_hadd_epi32(lo, hi), round), 8);
+    y = _mm256_add_epi16(_mm256_packs_epi32(y, y), offset);
+    y = _mm256_packus_epi16(y, y);
+    i32 first = _mm256_extract_epi32(y, 0);
+    i32 second = _mm256_extract_epi32(y, 4);
+    std::memcpy(dst + i, &first, 4);
+    std::memcpy(dst + i + 4, &second, 4);
+  }
+  y_row_sse2(src + i, dst + i, count - i);
+}
+
+inline void y_row(const u32 *src, u8 *dst, size_t count) {
+  if (utils::cpu_has_avx2())
+    y_row_avx2(src, dst, count);
+  else
+    y_row_sse2(src, dst, count);
+}
+
+// One row of chroma from two rows of pixels; count is in chroma samples.
+inline void uv_row_scalar(const u32 *row0, const u32 *row1, u8 *u, u8 *v,
+                          size_t count) {
+  for (size_t i = 0; i < count; ++i)
+    rgb_to_uv(row0[2 * i], row0[2 * i + 1], row1[2 * i], row1[2 * i + 1],
+              u + i, v + i);
+}
+
+inline void uv_row_sse2(const u32 *row0, const u32 *row1, u8 *u, u8 *v,
+                        size_t count) {
+  __m128i u_coefficients = _mm_setr_epi16(112, -74, -38, 0, 112, -74, -38, 0);
+  __m128i v_coefficients = _mm_setr_epi16(-18, -94, 112, 0, -18, -94, 112, 0);
+  __m128i round = _mm_set1_epi32(128);
+  __m128i offset = _mm_set1_epi16(128);
+  size_t i = 0;
+  for (; i + 4 <= count; i += 4) {
+    const __m128i *a = reinterpret_cast<const __m128i *>(row0 + 2 * i);
+    const __m128i *b = reinterpret_cast<const __m128i *>(row1 + 2 * i);
+    __m128 left = _mm_castsi128_ps(
+        _mm_avg_epu8(_mm_loadu_si128(a), _mm_loadu_si128(b)));
+    __m128 right = _mm_castsi128_ps(
+        _mm_avg_epu8(_mm_loadu_si128(a + 1), _mm_loadu_si128(b + 1)));
+    __m128i block = _mm_avg_epu8(
+        _mm_castps_si128(_mm_shuffle_ps(left, right, _MM_SHUFFLE(2, 0, 2, 0))),
+        _mm_castps_si128(_mm_shuffle_ps(left, right, _MM_SHUFFLE(3, 1, 3, 1))));
+
+    __m128i us = _mm_srai_epi32(
+        _mm_add_epi32(weighted_sums_sse2(block, u_coefficients), round), 8);
+    __m128i vs = _mm_srai_epi32(
+        _mm_add_epi32(weighted_sums_sse2(block, v_coefficients), round), 8);
+    __m128i uv = _mm_add_epi16(_mm_packs_epi32(us, vs), offset);
+    uv = _mm_packus_epi16(uv, uv);
+    i32 u4 = _mm_cvtsi128_si32(uv);
+    i32 v4 = _mm_cvtsi128_si32(_mm_srli_si128(uv, 4));
+    std::memcpy(u + i, &u4, 4);
+    std::memcpy(v + i, &v4, 4);
+  }
+  uv_row_scalar(row0 + 2 * i, row1 + 2 * i, u + i, v + i, count - i);
+}
+
+// Converts an even-sized frame to planar I420 (Y, then U, then V).
+inline void rgb_to_i420(const u32 *pixels, i32 pitch, i32 width, i32 height,
+                        u8 *out) {
+  u8 *y = out;
+  u8 *u = y + static_cast<size_t>(width) * height;
+  u8 *v = u + static_cast<size_t>(width / 2) * (height / 2);
+  for (i32 row = 0; row < height; ++row)
+    y_row(pixels + static_cast<size_t>(row) * pitch,
+          y + static_cast<size_t>(row) * width, width);
+  for (i32 row = 0; row < height / 2; ++row) {
+    const u32 *row0 = pixels + static_cast<size_t>(2 * row) * pitch;
+    uv_row_sse2(row0, row0 + pitch, u + static_cast<size_t>(row) * (width / 2),
+                v + static_cast<size_t>(row) * (width / 2), width / 2);
+  }
+}
+
+// Records the finished frames at a fixed frame rate. The game thread copies
+// each due frame into a preallocated ring and never waits: when the writer
+// falls behind the frame is dropped and counted. A writer thread converts
+// and streams the ring to disk. Frames the game was too slow to produce are
+// filled by repeating the previous one.
+class Recorder {
+public:
+  static constexpr size_t RING_FRAMES = 8;
+  static constexpr i32 FPS = 60;
+
+  std::atomic<u64> written = 0;
+  std::atomic<u64> dropped = 0;
+  std::atomic<u64> repeated = 0;
+
+  ~Recorder() {
+    stop();
+    join();
+  }
+
+  bool recording() const { return active; }
+
+  bool start(const render::RenderState &state, const std::string &directory,
+             Format format_) {
+    stop();
+    join();
+    // 4:2:0 needs whole 2x2 blocks; an odd last row or column is cropped.
+    width = state.width & ~1;
+    height = state.height & ~1;
+    if (!state.memory || width <= 0 || height <= 0)
+      return false;
+
+    std::filesystem::create_directories(directory);
+    std::time_t now = std::time(nullptr);
+    std::ostringstream name;
+    name << directory << "/match_"
+         << std::put_time(std::localtime(&now), "%Y%m%d_%H%M%S")
+         << format_extensions[format_];
+    file = std::fopen(name.str().c_str(), "wb");
+    if (!file)
+      return false;
+    std::setvbuf(file, nullptr, _IOFBF, 1 << 22);
+    path = name.str();
+
+    format = format_;
+    if (format == FORMAT_Y4M)
+      std::fprintf(file,
+                   "YUV4MPEG2 W%d H%d F%d:1 Ip A1:1 C420jpeg "
+                   "XCOLORRANGE=LIMITED\n",
+                   width, height, FPS);
+
+    size_t frame_pixels = static_cast<size_t>(width) * height;
+    for (Slot &slot : ring)
+      slot.pixels.resize(frame_pixels);
+    head.store(0);
+    tail.store(0);
+    written = dropped = repeated = 0;
+    next_due = 0;
+    started = utils::query_counter();
+    stopping = false;
+    active = true;
+    writer = std::thread([this] { write_frames(); });
+    return true;
+  }
+
+  // Called by the game thread with the finished frame.
+  void submit(const render::RenderState &state) {
+    if (!active)
+      return;
+    if ((state.width & ~1) != width || (state.height & ~1) != height) {
+      // A Y4M stream cannot change size.
+      stop();
+      return;
+    }
+
+    i64 now = utils::query_counter();
+    i64 period = utils::counter_frequency() / FPS;
+    if (next_due == 0)
+      next_due = now;
+    if (now < next_due)
+      return;
+    u64 owed = static_cast<u64>((now - next_due) / period) + 1;
+    next_due += static_cast<i64>(owed) * period;
+
+    u64 h = head.load(std::memory_order_relaxed);
+    if (h - tail.load(std::memory_order_acquire) == RING_FRAMES) {
+      dropped += owed;
+      return;
+    }
+    Slot &slot = ring[h % RING_FRAMES];
+    const u32 *pixels = static_cast<const u32 *>(state.memory);
+    for (i32 y = 0; y < height; ++y)
+      std::memcpy(slot.pixels.data() + static_cast<size_t>(y) * width,
+                  pixels + static_cast<size_t>(y) * state.pitch,
+                  static_cast<size_t>(width) * sizeof(u32));
+    slot.count = static_cast<u32>(std::min<u64>(owed, FPS));
+    head.store(h + 1, std::memory_order_release);
+    wake.notify_one();
+  }
+
+  // Returns at once; the writer drains the ring and closes the file.
+  void stop() {
+    if (!active)
+      return;
+    active = false;
+    stopping = true;
+    wake.notify_one();
+  }
+
+  void render_overlay(render::Renderer &renderer) const {
+    if (!active)
+      return;
+    double seconds = static_cast<double>(utils::query_counter() - started) /
+                     static_cast<double>(utils::counter_frequency());
+    u64 queued = head.load(std::memory_order_relaxed) -
+                 tail.load(std::memory_order_relaxed);
+    renderer.render_text(
+        std::format("REC {:.0f}S  {} FRAMES  {} REPEATED  {} DROPPED  "
+                    "QUEUE {} OF {}",
+                    seconds, written.load(), repeated.load(), dropped.load(),
+                    queued, RING_FRAMES),
+        0.0f, 44.0f, 0.35f, 0.35f, 0x00FF6B6B);
+  }
+
+private:
+  struct Slot {
+    std::vector<u32> pixels;
+    u32 count = 1;
+  };
+
+  void join() {
+    if (writer.joinable())
+      writer.join();
+  }
+
+  void write_frames() {
+    std::vector<u8> yuv(static_cast<size_t>(width) * height * 3 / 2);
+    for (;;) {
+      u64 t = tail.load(std::memory_order_relaxed);
+      if (t == head.load(std::memory_order_acquire)) {
+        if (stopping)
+          break;
+        // The game thread notifies without taking the lock, so a wakeup
+        // can be missed; the timeout bounds the delay.
+        std::unique_lock<std::mutex> lock(mutex);
+        wake.wait_for(lock, std::chrono::milliseconds(5));
+        continue;
+      }
+
+      const Slot &slot = ring[t % RING_FRAMES];
+      const void *data = slot.pixels.data();
+      size_t size = slot.pixels.size() * sizeof(u32);
+      if (format == FORMAT_Y4M) {
+        rgb_to_i420(slot.pixels.data(), width, width, height, yuv.data());
+        data = yuv.data();
+        size = yuv.size();
+      }
+      for (u32 i = 0; i < slot.count; ++i) {
+        if (format == FORMAT_Y4M)
+          std::fputs("FRAME\n", file);
+        std::fwrite(data, 1, size, file);
+      }
+      written += slot.count;
+      repeated += slot.count - 1;
+      tail.store(t + 1, std::memory_order_release);
+    }
+    std::fclose(file);
+    file = nullptr;
+  }
+
+  Format format = FORMAT_Y4M;
+  i32 width = 0;
+  i32 height = 0;
+  std::string path;
+  std::FILE *file = nullptr;
+
+  Slot ring[RING_FRAMES];
+  std::atomic<u64> head = 0;
+  std::atomic<u64> tail = 0;
+  i64 next_due = 0;
+  i64 started = 0;
+
+  bool active = false;
+  std::atomic<bool> stopping = false;
+  std::thread writer;
+  std::mutex mutex;
+  std::condition_variable wake;
+};
+
+// Keeps the last few seconds of play as small palette-indexed frames, so a
+// clip can be saved after the moment happened. The game thread only samples
+// and quantizes one frame per clip tick. Saving hands the whole ring to a
+// background thread, which encodes the GIF on its own thread pool at below
+// normal priority and leaves a core free for the game.
+class ClipRecorder {
+public:
+  static constexpr i32 FPS = 20;
+  static constexpr i32 MAX_WIDTH = 640;
+  static constexpr double OVERLAY_SECONDS = 5.0;
+
+  ~ClipRecorder() { join(); }
+
+  // Zero seconds turns clip recording off.
+  void configure(i32 seconds) {
+    capacity = static_cast<size_t>(std::max(0, seconds)) * FPS;
+    frames.clear();
+    head = count = 0;
+  }
+
+  bool encoding() const { return busy.load(std::memory_order_acquire); }
+
+  // Called by the game thread with the finished frame.
+  void submit(const render::Renderer &renderer) {
+    if (capacity == 0)
+      return;
+    i64 now = utils::query_counter();
+    i64 period = utils::counter_frequency() / FPS;
+    if (next_due == 0)
+      next_due = now;
+    if (now < next_due)
+      return;
+    next_due += ((now - next_due) / period + 1) * period;
+    sample(renderer, now);
+  }
+
+  // Adds the frame to the ring. It is sampled without filtering so every
+  // pixel keeps a colour the game drew.
+  void sample(const render::Renderer &renderer, i64 timestamp) {
+    const render::RenderState &state = renderer.render_state;
+    if (capacity == 0 || !state.memory || state.width <= 0 ||
+        state.height <= 0)
+      return;
+
+    i32 step = (state.width + MAX_WIDTH - 1) / MAX_WIDTH;
+    if (state.width / step != width || state.height / step != height) {
+      width = state.width / step;
+      height = state.height / step;
+      frames.clear();
+      head = count = 0;
+      palette.reset();
+    }
+
+    if (frames.size() < capacity)
+      frames.resize(capacity);
+    gif::Frame &frame = frames[head];
+    frame.pixels.resize(static_cast<size_t>(width) * height);
+    frame.timestamp = timestamp;
+    u8 *out = frame.pixels.data();
+
+    if (renderer.indexed()) {
+      // The frame is still palette indices; translate the game's palette
+      // once instead of every pixel.
+      std::array<u8, 256> lookup = {};
+      for (u32 i = 0; i < renderer.palette.count; ++i)
+        lookup[i] = palette.index_of(
+            render::apply_theme(renderer.palette.colors[i], renderer.theme));
+      for (i32 y = 0; y < height; ++y) {
+        const u8 *row = state.indices + y * step * state.index_pitch;
+        for (i32 x = 0; x < width; ++x)
+          *out++ = lookup[row[x * step]];
+      }
+    } else {
+      const u32 *pixels = static_cast<const u32 *>(state.memory);
+      for (i32 y = 0; y < height; ++y) {
+        const u32 *row = pixels + static_cast<size_t>(y) * step * state.pitch;
+        for (i32 x = 0; x < width; ++x)
+          *out++ = palette.index_of(row[x * step]);
+      }
+    }
+
+    head = (head + 1) % capacity;
+    count = std::min(count + 1, capacity);
+  }
+
+  // Starts encoding the buffered seconds to directory/clip_<time>.gif. The
+  // ring starts over empty; returns false while a clip is still encoding.
+  bool save(const std::string &directory) {
+    if (encoding() || count == 0)
+      return false;
+    join();
+
+    std::filesystem::create_directories(directory);
+    std::time_t now = std::time(nullptr);
+    std::ostringstream name;
+    name << directory << "/clip_"
+         << std::put_time(std::localtime(&now), "%Y%m%d_%H%M%S") << ".gif";
+
+    gif::Clip clip = take();
+    busy.store(true, std::memory_order_release);
+    saved_at = utils::query_counter();
+    encoder = std::thread([this, clip = std::move(clip), path = name.str()] {
+      SetThreadPriority(GetCurrentThread(), THREAD_PRIORITY_BELOW_NORMAL);
+      size_t workers = utils::ThreadPool::default_workers();
+      utils::ThreadPool pool(workers > 0 ? workers - 1 : 0);
+
+      i64 begin = utils::query_counter();
+      std::vector<u8> bytes = gif::encode(clip, pool, &last);
+      double seconds = static_cast<double>(utils::query_counter() - begin) /
+                       static_cast<double>(utils::counter_frequency());
+
+      std::ofstream out(path, std::ios::binary | std::ios::trunc);
+      out.write(reinterpret_cast<const char *>(bytes.data()), bytes.size());
+      last_ok = static_cast<bool>(out);
+      last_seconds = seconds;
+      last_threads = pool.concurrency();
+      last_path = path;
+      write_csv("stats", clip);
+      busy.store(false, std::memory_order_release);
+    });
+    return true;
+  }
+
+  void render_overlay(render::Renderer &renderer) const {
+    if (saved_at == 0)
+      return;
+    if (encoding()) {
+      renderer.render_text("SAVING GIF CLIP", 0.0f, 27.0f, 0.35f, 0.35f,
+                           0x00FFCC66);
+      return;
+    }
+    double since = static_cast<double>(utils::query_counter() - saved_at) /
+                   static_cast<double>(utils::counter_frequency());
+    if (since > OVERLAY_SECONDS + last_seconds)
+      return;
+    if (!last_ok) {
+      renderer.render_text("GIF CLIP FAILED", 0.0f, 27.0f, 0.35f, 0.35f,
+                           0x00FF6B6B);
+      return;
+    }
+    renderer.render_text(
+        std::format("GIF {} FRAMES  {:.0f} KB  {:.1f}% OF RAW  {:.0f} MS  "
+                    "{:.0f} FPS ON {} THREADS",
+                    last.frames, last.bytes / 1024.0,
+                    100.0 * last.bytes / std::max<u64>(last.raw_bytes, 1),
+                    last_seconds * 1000.0, last.frames / last_seconds,
+                    last_threads),
+        0.0f, 27.0f, 0.35f, 0.35f, 0x00FFCC66);
+  }
+
+  // Moves the buffered frames out, oldest first, and empties the ring.
+  gif::Clip take() {
+    gif::Clip clip;
+    clip.width = width;
+    clip.height = height;
+    clip.fps = FPS;
+    clip.frequency = utils::counter_frequency();
+    clip.palette = palette.entries();
+    clip.frames.reserve(count);
+    for (size_t i = 0; i < count; ++i)
+      clip.frames.push_back(
+          std::move(frames[(head + capacity - count + i) % capacity]));
+    frames.clear();
+    head = count = 0;
+    return clip;
+  }
+
+private:
+  void join() {
+    if (encoder.joinable())
+      encoder.join();
+  }
+
+  // One row per saved clip, appended to stats/gif.csv.
+  void write_csv(const std::string &directory, const gif::Clip &clip) const {
+    std::filesystem::create_directories(directory);
+    std::string path = directory + "/gif.csv";
+    bool exists = std::filesystem::exists(path);
+    std::ofstream out(path, std::ios::app);
+    if (!out)
+      return;
+    if (!exists)
+      out << "file,width,height,frames,images,bytes,raw_bytes,encode_ms,"
+             "threads,frames_per_s,mpixels_per_s\n";
+    double pixels = static_cast<double>(clip.width) * clip.height *
+                    static_cast<double>(last.frames);
+    out << last_path << "," << clip.width << "," << clip.height << ","
+        << last.frames << "," << last.images << "," << last.bytes << ","
+        << last.raw_bytes << "," << last_seconds * 1000.0 << ","
+        << last_threads << "," << last.frames / last_seconds << ","
+        << pixels / last_seconds / 1e6 << "\n";
+  }
+
+  gif::Palette palette;
+  std::vector<gif::Frame> frames;
+  size_t capacity = 0;
+  size_t head = 0;
+  size_t count = 0;
+  i32 width = 0;
+  i32 height = 0;
+  i64 next_due = 0;
+
+  // Written by the encoder thread before busy is cleared.
+  gif::Stats last;
+  double last_seconds = 0.0;
+  size_t last_threads = 0;
+  bool last_ok = false;
+  std::string last_path;
+
+  i64 saved_at = 0;
+  std::atomic<bool> busy = false;
+  std::thread encoder;
+};
+
+enum ImageFormat { IMAGE_PNG, IMAGE_QOI, IMAGE_FORMAT_COUNT };
+
+const char *image_format_names[IMAGE_FORMAT_COUNT] = {"png", "qoi"};
+const char *image_format_extensions[IMAGE_FORMAT_COUNT] = {".png", ".qoi"};
+
+// B, G, R, X pixels to packed R, G, B bytes, as PNG rows want them.
+inline void bgrx_to_rgb_scalar(const u32 *src, u8 *dst, size_t count) {
+  for (size_t i = 0; i < count; ++i) {
+    u32 c = src[i];
+    dst[3 * i] = static_cast<u8>(c >> 16);
+    dst[3 * i + 1] = static_cast<u8>(c >> 8);
+    dst[3 * i + 2] = static_cast<u8>(c);
+  }
+}
+
+// pshufb packs each lane's four pixels into its low 12 bytes and a
+// cross-lane permute closes the gap. Every store writes 8 bytes past the
+// 24 it produces, so the loop leaves room for them before the tail.
+GAME_TARGET_AVX2 inline void bgrx_to_rgb_avx2(const u32 *src, u8 *dst,
+                                              size_t count) {
+  __m256i shuffle = _mm256_setr_epi8(2, 1, 0, 6, 5, 4, 10, 9, 8, 14, 13, 12,
+                                     -1, -1, -1, -1, 2, 1, 0, 6, 5, 4, 10, 9,
+                                     8, 14, 13, 12, -1, -1, -1, -1);
+  __m256i compact = _mm256_setr_epi32(0, 1, 2, 4, 5, 6, 3, 7);
+  size_t i = 0;
+  for (; i + 11 <= count; i += 8) {
+    __m256i p = _mm256_loadu_si256(reinterpret_cast<const __m256i *>(src + i));
+    p = _mm256_permutevar8x32_epi32(_mm256_shuffle_epi8(p, shuffle), compact);
+    _mm256_storeu_si256(reinterpret_cast<__m256i *>(dst + 3 * i), p);
+  }
+  bgrx_to_rgb_scalar(src + i, dst + 3 * i, count - i);
+}
+
+inline void bgrx_to_rgb(const u32 *src, u8 *dst, size_t count) {
+  if (utils::cpu_has_avx2())
+    bgrx_to_rgb_avx2(src, dst, count);
+  else
+    bgrx_to_rgb_scalar(src, dst, count);
+}
+
+inline std::vector<u8> encode_image(const u32 *pixels, i32 width, i32 height,
+                                    i32 pitch, ImageFormat format) {
+  if (format == IMAGE_QOI)
+    return image::encode_qoi(pixels, width, height, pitch);
+  return image::encode_png(width, height, [&](i32 y, u8 *row) {
+    bgrx_to_rgb(pixels + static_cast<size_t>(y) * pitch, row, width);
+  });
+}
+
+// Saves screenshots without holding up the frame. The game thread copies
+// the frame, padding and all, into a free pooled buffer with one memcpy and
+// queues it; a worker thread converts, encodes and writes it. When every
+// buffer is still queued the shot is skipped rather than waited for.
+class Screenshotter {
+public:
+  static constexpr size_t BUFFERS = 3;
+  static constexpr double OVERLAY_SECONDS = 3.0;
+
+  Screenshotter() {
+    for (size_t i = 0; i < BUFFERS; ++i)
+      free_buffers.push_back(i);
+    worker = std::thread([this] { work(); });
+  }
+
+  ~Screenshotter() {
+    {
+      std::lock_guard<std::mutex> lock(mutex);
+      stopping = true;
+    }
+    wake.notify_one();
+    worker.join();
+  }
+
+  Screenshotter(const Screenshotter &) = delete;
+  Screenshotter &operator=(const Screenshotter &) = delete;
+
+  bool capture(const render::RenderState &state, const std::string &directory,
+               ImageFormat format) {
+    if (!state.memory || state.width <= 0 || state.height <= 0)
+      return false;
+    size_t index;
+    {
+      std::lock_guard<std::mutex> lock(mutex);
+      if (free_buffers.empty()) {
+        skipped++;
+        return false;
+      }
+      index = free_buffers.back();
+      free_buffers.pop_back();
+    }
+
+    Shot &shot = shots[index];
+    size_t pixels = static_cast<size_t>(state.pitch) * state.height;
+    if (shot.pixels.size() < pixels)
+      shot.pixels.resize(pixels);
+    std::memcpy(shot.pixels.data(), state.memory, pixels * sizeof(u32));
+    shot.width = state.width;
+    shot.height = state.height;
+    shot.pitch = state.pitch;
+    shot.format = format;
+
+    std::time_t now = std::time(nullptr);
+    std::ostringstream name;
+    name << directory << "/screenshot_"
+         << std::put_time(std::localtime(&now), "%Y%m%d_%H%M%S") << "_"
+         << sequence++ << image_format_extensions[format];
+    shot.path = name.str();
+    shot.directory = directory;
+
+    {
+      std::lock_guard<std::mutex> lock(mutex);
+      pending.push_back(index);
+    }
+    wake.notify_one();
+    return true;
+  }
+
+  void render_overlay(render::Renderer &renderer) const {
+    std::lock_guard<std::mutex> lock(mutex);
+    if (finished_at == 0)
+      return;
+    double since = static_cast<double>(utils::query_counter() - finished_at) /
+                   static_cast<double>(utils::counter_frequency());
+    if (since > OVERLAY_SECONDS)
+      return;
+    std::string text =
+        last_ok ? std::format("SCREENSHOT {:.0f} KB {}  ENCODE {:.0f} MS  "
+                              "WRITE {:.0f} MS  {} SKIPPED",
+                              last_bytes / 1024.0, last_format, last_encode_ms,
+                              last_write_ms, skipped)
+                : "SCREENSHOT FAILED"s;
+    renderer.render_text(text, 0.0f, 24.0f, 0.35f, 0.35f, 0x00AAAAAA);
+  }
+
+private:
+  struct Shot {
+    std::vector<u32> pixels;
+    i32 width = 0;
+    i32 height = 0;
+    i32 pitch = 0;
+    ImageFormat format = IMAGE_PNG;
+    std::string directory;
+    std::string path;
+  };
+
+  void work() {
+    for (;;) {
+      size_t index;
+      {
+        std::unique_lock<std::mutex> lock(mutex);
+        wake.wait(lock, [this] { return stopping || !pending.empty(); });
+        if (pending.empty())
+          return;
+        index = pending.front();
+        pending.erase(pending.begin());
+      }
+
+      Shot &shot = shots[index];
+      i64 begin = utils::query_counter();
+      std::vector<u8> bytes = encode_image(shot.pixels.data(), shot.width,
+                                           shot.height, shot.pitch,
+                                           shot.format);
+      i64 encoded = utils::query_counter();
+      std::filesystem::create_directories(shot.directory);
+      std::ofstream out(shot.path, std::ios::binary | std::ios::trunc);
+      out.write(reinterpret_cast<const char *>(bytes.data()), bytes.size());
+      out.close();
+      i64 written = utils::query_counter();
+
+      double ms_per_tick =
+          1000.0 / static_cast<double>(utils::counter_frequency());
+      std::lock_guard<std::mutex> lock(mutex);
+      last_ok = static_cast<bool>(out);
+      last_bytes = bytes.size();
+      last_format = shot.format == IMAGE_QOI ? "QOI" : "PNG";
+      last_encode_ms = (encoded - begin) * ms_per_tick;
+      last_write_ms = (written - encoded) * ms_per_tick;
+      finished_at = written;
+      free_buffers.push_back(index);
+    }
+  }
+
+  Shot shots[BUFFERS];
+  std::vector<size_t> free_buffers;
+  std::vector<size_t> pending;
+  u64 sequence = 0;
+  bool stopping = false;
+
+  u64 skipped = 0;
+  bool last_ok = false;
+  size_t last_bytes = 0;
+  const char *last_format = "";
+  double last_encode_ms = 0.0;
+  double last_write_ms = 0.0;
+  i64 finished_at = 0;
+
+  mutable std::mutex mutex;
+  std::condition_variable wake;
+  std::thread worker;
+};
+} // namespace capture
+
 namespace audio {
 
 bool enabled = true;
 bool initialized = false;
 
+// Opening the device and the music is slow enough to hold up the first
+// frame, so it runs on a thread of its own; update() picks up the result on
+// the main thread. The effects are decoded there too, right after the
+// engine opens, so no play has to wait on a decoder.
+std::thread loader;
+std::atomic<bool> loaded = false;
+
 float music_volume = 1.0f;
 float sfx_volume = 1.0f;
 
@@ -321,38 +2882,49 @@ struct SoundPool {
   }
 };
 
-std::array<std::string, 10> sound_filenames = {
-    "navigation.mp3",  "paddle_hit.mp3",     "setting.mp3",        "button.mp3",
-    "button_back.mp3", "go_tick.mp3",        "countdown_tick.mp3", "shine.mp3",
-    "winner.mp3",      "game_timer_tick.mp3"};
-
 std::unordered_map<std::string, SoundPool> sfx_sounds;
+std::vector<std::string> embedded_sounds;
+
+// A sound packed into the executable is handed to miniaudio under its file
+// name, so loading it by that name reads the unpacked bytes instead.
+void use_embedded(const std::string &path) {
+  std::span<const u8> bytes = assets::embedded().get(path);
+  if (bytes.empty())
+    return;
+  if (ma_resource_manager_register_encoded_data(
+          ma_engine_get_resource_manager(&engine), path.c_str(),
+          bytes.data(), bytes.size()) == MA_SUCCESS)
+    embedded_sounds.push_back(path);
+}
+
+const char *effects[] = {"button.mp3",          "button_back.mp3",
+                         "countdown_tick.mp3",  "game_timer_tick.mp3",
+                         "go_tick.mp3",         "navigation.mp3",
+                         "paddle_hit.mp3",      "setting.mp3",
+                         "shine.mp3",           "winner.mp3"};
 
 void load_sfx(const std::string &filename) {
+  // The first play must not be held back by the cooldown.
   SoundPool pool;
+  pool.timer = pool.cooldown;
+  std::string path = std::format("assets/sfx/{}", filename);
+  use_embedded(path);
   for (int i = 0; i < 3; ++i) {
     ma_sound *s = new ma_sound;
-    if (ma_sound_init_from_file(&engine,
-                                std::format("assets/sfx/{}", filename).c_str(),
-                                0, nullptr, nullptr, s) == MA_SUCCESS) {
+    if (ma_sound_init_from_file(&engine, path.c_str(), 0, nullptr, nullptr,
+                                s) == MA_SUCCESS) {
       ma_sound_set_volume(s, sfx_volume);
       pool.sounds.push_back(s);
     } else {
       delete s;
     }
   }
+  if (pool.sounds.empty())
+    GAME_LOG(ERROR, "cannot load sound {}", path);
 
   sfx_sounds[filename] = std::move(pool);
 }
 
-void update(float dt) {
-  if (!initialized)
-    return;
-
-  for (auto &[_, pool] : sfx_sounds)
-    pool.update(dt);
-}
-
 void update_music_volume() {
   if (!initialized)
     return;
@@ -368,12 +2940,17 @@ void update_sfx_volume() {
 }
 
 void play_effect(const std::string &filename) {
+  flight::recorder.sound(filename);
   if (!initialized)
     return;
 
   auto it = sfx_sounds.find(filename);
-  if (it != sfx_sounds.end())
-    it->second.play();
+  if (it == sfx_sounds.end()) {
+    GAME_LOG(WARN, "effect {} was not preloaded", filename);
+    load_sfx(filename);
+    it = sfx_sounds.find(filename);
+  }
+  it->second.play();
 }
 
 void set_enabled(bool state) {
@@ -387,8 +2964,31 @@ void set_enabled(bool state) {
     ma_sound_stop(&music);
 }
 
+void update(float dt) {
+  if (!initialized) {
+    if (!loaded)
+      return;
+    // The settings may have changed while the device was opening.
+    loader.join();
+    initialized = true;
+    update_music_volume();
+    update_sfx_volume();
+    set_enabled(enabled);
+  }
+
+  u32 voices = ma_sound_is_playing(&music) ? 1 : 0;
+  for (auto &[_, pool] : sfx_sounds) {
+    pool.update(dt);
+    for (ma_sound *s : pool.sounds)
+      voices += ma_sound_is_playing(s) ? 1 : 0;
+  }
+  metrics::audio_voices.set(voices);
+}
+
 void cleanup() {
-  if (!initialized)
+  if (loader.joinable())
+    loader.join();
+  if (!loaded)
     return;
 
   for (auto &[_, pool] : sfx_sounds) {
@@ -401,31 +3001,47 @@ void cleanup() {
   sfx_sounds.clear();
 
   ma_sound_uninit(&music);
+  for (const std::string &path : embedded_sounds)
+    ma_resource_manager_unregister_data(
+        ma_engine_get_resource_manager(&engine), path.c_str());
+  embedded_sounds.clear();
   ma_engine_uninit(&engine);
 
+  loaded = false;
   initialized = false;
 }
 
-void init() {
-  if (initialized)
-    return;
-
-  if (ma_engine_init(nullptr, &engine) != MA_SUCCESS)
-    return;
-
-  for (auto &fn : sound_filenames)
-    load_sfx(fn);
+bool open() {
+  ma_result result = ma_engine_init(nullptr, &engine);
+  if (result != MA_SUCCESS) {
+    GAME_LOG(ERROR, "audio engine init failed with {}", result);
+    return false;
+  }
 
-  if (ma_sound_init_from_file(&engine, "assets/music/music.mp3", 0, nullptr,
-                              nullptr, &music) == MA_SUCCESS) {
-    update_music_volume();
+  use_embedded("assets/music/music.mp3");
+  result = ma_sound_init_from_file(&engine, "assets/music/music.mp3", 0,
+                                   nullptr, nullptr, &music);
+  if (result == MA_SUCCESS)
     ma_sound_set_looping(&music, MA_TRUE);
-    ma_sound_set_volume(&music, music_volume);
-    ma_sound_start(&music);
-  }
+  else
+    GAME_LOG(ERROR, "cannot load music, error {}", result);
+
+  for (const char *effect : effects)
+    load_sfx(effect);
+  return true;
+}
 
-  initialized = true;
+void init() {
+  if (initialized || loader.joinable())
+    return;
+
+  loader = std::thread([] {
+    i64 start = utils::query_counter();
+    loaded = open();
+    telemetry::startup.add("audio", start, utils::query_counter(), true);
+  });
 }
+
 } // namespace audio
 
 namespace objects {
@@ -452,11 +3068,13 @@ struct PlayerController {
   float dp;
   float ddp_speed;
   float damping;
+  i8 push = 0; // the last update's input: -1 up, 1 down, 0 neither
 
   void init(float x, float _damping) {
     pos.x = x;
     pos.y = 0.0f;
     dp = 0.0f;
+    push = 0;
     ddp_speed = 1400;
     damping = _damping;
   }
@@ -468,6 +3086,7 @@ struct PlayerController {
   void update_ddp_damping(float &ddp) { ddp -= dp * damping; }
 
   void update(float dt, float &ddp) {
+    push = ddp < 0.0f ? -1 : ddp > 0.0f ? 1 : 0;
     update_ddp_damping(ddp);
     update_pos_y(dt, ddp);
     update_dp(dt, ddp);
@@ -484,6 +3103,7 @@ struct Player {
       : renderer(&renderer), arrow_controls(arrow_controls_) {}
 
   render::Renderer *renderer;
+  utils::Random *random = nullptr;
   PlayerController controller;
   bool arrow_controls;
   bool ai_mode = true;
@@ -497,13 +3117,51 @@ struct Player {
 
   void increment_score() { score++; }
 
-  void handle_input(float dt, float &ddp) {
-    if (input::is_down(arrow_controls ? input::BUTTON_UP_ARROW
-                                      : input::BUTTON_UP))
-      controller.move_up(ddp);
-    if (input::is_down(arrow_controls ? input::BUTTON_DOWN_ARROW
-                                      : input::BUTTON_DOWN))
-      controller.move_down(ddp);
+  // Integrates the frame in sub-steps split at each key transition, so a
+  // press early in the frame accelerates the paddle for most of it.
+  input::Key up_key() const {
+    return arrow_controls ? input::BUTTON_UP_ARROW : input::BUTTON_UP;
+  }
+  input::Key down_key() const {
+    return arrow_controls ? input::BUTTON_DOWN_ARROW : input::BUTTON_DOWN;
+  }
+
+  void handle_input(float dt) {
+    input::Key up = up_key();
+    input::Key down = down_key();
+    trace::latency.mark(trace::STAGE_INPUT, up);
+    trace::latency.mark(trace::STAGE_INPUT, down);
+
+    bool up_held = input::frame_events.down_at_begin[up];
+    bool down_held = input::frame_events.down_at_begin[down];
+    float t = 0.0f;
+
+    auto step_until = [&](float until) {
+      if (until <= t)
+        return;
+      float ddp = 0.0f;
+      if (up_held)
+        controller.move_up(ddp);
+      if (down_held)
+        controller.move_down(ddp);
+      controller.update(until - t, ddp);
+      t = until;
+    };
+
+    for (size_t i = 0; i < input::frame_events.count; ++i) {
+      const input::InputEvent &event = input::frame_events.events[i];
+      if (event.key != up && event.key != down)
+        continue;
+      step_until(input::frame_events.fraction(event) * dt);
+      if (event.key == up)
+        up_held = event.is_down;
+      else
+        down_held = event.is_down;
+    }
+    step_until(dt);
+
+    trace::latency.mark(trace::STAGE_SIMULATE, up);
+    trace::latency.mark(trace::STAGE_SIMULATE, down);
   }
 
   void predict_ball(Player &self, Vector2 &ball_vel, Vector2 &ball_pos,
@@ -532,11 +3190,10 @@ struct Player {
 
         switch (level) {
         case 1: {
-          float inacurracy =
-              (static_cast<float>(rand()) / RAND_MAX) * 12.0f - 16.0f;
+          float inacurracy = random->unit() * 12.0f - 16.0f;
           final_y += inacurracy;
 
-          if ((rand() % 15) == 0) {
+          if ((random->next() % 15) == 0) {
             final_y = TOP;
           }
 
@@ -544,11 +3201,10 @@ struct Player {
           break;
         }
         case 2: {
-          float inacurracy =
-              (static_cast<float>(rand()) / RAND_MAX) * 12.0f - 10.0f;
+          float inacurracy = random->unit() * 12.0f - 10.0f;
           final_y += inacurracy;
 
-          if ((rand() % 5) == 0) {
+          if ((random->next() % 5) == 0) {
             final_y = TOP;
           }
 
@@ -599,7 +3255,7 @@ struct Player {
 
   void run_ai_mode(Player &self, Vector2 &ball_pos, Vector2 &ball_vel,
                    float &ddp, AIDifficulty difficulty) {
-
+    perf::Scope zone(perf::ZONE_AI);
     if (!((self.controller.pos.x > 0.0f && ball_pos.x > 0.0f) ||
           (self.controller.pos.x < 0.0f && ball_pos.x < 0.0f))) {
       return;
@@ -681,13 +3337,13 @@ struct Player {
 
   void update(float dt, Vector2 &ball_pos, Vector2 &ball_vel,
               AIDifficulty difficulty = Medium) {
-    float ddp = 0.0f;
-
-    if (ai_mode)
+    if (ai_mode) {
+      float ddp = 0.0f;
       run_ai_mode(*this, ball_pos, ball_vel, ddp, difficulty);
-    else
-      handle_input(dt, ddp);
-    controller.update(dt, ddp);
+      controller.update(dt, ddp);
+    } else {
+      handle_input(dt);
+    }
     add_collision();
 
     if (pulse_timer > 0.0f) {
@@ -719,6 +3375,9 @@ struct BallController {
 
   bool scored = false;
   int winner = 0;
+  u32 hits = 0;
+  u32 ticks = 0;
+  analytics::HitLog *hit_log = nullptr;
 
   void init(Player *player1, Player *player2) {
     pos.x = 0.0f;
@@ -734,6 +3393,8 @@ struct BallController {
 
     scored = false;
     winner = 0;
+    hits = 0;
+    ticks = 0;
   }
 
   void add_collision(Player *player, Ball &ball);
@@ -751,6 +3412,7 @@ struct ParticleBurst {
   std::vector<Particle> particles;
   bool active = false;
   render::Renderer *renderer = nullptr;
+  utils::Random *random = nullptr;
 
   int count = 80;
   float lifetime = 1.0f;
@@ -775,18 +3437,18 @@ struct ParticleBurst {
     particles.reserve(count);
 
     for (int i = 0; i < count; i++) {
-      float angle = ((float)std::rand() / RAND_MAX) * 2.0f * 3.14159265f;
-      float speed =
-          speed_min + ((float)std::rand() / RAND_MAX) * (speed_max - speed_min);
-      particles.push_back(
-          {x, y, std::cos(angle) * speed, std::sin(angle) * speed,
-           lifetime * (0.5f + ((float)std::rand() / RAND_MAX) * 0.5f)});
+      float angle = random->unit() * 2.0f * 3.14159265f;
+      float speed = speed_min + random->unit() * (speed_max - speed_min);
+      particles.push_back({x, y, std::cos(angle) * speed,
+                           std::sin(angle) * speed,
+                           lifetime * (0.5f + random->unit() * 0.5f)});
     }
   }
 
   void update(float dt) {
     if (!active)
       return;
+    perf::Scope zone(perf::ZONE_PARTICLES);
     for (auto &p : particles) {
       p.pos.x += p.vel.x * dt;
       p.pos.y += p.vel.y * dt;
@@ -803,14 +3465,11 @@ struct ParticleBurst {
   void render() {
     if (!active || !renderer)
       return;
+    u32 color = pos.x > 0.0f ? 0x004DABF7 : 0x00FF6B6B;
     for (auto &p : particles) {
       float a = utils::clamp(0.0f, p.life / lifetime, 1.0f);
-      u8 r = static_cast<u8>((pos.x > 0.0f ? 77 : 255) * a);
-      u8 g = static_cast<u8>((pos.x > 0.0f ? 171 : 107) * a);
-      u8 b = static_cast<u8>((pos.x > 0.0f ? 247 : 107) * a);
-      u32 color = (r << 16) | (g << 8) | b;
-
-      renderer->render_rect(p.pos.x, p.pos.y, 1.0f, 1.0f, color);
+      renderer->blend_rect(p.pos.x, p.pos.y, 1.0f, 1.0f, color, a,
+                           render::BLEND_ADDITIVE);
     }
   }
 
@@ -844,12 +3503,7 @@ struct FlashEffect {
   void render() {
     if (!active || !renderer)
       return;
-    u8 a = (u8)(utils::clamp(0.0f, alpha, 1.0f) * 255.0f);
-    u8 r = (u8)(255 * (0.3f + 0.7f * alpha));
-    u8 g = r;
-    u8 b = r;
-    u32 color = (r << 16) | (g << 8) | b;
-    renderer->render_rect(0.0f, 0.0f, 100.0f, 100.0f, color);
+    renderer->blend_screen(0x00FFFFFF, alpha * 0.8f, render::BLEND_ALPHA);
   }
 
   bool finished() const { return !active; }
@@ -918,6 +3572,10 @@ inline void BallController::add_collision(Player *player, Ball &ball) {
     pos.x = 80.0f + size;
     audio::play_effect("shine.mp3");
     player1->increment_score();
+    GAME_LOG(INFO, "goal for player 1, {}-{}", player1->score, player2->score);
+    metrics::goals.add();
+    if (hit_log)
+      hit_log->goal(ticks, 1);
     return;
   }
 
@@ -927,6 +3585,10 @@ inline void BallController::add_collision(Player *player, Ball &ball) {
     pos.x = -80.0f - size;
     audio::play_effect("shine.mp3");
     player2->increment_score();
+    GAME_LOG(INFO, "goal for player 2, {}-{}", player1->score, player2->score);
+    metrics::goals.add();
+    if (hit_log)
+      hit_log->goal(ticks, 2);
     return;
   }
 
@@ -940,6 +3602,7 @@ inline void BallController::add_collision(Player *player, Ball &ball) {
   bool overlap_y = (fabsf(pos.y - py) <= (height + size));
 
   if (overlap_x && overlap_y) {
+    float speed = std::sqrt(vel.x * vel.x + vel.y * vel.y);
     if (vel.x < 0.0f) {
       pos.x = px + width + size;
     } else {
@@ -955,6 +3618,11 @@ inline void BallController::add_collision(Player *player, Ball &ball) {
     float paddle_influence = dp * 0.20f;
 
     vel.y += hit_influence + paddle_influence + 0.0001f;
+    hits++;
+    GAME_LOG(DEBUG, "paddle hit {} at {:+.2f}, paddle speed {:.1f}", hits, hit,
+             dp);
+    if (hit_log)
+      hit_log->hit(ticks, player == player1 ? 1 : 2, hit, dp, speed);
     audio::play_effect("paddle_hit.mp3");
   }
 }
@@ -967,7 +3635,9 @@ inline void BallController::update_physics(float dt) {
 inline void BallController::update(float dt, Ball &ball) {
   if (scored)
     return;
+  perf::Scope zone(perf::ZONE_BALL);
 
+  ticks++;
   update_physics(dt);
 
   if (player1)
@@ -1034,6 +3704,407 @@ struct World {
   }
 };
 
+// Everything a match needs to start the same way twice.
+struct MatchSettings {
+  u32 seed = 0;
+  bool versus_ai = true;
+  objects::AIDifficulty ai_difficulty = objects::Medium;
+  float ball_speed = 2.0f;
+  float paddle_speed = 2.0f;
+  float paddle_damping = 1.5f;
+  float duration_secs = 30.0f;
+  float world_time = 0.0f;
+};
+
+// The simulated part of a match: countdown, rallies, the celebration after
+// a point and the result. Objects draw themselves while they update, so a
+// match bound to a renderer without a frame buffer only simulates. Copies
+// are independent snapshots bound to the same renderer.
+struct Match {
+  render::Renderer *renderer;
+  MatchSettings settings;
+  utils::Random random;
+
+  World world;
+  objects::Player player1;
+  objects::Player player2;
+  objects::Ball ball;
+  objects::ParticleBurst particle_burst;
+  objects::FlashEffect flash;
+
+  bool in_countdown = false;
+  float countdown_time = 0.0f;
+  int countdown_value = 3;
+
+  float game_time_elapsed = 0.0f;
+  bool game_timer_active = false;
+  bool time_up_state = false;
+  float time_up_delay = 0.0f;
+  float tick_timer = 0.0f;
+
+  bool in_celebration = false;
+  float celebration_time = 0.0f;
+
+  // Paddle hits are counted by the ball; a rally ends with each point.
+  u32 rallies = 0;
+  u32 longest_rally = 0;
+  u32 rally_start = 0;
+
+  explicit Match(render::Renderer &renderer_)
+      : renderer(&renderer_), world(renderer_), player1(renderer_, false),
+        player2(renderer_, true), ball(renderer_), particle_burst(renderer_),
+        flash(renderer_) {
+    bind(renderer_);
+  }
+
+  // A copy still points at the original's players, generator and
+  // renderer until bind() is called on it.
+  Match(const Match &) = default;
+  Match &operator=(const Match &) = delete;
+
+  // Points every object at `target` and at this match's own players and
+  // random generator.
+  void bind(render::Renderer &target) {
+    renderer = &target;
+    world.renderer = &target;
+    player1.renderer = player2.renderer = &target;
+    ball.renderer = &target;
+    particle_burst.renderer = &target;
+    flash.renderer = &target;
+    player1.random = player2.random = particle_burst.random = &random;
+    ball.controller.player1 = &player1;
+    ball.controller.player2 = &player2;
+  }
+
+  void start(const MatchSettings &settings_) {
+    settings = settings_;
+    random.seed(settings.seed);
+    world.total_time = settings.world_time;
+
+    player1.init(-70.0f, false, settings.paddle_speed,
+                 settings.paddle_damping);
+    player2.init(70.0f, settings.versus_ai, settings.paddle_speed,
+                 settings.paddle_damping);
+    player1.reset();
+    player2.reset();
+    player1.pulse_timer = player2.pulse_timer = 0.0f;
+    player1.score = 0;
+    player2.score = 0;
+    ball.init(player1, player2, settings.ball_speed);
+
+    particle_burst.active = false;
+    particle_burst.particles.clear();
+    flash.active = false;
+    flash.alpha = 0.0f;
+
+    in_countdown = true;
+    countdown_time = 0.0f;
+    countdown_value = 3;
+    game_time_elapsed = 0.0f;
+    game_timer_active = false;
+    time_up_state = false;
+    time_up_delay = 0.0f;
+    tick_timer = 0.0f;
+    in_celebration = false;
+    celebration_time = 0.0f;
+    rallies = 0;
+    longest_rally = 0;
+    rally_start = 0;
+  }
+
+  void end_rally() {
+    u32 hits = ball.controller.hits - rally_start;
+    rallies++;
+    longest_rally = std::max(longest_rally, hits);
+    rally_start = ball.controller.hits;
+  }
+
+  // Advances the match by one frame and draws it. Returns true once the
+  // result has been shown and the match is over; that frame is not drawn.
+  bool tick(float dt) {
+    if (in_countdown) {
+      world.draw_simple(dt);
+      countdown_time += dt;
+
+      if (countdown_time >= 0.35f) {
+        countdown_time = 0.0f;
+        countdown_value--;
+
+        if (countdown_value > 0)
+          audio::play_effect("countdown_tick.mp3");
+        else if (countdown_value == 0)
+          audio::play_effect("go_tick.mp3");
+      }
+
+      std::string text;
+      float color;
+      if (countdown_value > 0) {
+        text = std::to_string(countdown_value);
+        color = 0x00FFFFFF;
+      } else {
+        text = "GO!";
+        color = 0x00FFCC66;
+      }
+
+      renderer->render_text(text, 0.0f, 0.0f, 2.0f, 1.0f, color);
+
+      if (countdown_value < 0) {
+        in_countdown = false;
+        game_timer_active = true;
+        game_time_elapsed = 0.0f;
+        time_up_state = false;
+      }
+    }
+
+    else if (in_celebration) {
+      celebration_time += dt;
+      flash.update(dt);
+      particle_burst.update(dt);
+
+      if (flash.finished() && particle_burst.finished()) {
+        ball.reset();
+        player1.reset();
+        player2.reset();
+        in_celebration = false;
+      }
+
+      world.draw(0.0f);
+      player1.update(dt, ball.controller.pos, ball.controller.vel);
+      player2.update(dt, ball.controller.pos, ball.controller.vel);
+      ball.render();
+    }
+
+    else {
+      if (!time_up_state) {
+        world.draw(dt);
+        player1.update(dt, ball.controller.pos, ball.controller.vel,
+                       settings.ai_difficulty);
+        player2.update(dt, ball.controller.pos, ball.controller.vel,
+                       settings.ai_difficulty);
+        ball.update(dt);
+      } else {
+        world.draw_simple(dt);
+      }
+
+      if (game_timer_active && !time_up_state) {
+        game_time_elapsed += dt;
+
+        float time_left =
+            std::max(0.0f, settings.duration_secs - game_time_elapsed);
+        int minutes = static_cast<int>(time_left) / 60;
+        int seconds = static_cast<int>(time_left) % 60;
+
+        char timer_text[16];
+        sprintf(timer_text, "%02d:%02d", minutes, seconds);
+
+        if (minutes == 0 && seconds <= 5) {
+          renderer->render_text(timer_text, 0.0f, -40.0f, 0.8f, 0.8f,
+                                0xFF0000);
+
+          tick_timer += dt;
+
+          if (tick_timer >= 1.0f) {
+            tick_timer = 0.0f;
+            audio::play_effect("game_timer_tick.mp3");
+          }
+        } else {
+          renderer->render_text(timer_text, 0.0f, -40.0f, 0.8f, 0.8f,
+                                0x00FFFFFF);
+        }
+
+        if (game_time_elapsed >= settings.duration_secs) {
+          // The rally cut short by the timer counts if the ball was hit.
+          if (ball.controller.hits > rally_start)
+            end_rally();
+          game_timer_active = false;
+          time_up_state = true;
+          time_up_delay = 0.0f;
+          audio::play_effect("winner.mp3");
+        }
+      }
+
+      if (time_up_state) {
+        std::string winner;
+        float color;
+        if (player1.score > player2.score) {
+          winner = "PLAYER 1 WINS!";
+          color = player1.color;
+        } else if (player2.score > player1.score) {
+          winner = "PLAYER 2 WINS!";
+          color = player2.color;
+        } else {
+          winner = "DRAW!";
+          color = 0x00FFCC66;
+        }
+
+        renderer->render_text("TIME IS UP!", 0.0f, -10.0f, 0.8f, 0.7f,
+                              0x00FFFFFF);
+        renderer->render_text(winner, 0.0f, 0.0f, 1.2f, 0.8f, color);
+
+        time_up_delay += dt;
+        if (time_up_delay >= 2.5f) {
+          time_up_state = false;
+          return true;
+        }
+      }
+
+      if (!time_up_state && ball.controller.scored) {
+        end_rally();
+        in_celebration = true;
+        celebration_time = 0.0f;
+        float px = ball.controller.pos.x;
+        float py = ball.controller.pos.y;
+        particle_burst.start(px, py);
+        flash.start();
+      }
+    }
+
+    particle_burst.render();
+    flash.render();
+    return false;
+  }
+};
+
+namespace replay {
+constexpr u32 MAGIC = 0x50525050; // "PPRP"
+constexpr u32 VERSION = 1;
+
+// Paddle keys are the only input a match reads.
+constexpr input::Key keys[] = {input::BUTTON_UP, input::BUTTON_DOWN,
+                               input::BUTTON_UP_ARROW,
+                               input::BUTTON_DOWN_ARROW};
+
+// Counter offsets are kept as recorded so a replay computes exactly the
+// same sub-frame fractions as the live game did.
+struct Tick {
+  float dt = 0.0f;
+  i64 interval = 0;
+  u8 down_at_begin = 0;
+  u8 event_count = 0;
+  u32 first_event = 0;
+};
+
+struct Event {
+  i64 offset = 0;
+  u8 key = 0;
+  u8 is_down = 0;
+};
+
+// A match as its settings plus every frame's dt and paddle input.
+struct Recording {
+  MatchSettings settings;
+  std::vector<Tick> ticks;
+  std::vector<Event> events;
+
+  void begin(const MatchSettings &settings_) {
+    settings = settings_;
+    ticks.clear();
+    events.clear();
+  }
+
+  void record(float dt, const input::FrameEvents &frame) {
+    Tick tick;
+    tick.dt = dt;
+    tick.interval = frame.frame_end - frame.frame_begin;
+    tick.first_event = static_cast<u32>(events.size());
+    for (u8 k = 0; k < std::size(keys); ++k)
+      if (frame.down_at_begin[keys[k]])
+        tick.down_at_begin |= 1 << k;
+    for (size_t i = 0; i < frame.count; ++i) {
+      const input::InputEvent &event = frame.events[i];
+      for (u8 k = 0; k < std::size(keys); ++k) {
+        if (event.key != keys[k])
+          continue;
+        events.push_back({event.timestamp - frame.frame_begin, k,
+                          static_cast<u8>(event.is_down)});
+        tick.event_count++;
+      }
+    }
+    ticks.push_back(tick);
+  }
+
+  // Loads tick `index` into this thread's input::frame_events.
+  void apply(size_t index) const {
+    const Tick &tick = ticks[index];
+    input::FrameEvents &frame = input::frame_events;
+    frame.frame_begin = 0;
+    frame.frame_end = tick.interval;
+    for (bool &down : frame.down_at_begin)
+      down = false;
+    for (u8 k = 0; k < std::size(keys); ++k)
+      frame.down_at_begin[keys[k]] = (tick.down_at_begin >> k) & 1;
+    frame.count = tick.event_count;
+    for (u32 i = 0; i < tick.event_count; ++i) {
+      const Event &event = events[tick.first_event + i];
+      frame.events[i] = {i, event.offset, keys[event.key],
+                         event.is_down != 0};
+    }
+  }
+
+  float duration() const {
+    float total = 0.0f;
+    for (const Tick &tick : ticks)
+      total += tick.dt;
+    return total;
+  }
+
+  bool save(const std::string &path) const {
+    std::ofstream out(path, std::ios::binary | std::ios::trunc);
+    if (!out)
+      return false;
+    u32 header[2] = {MAGIC, VERSION};
+    u64 counts[2] = {ticks.size(), events.size()};
+    out.write(reinterpret_cast<const char *>(header), sizeof(header));
+    out.write(reinterpret_cast<const char *>(&settings), sizeof(settings));
+    out.write(reinterpret_cast<const char *>(counts), sizeof(counts));
+    out.write(reinterpret_cast<const char *>(ticks.data()),
+              ticks.size() * sizeof(Tick));
+    out.write(reinterpret_cast<const char *>(events.data()),
+              events.size() * sizeof(Event));
+    return static_cast<bool>(out);
+  }
+
+  bool load(const std::string &path) {
+    std::ifstream in(path, std::ios::binary);
+    u32 header[2] = {};
+    u64 counts[2] = {};
+    in.read(reinterpret_cast<char *>(header), sizeof(header));
+    if (!in || header[0] != MAGIC || header[1] != VERSION)
+      return false;
+    in.read(reinterpret_cast<char *>(&settings), sizeof(settings));
+    in.read(reinterpret_cast<char *>(counts), sizeof(counts));
+    if (!in)
+      return false;
+    // The counts come from the file, so they must fit what is left of it
+    // before anything is allocated for them.
+    std::streamoff at = in.tellg();
+    in.seekg(0, std::ios::end);
+    u64 left = static_cast<u64>(in.tellg() - at);
+    in.seekg(at);
+    if (!in || counts[0] > left / sizeof(Tick) ||
+        counts[1] > (left - counts[0] * sizeof(Tick)) / sizeof(Event) ||
+        counts[1] > counts[0] * input::FrameEvents::CAPACITY)
+      return false;
+    ticks.resize(counts[0]);
+    events.resize(counts[1]);
+    in.read(reinterpret_cast<char *>(ticks.data()),
+            ticks.size() * sizeof(Tick));
+    in.read(reinterpret_cast<char *>(events.data()),
+            events.size() * sizeof(Event));
+    if (!in)
+      return false;
+    for (const Tick &tick : ticks)
+      if (tick.event_count > input::FrameEvents::CAPACITY ||
+          tick.first_event + tick.event_count > events.size())
+        return false;
+    for (const Event &event : events)
+      if (event.key >= std::size(keys))
+        return false;
+    return true;
+  }
+};
+} // namespace replay
+
 struct Config {
   std::string filename;
   json data;
@@ -1043,6 +4114,18 @@ struct Config {
   float ball_speed = 2.0f;
   float game_duration_secs = 30.0f;
   objects::AIDifficulty ai_difficulty = static_cast<objects::AIDifficulty>(1);
+  render::Theme theme = render::THEME_CLASSIC;
+  bool indexed_framebuffer = false;
+  bool post_bloom = false;
+  bool post_scanlines = false;
+  bool post_vignette = false;
+  bool front_to_back = false;
+  bool large_pages = false;
+  capture::Format capture_format = capture::FORMAT_Y4M;
+  bool record_replays = false;
+  i32 gif_seconds = 10;
+  capture::ImageFormat screenshot_format = capture::IMAGE_PNG;
+  i32 metrics_port = 0; // off
 
   Config(const std::string &filename_) : filename(filename_) {
     data = json::object();
@@ -1053,7 +4136,21 @@ struct Config {
                         {"music_enabled", audio::enabled},
                         {"music_volume", audio::music_volume},
                         {"sfx_volume", audio::sfx_volume},
-                        {"game_duration_secs", game_duration_secs}};
+                        {"game_duration_secs", game_duration_secs},
+                        {"theme", static_cast<int>(theme)},
+                        {"indexed_framebuffer", indexed_framebuffer},
+                        {"post_bloom", post_bloom},
+                        {"post_scanlines", post_scanlines},
+                        {"post_vignette", post_vignette},
+                        {"front_to_back", front_to_back},
+                        {"large_pages", large_pages},
+                        {"capture_format",
+                         capture::format_names[capture_format]},
+                        {"record_replays", record_replays},
+                        {"gif_seconds", gif_seconds},
+                        {"screenshot_format",
+                         capture::image_format_names[screenshot_format]},
+                        {"metrics_port", metrics_port}};
   }
 
   void init() {
@@ -1062,6 +4159,7 @@ struct Config {
       try {
         load_from_file(filename);
       } catch (...) {
+        GAME_LOG(WARN, "{} is unreadable, writing the defaults", filename);
         sync_json_from_members();
         save_to_file(filename);
       }
@@ -1070,10 +4168,20 @@ struct Config {
       if (!p.empty() && !exists(p))
         create_directories(p);
 
-      if (exists("config/default.json")) {
+      std::span<const u8> packed =
+          assets::embedded().get("config/default.json");
+      if (!packed.empty()) {
+        try {
+          load(json::parse(packed.begin(), packed.end()));
+        } catch (...) {
+          GAME_LOG(WARN, "embedded default config is unreadable");
+          sync_json_from_members();
+        }
+      } else if (exists("config/default.json")) {
         try {
           load_from_file("config/default.json");
         } catch (...) {
+          GAME_LOG(WARN, "config/default.json is unreadable");
           sync_json_from_members();
         }
       }
@@ -1096,6 +4204,19 @@ struct Config {
     data["settings"]["music_volume"] = audio::music_volume;
     data["settings"]["sfx_volume"] = audio::sfx_volume;
     data["settings"]["game_duration_secs"] = game_duration_secs;
+    data["settings"]["theme"] = static_cast<int>(theme);
+    data["settings"]["indexed_framebuffer"] = indexed_framebuffer;
+    data["settings"]["post_bloom"] = post_bloom;
+    data["settings"]["post_scanlines"] = post_scanlines;
+    data["settings"]["post_vignette"] = post_vignette;
+    data["settings"]["front_to_back"] = front_to_back;
+    data["settings"]["large_pages"] = large_pages;
+    data["settings"]["capture_format"] = capture::format_names[capture_format];
+    data["settings"]["record_replays"] = record_replays;
+    data["settings"]["gif_seconds"] = gif_seconds;
+    data["settings"]["screenshot_format"] =
+        capture::image_format_names[screenshot_format];
+    data["settings"]["metrics_port"] = metrics_port;
 
     std::ofstream file(filename_, std::ios::trunc);
     if (!file) {
@@ -1144,6 +4265,11 @@ struct Config {
     data["settings"]["game_duration_secs"] = value;
   }
 
+  void set_theme(render::Theme value) {
+    theme = value;
+    data["settings"]["theme"] = static_cast<int>(theme);
+  }
+
   void load_from_file(const std::string &filename_) {
     std::ifstream file(filename_);
     if (!file)
@@ -1151,13 +4277,17 @@ struct Config {
 
     json loaded;
     file >> loaded;
+    load(std::move(loaded));
+  }
 
+  void load(json loaded) {
     if (!loaded.is_object() || !loaded.contains("settings")) {
       throw std::runtime_error("Invalid config json");
     }
 
     data = std::move(loaded);
     auto settings = data["settings"];
+    metrics::config_loads.add();
 
     if (settings.contains("paddle_speed"))
       paddle_speed = settings["paddle_speed"].get<float>();
@@ -1176,6 +4306,40 @@ struct Config {
       audio::sfx_volume = settings["sfx_volume"].get<float>();
     if (settings.contains("game_duration_secs"))
       game_duration_secs = settings["game_duration_secs"].get<u16>();
+    if (settings.contains("theme"))
+      theme = static_cast<render::Theme>(utils::clamp(
+          0, settings["theme"].get<int>(), render::THEME_COUNT - 1));
+    if (settings.contains("indexed_framebuffer"))
+      indexed_framebuffer = settings["indexed_framebuffer"].get<bool>();
+    if (settings.contains("post_bloom"))
+      post_bloom = settings["post_bloom"].get<bool>();
+    if (settings.contains("post_scanlines"))
+      post_scanlines = settings["post_scanlines"].get<bool>();
+    if (settings.contains("post_vignette"))
+      post_vignette = settings["post_vignette"].get<bool>();
+    if (settings.contains("front_to_back"))
+      front_to_back = settings["front_to_back"].get<bool>();
+    if (settings.contains("large_pages"))
+      large_pages = settings["large_pages"].get<bool>();
+    if (settings.contains("record_replays"))
+      record_replays = settings["record_replays"].get<bool>();
+    if (settings.contains("gif_seconds"))
+      gif_seconds = utils::clamp(0, settings["gif_seconds"].get<i32>(), 60);
+    if (settings.contains("metrics_port"))
+      metrics_port =
+          utils::clamp(0, settings["metrics_port"].get<i32>(), 65535);
+    if (settings.contains("capture_format")) {
+      std::string name = settings["capture_format"].get<std::string>();
+      for (i32 f = 0; f < capture::FORMAT_COUNT; ++f)
+        if (name == capture::format_names[f])
+          capture_format = static_cast<capture::Format>(f);
+    }
+    if (settings.contains("screenshot_format")) {
+      std::string name = settings["screenshot_format"].get<std::string>();
+      for (i32 f = 0; f < capture::IMAGE_FORMAT_COUNT; ++f)
+        if (name == capture::image_format_names[f])
+          screenshot_format = static_cast<capture::ImageFormat>(f);
+    }
 
     paddle_speed = utils::round_to(paddle_speed, 1);
     paddle_damping = utils::round_to(paddle_damping, 1);
@@ -1196,6 +4360,19 @@ private:
     data["settings"]["music_volume"] = audio::music_volume;
     data["settings"]["sfx_volume"] = audio::sfx_volume;
     data["settings"]["game_duration_secs"] = game_duration_secs;
+    data["settings"]["theme"] = static_cast<int>(theme);
+    data["settings"]["indexed_framebuffer"] = indexed_framebuffer;
+    data["settings"]["post_bloom"] = post_bloom;
+    data["settings"]["post_scanlines"] = post_scanlines;
+    data["settings"]["post_vignette"] = post_vignette;
+    data["settings"]["front_to_back"] = front_to_back;
+    data["settings"]["large_pages"] = large_pages;
+    data["settings"]["capture_format"] = capture::format_names[capture_format];
+    data["settings"]["record_replays"] = record_replays;
+    data["settings"]["gif_seconds"] = gif_seconds;
+    data["settings"]["screenshot_format"] =
+        capture::image_format_names[screenshot_format];
+    data["settings"]["metrics_port"] = metrics_port;
   }
 };
 
@@ -1207,42 +4384,64 @@ class Window {
     MENU_PLAYING = 2,
     MENU_BACK = 3
   };
+  static constexpr const char *menu_names[] = {"main", "settings", "playing",
+                                               "back"};
 
 public:
   Window()
       : dimensions{0, 0, 1080, 720}, title("Ping Pong Game"), icon_path(""),
-        renderer(), world(renderer), player1(renderer, false),
-        player2(renderer, true), ball(renderer), particle_burst(renderer),
-        flash() {
-    std::srand((unsigned)std::time(nullptr));
-  }
+        renderer(), world(renderer), match(renderer) {}
 
   Window(objects::Dimensions dimensions, std::string title,
          std::string icon_path)
       : dimensions(dimensions), title(title), icon_path(icon_path), renderer(),
-        world(renderer), player1(renderer, false), player2(renderer, true),
-        ball(renderer), particle_burst(renderer), flash(renderer) {
-    std::srand((unsigned)std::time(nullptr));
-  }
+        world(renderer), match(renderer) {}
 
   i16 mainloop() {
-    if (!init())
+    events::logger.start("logs");
+    flight::install("crashes");
+    if (!init()) {
+      events::logger.stop();
       return 0;
+    }
 
     timeBeginPeriod(1);
+    if (!input::raw_keyboard.start())
+      GAME_LOG(WARN, "raw keyboard input is unavailable, keys are timed "
+                     "from window messages");
+    telemetry::frame_times.begin_session();
+    hits_path = "stats/hits/" + telemetry::session_name() + ".hits";
 
+    power::Activity last_activity = power::ACTIVITY_FOREGROUND;
     while (running) {
       MSG message;
 
-      for (i32 i = 0; i < input::BUTTON_COUNT; i++)
-        input::buttons[i].changed = false;
+      // Frame time statistics only describe uninterrupted foreground frames;
+      // throttled frames and the first one after a wait measure the sleep.
+      power::Activity activity = current_activity();
+      bool steady = activity == power::ACTIVITY_FOREGROUND &&
+                    last_activity == power::ACTIVITY_FOREGROUND;
+      last_activity = activity;
+      if (activity != power::ACTIVITY_FOREGROUND) {
+        auto_pause();
+        MsgWaitForMultipleObjectsEx(0, nullptr, power::wait_ms[activity],
+                                    QS_ALLINPUT, MWMO_INPUTAVAILABLE);
+      } else {
+        countdown_held = false;
+      }
+      power::stats.wakeup(activity);
+
+      input::begin_frame();
 
-      while (PeekMessageA(&message, window, 0, 0, PM_REMOVE)) {
+      while (PeekMessageA(&message, nullptr, 0, 0, PM_REMOVE)) {
 
         switch (message.message) {
         case WM_KEYDOWN:
         case WM_KEYUP: {
-          input::process_button(message);
+          if (!input::raw_keyboard.running())
+            input::process_button(message,
+                                  input::message_timestamp(
+                                      message, last_counter.QuadPart));
         } break;
 
         default:
@@ -1250,6 +4449,23 @@ public:
           DispatchMessageA(&message);
         }
       }
+      // Raw input arrives whichever window is in front; a press only counts
+      // for the game's, a release always does so no key is left held.
+      bool in_front = GetForegroundWindow() == window;
+      input::raw_keyboard.drain([&](input::Key key, bool down, i64 at) {
+        if (in_front || !down)
+          input::set_key(key, down, at);
+      });
+      trace::latency.begin_frame(input::frame_events);
+      apply_resize();
+
+      // Nothing would be seen, so neither simulate nor present. The clock
+      // restarts so the first visible frame does not see the whole gap.
+      if (activity == power::ACTIVITY_OCCLUDED ||
+          activity == power::ACTIVITY_MINIMIZED) {
+        QueryPerformanceCounter(&last_counter);
+        continue;
+      }
 
       if (renderer.render_state.memory && renderer.render_state.width > 0 &&
           renderer.render_state.height > 0) {
@@ -1257,494 +4473,456 @@ public:
         QueryPerformanceCounter(&current_counter);
         float dt = (float)(current_counter.QuadPart - last_counter.QuadPart) /
                    (float)frequency.QuadPart;
+        input::set_frame_interval(last_counter.QuadPart,
+                                  current_counter.QuadPart);
+        if (steady) {
+          telemetry::frame_times.record(current_phase(),
+                                        current_counter.QuadPart -
+                                            last_counter.QuadPart);
+          metrics::frame_seconds.observe(dt);
+        }
         last_counter = current_counter;
 
         audio::update(dt);
+        bool shown = frame(dt);
+        record_flight(dt);
+        if (!shown)
+          continue;
+
+        present();
+        telemetry::startup.first_frame();
+        metrics::frames.add();
+        power::stats.frame();
+      }
+      trace::latency.end_frame();
+    }
 
-        if (input::is_pressed(input::BUTTON_F11))
-          toggle_fullscreen();
-
-        if (menu_state == MENU_MAIN) {
-          world.draw_simple(dt);
-
-          float title_y = -22.0f;
-          float title_size = 1.5f;
-          float title_spacing = 0.8f;
-          renderer.render_text("PING PONG", 0.0f, title_y, title_size,
-                               title_spacing, 0x00FFFFFF);
-
-          const float start_y = 0.0f;
-          const float gap = 9.0f;
-          for (size_t i = 0; i < menu_items.size(); ++i) {
-            float y = start_y + static_cast<float>(i) * gap;
-            u32 color = (i == (size_t)menu_index) ? 0x00FFCC66 : 0x00666666;
-            renderer.render_rect(0.0f, y, 33.0f, 4.0f, 0x00102030);
-            renderer.render_text(menu_items[i], 0.0f, y, 0.6f, 0.6f, color);
-            if (i == (size_t)menu_index)
-              renderer.render_rect(-29.0f, y, 1.2f, 1.2f, 0x00FFFFFF);
-          }
+    input::raw_keyboard.stop();
+    timeEndPeriod(1);
+    trace::latency.write_csv("stats");
+    power::stats.write_csv("stats");
+    telemetry::frame_times.write_csv("stats");
+    audio::cleanup();
+    telemetry::startup.write_csv("stats");
+    metrics::server.stop();
+    hit_log.save(hits_path);
+    destroy();
+    events::logger.stop();
 
-          if (input::is_pressed(input::BUTTON_UP_ARROW) ||
-              input::is_pressed(input::BUTTON_UP)) {
-            audio::play_effect("navigation.mp3");
-            menu_index--;
-            if (menu_index < 0)
-              menu_index = static_cast<int>(menu_items.size()) - 1;
-          }
-          if (input::is_pressed(input::BUTTON_DOWN_ARROW) ||
-              input::is_pressed(input::BUTTON_DOWN)) {
-            audio::play_effect("navigation.mp3");
-            menu_index++;
-            if (menu_index >= static_cast<int>(menu_items.size()))
-              menu_index = 0;
-          }
-          if (input::is_pressed(input::BUTTON_ENTER)) {
-            if (menu_index == 0) {
-              player1.init(-70.0f, false, game_config.paddle_speed,
-                           game_config.paddle_damping);
-              player2.init(70.0f, true, game_config.paddle_speed,
-                           game_config.paddle_damping);
-              player1.ai_mode = false;
-              player2.ai_mode = true;
-              player1.score = 0;
-              player2.score = 0;
-
-              ball.init(player1, player2, game_config.ball_speed);
-              countdown_value = 3;
-              countdown_time = 0.0f;
-              in_countdown = true;
-              menu_state = MENU_PLAYING;
-            } else if (menu_index == 1) {
-              player1.init(-70.0f, false, game_config.paddle_speed,
-                           game_config.paddle_damping);
-              player2.init(70.0f, false, game_config.paddle_speed,
-                           game_config.paddle_damping);
-              player1.ai_mode = false;
-              player2.ai_mode = false;
-              player1.score = 0;
-              player2.score = 0;
-              ball.init(player1, player2, game_config.ball_speed);
-              countdown_value = 3;
-              countdown_time = 0.0f;
-              in_countdown = true;
-              menu_state = MENU_PLAYING;
-            } else if (menu_index == 2) {
-              menu_state = MENU_SETTINGS;
-            } else if (menu_index == 3) {
-              running = false;
-            }
-
-            audio::play_effect("button.mp3");
-          }
-        } else if (menu_state == MENU_SETTINGS) {
-          static i32 settings_index = 0;
-          static float _ball_speed = game_config.ball_speed;
-          static float _paddle_speed = game_config.paddle_speed;
-          static float _paddle_damping = game_config.paddle_damping;
-          static u16 _game_duration_secs = game_config.game_duration_secs;
-          static i32 _ai_difficulty =
-              static_cast<i32>(game_config.ai_difficulty);
-
-          std::vector<std::string> setting_labels = {
-              "BALL SPEED",    "PADDLE SPEED",  "PADDLE FRICTION",
-              "AI DIFFICULTY", "ENABLE MUSIC",  "MUSIC VOLUME",
-              "SFX VOLUME",    "GAME DURATION", "BACK"};
-
-          world.draw_simple(dt);
-          renderer.render_text("SETTINGS", 0.0f, -42.0f, 1.2f, 0.7f,
-                               0x00FFFFFF);
-
-          const float start_y = -30.0f;
-          const float gap = 9.0f;
-
-          for (size_t i = 0; i < setting_labels.size(); ++i) {
-            float y = start_y + static_cast<float>(i) * gap;
-            u32 color = (i == (size_t)settings_index) ? 0x00FFCC66 : 0x00666666;
-            renderer.render_rect(0.0f, y, 52.0f, 4.0f, 0x00102030);
-
-            float game_duration = 30.0f;
-            std::string label = setting_labels[i];
-            std::string value;
-
-            if (label == "BALL SPEED") {
-              value = std::format("{:.1f}", _ball_speed);
-            } else if (label == "PADDLE SPEED") {
-              value = std::format("{:.1f}", _paddle_speed);
-            } else if (label == "AI DIFFICULTY") {
-              switch (_ai_difficulty) {
-              case 0:
-                value = "EASY";
-                break;
-              case 1:
-                value = "NORMAL";
-                break;
-              case 2:
-                value = "HARD";
-                break;
-              case 3:
-                value = "VERYHARD";
-                break;
-              default:
-                value = "UNBEATABLE";
-                break;
-              }
-            } else if (label == "PADDLE FRICTION") {
-              value = std::format("{:.1f}", _paddle_damping);
-            } else if (label == "ENABLE MUSIC") {
-              value = audio::enabled ? "ON" : "OFF";
-            } else if (label == "MUSIC VOLUME") {
-              value = std::format("{}%", static_cast<int>(std::round(
-                                             audio::music_volume * 100.0f)));
-            } else if (label == "SFX VOLUME") {
-              value = std::format("{}%", static_cast<int>(std::round(
-                                             audio::sfx_volume * 100.0f)));
-            } else if (label == "GAME DURATION") {
-              value = std::format("{}S", _game_duration_secs);
-            } else {
-              value = "";
-            }
-
-            renderer.render_text(label, -14.0f, y, 0.6f, 0.6f, color);
-            if (!value.empty())
-              renderer.render_text(value, 32.0f, y, 0.6f, 0.6f, 0x00AAAAAA);
-            if (i == (size_t)settings_index) {
-              renderer.render_rect(-44.0f, y, 1.2f, 1.2f, 0x00FFFFFF);
-            }
-          }
+    return 1;
+  }
 
-          if (input::is_pressed(input::BUTTON_UP_ARROW) ||
-              input::is_pressed(input::BUTTON_UP)) {
-            audio::play_effect("navigation.mp3");
-            settings_index--;
-            if (settings_index < 0)
-              settings_index = static_cast<int>(setting_labels.size()) - 1;
-          }
+  // One frame of the menus or the match: reads this frame's input, draws
+  // into the renderer's frame buffer and adds the overlays. Returns false
+  // when a match just ended and the frame should not be presented.
+  bool frame(float dt) {
+    renderer.begin_frame();
 
-          if (input::is_pressed(input::BUTTON_DOWN_ARROW) ||
-              input::is_pressed(input::BUTTON_DOWN)) {
-            audio::play_effect("navigation.mp3");
-            settings_index++;
-            if (settings_index >= static_cast<int>(setting_labels.size()))
-              settings_index = 0;
-          }
+    if (menu_state != logged_menu) {
+      GAME_LOG(INFO, "menu {} -> {}", menu_names[logged_menu],
+               menu_names[menu_state]);
+      logged_menu = menu_state;
+    }
 
-          if (input::is_pressed(input::BUTTON_LEFT_ARROW)) {
-            audio::play_effect("setting.mp3");
-            if (settings_index == 0) {
-              _ball_speed =
-                  std::max(0.5f, utils::round_to(_ball_speed - 0.1f, 1));
-            } else if (settings_index == 1) {
-              _paddle_speed =
-                  std::max(0.5f, utils::round_to(_paddle_speed - 0.1f, 1));
-            } else if (settings_index == 2) {
-              _paddle_damping =
-                  std::max(0.8f, utils::round_to(_paddle_damping - 0.1f, 1));
-            } else if (settings_index == 3) {
-              _ai_difficulty = std::max(0, _ai_difficulty - 1);
-            } else if (settings_index == 4) {
-              game_config.set_music_enabled(false);
-            } else if (settings_index == 5) {
-              float newVol = std::max(
-                  0.0f, utils::round_to(audio::music_volume - 0.1f, 1));
-              game_config.set_music_volume(newVol);
-              audio::update_music_volume();
-            } else if (settings_index == 6) {
-              float newVol =
-                  std::max(0.0f, utils::round_to(audio::sfx_volume - 0.1f, 1));
-              game_config.set_sfx_volume(newVol);
-              audio::update_sfx_volume();
-            } else if (settings_index == 7) {
-              _game_duration_secs = std::max(5, _game_duration_secs - 1);
-            }
-          }
+    if (input::is_pressed(input::BUTTON_F11))
+      toggle_fullscreen();
+    if (input::is_pressed(input::BUTTON_F2))
+      telemetry::frame_times.show = !telemetry::frame_times.show;
+    if (input::is_pressed(input::BUTTON_F3))
+      trace::latency.toggle();
+    if (input::is_pressed(input::BUTTON_F4))
+      show_post_timings = !show_post_timings;
+    if (input::is_pressed(input::BUTTON_F5))
+      renderer.count_overdraw = !renderer.count_overdraw;
+    if (input::is_pressed(input::BUTTON_F6))
+      renderer.front_to_back = !renderer.front_to_back;
+    if (input::is_pressed(input::BUTTON_F7))
+      power::stats.show = !power::stats.show;
+    if (input::is_pressed(input::BUTTON_F8)) {
+      if (recorder.recording())
+        recorder.stop();
+      else
+        recorder.start(renderer.render_state, "captures",
+                       game_config.capture_format);
+    }
+    if (input::is_pressed(input::BUTTON_F9))
+      clips.save("captures");
+
+    if (menu_state == MENU_MAIN) {
+      world.draw_simple(dt);
+
+      float title_y = -22.0f;
+      float title_size = 1.5f;
+      float title_spacing = 0.8f;
+      renderer.render_text("PING PONG", 0.0f, title_y, title_size,
+                           title_spacing, 0x00FFFFFF);
+
+      const float start_y = 0.0f;
+      const float gap = 9.0f;
+      for (size_t i = 0; i < menu_items.size(); ++i) {
+        float y = start_y + static_cast<float>(i) * gap;
+        u32 color = (i == (size_t)menu_index) ? 0x00FFCC66 : 0x00666666;
+        renderer.render_rect(0.0f, y, 33.0f, 4.0f, 0x00102030);
+        renderer.render_text(menu_items[i], 0.0f, y, 0.6f, 0.6f, color);
+        if (i == (size_t)menu_index)
+          renderer.render_rect(-29.0f, y, 1.2f, 1.2f, 0x00FFFFFF);
+      }
 
-          if (input::is_pressed(input::BUTTON_RIGHT_ARROW)) {
-            audio::play_effect("setting.mp3");
-            if (settings_index == 0) {
-              _ball_speed =
-                  std::min(3.0f, utils::round_to(_ball_speed + 0.1f, 1));
-            } else if (settings_index == 1) {
-              _paddle_speed =
-                  std::min(3.0f, utils::round_to(_paddle_speed + 0.1f, 1));
-            } else if (settings_index == 2) {
-              _paddle_damping =
-                  std::min(2.0f, utils::round_to(_paddle_damping + 0.1f, 1));
-            } else if (settings_index == 3) {
-              _ai_difficulty = std::min(4, _ai_difficulty + 1);
-            } else if (settings_index == 4) {
-              game_config.set_music_enabled(true);
-            } else if (settings_index == 5) {
-              float newVol = std::min(
-                  1.0f, utils::round_to(audio::music_volume + 0.1f, 1));
-              game_config.set_music_volume(newVol);
-              audio::update_music_volume();
-            } else if (settings_index == 6) {
-              float newVol =
-                  std::min(1.0f, utils::round_to(audio::sfx_volume + 0.1f, 1));
-              game_config.set_sfx_volume(newVol);
-              audio::update_sfx_volume();
-            } else if (settings_index == 7) {
-              _game_duration_secs = std::min(600, _game_duration_secs + 1);
-            }
-          }
+      if (input::is_pressed(input::BUTTON_UP_ARROW) ||
+          input::is_pressed(input::BUTTON_UP)) {
+        audio::play_effect("navigation.mp3");
+        menu_index--;
+        if (menu_index < 0)
+          menu_index = static_cast<int>(menu_items.size()) - 1;
+      }
+      if (input::is_pressed(input::BUTTON_DOWN_ARROW) ||
+          input::is_pressed(input::BUTTON_DOWN)) {
+        audio::play_effect("navigation.mp3");
+        menu_index++;
+        if (menu_index >= static_cast<int>(menu_items.size()))
+          menu_index = 0;
+      }
+      if (input::is_pressed(input::BUTTON_ENTER)) {
+        if (menu_index == 0) {
+          start_match(true);
+        } else if (menu_index == 1) {
+          start_match(false);
+        } else if (menu_index == 2) {
+          open_settings();
+        } else if (menu_index == 3) {
+          running = false;
+        }
 
-          if (input::is_pressed(input::BUTTON_ENTER)) {
-            if (settings_index == static_cast<int>(setting_labels.size() - 1)) {
-              audio::play_effect("button_back.mp3");
-
-              game_config.set_ball_speed(_ball_speed);
-              game_config.set_paddle_speed(_paddle_speed);
-              game_config.set_paddle_damping(_paddle_damping);
-              game_config.set_ai_difficulty(
-                  static_cast<objects::AIDifficulty>(_ai_difficulty));
-              game_config.set_game_duration_secs(_game_duration_secs);
-
-              game_config.save_to_file("config/config.json");
-
-              menu_state = MENU_MAIN;
-            }
-          } else {
-            game_config.paddle_speed = _paddle_speed;
-            game_config.paddle_damping = _paddle_damping;
-            game_config.ball_speed = _ball_speed;
-            game_config.ai_difficulty =
-                static_cast<objects::AIDifficulty>(_ai_difficulty);
-            game_config.game_duration_secs = _game_duration_secs;
-          }
-        } else if (menu_state == MENU_PLAYING) {
-          static i8 paused_index = 0;
-          std::vector<std::string> paused_items = {"RESUME", "RESTART",
-                                                   "MAIN MENU"};
-
-          if (in_countdown) {
-            world.draw_simple(dt);
-            countdown_time += dt;
-
-            if (countdown_time >= 0.35f) {
-              countdown_time = 0.0f;
-              countdown_value--;
-
-              if (countdown_value > 0)
-                audio::play_effect("countdown_tick.mp3");
-              else if (countdown_value == 0)
-                audio::play_effect("go_tick.mp3");
-            }
-
-            std::string text;
-            float color;
-            if (countdown_value > 0) {
-              text = std::to_string(countdown_value);
-              color = 0x00FFFFFF;
-            } else {
-              text = "GO!";
-              color = 0x00FFCC66;
-            }
-
-            renderer.render_text(text, 0.0f, 0.0f, 2.0f, 1.0f, color);
-
-            if (countdown_value < 0) {
-              in_countdown = false;
-              game_running = true;
-              paused = false;
-
-              game_timer_active = true;
-              game_time_elapsed = 0.0f;
-              time_up_state = false;
-            }
+        audio::play_effect("button.mp3");
+      }
+    } else if (menu_state == MENU_SETTINGS) {
+      std::vector<std::string> setting_labels = {
+          "BALL SPEED",    "PADDLE SPEED",  "PADDLE FRICTION",
+          "AI DIFFICULTY", "ENABLE MUSIC",  "MUSIC VOLUME",
+          "SFX VOLUME",    "GAME DURATION", "THEME",
+          "BACK"};
+
+      world.draw_simple(dt);
+      renderer.render_text("SETTINGS", 0.0f, -42.0f, 1.2f, 0.7f, 0x00FFFFFF);
+
+      const float start_y = -32.0f;
+      const float gap = 8.0f;
+
+      for (size_t i = 0; i < setting_labels.size(); ++i) {
+        float y = start_y + static_cast<float>(i) * gap;
+        u32 color = (i == (size_t)settings_index) ? 0x00FFCC66 : 0x00666666;
+        renderer.render_rect(0.0f, y, 52.0f, 3.5f, 0x00102030);
+
+        float game_duration = 30.0f;
+        std::string label = setting_labels[i];
+        std::string value;
+
+        if (label == "BALL SPEED") {
+          value = std::format("{:.1f}", draft.ball_speed);
+        } else if (label == "PADDLE SPEED") {
+          value = std::format("{:.1f}", draft.paddle_speed);
+        } else if (label == "AI DIFFICULTY") {
+          switch (draft.ai_difficulty) {
+          case 0:
+            value = "EASY";
+            break;
+          case 1:
+            value = "NORMAL";
+            break;
+          case 2:
+            value = "HARD";
+            break;
+          case 3:
+            value = "VERYHARD";
+            break;
+          default:
+            value = "UNBEATABLE";
+            break;
           }
+        } else if (label == "PADDLE FRICTION") {
+          value = std::format("{:.1f}", draft.paddle_damping);
+        } else if (label == "ENABLE MUSIC") {
+          value = audio::enabled ? "ON" : "OFF";
+        } else if (label == "MUSIC VOLUME") {
+          value = std::format("{}%", static_cast<int>(std::round(
+                                         audio::music_volume * 100.0f)));
+        } else if (label == "SFX VOLUME") {
+          value = std::format("{}%", static_cast<int>(std::round(
+                                         audio::sfx_volume * 100.0f)));
+        } else if (label == "GAME DURATION") {
+          value = std::format("{}S", draft.game_duration_secs);
+        } else if (label == "THEME") {
+          value = render::theme_names[draft.theme];
+        } else {
+          value = "";
+        }
 
-          else if (in_celebration) {
-            celebration_time += dt;
-            flash.update(dt);
-            particle_burst.update(dt);
-
-            if (flash.finished() && particle_burst.finished()) {
-              ball.reset();
-              player1.reset();
-              player2.reset();
-              in_celebration = false;
-            }
-
-            world.draw(0.0f);
-            player1.update(dt, ball.controller.pos, ball.controller.vel);
-            player2.update(dt, ball.controller.pos, ball.controller.vel);
-            ball.render();
-          }
+        renderer.render_text(label, -14.0f, y, 0.6f, 0.6f, color);
+        if (!value.empty())
+          renderer.render_text(value, 32.0f, y, 0.6f, 0.6f, 0x00AAAAAA);
+        if (i == (size_t)settings_index) {
+          renderer.render_rect(-44.0f, y, 1.2f, 1.2f, 0x00FFFFFF);
+        }
+      }
 
-          else if (!in_celebration) {
-            if (confirm_modal) {
-              world.draw_simple(dt);
-              renderer.render_text("PAUSED", 0.0f, -17.0f, 1.2f, 0.7f,
-                                   0x00FFFFFF);
-
-              for (size_t i = 0; i < paused_items.size(); ++i) {
-                float y = static_cast<float>(i) * 9.0f;
-                u32 color =
-                    (i == (size_t)paused_index) ? 0x00FFCC66 : 0x00666666;
-                renderer.render_rect(0.0f, y, 33.0f, 4.0f, 0x00102030);
-                renderer.render_text(paused_items[i], 0.0f, y, 0.6f, 0.6f,
-                                     color);
-                if (i == (size_t)paused_index)
-                  renderer.render_rect(-29.0f, y, 1.2f, 1.2f, 0x00FFFFFF);
-              }
-
-              if (input::is_pressed(input::BUTTON_UP_ARROW) ||
-                  input::is_pressed(input::BUTTON_UP)) {
-                audio::play_effect("navigation.mp3");
-                paused_index = (paused_index - 1 + paused_items.size()) %
-                               paused_items.size();
-              }
-
-              if (input::is_pressed(input::BUTTON_DOWN_ARROW) ||
-                  input::is_pressed(input::BUTTON_DOWN)) {
-                audio::play_effect("navigation.mp3");
-                paused_index = (paused_index + 1) % paused_items.size();
-              }
-            } else {
-              if (!time_up_state) {
-                world.draw(dt);
-                player1.update(dt, ball.controller.pos, ball.controller.vel,
-                               game_config.ai_difficulty);
-                player2.update(dt, ball.controller.pos, ball.controller.vel,
-                               game_config.ai_difficulty);
-                ball.update(dt);
-              } else {
-                world.draw_simple(dt);
-              }
-
-              if (game_timer_active && !paused && !confirm_modal &&
-                  !in_countdown && !time_up_state) {
-                game_time_elapsed += dt;
-
-                float time_left = std::max(
-                    0.0f, game_config.game_duration_secs - game_time_elapsed);
-                int minutes = static_cast<int>(time_left) / 60;
-                int seconds = static_cast<int>(time_left) % 60;
-
-                char timer_text[16];
-                sprintf(timer_text, "%02d:%02d", minutes, seconds);
-
-                if (minutes == 0 && seconds <= 5) {
-                  renderer.render_text(timer_text, 0.0f, -40.0f, 0.8f, 0.8f,
-                                       0xFF0000);
-
-                  tick_timer += dt;
-
-                  if (tick_timer >= 1.0f) {
-                    tick_timer = 0.0f;
-                    audio::play_effect("game_timer_tick.mp3");
-                  }
-                } else {
-                  renderer.render_text(timer_text, 0.0f, -40.0f, 0.8f, 0.8f,
-                                       0x00FFFFFF);
-                }
-
-                if (game_time_elapsed >= game_config.game_duration_secs) {
-                  game_timer_active = false;
-                  time_up_state = true;
-                  time_up_delay = 0.0f;
-                  audio::play_effect("winner.mp3");
-                }
-              }
-
-              if (time_up_state) {
-                std::string winner;
-                float color;
-                if (player1.score > player2.score) {
-                  winner = "PLAYER 1 WINS!";
-                  color = player1.color;
-                } else if (player2.score > player1.score) {
-                  winner = "PLAYER 2 WINS!";
-                  color = player2.color;
-                } else {
-                  winner = "DRAW!";
-                  color = 0x00FFCC66;
-                }
-
-                renderer.render_text("TIME IS UP!", 0.0f, -10.0f, 0.8f, 0.7f,
-                                     0x00FFFFFF);
-                renderer.render_text(winner, 0.0f, 0.0f, 1.2f, 0.8f, color);
-
-                time_up_delay += dt;
-                if (time_up_delay >= 2.5f) {
-                  menu_state = MENU_MAIN;
-                  time_up_state = false;
-                  continue;
-                }
-              }
-
-              if (!time_up_state && ball.controller.scored) {
-                in_celebration = true;
-                celebration_time = 0.0f;
-                float px = ball.controller.pos.x;
-                float py = ball.controller.pos.y;
-                particle_burst.start(px, py);
-                flash.start();
-              }
-            }
-          }
+      if (input::is_pressed(input::BUTTON_UP_ARROW) ||
+          input::is_pressed(input::BUTTON_UP)) {
+        audio::play_effect("navigation.mp3");
+        settings_index--;
+        if (settings_index < 0)
+          settings_index = static_cast<int>(setting_labels.size()) - 1;
+      }
+
+      if (input::is_pressed(input::BUTTON_DOWN_ARROW) ||
+          input::is_pressed(input::BUTTON_DOWN)) {
+        audio::play_effect("navigation.mp3");
+        settings_index++;
+        if (settings_index >= static_cast<int>(setting_labels.size()))
+          settings_index = 0;
+      }
+
+      if (input::is_pressed(input::BUTTON_LEFT_ARROW)) {
+        audio::play_effect("setting.mp3");
+        if (settings_index == 0) {
+          draft.ball_speed =
+              std::max(0.5f, utils::round_to(draft.ball_speed - 0.1f, 1));
+        } else if (settings_index == 1) {
+          draft.paddle_speed =
+              std::max(0.5f, utils::round_to(draft.paddle_speed - 0.1f, 1));
+        } else if (settings_index == 2) {
+          draft.paddle_damping =
+              std::max(0.8f, utils::round_to(draft.paddle_damping - 0.1f, 1));
+        } else if (settings_index == 3) {
+          draft.ai_difficulty = std::max(0, draft.ai_difficulty - 1);
+        } else if (settings_index == 4) {
+          game_config.set_music_enabled(false);
+        } else if (settings_index == 5) {
+          float newVol =
+              std::max(0.0f, utils::round_to(audio::music_volume - 0.1f, 1));
+          game_config.set_music_volume(newVol);
+          audio::update_music_volume();
+        } else if (settings_index == 6) {
+          float newVol =
+              std::max(0.0f, utils::round_to(audio::sfx_volume - 0.1f, 1));
+          game_config.set_sfx_volume(newVol);
+          audio::update_sfx_volume();
+        } else if (settings_index == 7) {
+          draft.game_duration_secs = std::max(5, draft.game_duration_secs - 1);
+        } else if (settings_index == 8) {
+          draft.theme = static_cast<render::Theme>(
+              (draft.theme + render::THEME_COUNT - 1) % render::THEME_COUNT);
+          renderer.theme = draft.theme;
+        }
+      }
+
+      if (input::is_pressed(input::BUTTON_RIGHT_ARROW)) {
+        audio::play_effect("setting.mp3");
+        if (settings_index == 0) {
+          draft.ball_speed =
+              std::min(3.0f, utils::round_to(draft.ball_speed + 0.1f, 1));
+        } else if (settings_index == 1) {
+          draft.paddle_speed =
+              std::min(3.0f, utils::round_to(draft.paddle_speed + 0.1f, 1));
+        } else if (settings_index == 2) {
+          draft.paddle_damping =
+              std::min(2.0f, utils::round_to(draft.paddle_damping + 0.1f, 1));
+        } else if (settings_index == 3) {
+          draft.ai_difficulty = std::min(4, draft.ai_difficulty + 1);
+        } else if (settings_index == 4) {
+          game_config.set_music_enabled(true);
+        } else if (settings_index == 5) {
+          float newVol =
+              std::min(1.0f, utils::round_to(audio::music_volume + 0.1f, 1));
+          game_config.set_music_volume(newVol);
+          audio::update_music_volume();
+        } else if (settings_index == 6) {
+          float newVol =
+              std::min(1.0f, utils::round_to(audio::sfx_volume + 0.1f, 1));
+          game_config.set_sfx_volume(newVol);
+          audio::update_sfx_volume();
+        } else if (settings_index == 7) {
+          draft.game_duration_secs =
+              std::min(600, draft.game_duration_secs + 1);
+        } else if (settings_index == 8) {
+          draft.theme = static_cast<render::Theme>((draft.theme + 1) %
+                                                   render::THEME_COUNT);
+          renderer.theme = draft.theme;
+        }
+      }
+
+      if (input::is_pressed(input::BUTTON_ENTER)) {
+        if (settings_index == static_cast<int>(setting_labels.size() - 1)) {
+          audio::play_effect("button_back.mp3");
+
+          game_config.set_ball_speed(draft.ball_speed);
+          game_config.set_paddle_speed(draft.paddle_speed);
+          game_config.set_paddle_damping(draft.paddle_damping);
+          game_config.set_ai_difficulty(
+              static_cast<objects::AIDifficulty>(draft.ai_difficulty));
+          game_config.set_game_duration_secs(draft.game_duration_secs);
+          game_config.set_theme(draft.theme);
+
+          if (!game_config.filename.empty())
+            game_config.save_to_file(game_config.filename);
+
+          menu_state = MENU_MAIN;
+        }
+      } else if (input::is_pressed(input::BUTTON_ESC)) {
+        // Cancel: the draft, the theme preview included, is thrown away.
+        audio::play_effect("button_back.mp3");
+        draft = draft_before;
+        renderer.theme = game_config.theme;
+        menu_state = MENU_MAIN;
+      }
+      if (!input::is_pressed(input::BUTTON_ENTER)) {
+        game_config.paddle_speed = draft.paddle_speed;
+        game_config.paddle_damping = draft.paddle_damping;
+        game_config.ball_speed = draft.ball_speed;
+        game_config.ai_difficulty =
+            static_cast<objects::AIDifficulty>(draft.ai_difficulty);
+        game_config.game_duration_secs = draft.game_duration_secs;
+      }
+    } else if (menu_state == MENU_PLAYING) {
+      std::vector<std::string> paused_items = {"RESUME", "RESTART",
+                                               "MAIN MENU"};
+
+      // Countdown and celebration run on under the pause menu.
+      if (confirm_modal && !match.in_countdown && !match.in_celebration) {
+        world.draw_simple(dt);
+        renderer.render_text("PAUSED", 0.0f, -17.0f, 1.2f, 0.7f, 0x00FFFFFF);
+
+        for (size_t i = 0; i < paused_items.size(); ++i) {
+          float y = static_cast<float>(i) * 9.0f;
+          u32 color = (i == (size_t)paused_index) ? 0x00FFCC66 : 0x00666666;
+          renderer.render_rect(0.0f, y, 33.0f, 4.0f, 0x00102030);
+          renderer.render_text(paused_items[i], 0.0f, y, 0.6f, 0.6f, color);
+          if (i == (size_t)paused_index)
+            renderer.render_rect(-29.0f, y, 1.2f, 1.2f, 0x00FFFFFF);
+        }
+
+        if (input::is_pressed(input::BUTTON_UP_ARROW) ||
+            input::is_pressed(input::BUTTON_UP)) {
+          audio::play_effect("navigation.mp3");
+          paused_index = (paused_index - 1 + paused_items.size()) %
+                         paused_items.size();
+        }
+
+        if (input::is_pressed(input::BUTTON_DOWN_ARROW) ||
+            input::is_pressed(input::BUTTON_DOWN)) {
+          audio::play_effect("navigation.mp3");
+          paused_index = (paused_index + 1) % paused_items.size();
+        }
+      } else {
+        float match_dt = countdown_held && match.in_countdown ? 0.0f : dt;
+        if (recording_replay)
+          replay_recording.record(match_dt, input::frame_events);
+        bool over = match.tick(match_dt);
+        if (match.time_up_state)
+          save_result();
+        if (over) {
+          finish_match();
+          menu_state = MENU_MAIN;
+          return false;
+        }
+      }
 
-          if (input::is_pressed(input::BUTTON_ESC))
-            confirm_modal = !confirm_modal;
-
-          if (confirm_modal) {
-            if (input::is_pressed(input::BUTTON_ENTER) ||
-                input::is_pressed(input::BUTTON_PAUSE)) {
-              audio::play_effect("button.mp3");
-              if (paused_index == 0) {
-                confirm_modal = false;
-              } else if (paused_index == 1) {
-                audio::play_effect("button_back.mp3");
-                player1.reset();
-                player2.reset();
-                ball.reset();
-                player1.score = 0;
-                player2.score = 0;
-                particle_burst.active = false;
-                flash.active = false;
-                in_celebration = false;
-                countdown_value = 3;
-                countdown_time = 0.0f;
-                in_countdown = true;
-                game_time_elapsed = 0.0f;
-                game_timer_active = true;
-                game_running = false;
-                paused = false;
-                confirm_modal = false;
-                menu_state = MENU_PLAYING;
-              } else if (paused_index == 2) {
-                ball.reset();
-                player1.reset();
-                player2.reset();
-                particle_burst.active = false;
-                flash.active = false;
-                game_running = false;
-                paused = false;
-                in_countdown = false;
-                confirm_modal = false;
-                menu_state = MENU_MAIN;
-              }
-            }
+      if (input::is_pressed(input::BUTTON_ESC))
+        confirm_modal = !confirm_modal;
+
+      if (confirm_modal) {
+        if (input::is_pressed(input::BUTTON_ENTER) ||
+            input::is_pressed(input::BUTTON_PAUSE)) {
+          audio::play_effect("button.mp3");
+          if (paused_index == 0) {
+            confirm_modal = false;
+          } else if (paused_index == 1) {
+            audio::play_effect("button_back.mp3");
+            finish_match();
+            start_match(match.settings.versus_ai);
+          } else if (paused_index == 2) {
+            finish_match();
+            confirm_modal = false;
+            menu_state = MENU_MAIN;
           }
         }
-        particle_burst.render();
-        flash.render();
       }
+    }
 
-      StretchDIBits(
-          hdc, 0, 0, renderer.render_state.width, renderer.render_state.height,
-          0, 0, renderer.render_state.width, renderer.render_state.height,
-          renderer.render_state.memory, &renderer.render_state.bitmap_info,
-          DIB_RGB_COLORS, SRCCOPY);
-      // Sleep(1);
+    renderer.flush();
+    trace::latency.mark_rendered();
+    if (renderer.count_overdraw) {
+      renderer.render_overdraw_heatmap();
+      renderer.render_text(std::format("OVERDRAW {:.2f} WRITES PER PIXEL",
+                                       renderer.overdraw_average),
+                           0.0f, 47.0f, 0.35f, 0.35f, 0x00FFFFFF);
+    } else if (post_process.enabled()) {
+      renderer.resolve_indexed();
+      post_process.apply(renderer.render_state);
+    }
+    clips.submit(renderer);
+    if (input::is_pressed(input::BUTTON_F12)) {
+      renderer.resolve_indexed();
+      screenshots.capture(renderer.render_state, "captures",
+                          game_config.screenshot_format);
     }
+    if (recorder.recording()) {
+      renderer.resolve_indexed();
+      recorder.submit(renderer.render_state);
+    }
+    recorder.render_overlay(renderer);
+    clips.render_overlay(renderer);
+    screenshots.render_overlay(renderer);
+    if (show_post_timings)
+      post_process.render_timings(renderer);
+    trace::latency.render_overlay(renderer);
+    power::stats.render_overlay(renderer);
+    telemetry::frame_times.render_overlay(renderer, current_phase());
+    if (telemetry::frame_times.show)
+      telemetry::startup.render_overlay(renderer);
+
+    return true;
+  }
 
-    timeEndPeriod(1);
-    audio::cleanup();
-    destroy();
+  telemetry::Phase current_phase() const {
+    if (menu_state != MENU_PLAYING)
+      return telemetry::PHASE_MENU;
+    if (match.in_countdown)
+      return telemetry::PHASE_COUNTDOWN;
+    if (match.in_celebration)
+      return telemetry::PHASE_CELEBRATION;
+    return confirm_modal ? telemetry::PHASE_MENU : telemetry::PHASE_GAMEPLAY;
+  }
 
-    return 1;
+  // Sets up the menus and matches without a window, drawing into a frame
+  // buffer of `width` x `height` that fullscreen swaps for a 1080p screen.
+  // Config files are neither read nor written, so every run starts from the
+  // defaults; input comes from input::set_key.
+  void init_headless(i32 width, i32 height, u32 seed) {
+    headless = true;
+    dimensions.width = width;
+    dimensions.height = height;
+    framebuffer.reserve(std::max(width, HEADLESS_SCREEN_WIDTH),
+                        std::max(height, HEADLESS_SCREEN_HEIGHT), false);
+    pending_width = width;
+    pending_height = height;
+    resize_pending = true;
+    game_config.filename.clear();
+    match_seed = seed;
+  }
+
+  // What the main loop does between pumping messages and presenting.
+  bool headless_frame(float dt) {
+    apply_resize();
+    if (!frame(dt))
+      return false;
+    renderer.flush();
+    return true;
+  }
+
+  const render::RenderState &frame_buffer() const {
+    return renderer.render_state;
   }
+  Config &config() { return game_config; }
 
 private:
   static LRESULT CALLBACK WndProcStatic(HWND hwnd, UINT msg, WPARAM wParam,
@@ -1774,52 +4952,233 @@ private:
 
     case WM_SIZE: {
       RECT rect;
-
       GetClientRect(hwnd, &rect);
+      pending_width = rect.right - rect.left;
+      pending_height = rect.bottom - rect.top;
+      resize_pending = true;
+    }
+      return 0;
+    }
 
-      i32 new_width = rect.right - rect.left;
-      i32 new_height = rect.bottom - rect.top;
+    return DefWindowProcA(hwnd, uMsg, wParam, lParam);
+  }
 
-      if (new_width <= 0 || new_height <= 0) {
-        renderer.render_state.width = renderer.render_state.height = 0;
-        return 0;
-      }
+  // Indexed frames are handed to GDI as an 8bpp DIB so the blit does the
+  // palette expansion; if the driver refuses, expand them ourselves.
+  void present() {
+    renderer.flush();
+    render::RenderState &state = renderer.render_state;
+    if (renderer.indexed() && state.width > 0 && state.height > 0) {
+      if (StretchDIBits(hdc, 0, 0, state.width, state.height, 0, 0,
+                        state.width, state.height, state.indices,
+                        renderer.indexed_bitmap_info(), DIB_RGB_COLORS,
+                        SRCCOPY))
+        return;
+      renderer.resolve_indexed();
+    }
 
-      if (renderer.render_state.memory) {
-        VirtualFree(renderer.render_state.memory, 0, MEM_RELEASE);
-        renderer.render_state.memory = nullptr;
-      }
+    StretchDIBits(hdc, 0, 0, state.width, state.height, 0, 0, state.width,
+                  state.height, state.memory, &state.bitmap_info,
+                  DIB_RGB_COLORS, SRCCOPY);
+  }
 
-      renderer.render_state.width = new_width;
-      renderer.render_state.height = new_height;
-      const SIZE_T size = static_cast<SIZE_T>(renderer.render_state.width) *
-                          static_cast<SIZE_T>(renderer.render_state.height) *
-                          sizeof(u32);
+  power::Activity current_activity() const {
+    if (IsIconic(window))
+      return power::ACTIVITY_MINIMIZED;
+    if (occluded())
+      return power::ACTIVITY_OCCLUDED;
+    if (GetForegroundWindow() != window)
+      return power::ACTIVITY_BACKGROUND;
+    return power::ACTIVITY_FOREGROUND;
+  }
 
-      renderer.render_state.memory =
-          VirtualAlloc(nullptr, size, MEM_RESERVE | MEM_COMMIT, PAGE_READWRITE);
+  // GDI has no occlusion query and under DWM the window DC never clips. The
+  // window counts as hidden when DWM cloaks it (another virtual desktop, a
+  // suspended app) or the foreground window covers the whole client area.
+  bool occluded() const {
+    DWORD cloaked = 0;
+    if (SUCCEEDED(DwmGetWindowAttribute(window, DWMWA_CLOAKED, &cloaked,
+                                        sizeof(cloaked))) &&
+        cloaked)
+      return true;
+
+    HWND front = GetForegroundWindow();
+    if (!front || front == window || IsIconic(front))
+      return false;
+    RECT client, cover;
+    GetClientRect(window, &client);
+    MapWindowPoints(window, nullptr, reinterpret_cast<POINT *>(&client), 2);
+    if (!GetWindowRect(front, &cover))
+      return false;
+    return cover.left <= client.left && cover.top <= client.top &&
+           cover.right >= client.right && cover.bottom >= client.bottom;
+  }
 
-      if (!renderer.render_state.memory) {
-        renderer.render_state.width = renderer.render_state.height = 0;
-        return 0;
-      }
+  void open_settings() {
+    draft.ball_speed = game_config.ball_speed;
+    draft.paddle_speed = game_config.paddle_speed;
+    draft.paddle_damping = game_config.paddle_damping;
+    draft.game_duration_secs = static_cast<u16>(game_config.game_duration_secs);
+    draft.ai_difficulty = static_cast<i32>(game_config.ai_difficulty);
+    draft.theme = game_config.theme;
+    draft_before = draft;
+    menu_state = MENU_SETTINGS;
+  }
+
+  void start_match(bool versus_ai) {
+    MatchSettings settings;
+    settings.seed =
+        match_seed ? match_seed : static_cast<u32>(utils::query_counter());
+    settings.versus_ai = versus_ai;
+    settings.ai_difficulty = game_config.ai_difficulty;
+    settings.ball_speed = game_config.ball_speed;
+    settings.paddle_speed = game_config.paddle_speed;
+    settings.paddle_damping = game_config.paddle_damping;
+    settings.duration_secs = game_config.game_duration_secs;
+    settings.world_time = world.total_time;
+    match.start(settings);
+    match_started = std::time(nullptr);
+    if (!headless) {
+      hit_log.begin_match(settings.versus_ai
+                              ? static_cast<u8>(settings.ai_difficulty)
+                              : static_cast<u8>(results::MODE_FRIEND));
+      match.ball.controller.hit_log = &hit_log;
+    }
+    GAME_LOG(INFO, "match start, seed {:08x}, versus ai {}, difficulty {}",
+             settings.seed, versus_ai, settings.ai_difficulty);
+    result_saved = false;
+
+    recording_replay = game_config.record_replays;
+    if (recording_replay)
+      replay_recording.begin(settings);
+    confirm_modal = false;
+    menu_state = MENU_PLAYING;
+  }
+
+  // Appends the match whose time just ran out to the results log, once.
+  // Headless runs replay scripted matches and leave the log alone.
+  void save_result() {
+    if (result_saved || headless)
+      return;
+    result_saved = true;
+    const MatchSettings &s = match.settings;
+    results::Record record = {};
+    record.start_time = match_started;
+    record.end_time = std::time(nullptr);
+    record.seed = s.seed;
+    record.mode = s.versus_ai ? static_cast<u8>(s.ai_difficulty)
+                              : static_cast<u8>(results::MODE_FRIEND);
+    record.score1 = static_cast<u16>(match.player1.score);
+    record.score2 = static_cast<u16>(match.player2.score);
+    record.winner = record.score1 > record.score2   ? 1
+                    : record.score2 > record.score1 ? 2
+                                                    : 0;
+    record.rallies = static_cast<u16>(match.rallies);
+    record.longest_rally = static_cast<u16>(match.longest_rally);
+    record.hits = match.ball.controller.hits;
+    record.duration_secs = s.duration_secs;
+    record.played_secs = match.game_time_elapsed;
+    record.ball_speed = s.ball_speed;
+    record.paddle_speed = s.paddle_speed;
+    record.paddle_damping = s.paddle_damping;
+    GAME_LOG(INFO, "match over {}-{}, {} rallies, longest {}", record.score1,
+             record.score2, record.rallies, record.longest_rally);
+    match_results.append(record);
+    metrics::matches.add();
+    hit_log.save(hits_path);
+  }
+
+  // Hands this frame's input, menu and match state to the crash flight
+  // recorder, along with the frame buffer it was drawn into.
+  void record_flight(float dt) {
+    static_assert(std::size(flight::key_names) == input::BUTTON_COUNT);
+    flight::Frame f = {};
+    f.dt_ms = dt * 1000.0f;
+    f.counter = utils::query_counter();
+    for (i32 k = 0; k < input::BUTTON_COUNT; ++k)
+      if (input::buttons[k].is_down)
+        f.buttons |= 1u << k;
+    f.menu = static_cast<u8>(menu_state);
+    f.phase = static_cast<u8>(current_phase());
+    f.score1 = static_cast<u16>(match.player1.score);
+    f.score2 = static_cast<u16>(match.player2.score);
+    f.ball_x = match.ball.controller.pos.x;
+    f.ball_y = match.ball.controller.pos.y;
+    f.ball_vx = match.ball.controller.vel.x;
+    f.ball_vy = match.ball.controller.vel.y;
+    f.paddle1_y = match.player1.controller.pos.y;
+    f.paddle1_dp = match.player1.controller.dp;
+    f.paddle2_y = match.player2.controller.pos.y;
+    f.paddle2_dp = match.player2.controller.dp;
+    flight::recorder.record(f);
+
+    const render::RenderState &state = renderer.render_state;
+    flight::Screen screen;
+    screen.pixels = static_cast<const u32 *>(state.memory);
+    screen.indices = renderer.indexed() ? state.indices : nullptr;
+    screen.palette = state.indexed_bitmap_info.colors;
+    screen.width = state.width;
+    screen.height = state.height;
+    screen.pitch = state.pitch;
+    screen.index_pitch = state.index_pitch;
+    flight::recorder.set_screen(screen);
+  }
 
-      ZeroMemory(&renderer.render_state.bitmap_info,
-                 sizeof(renderer.render_state.bitmap_info));
-      BITMAPINFOHEADER &h = renderer.render_state.bitmap_info.bmiHeader;
+  // Saves the replay of the match that just ended or was abandoned.
+  void finish_match() {
+    if (!recording_replay || replay_recording.ticks.empty())
+      return;
+    recording_replay = false;
+    std::filesystem::create_directories("replays");
+    std::time_t now = std::time(nullptr);
+    std::ostringstream path;
+    path << "replays/match_"
+         << std::put_time(std::localtime(&now), "%Y%m%d_%H%M%S") << ".replay";
+    replay_recording.save(path.str());
+  }
 
-      h.biSize = sizeof(h);
-      h.biWidth = renderer.render_state.width;
-      h.biHeight = -renderer.render_state.height;
-      h.biPlanes = 1;
-      h.biBitCount = 32;
-      h.biCompression = BI_RGB;
-      h.biSizeImage = static_cast<DWORD>(size);
+  // A match is paused as soon as the window stops being in front. The serve
+  // countdown does not run on under the pause menu until the window is back.
+  void auto_pause() {
+    if (menu_state == MENU_PLAYING && !match.time_up_state) {
+      confirm_modal = true;
+      countdown_held = true;
     }
-      return 0;
+  }
+
+  // WM_SIZE only records the client size and the buffers follow once per
+  // frame, so a storm of resizes while dragging costs a single commit.
+  void apply_resize() {
+    framebuffer.trim();
+    if (!resize_pending)
+      return;
+    resize_pending = false;
+
+    render::RenderState &state = renderer.render_state;
+    if (pending_width <= 0 || pending_height <= 0 ||
+        !framebuffer.resize(pending_width, pending_height)) {
+      state.width = state.height = 0;
+      return;
     }
 
-    return DefWindowProcA(hwnd, uMsg, wParam, lParam);
+    state.memory = framebuffer.pixels();
+    state.indices = framebuffer.indices();
+    state.width = pending_width;
+    state.height = pending_height;
+    state.pitch = framebuffer.pixel_pitch();
+    state.index_pitch = framebuffer.index_pitch();
+
+    ZeroMemory(&state.bitmap_info, sizeof(state.bitmap_info));
+    BITMAPINFOHEADER &h = state.bitmap_info.bmiHeader;
+
+    h.biSize = sizeof(h);
+    h.biWidth = state.pitch;
+    h.biHeight = -state.height;
+    h.biPlanes = 1;
+    h.biBitCount = 32;
+    h.biCompression = BI_RGB;
+    h.biSizeImage =
+        static_cast<DWORD>(state.pitch) * state.height * sizeof(u32);
   }
 
   HICON getIcon() {
@@ -1827,10 +5186,9 @@ private:
   }
 
   inline void destroy() {
-    if (renderer.render_state.memory) {
-      VirtualFree(renderer.render_state.memory, 0, MEM_RELEASE);
-      renderer.render_state.memory = nullptr;
-    }
+    framebuffer.release();
+    renderer.render_state.memory = nullptr;
+    renderer.render_state.indices = nullptr;
 
     if (hdc) {
       ReleaseDC(window, hdc);
@@ -1850,6 +5208,17 @@ private:
   }
 
   void toggle_fullscreen() {
+    // Without a window there is nothing to restyle; the frame buffer
+    // changes size the way WM_SIZE would make it.
+    if (headless) {
+      is_fullscreen = !is_fullscreen;
+      pending_width = is_fullscreen ? HEADLESS_SCREEN_WIDTH : dimensions.width;
+      pending_height =
+          is_fullscreen ? HEADLESS_SCREEN_HEIGHT : dimensions.height;
+      resize_pending = true;
+      return;
+    }
+
     DWORD style = GetWindowLong(window, GWL_STYLE);
 
     if (!is_fullscreen) {
@@ -1876,6 +5245,16 @@ private:
   }
 
   i32 init() {
+    telemetry::startup.begin();
+
+    // The config touches nothing but itself and the audio settings, so it
+    // is read while the window is created.
+    std::jthread config_loader([this] {
+      i64 start = utils::query_counter();
+      game_config.init();
+      telemetry::startup.add("config", start, utils::query_counter(), true);
+    });
+
     window_class = {};
     window_class.style = CS_HREDRAW | CS_VREDRAW;
     window_class.lpszClassName = "Game Window Class";
@@ -1887,6 +5266,7 @@ private:
     if (!RegisterClassA(&window_class))
       return 0;
     class_registered = true;
+    telemetry::startup.mark("register_class");
 
     window = CreateWindowA(window_class.lpszClassName, title.c_str(),
                            WS_OVERLAPPEDWINDOW | WS_VISIBLE, CW_USEDEFAULT,
@@ -1898,19 +5278,45 @@ private:
 
     hdc = GetDC(window);
 
-    particle_burst.renderer = &renderer;
-    flash.renderer = &renderer;
-
     QueryPerformanceFrequency(&frequency);
     QueryPerformanceCounter(&last_counter);
+    telemetry::startup.mark("create_window");
 
     toggle_fullscreen();
+    telemetry::startup.mark("fullscreen");
+
+    config_loader.join();
+    telemetry::startup.mark("config_wait");
 
+    // Needs the audio settings from the config.
     audio::init();
-    game_config.init();
+    match_results.open_async();
+
+    if (game_config.metrics_port &&
+        !metrics::server.start(static_cast<u16>(game_config.metrics_port)))
+      GAME_LOG(WARN, "cannot serve metrics on port {}",
+               game_config.metrics_port);
+
+    renderer.theme = game_config.theme;
+    renderer.pixel_format = game_config.indexed_framebuffer
+                                ? render::PIXEL_FORMAT_INDEXED8
+                                : render::PIXEL_FORMAT_RGB32;
 
-    audio::update_music_volume();
-    audio::update_sfx_volume();
+    renderer.front_to_back = game_config.front_to_back;
+
+    // Room for a frame as large as the whole desktop.
+    framebuffer.reserve(GetSystemMetrics(SM_CXVIRTUALSCREEN),
+                        GetSystemMetrics(SM_CYVIRTUALSCREEN),
+                        game_config.large_pages);
+    resize_pending = true;
+    telemetry::startup.mark("frame_buffer");
+
+    post_process.bloom = game_config.post_bloom;
+    post_process.scanlines = game_config.post_scanlines;
+    post_process.vignette = game_config.post_vignette;
+
+    clips.configure(game_config.gif_seconds);
+    telemetry::startup.mark("setup");
 
     return 1;
   }
@@ -1927,42 +5333,60 @@ private:
   WINDOWPLACEMENT prev_wnd_place = {sizeof(prev_wnd_place)};
 
   render::Renderer renderer = {};
+  render::FramebufferAllocator framebuffer;
+  i32 pending_width = 0;
+  i32 pending_height = 0;
+  bool resize_pending = false;
   World world = {renderer};
 
   MenuState menu_state = MENU_MAIN;
-
-  objects::Player player1 = {renderer, false};
-  objects::Player player2 = {renderer, true};
-  objects::Ball ball = {renderer};
-
-  objects::ParticleBurst particle_burst = {renderer};
-  objects::FlashEffect flash = {renderer};
+  MenuState logged_menu = MENU_MAIN;
+
+  Match match;
+  replay::Recording replay_recording;
+  bool recording_replay = false;
+  results::Store match_results;
+  i64 match_started = 0;
+  bool result_saved = false;
+  analytics::HitLog hit_log;
+  std::string hits_path;
+
+  render::PostProcess post_process;
+  capture::Recorder recorder;
+  capture::ClipRecorder clips;
+  capture::Screenshotter screenshots;
+  bool show_post_timings = false;
 
   bool running = true;
   bool class_registered = false;
   bool is_fullscreen = false;
+  bool headless = false;
+
+  static constexpr i32 HEADLESS_SCREEN_WIDTH = 1920;
+  static constexpr i32 HEADLESS_SCREEN_HEIGHT = 1080;
 
   std::vector<std::string> menu_items = {"PLAY VS AI", "PLAY VS FRIEND",
                                          "SETTINGS", "EXIT"};
   int menu_index = 0;
-  float countdown_timer = 3.0f;
-
-  bool game_running = false;
-  bool paused = false;
   bool confirm_modal = false;
+  bool countdown_held = false;
+
+  // Settings being edited; they reach the config when leaving the screen.
+  struct SettingsDraft {
+    float ball_speed = 2.0f;
+    float paddle_speed = 2.0f;
+    float paddle_damping = 1.5f;
+    u16 game_duration_secs = 30;
+    i32 ai_difficulty = 1;
+    render::Theme theme = render::THEME_CLASSIC; // previewed until commit
+  };
+  SettingsDraft draft = {};
+  SettingsDraft draft_before = {}; // restored when the screen is cancelled
+  i32 settings_index = 0;
+  i8 paused_index = 0;
 
-  bool in_countdown = false;
-  float countdown_time = 0.0f;
-  int countdown_value = 3;
-
-  float game_time_elapsed = 0.0f;
-  bool game_timer_active = false;
-  bool time_up_state = false;
-  float time_up_delay = 0.0f;
-  float tick_timer = 0.0f;
-
-  bool in_celebration = false;
-  float celebration_time = 0.0f;
+  // Seeds every match when non-zero, for headless runs that must repeat.
+  u32 match_seed = 0;
 
   LARGE_INTEGER frequency = {};
   LARGE_INTEGER last_counter = {};
@@ -0,0 +1,347 @@
+#pragma once
+
+#include <algorithm>
+#include <array>
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include <vector>
+
+#include "thread_pool.hpp"
+
+namespace game {
+namespace gif {
+// Index 255 is never handed out and marks pixels that did not change.
+constexpr uint8_t TRANSPARENT = 255;
+
+// The game paints with a few dozen flat colours. The first EXACT_COLORS
+// distinct colours get entries of their own; colours seen after that
+// (blends, bloom, text edges) map to a 5x5x5 colour cube.
+class Palette {
+public:
+  static constexpr uint32_t EXACT_COLORS = 128;
+  static constexpr uint32_t CUBE_BASE = EXACT_COLORS;
+  static constexpr size_t SLOTS = 512;
+  static constexpr uint32_t EMPTY = 0xFFFFFFFF;
+
+  Palette() { reset(); }
+
+  void reset() {
+    colors.fill(0);
+    for (uint32_t r = 0; r < 5; ++r)
+      for (uint32_t g = 0; g < 5; ++g)
+        for (uint32_t b = 0; b < 5; ++b)
+          colors[CUBE_BASE + r * 25 + g * 5 + b] =
+              (r * 255 / 4) << 16 | (g * 255 / 4) << 8 | (b * 255 / 4);
+    keys.fill(EMPTY);
+    exact = 0;
+    cached = 0;
+    last_color = EMPTY;
+  }
+
+  uint8_t index_of(uint32_t color) {
+    color &= 0x00FFFFFF;
+    if (color == last_color)
+      return last_index;
+    size_t slot = (color * 0x9E3779B1u) >> 23;
+    while (keys[slot] != EMPTY && keys[slot] != color)
+      slot = (slot + 1) & (SLOTS - 1);
+    uint8_t index = keys[slot] == color ? values[slot] : insert(slot, color);
+    last_color = color;
+    last_index = index;
+    return index;
+  }
+
+  const std::array<uint32_t, 256> &entries() const { return colors; }
+
+private:
+  uint8_t insert(size_t slot, uint32_t color) {
+    uint8_t index;
+    if (exact < EXACT_COLORS) {
+      index = static_cast<uint8_t>(exact++);
+      colors[index] = color;
+    } else {
+      index = cube_index(color);
+    }
+    if (cached < SLOTS * 3 / 4) {
+      keys[slot] = color;
+      values[slot] = index;
+      cached++;
+    }
+    return index;
+  }
+
+  static uint8_t cube_index(uint32_t color) {
+    uint32_t r = (((color >> 16) & 0xFF) * 4 + 127) / 255;
+    uint32_t g = (((color >> 8) & 0xFF) * 4 + 127) / 255;
+    uint32_t b = ((color & 0xFF) * 4 + 127) / 255;
+    return static_cast<uint8_t>(CUBE_BASE + r * 25 + g * 5 + b);
+  }
+
+  std::array<uint32_t, 256> colors;
+  std::array<uint32_t, SLOTS> keys;
+  std::array<uint8_t, SLOTS> values = {};
+  uint32_t exact = 0;
+  uint32_t cached = 0;
+  uint32_t last_color = EMPTY;
+  uint8_t last_index = 0;
+};
+
+// LZW with a minimum code size of 8, as GIF image data needs it. The
+// string table is a hash of (prefix code, next index) pairs.
+class LzwEncoder {
+public:
+  LzwEncoder() : keys(TABLE_SIZE), codes(TABLE_SIZE) {}
+
+  void encode(const uint8_t *data, size_t count, std::vector<uint8_t> &out) {
+    bits = 0;
+    bit_count = 0;
+    reset();
+    write(CLEAR_CODE, out);
+    if (count == 0) {
+      write(END_CODE, out);
+      flush(out);
+      return;
+    }
+
+    uint32_t prefix = data[0];
+    for (size_t i = 1; i < count; ++i) {
+      uint32_t key = prefix << 8 | data[i];
+      size_t slot = (key * 0x9E3779B1u) >> (32 - TABLE_BITS);
+      while (keys[slot] != EMPTY && keys[slot] != key)
+        slot = (slot + 1) & (TABLE_SIZE - 1);
+      if (keys[slot] == key) {
+        prefix = codes[slot];
+        continue;
+      }
+
+      write(prefix, out);
+      keys[slot] = key;
+      codes[slot] = static_cast<uint16_t>(++max_code);
+      if (max_code >= (1u << code_size))
+        code_size++;
+      if (max_code == MAX_CODE) {
+        write(CLEAR_CODE, out);
+        reset();
+      }
+      prefix = data[i];
+    }
+    write(prefix, out);
+    write(END_CODE, out);
+    flush(out);
+  }
+
+private:
+  static constexpr uint32_t CLEAR_CODE = 256;
+  static constexpr uint32_t END_CODE = 257;
+  static constexpr uint32_t MAX_CODE = 4095;
+  static constexpr uint32_t TABLE_BITS = 13;
+  static constexpr size_t TABLE_SIZE = size_t(1) << TABLE_BITS;
+  static constexpr uint32_t EMPTY = 0xFFFFFFFF;
+
+  void reset() {
+    std::fill(keys.begin(), keys.end(), EMPTY);
+    code_size = 9;
+    max_code = END_CODE;
+  }
+
+  void write(uint32_t code, std::vector<uint8_t> &out) {
+    bits |= code << bit_count;
+    bit_count += code_size;
+    while (bit_count >= 8) {
+      out.push_back(static_cast<uint8_t>(bits));
+      bits >>= 8;
+      bit_count -= 8;
+    }
+  }
+
+  void flush(std::vector<uint8_t> &out) {
+    if (bit_count > 0)
+      out.push_back(static_cast<uint8_t>(bits));
+    bits = 0;
+    bit_count = 0;
+  }
+
+  std::vector<uint32_t> keys;
+  std::vector<uint16_t> codes;
+  uint32_t code_size = 9;
+  uint32_t max_code = END_CODE;
+  uint32_t bits = 0;
+  uint32_t bit_count = 0;
+};
+
+struct Frame {
+  std::vector<uint8_t> pixels; // palette indices, width * height
+  int64_t timestamp = 0;       // performance counter ticks
+};
+
+struct Clip {
+  int32_t width = 0;
+  int32_t height = 0;
+  int32_t fps = 20;      // nominal rate, for the last frame's delay
+  int64_t frequency = 1; // of the timestamps
+  std::array<uint32_t, 256> palette = {};
+  std::vector<Frame> frames;
+};
+
+struct Stats {
+  size_t frames = 0;      // frames in the clip
+  size_t images = 0;      // after dropping frames that did not change
+  uint64_t pixels = 0;    // pixels inside the changed rectangles
+  uint64_t raw_bytes = 0; // the clip as 32-bit frames
+  uint64_t bytes = 0;     // the GIF file
+};
+
+// Encodes a looping GIF. Each frame after the first is cut down to the
+// rectangle that differs from the frame before it, with pixels that did not
+// change inside it left transparent. The rectangles are found and LZW coded
+// in parallel; only the final concatenation is sequential.
+inline std::vector<uint8_t> encode(const Clip &clip, utils::ThreadPool &pool,
+                                   Stats *stats = nullptr,
+                                   bool diff_frames = true) {
+  struct Image {
+    int32_t x0 = 0, y0 = 0, x1 = 0, y1 = 0;
+    uint32_t delay = 0; // centiseconds
+    bool transparent = false;
+    std::vector<uint8_t> data;
+  };
+
+  size_t count = clip.frames.size();
+  size_t width = static_cast<size_t>(clip.width);
+  std::vector<Image> images(count);
+
+  // Delays are taken from the running total so they add up to the clip's
+  // real length. Browsers treat delays under 2 as 10, so 2 is the minimum.
+  for (size_t i = 0; i < count; ++i) {
+    int64_t begin = clip.frames[i].timestamp - clip.frames[0].timestamp;
+    int64_t end = i + 1 < count
+                      ? clip.frames[i + 1].timestamp - clip.frames[0].timestamp
+                      : begin + clip.frequency / clip.fps;
+    int64_t cs = end * 100 / clip.frequency - begin * 100 / clip.frequency;
+    images[i].delay = static_cast<uint32_t>(std::max<int64_t>(cs, 2));
+  }
+
+  pool.parallel_for(count, [&](size_t i) {
+    Image &image = images[i];
+    const uint8_t *current = clip.frames[i].pixels.data();
+    image.x1 = clip.width;
+    image.y1 = clip.height;
+
+    std::vector<uint8_t> region;
+    const uint8_t *source = current;
+    if (i > 0 && diff_frames) {
+      const uint8_t *previous = clip.frames[i - 1].pixels.data();
+      auto same_row = [&](int32_t y) {
+        return std::memcmp(current + y * width, previous + y * width, width) ==
+               0;
+      };
+      while (image.y0 < image.y1 && same_row(image.y0))
+        image.y0++;
+      if (image.y0 == image.y1) {
+        image.y1 = 0; // unchanged, merged into the previous frame
+        return;
+      }
+      while (same_row(image.y1 - 1))
+        image.y1--;
+
+      image.x0 = clip.width;
+      image.x1 = 0;
+      for (int32_t y = image.y0; y < image.y1; ++y) {
+        const uint8_t *a = current + y * width;
+        const uint8_t *b = previous + y * width;
+        int32_t left = 0;
+        while (left < image.x0 && a[left] == b[left])
+          left++;
+        int32_t right = clip.width;
+        while (right > image.x1 && a[right - 1] == b[right - 1])
+          right--;
+        image.x0 = std::min(image.x0, left);
+        image.x1 = std::max(image.x1, right);
+      }
+
+      region.resize(static_cast<size_t>(image.x1 - image.x0) *
+                    (image.y1 - image.y0));
+      uint8_t *out = region.data();
+      for (int32_t y = image.y0; y < image.y1; ++y)
+        for (int32_t x = image.x0; x < image.x1; ++x) {
+          uint8_t value = current[y * width + x];
+          *out++ = value == previous[y * width + x] ? TRANSPARENT : value;
+        }
+      image.transparent = true;
+      source = region.data();
+    }
+
+    LzwEncoder encoder;
+    size_t pixels =
+        static_cast<size_t>(image.x1 - image.x0) * (image.y1 - image.y0);
+    image.data.reserve(pixels / 4);
+    encoder.encode(source, pixels, image.data);
+  });
+
+  size_t total = 1024;
+  for (const Image &image : images)
+    total += image.data.size() + image.data.size() / 255 + 32;
+  std::vector<uint8_t> out;
+  out.reserve(total);
+  auto put = [&](std::initializer_list<uint8_t> bytes) {
+    out.insert(out.end(), bytes);
+  };
+  auto put16 = [&](uint32_t value) {
+    put({static_cast<uint8_t>(value), static_cast<uint8_t>(value >> 8)});
+  };
+
+  put({'G', 'I', 'F', '8', '9', 'a'});
+  put16(clip.width);
+  put16(clip.height);
+  put({0xF7, 0, 0}); // global table of 256 colours
+  for (uint32_t color : clip.palette)
+    put({static_cast<uint8_t>(color >> 16), static_cast<uint8_t>(color >> 8),
+         static_cast<uint8_t>(color)});
+  const char loop[] = "\x21\xFF\x0BNETSCAPE2.0\x03\x01\x00\x00\x00";
+  out.insert(out.end(), loop, loop + 19);
+
+  Stats result;
+  result.frames = count;
+  result.raw_bytes = static_cast<uint64_t>(width) * clip.height * 4 * count;
+  for (size_t i = 0; i < count; ++i) {
+    Image &image = images[i];
+    if (image.y1 == 0)
+      continue;
+    // Frames that did not change lengthen this one instead.
+    uint32_t delay = image.delay;
+    for (size_t j = i + 1; j < count && images[j].y1 == 0; ++j)
+      delay += images[j].delay;
+
+    // Graphic control: keep the previous frame underneath (disposal 1).
+    put({0x21, 0xF9, 4,
+         static_cast<uint8_t>(0x04 | (image.transparent ? 1 : 0))});
+    put16(std::min<uint32_t>(delay, 0xFFFF));
+    put({TRANSPARENT, 0});
+
+    put({0x2C});
+    put16(image.x0);
+    put16(image.y0);
+    put16(image.x1 - image.x0);
+    put16(image.y1 - image.y0);
+    put({0, 8});
+    for (size_t at = 0; at < image.data.size(); at += 255) {
+      size_t block = std::min<size_t>(255, image.data.size() - at);
+      out.push_back(static_cast<uint8_t>(block));
+      out.insert(out.end(), image.data.begin() + at,
+                 image.data.begin() + at + block);
+    }
+    put({0});
+
+    result.images++;
+    result.pixels +=
+        static_cast<uint64_t>(image.x1 - image.x0) * (image.y1 - image.y0);
+  }
+  put({0x3B});
+
+  result.bytes = out.size();
+  if (stats)
+    *stats = result;
+  return out;
+}
+} // namespace gif
+} // namespace game
@@ -0,0 +1,262 @@
+#pragma once
+
+#include "game.hpp"
+#include "headless.hpp"
+#include "replay_export.hpp"
+
+// Renders fixed scenes headlessly through the real menus and match at
+// several resolutions, and checks each final frame against a stored hash:
+//   pingpong.exe --golden            compare against golden/hashes.txt
+//   pingpong.exe --golden --update   record new hashes and images
+//
+// Scenes are driven by scripted key presses at a fixed 60 Hz step with a
+// fixed match seed, so a scene always ends on the same frame. The frame
+// time of every scene is printed with the result and appended to
+// stats/golden.csv, so a change to the drawing code is checked for both
+// output and speed in one run.
+
+namespace game {
+namespace golden {
+constexpr u32 SEED = 0x5EED;
+
+struct Size {
+  i32 width;
+  i32 height;
+};
+
+// The odd size catches rounding and clipping at the right and bottom edges.
+const Size sizes[] = {{640, 360}, {1280, 720}, {1920, 1080}, {1023, 577}};
+
+using headless::Driver;
+using headless::TICKS_PER_SECOND;
+
+struct Scene {
+  const char *name;
+  bool (*script)(Driver &);
+};
+
+inline bool main_menu(Driver &d) {
+  d.step(30);
+  return true;
+}
+
+inline bool settings(Driver &d) {
+  d.tap(input::BUTTON_DOWN_ARROW);
+  d.tap(input::BUTTON_DOWN_ARROW);
+  d.tap(input::BUTTON_ENTER);
+  for (i32 i = 0; i < 3; ++i)
+    d.tap(input::BUTTON_DOWN_ARROW);
+  d.step(10);
+  return true;
+}
+
+// Player 1 moves up and down while the AI plays the ball back.
+inline bool gameplay(Driver &d) {
+  d.tap(input::BUTTON_ENTER);
+  if (!d.until(telemetry::PHASE_GAMEPLAY, 10 * TICKS_PER_SECOND))
+    return false;
+  d.hold(input::BUTTON_UP, 20);
+  d.step(20);
+  d.hold(input::BUTTON_DOWN, 30);
+  d.step(10);
+  return true;
+}
+
+// The first point, a few frames into the burst.
+inline bool celebration(Driver &d) {
+  d.tap(input::BUTTON_ENTER);
+  if (!d.until(telemetry::PHASE_CELEBRATION, 60 * TICKS_PER_SECOND))
+    return false;
+  d.step(12);
+  return true;
+}
+
+const Scene scenes[] = {{"main_menu", main_menu},
+                        {"settings", settings},
+                        {"gameplay", gameplay},
+                        {"celebration", celebration}};
+
+// FNV-1a over the colour bytes; the unused fourth byte is ignored.
+inline u64 hash_frame(const std::vector<u32> &pixels) {
+  u64 hash = 0xCBF29CE484222325ull;
+  for (u32 pixel : pixels)
+    for (i32 shift = 0; shift < 24; shift += 8) {
+      hash ^= (pixel >> shift) & 0xFF;
+      hash *= 0x100000001B3ull;
+    }
+  return hash;
+}
+
+inline std::string key_of(const Scene &scene, const Size &size) {
+  return std::format("{}_{}x{}", scene.name, size.width, size.height);
+}
+
+inline std::unordered_map<std::string, u64>
+load_hashes(const std::string &path) {
+  std::unordered_map<std::string, u64> hashes;
+  std::ifstream in(path);
+  std::string line;
+  while (std::getline(in, line)) {
+    if (line.empty() || line[0] == '#')
+      continue;
+    std::istringstream fields(line);
+    std::string key;
+    u64 hash = 0;
+    if (fields >> key >> std::hex >> hash)
+      hashes[key] = hash;
+  }
+  return hashes;
+}
+
+// Reads back the 32-bit top-down BMPs that write_bmp produces.
+inline bool read_bmp(const std::string &path, std::vector<u32> &pixels,
+                     i32 width, i32 height) {
+  std::ifstream in(path, std::ios::binary);
+  if (!in)
+    return false;
+  in.seekg(14 + 40);
+  pixels.resize(static_cast<size_t>(width) * height);
+  in.read(reinterpret_cast<char *>(pixels.data()),
+          static_cast<std::streamsize>(pixels.size() * 4));
+  return static_cast<bool>(in);
+}
+
+// Differing pixels in red over a dimmed copy of the expected frame.
+inline size_t write_diff(const std::string &path,
+                         const std::vector<u32> &expected,
+                         const std::vector<u32> &actual, i32 width,
+                         i32 height) {
+  std::vector<u32> diff(actual.size());
+  size_t differing = 0;
+  for (size_t i = 0; i < actual.size(); ++i) {
+    if ((expected[i] ^ actual[i]) & 0x00FFFFFF) {
+      diff[i] = 0x00FF0000;
+      differing++;
+    } else {
+      diff[i] = (expected[i] >> 2) & 0x003F3F3F;
+    }
+  }
+  replay_export::write_bmp(path, diff.data(), width, height);
+  return differing;
+}
+
+inline void append_csv(const std::string &directory, const std::string &key,
+                       u64 hash, const char *result, const Driver &driver) {
+  std::filesystem::create_directories(directory);
+  std::string path = directory + "/golden.csv";
+  bool exists = std::filesystem::exists(path);
+  std::ofstream out(path, std::ios::app);
+  if (!out)
+    return;
+  if (!exists)
+    out << "time,scene,hash,result,frames,mean_frame_ms,last_frame_ms\n";
+  std::time_t now = std::time(nullptr);
+  out << std::put_time(std::localtime(&now), "%Y%m%d_%H%M%S") << "," << key
+      << "," << std::format("{:016x}", hash) << "," << result << ","
+      << driver.frames() << "," << driver.mean_ms() << ","
+      << driver.last_ms() << "\n";
+}
+
+// --golden [--update] [scene]
+inline i32 run(const std::vector<std::string> &args) {
+  utils::attach_console();
+
+  const std::string directory = "golden";
+  const std::string hashes_path = directory + "/hashes.txt";
+  bool update = false;
+  std::string selected = "all";
+  for (const std::string &arg : args) {
+    if (arg == "--update")
+      update = true;
+    else
+      selected = arg;
+  }
+
+  std::unordered_map<std::string, u64> expected = load_hashes(hashes_path);
+  if (expected.empty() && !update) {
+    std::printf("no golden hashes in %s; record them with --golden "
+                "--update\n",
+                hashes_path.c_str());
+    return 1;
+  }
+  std::filesystem::create_directories(directory + "/actual");
+
+  std::printf("%-24s %-8s %18s %8s %10s %10s\n", "scene", "result", "hash",
+              "frames", "mean ms", "last ms");
+  i32 failures = 0;
+  bool found = false;
+  for (const Scene &scene : scenes) {
+    if (selected != "all" && selected != scene.name)
+      continue;
+    found = true;
+    for (const Size &size : sizes) {
+      std::string key = key_of(scene, size);
+      Driver driver(size.width, size.height, SEED);
+      bool reached = scene.script(driver);
+      std::vector<u32> frame = driver.frame();
+      u64 hash = hash_frame(frame);
+
+      const char *result = "ok";
+      std::string reference = directory + "/" + key + ".bmp";
+      if (!reached) {
+        result = "stuck";
+      } else if (update) {
+        expected[key] = hash;
+        replay_export::write_bmp(reference, frame.data(), size.width,
+                                 size.height);
+        result = "updated";
+      } else if (!expected.contains(key)) {
+        result = "missing";
+      } else if (expected[key] != hash) {
+        result = "changed";
+      }
+
+      if (!reached || (!update && std::strcmp(result, "ok") != 0)) {
+        failures++;
+        std::string actual = directory + "/actual/" + key + ".bmp";
+        replay_export::write_bmp(actual, frame.data(), size.width,
+                                 size.height);
+        std::vector<u32> before;
+        if (read_bmp(reference, before, size.width, size.height)) {
+          size_t differing =
+              write_diff(directory + "/actual/" + key + "_diff.bmp", before,
+                         frame, size.width, size.height);
+          std::printf("  %s: %zu pixels differ\n", key.c_str(), differing);
+        }
+      }
+
+      std::printf("%-24s %-8s %18s %8u %10.3f %10.3f\n", key.c_str(), result,
+                  std::format("{:016x}", hash).c_str(), driver.frames(),
+                  driver.mean_ms(), driver.last_ms());
+      append_csv("stats", key, hash, result, driver);
+    }
+  }
+
+  if (!found) {
+    std::printf("unknown scene '%s'; available:", selected.c_str());
+    for (const Scene &scene : scenes)
+      std::printf(" %s", scene.name);
+    std::printf(" all\n");
+    return 1;
+  }
+
+  if (update) {
+    std::vector<std::string> keys;
+    for (const auto &[key, hash] : expected)
+      keys.push_back(key);
+    std::sort(keys.begin(), keys.end());
+    std::ofstream out(hashes_path, std::ios::trunc);
+    out << "# scene_WxH fnv1a-64 of the final frame, from --golden --update\n";
+    for (const std::string &key : keys)
+      out << key << " " << std::format("{:016x}", expected[key]) << "\n";
+    std::printf("recorded %zu hashes in %s\n", keys.size(),
+                hashes_path.c_str());
+    return 0;
+  }
+
+  if (failures > 0)
+    std::printf("%d of the frames do not match\n", failures);
+  return failures > 0 ? 1 : 0;
+}
+} // namespace golden
+} // namespace game
@@ -0,0 +1,105 @@
+#pragma once
+
+#include "game.hpp"
+
+namespace game {
+namespace headless {
+constexpr i32 TICKS_PER_SECOND = 60;
+
+// The real menus and match without a window, fed scripted key presses at a
+// fixed 60 Hz step and as fast as they run. Every frame's time goes into a
+// histogram; once `max_frames` have run, further steps do nothing so a
+// script can simply stop there.
+class Driver {
+public:
+  Driver(i32 width, i32 height, u32 seed, u32 max_frames = 0xFFFFFFFF)
+      : game_window(std::make_unique<window::Window>()),
+        max_frames(max_frames) {
+    for (i32 k = 0; k < input::BUTTON_COUNT; ++k)
+      input::buttons[k] = {};
+    game_window->init_headless(width, height, seed);
+  }
+
+  window::Window &window() { return *game_window; }
+
+  void step(i32 frames = 1) {
+    for (i32 i = 0; i < frames; ++i)
+      advance(input::BUTTON_COUNT, false);
+  }
+
+  // Down for one frame, up the next.
+  void tap(input::Key key) {
+    advance(key, true);
+    advance(key, false);
+  }
+
+  void hold(input::Key key, i32 frames) {
+    advance(key, true);
+    step(frames - 1);
+    advance(key, false);
+  }
+
+  bool until(telemetry::Phase target, i32 max_steps) {
+    for (i32 i = 0; i < max_steps && !done() && phase() != target; ++i)
+      step();
+    return phase() == target;
+  }
+
+  telemetry::Phase phase() const { return game_window->current_phase(); }
+
+  bool done() const { return count >= max_frames; }
+
+  // The visible pixels of the last frame, row after row.
+  std::vector<u32> frame() const {
+    const render::RenderState &state = game_window->frame_buffer();
+    const u32 *memory = static_cast<const u32 *>(state.memory);
+    std::vector<u32> pixels(static_cast<size_t>(state.width) * state.height);
+    for (i32 y = 0; y < state.height; ++y)
+      std::memcpy(pixels.data() + static_cast<size_t>(y) * state.width,
+                  memory + static_cast<size_t>(y) * state.pitch,
+                  static_cast<size_t>(state.width) * sizeof(u32));
+    return pixels;
+  }
+
+  i32 width() const { return game_window->frame_buffer().width; }
+  i32 height() const { return game_window->frame_buffer().height; }
+
+  const telemetry::FrameHistogram &times() const { return histogram; }
+  u32 frames() const { return count; }
+  double seconds() const { return to_ms(histogram.sum) / 1000.0; }
+  double mean_ms() const { return count ? to_ms(histogram.sum) / count : 0.0; }
+  double last_ms() const { return to_ms(latest); }
+
+  static double to_ms(u64 ticks) {
+    return static_cast<double>(ticks) * 1000.0 /
+           static_cast<double>(utils::counter_frequency());
+  }
+
+private:
+  void advance(input::Key key, bool down) {
+    if (done())
+      return;
+    i64 period = utils::counter_frequency() / TICKS_PER_SECOND;
+    i64 begin = clock;
+    clock += period;
+    input::begin_frame();
+    input::set_frame_interval(begin, clock);
+    if (key != input::BUTTON_COUNT)
+      input::set_key(key, down, begin);
+
+    i64 start = utils::query_counter();
+    game_window->headless_frame(1.0f / TICKS_PER_SECOND);
+    latest = static_cast<u64>(utils::query_counter() - start);
+    histogram.record(latest);
+    count++;
+  }
+
+  std::unique_ptr<window::Window> game_window;
+  u32 max_frames;
+  u32 count = 0;
+  i64 clock = 0;
+  u64 latest = 0;
+  telemetry::FrameHistogram histogram;
+};
+} // namespace headless
+} // namespace game
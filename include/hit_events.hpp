@@ -0,0 +1,119 @@
+#pragma once
+
+#include <algorithm>
+#include <cmath>
+#include <cstdint>
+#include <filesystem>
+#include <fstream>
+#include <string>
+#include <vector>
+
+// Compact events for play analytics: every paddle hit with where on the
+// paddle the ball landed, how fast the paddle and ball were moving and the
+// physics tick, every goal, and the start of every match. A match played in
+// the game appends its events to stats/hits/<session>.hits; --analytics
+// reads them back, or simulates its own.
+
+namespace game {
+namespace analytics {
+enum EventKind : uint8_t { EVENT_MATCH, EVENT_HIT, EVENT_GOAL };
+
+// Fixed point keeps an event at 12 bytes. The offset is (ball y - paddle
+// y) / paddle half height, about -1.1 to 1.1 with the ball's size.
+constexpr float OFFSET_SCALE = 8192.0f;
+constexpr float DP_SCALE = 16.0f;
+constexpr float SPEED_SCALE = 16.0f;
+
+struct HitEvent {
+  uint32_t tick;
+  uint8_t kind;
+  uint8_t paddle; // 1 or 2: who hit, or who scored; the mode for a match
+  int16_t offset;
+  int16_t dp;
+  uint16_t speed;
+
+  float hit_offset() const { return offset / OFFSET_SCALE; }
+  float paddle_speed() const { return dp / DP_SCALE; }
+  float ball_speed() const { return speed / SPEED_SCALE; }
+};
+static_assert(sizeof(HitEvent) == 12);
+
+constexpr uint32_t MAGIC = 0x54485050; // "PPHT"
+constexpr uint32_t VERSION = 1;
+
+struct FileHeader {
+  uint32_t magic;
+  uint32_t version;
+  uint32_t event_size;
+  uint32_t reserved;
+};
+
+inline int16_t to_fixed16(float value, float scale) {
+  return static_cast<int16_t>(
+      std::lround(std::clamp(value * scale, -32767.0f, 32767.0f)));
+}
+
+// Collects the events of the matches in progress; cheap enough to append
+// from the ball's collision code every time.
+class HitLog {
+public:
+  void begin_match(uint8_t mode) {
+    events.push_back({0, EVENT_MATCH, mode, 0, 0, 0});
+  }
+
+  void hit(uint32_t tick, uint8_t paddle, float offset, float dp,
+           float speed) {
+    events.push_back(
+        {tick, EVENT_HIT, paddle, to_fixed16(offset, OFFSET_SCALE),
+         to_fixed16(dp, DP_SCALE),
+         static_cast<uint16_t>(std::lround(
+             std::clamp(speed * SPEED_SCALE, 0.0f, 65535.0f)))});
+  }
+
+  void goal(uint32_t tick, uint8_t scorer) {
+    events.push_back({tick, EVENT_GOAL, scorer, 0, 0, 0});
+  }
+
+  // Appends what was collected to `path` and starts over.
+  bool save(const std::string &path) {
+    if (events.empty())
+      return true;
+    std::filesystem::path file(path);
+    if (file.has_parent_path())
+      std::filesystem::create_directories(file.parent_path());
+    bool exists = std::filesystem::exists(file);
+    std::ofstream out(file, std::ios::binary | std::ios::app);
+    if (!out)
+      return false;
+    if (!exists) {
+      FileHeader header = {MAGIC, VERSION, sizeof(HitEvent), 0};
+      out.write(reinterpret_cast<const char *>(&header), sizeof(header));
+    }
+    out.write(reinterpret_cast<const char *>(events.data()),
+              static_cast<std::streamsize>(events.size() * sizeof(HitEvent)));
+    events.clear();
+    return static_cast<bool>(out);
+  }
+
+  std::vector<HitEvent> events;
+};
+
+// Appends the events in `path` to `events`; false if it is not a hit log.
+inline bool load(const std::string &path, std::vector<HitEvent> &events) {
+  std::ifstream in(path, std::ios::binary);
+  FileHeader header = {};
+  in.read(reinterpret_cast<char *>(&header), sizeof(header));
+  if (!in || header.magic != MAGIC || header.version != VERSION ||
+      header.event_size != sizeof(HitEvent))
+    return false;
+  size_t bytes = static_cast<size_t>(std::filesystem::file_size(path)) -
+                 sizeof(FileHeader);
+  size_t first = events.size();
+  events.resize(first + bytes / sizeof(HitEvent));
+  in.read(reinterpret_cast<char *>(events.data() + first),
+          static_cast<std::streamsize>((events.size() - first) *
+                                       sizeof(HitEvent)));
+  return true;
+}
+} // namespace analytics
+} // namespace game
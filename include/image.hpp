@@ -0,0 +1,473 @@
+#pragma once
+
+#include <emmintrin.h>
+
+#include <algorithm>
+#include <array>
+#include <cstddef>
+#include <cstdint>
+#include <cstdlib>
+#include <cstring>
+#include <vector>
+
+namespace game {
+namespace image {
+inline uint32_t crc32(const uint8_t *data, size_t size, uint32_t crc = 0) {
+  static const std::array<uint32_t, 256> table = [] {
+    std::array<uint32_t, 256> t = {};
+    for (uint32_t i = 0; i < 256; ++i) {
+      uint32_t c = i;
+      for (int k = 0; k < 8; ++k)
+        c = c & 1 ? 0xEDB88320u ^ (c >> 1) : c >> 1;
+      t[i] = c;
+    }
+    return t;
+  }();
+  crc = ~crc;
+  for (size_t i = 0; i < size; ++i)
+    crc = table[(crc ^ data[i]) & 0xFF] ^ (crc >> 8);
+  return ~crc;
+}
+
+inline uint32_t adler32(const uint8_t *data, size_t size) {
+  // 5552 bytes is the most that can be summed before b can overflow.
+  uint32_t a = 1, b = 0;
+  while (size > 0) {
+    size_t block = std::min<size_t>(size, 5552);
+    size -= block;
+    for (size_t i = 0; i < block; ++i) {
+      a += data[i];
+      b += a;
+    }
+    data += block;
+    a %= 65521;
+    b %= 65521;
+  }
+  return b << 16 | a;
+}
+
+// Single-pass deflate for rendered frames: greedy LZ77 with one hash probe
+// per position and the fixed Huffman code, written as one final block. Flat
+// colour rows filter to long runs, which this handles well; it makes no
+// attempt at the ratio of zlib's higher levels.
+class Deflater {
+public:
+  Deflater() : head(size_t(1) << HASH_BITS) {}
+
+  // Appends data as a zlib stream (header, deflate block, Adler-32).
+  void zlib(const uint8_t *data, size_t size, std::vector<uint8_t> &out) {
+    out.push_back(0x78);
+    out.push_back(0x01);
+    deflate(data, size, out);
+    uint32_t adler = adler32(data, size);
+    for (int shift = 24; shift >= 0; shift -= 8)
+      out.push_back(static_cast<uint8_t>(adler >> shift));
+  }
+
+  void deflate(const uint8_t *data, size_t size, std::vector<uint8_t> &out) {
+    const Tables &t = tables();
+    std::fill(head.begin(), head.end(), -1);
+    bits = 0;
+    bit_count = 0;
+    put(0x3, 3, out); // final block, fixed Huffman
+
+    size_t i = 0;
+    while (i + MIN_MATCH <= size) {
+      uint32_t h = hash(data + i);
+      int64_t candidate = head[h];
+      head[h] = static_cast<int32_t>(i);
+      if (candidate < 0 || i - candidate > WINDOW ||
+          std::memcmp(data + candidate, data + i, MIN_MATCH) != 0) {
+        put(t.code[data[i]], t.length[data[i]], out);
+        i++;
+        continue;
+      }
+
+      size_t limit = std::min<size_t>(MAX_MATCH, size - i);
+      size_t length = MIN_MATCH;
+      while (length < limit && data[candidate + length] == data[i + length])
+        length++;
+
+      uint32_t symbol = t.length_symbol[length];
+      put(t.code[symbol], t.length[symbol], out);
+      put(static_cast<uint32_t>(length) - LENGTH_BASE[symbol - 257],
+          LENGTH_EXTRA[symbol - 257], out);
+
+      uint32_t distance = static_cast<uint32_t>(i - candidate);
+      uint32_t d = distance - 1;
+      uint32_t code = d < 256 ? t.distance_symbol[d]
+                              : t.distance_symbol[256 + (d >> 7)];
+      put(t.distance_code[code], 5, out);
+      put(distance - DISTANCE_BASE[code], DISTANCE_EXTRA[code], out);
+      i += length;
+    }
+    for (; i < size; ++i)
+      put(t.code[data[i]], t.length[data[i]], out);
+    put(t.code[256], t.length[256], out);
+    if (bit_count > 0)
+      out.push_back(static_cast<uint8_t>(bits));
+  }
+
+private:
+  static constexpr int HASH_BITS = 15;
+  static constexpr size_t WINDOW = 32768;
+  static constexpr size_t MIN_MATCH = 4;
+  static constexpr size_t MAX_MATCH = 258;
+
+  static constexpr uint16_t LENGTH_BASE[29] = {
+      3,  4,  5,  6,  7,  8,  9,  10, 11,  13,  15,  17,  19,  23, 27,
+      31, 35, 43, 51, 59, 67, 83, 99, 115, 131, 163, 195, 227, 258};
+  static constexpr uint8_t LENGTH_EXTRA[29] = {0, 0, 0, 0, 0, 0, 0, 0, 1, 1,
+                                               1, 1, 2, 2, 2, 2, 3, 3, 3, 3,
+                                               4, 4, 4, 4, 5, 5, 5, 5, 0};
+  static constexpr uint16_t DISTANCE_BASE[30] = {
+      1,    2,    3,    4,    5,    7,     9,     13,    17,  25,
+      33,   49,   65,   97,   129,  193,   257,   385,   513, 769,
+      1025, 1537, 2049, 3073, 4097, 6145,  8193,  12289, 16385, 24577};
+  static constexpr uint8_t DISTANCE_EXTRA[30] = {
+      0, 0, 0, 0, 1, 1, 2, 2, 3, 3, 4, 4, 5, 5, 6,
+      6, 7, 7, 8, 8, 9, 9, 10, 10, 11, 11, 12, 12, 13, 13};
+
+  // Codes are stored bit-reversed, ready to be written LSB first.
+  struct Tables {
+    std::array<uint16_t, 288> code = {};
+    std::array<uint8_t, 288> length = {};
+    std::array<uint16_t, 259> length_symbol = {};
+    std::array<uint8_t, 512> distance_symbol = {};
+    std::array<uint8_t, 30> distance_code = {};
+  };
+
+  static uint32_t reverse(uint32_t code, int length) {
+    uint32_t result = 0;
+    for (int i = 0; i < length; ++i)
+      result |= ((code >> i) & 1) << (length - 1 - i);
+    return result;
+  }
+
+  static const Tables &tables() {
+    static const Tables t = [] {
+      Tables t;
+      for (uint32_t s = 0; s < 288; ++s) {
+        uint32_t code, length;
+        if (s < 144)
+          code = 0x30 + s, length = 8;
+        else if (s < 256)
+          code = 0x190 + s - 144, length = 9;
+        else if (s < 280)
+          code = s - 256, length = 7;
+        else
+          code = 0xC0 + s - 280, length = 8;
+        t.code[s] = static_cast<uint16_t>(reverse(code, length));
+        t.length[s] = static_cast<uint8_t>(length);
+      }
+      for (uint32_t s = 0; s < 29; ++s) {
+        uint32_t end = s + 1 < 29 ? LENGTH_BASE[s + 1] : 259;
+        for (uint32_t l = LENGTH_BASE[s]; l < end; ++l)
+          t.length_symbol[l] = static_cast<uint16_t>(257 + s);
+      }
+      // zlib's layout: distances up to 256 directly, larger ones by d >> 7.
+      for (uint32_t c = 0; c < 30; ++c) {
+        uint32_t first = DISTANCE_BASE[c] - 1;
+        uint32_t last = first + (1u << DISTANCE_EXTRA[c]);
+        for (uint32_t d = first; d < last; ++d) {
+          if (d < 256)
+            t.distance_symbol[d] = static_cast<uint8_t>(c);
+          else
+            t.distance_symbol[256 + (d >> 7)] = static_cast<uint8_t>(c);
+        }
+        t.distance_code[c] = static_cast<uint8_t>(reverse(c, 5));
+      }
+      return t;
+    }();
+    return t;
+  }
+
+  static uint32_t hash(const uint8_t *p) {
+    uint32_t value;
+    std::memcpy(&value, p, 4);
+    return (value * 2654435761u) >> (32 - HASH_BITS);
+  }
+
+  void put(uint32_t value, uint32_t count, std::vector<uint8_t> &out) {
+    bits |= static_cast<uint64_t>(value) << bit_count;
+    bit_count += count;
+    while (bit_count >= 8) {
+      out.push_back(static_cast<uint8_t>(bits));
+      bits >>= 8;
+      bit_count -= 8;
+    }
+  }
+
+  std::vector<int32_t> head;
+  uint64_t bits = 0;
+  uint32_t bit_count = 0;
+};
+
+// Written without early returns so compilers emit conditional moves.
+inline uint8_t paeth(uint8_t a, uint8_t b, uint8_t c) {
+  int pa = std::abs(b - c);
+  int pb = std::abs(a - c);
+  int pc = std::abs(a + b - 2 * c);
+  uint8_t bc = pb <= pc ? b : c;
+  return pa <= pb && pa <= pc ? a : bc;
+}
+
+inline uint32_t magnitude(uint8_t value) {
+  return static_cast<uint32_t>(std::abs(static_cast<int8_t>(value)));
+}
+
+inline uint8_t predict(int filter, uint8_t a, uint8_t b, uint8_t c) {
+  switch (filter) {
+  case 1:
+    return a;
+  case 2:
+    return b;
+  case 3:
+    return static_cast<uint8_t>((a + b) >> 1);
+  case 4:
+    return paeth(a, b, c);
+  default:
+    return 0;
+  }
+}
+
+// Paeth needs nine bits, so it runs on 16-bit halves.
+inline __m128i paeth_half_sse2(__m128i a, __m128i b, __m128i c) {
+  auto abs16 = [](__m128i x) {
+    return _mm_max_epi16(x, _mm_sub_epi16(_mm_setzero_si128(), x));
+  };
+  __m128i pa = _mm_sub_epi16(b, c);
+  __m128i pb = _mm_sub_epi16(a, c);
+  __m128i pc = abs16(_mm_add_epi16(pa, pb));
+  pa = abs16(pa);
+  pb = abs16(pb);
+  __m128i use_c = _mm_cmpgt_epi16(pb, pc);
+  __m128i bc =
+      _mm_or_si128(_mm_and_si128(use_c, c), _mm_andnot_si128(use_c, b));
+  __m128i not_a =
+      _mm_or_si128(_mm_cmpgt_epi16(pa, pb), _mm_cmpgt_epi16(pa, pc));
+  return _mm_or_si128(_mm_and_si128(not_a, bc), _mm_andnot_si128(not_a, a));
+}
+
+inline __m128i paeth_sse2(__m128i a, __m128i b, __m128i c) {
+  __m128i zero = _mm_setzero_si128();
+  __m128i lo = paeth_half_sse2(_mm_unpacklo_epi8(a, zero),
+                               _mm_unpacklo_epi8(b, zero),
+                               _mm_unpacklo_epi8(c, zero));
+  __m128i hi = paeth_half_sse2(_mm_unpackhi_epi8(a, zero),
+                               _mm_unpackhi_epi8(b, zero),
+                               _mm_unpackhi_epi8(c, zero));
+  return _mm_packus_epi16(lo, hi);
+}
+
+// _mm_avg_epu8 rounds up; PNG's average rounds down.
+inline __m128i average_sse2(__m128i a, __m128i b) {
+  return _mm_sub_epi8(
+      _mm_avg_epu8(a, b),
+      _mm_and_si128(_mm_xor_si128(a, b), _mm_set1_epi8(1)));
+}
+
+inline __m128i predict_sse2(int filter, __m128i a, __m128i b, __m128i c) {
+  switch (filter) {
+  case 1:
+    return a;
+  case 2:
+    return b;
+  case 3:
+    return average_sse2(a, b);
+  case 4:
+    return paeth_sse2(a, b, c);
+  default:
+    return _mm_setzero_si128();
+  }
+}
+
+// |(int8)d| for every byte, as min(d, -d) on unsigned bytes.
+inline __m128i magnitude_sse2(__m128i d) {
+  return _mm_min_epu8(d, _mm_sub_epi8(_mm_setzero_si128(), d));
+}
+
+// Filters one RGB row into out (filter byte first), picking the filter with
+// the smallest sum of absolute differences as libpng does. All five sums
+// come from one pass and only the chosen filter is written. above is a row
+// of zeros for the first row.
+inline void filter_row(const uint8_t *row, const uint8_t *above, size_t bytes,
+                       uint8_t *out) {
+  const size_t bpp = 3;
+  // The first pixel has no left neighbour, so vectors start after it.
+  size_t vector_begin = bytes >= bpp + 16 ? bpp : bytes;
+  size_t vector_end = vector_begin + (bytes - vector_begin) / 16 * 16;
+  auto load = [](const uint8_t *p) {
+    return _mm_loadu_si128(reinterpret_cast<const __m128i *>(p));
+  };
+  auto neighbours = [&](size_t i, uint8_t &a, uint8_t &b, uint8_t &c) {
+    a = i >= bpp ? row[i - bpp] : 0;
+    b = above[i];
+    c = i >= bpp ? above[i - bpp] : 0;
+  };
+
+  uint64_t sums[5] = {};
+  auto score = [&](size_t begin, size_t end) {
+    for (size_t i = begin; i < end; ++i) {
+      uint8_t a, b, c;
+      neighbours(i, a, b, c);
+      for (int f = 0; f < 5; ++f)
+        sums[f] +=
+            magnitude(static_cast<uint8_t>(row[i] - predict(f, a, b, c)));
+    }
+  };
+  score(0, vector_begin);
+  score(vector_end, bytes);
+  __m128i zero = _mm_setzero_si128();
+  __m128i totals[5] = {zero, zero, zero, zero, zero};
+  for (size_t i = vector_begin; i < vector_end; i += 16) {
+    __m128i x = load(row + i);
+    __m128i a = load(row + i - bpp);
+    __m128i b = load(above + i);
+    __m128i c = load(above + i - bpp);
+    for (int f = 0; f < 5; ++f) {
+      __m128i d = _mm_sub_epi8(x, predict_sse2(f, a, b, c));
+      totals[f] =
+          _mm_add_epi64(totals[f], _mm_sad_epu8(magnitude_sse2(d), zero));
+    }
+  }
+  for (int f = 0; f < 5; ++f) {
+    uint64_t halves[2];
+    _mm_storeu_si128(reinterpret_cast<__m128i *>(halves), totals[f]);
+    sums[f] += halves[0] + halves[1];
+  }
+
+  int best = static_cast<int>(std::min_element(sums, sums + 5) - sums);
+  out[0] = static_cast<uint8_t>(best);
+  out++;
+  auto write = [&](size_t begin, size_t end) {
+    for (size_t i = begin; i < end; ++i) {
+      uint8_t a, b, c;
+      neighbours(i, a, b, c);
+      out[i] = static_cast<uint8_t>(row[i] - predict(best, a, b, c));
+    }
+  };
+  write(0, vector_begin);
+  write(vector_end, bytes);
+  for (size_t i = vector_begin; i < vector_end; i += 16) {
+    __m128i predicted = predict_sse2(best, load(row + i - bpp),
+                                     load(above + i), load(above + i - bpp));
+    _mm_storeu_si128(reinterpret_cast<__m128i *>(out + i),
+                     _mm_sub_epi8(load(row + i), predicted));
+  }
+}
+
+inline void put_be32(std::vector<uint8_t> &out, uint32_t value) {
+  for (int shift = 24; shift >= 0; shift -= 8)
+    out.push_back(static_cast<uint8_t>(value >> shift));
+}
+
+inline void png_chunk(std::vector<uint8_t> &out, const char *type,
+                      const uint8_t *data, size_t size) {
+  put_be32(out, static_cast<uint32_t>(size));
+  size_t start = out.size();
+  out.insert(out.end(), type, type + 4);
+  out.insert(out.end(), data, data + size);
+  put_be32(out, crc32(out.data() + start, size + 4));
+}
+
+// 8-bit RGB PNG. rgb_row(y, row) fills row y with width * 3 bytes.
+template <typename RowSource>
+std::vector<uint8_t> encode_png(int32_t width, int32_t height,
+                                RowSource &&rgb_row) {
+  size_t bytes = static_cast<size_t>(width) * 3;
+  std::vector<uint8_t> rows[2] = {std::vector<uint8_t>(bytes),
+                                  std::vector<uint8_t>(bytes)};
+  std::vector<uint8_t> filtered((bytes + 1) * height);
+  for (int32_t y = 0; y < height; ++y) {
+    uint8_t *row = rows[y & 1].data();
+    rgb_row(y, row);
+    filter_row(row, rows[(y + 1) & 1].data(), bytes,
+               filtered.data() + y * (bytes + 1));
+  }
+
+  std::vector<uint8_t> out;
+  const uint8_t signature[8] = {0x89, 'P', 'N', 'G', '\r', '\n', 0x1A, '\n'};
+  out.insert(out.end(), signature, signature + 8);
+
+  std::vector<uint8_t> header;
+  put_be32(header, static_cast<uint32_t>(width));
+  put_be32(header, static_cast<uint32_t>(height));
+  header.insert(header.end(), {8, 2, 0, 0, 0}); // 8-bit RGB
+  png_chunk(out, "IHDR", header.data(), header.size());
+
+  std::vector<uint8_t> compressed;
+  compressed.reserve(filtered.size() / 8);
+  Deflater deflater;
+  deflater.zlib(filtered.data(), filtered.size(), compressed);
+  png_chunk(out, "IDAT", compressed.data(), compressed.size());
+  png_chunk(out, "IEND", nullptr, 0);
+  return out;
+}
+
+// QOI (qoiformat.org) from B, G, R, X pixels, written as 3-channel RGB.
+inline std::vector<uint8_t> encode_qoi(const uint32_t *pixels, int32_t width,
+                                       int32_t height, int32_t pitch) {
+  std::vector<uint8_t> out;
+  out.reserve(static_cast<size_t>(width) * height + 64);
+  out.insert(out.end(), {'q', 'o', 'i', 'f'});
+  put_be32(out, static_cast<uint32_t>(width));
+  put_be32(out, static_cast<uint32_t>(height));
+  out.push_back(3);
+  out.push_back(0);
+
+  std::array<uint32_t, 64> index = {};
+  uint32_t previous = 0xFF000000; // opaque black, stored as A, R, G, B
+  uint32_t run = 0;
+  for (int32_t y = 0; y < height; ++y) {
+    const uint32_t *row = pixels + static_cast<size_t>(y) * pitch;
+    for (int32_t x = 0; x < width; ++x) {
+      uint32_t pixel = row[x] | 0xFF000000;
+      if (pixel == previous) {
+        if (++run == 62) {
+          out.push_back(static_cast<uint8_t>(0xC0 | (run - 1)));
+          run = 0;
+        }
+        continue;
+      }
+      if (run > 0) {
+        out.push_back(static_cast<uint8_t>(0xC0 | (run - 1)));
+        run = 0;
+      }
+
+      uint8_t r = static_cast<uint8_t>(pixel >> 16);
+      uint8_t g = static_cast<uint8_t>(pixel >> 8);
+      uint8_t b = static_cast<uint8_t>(pixel);
+      uint32_t slot = (r * 3 + g * 5 + b * 7 + 255 * 11) % 64;
+      if (index[slot] == pixel) {
+        out.push_back(static_cast<uint8_t>(slot));
+      } else {
+        index[slot] = pixel;
+        int8_t dr = static_cast<int8_t>(r - ((previous >> 16) & 0xFF));
+        int8_t dg = static_cast<int8_t>(g - ((previous >> 8) & 0xFF));
+        int8_t db = static_cast<int8_t>(b - (previous & 0xFF));
+        int8_t dr_dg = static_cast<int8_t>(dr - dg);
+        int8_t db_dg = static_cast<int8_t>(db - dg);
+        if (dr >= -2 && dr <= 1 && dg >= -2 && dg <= 1 && db >= -2 &&
+            db <= 1) {
+          out.push_back(
+              static_cast<uint8_t>(0x40 | (dr + 2) << 4 | (dg + 2) << 2 |
+                                   (db + 2)));
+        } else if (dg >= -32 && dg <= 31 && dr_dg >= -8 && dr_dg <= 7 &&
+                   db_dg >= -8 && db_dg <= 7) {
+          out.push_back(static_cast<uint8_t>(0x80 | (dg + 32)));
+          out.push_back(static_cast<uint8_t>((dr_dg + 8) << 4 | (db_dg + 8)));
+        } else {
+          out.insert(out.end(), {0xFE, r, g, b});
+        }
+      }
+      previous = pixel;
+    }
+  }
+  if (run > 0)
+    out.push_back(static_cast<uint8_t>(0xC0 | (run - 1)));
+  out.insert(out.end(), {0, 0, 0, 0, 0, 0, 0, 1});
+  return out;
+}
+} // namespace image
+} // namespace game
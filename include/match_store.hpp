@@ -0,0 +1,503 @@
+#pragma once
+
+#include <algorithm>
+#include <chrono>
+#include <cstddef>
+#include <cstdint>
+#include <cstdio>
+#include <cstring>
+#include <ctime>
+#include <filesystem>
+#include <fstream>
+#include <span>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include <Windows.h>
+
+// Every finished match is appended to stats/matches.log as a fixed-size
+// record, and stats/matches.idx keeps totals per UTC day and mode next to
+// it. The log is only ever appended to; the index can always be rebuilt
+// from it and is, whenever it covers fewer records than the log holds.
+//   pingpong.exe --matches [--from YYYY-MM-DD] [--to YYYY-MM-DD]
+//                [--mode easy|...|friend] [--scan]
+// answers from the index, or with --scan by reading every record of the
+// memory-mapped log.
+
+namespace game {
+namespace results {
+enum Mode : uint8_t {
+  MODE_EASY,
+  MODE_MEDIUM,
+  MODE_HARD,
+  MODE_VERY_HARD,
+  MODE_UNBEATABLE,
+  MODE_FRIEND,
+
+  MODE_COUNT
+};
+
+const char *mode_names[MODE_COUNT] = {"easy",       "medium", "hard",
+                                      "very_hard",  "unbeatable",
+                                      "friend"};
+
+constexpr uint32_t LOG_MAGIC = 0x524D5050;   // "PPMR"
+constexpr uint32_t INDEX_MAGIC = 0x494D5050; // "PPMI"
+constexpr uint32_t VERSION = 1;
+constexpr int64_t SECONDS_PER_DAY = 86400;
+
+// A point ends a rally; `hits` counts paddle hits over all of them.
+struct Record {
+  int64_t start_time; // Unix seconds
+  int64_t end_time;
+  uint32_t seed;
+  uint8_t mode;
+  uint8_t winner; // 0 for a draw
+  uint16_t score1;
+  uint16_t score2;
+  uint16_t rallies;
+  uint16_t longest_rally;
+  uint16_t reserved;
+  uint32_t hits;
+  float duration_secs;
+  float played_secs;
+  float ball_speed;
+  float paddle_speed;
+  float paddle_damping;
+  uint32_t checksum;
+};
+static_assert(sizeof(Record) == 64);
+
+struct FileHeader {
+  uint32_t magic;
+  uint32_t version;
+  uint32_t record_size;
+  uint32_t reserved;
+};
+
+inline uint32_t checksum(const Record &record) {
+  const uint8_t *bytes = reinterpret_cast<const uint8_t *>(&record);
+  uint32_t hash = 2166136261u;
+  for (size_t i = 0; i < offsetof(Record, checksum); ++i)
+    hash = (hash ^ bytes[i]) * 16777619u;
+  return hash;
+}
+
+inline uint32_t day_of(int64_t unix_seconds) {
+  return static_cast<uint32_t>(std::max<int64_t>(unix_seconds, 0) /
+                               SECONDS_PER_DAY);
+}
+
+struct Totals {
+  uint64_t matches = 0;
+  uint64_t wins1 = 0;
+  uint64_t wins2 = 0;
+  uint64_t draws = 0;
+  uint64_t points1 = 0;
+  uint64_t points2 = 0;
+  uint64_t hits = 0;
+  uint64_t rallies = 0;
+  uint64_t longest_rally = 0;
+  double played_secs = 0.0;
+
+  void add(const Record &r) {
+    matches++;
+    wins1 += r.winner == 1;
+    wins2 += r.winner == 2;
+    draws += r.winner == 0;
+    points1 += r.score1;
+    points2 += r.score2;
+    hits += r.hits;
+    rallies += r.rallies;
+    longest_rally = std::max<uint64_t>(longest_rally, r.longest_rally);
+    played_secs += r.played_secs;
+  }
+
+  void add(const Totals &t) {
+    matches += t.matches;
+    wins1 += t.wins1;
+    wins2 += t.wins2;
+    draws += t.draws;
+    points1 += t.points1;
+    points2 += t.points2;
+    hits += t.hits;
+    rallies += t.rallies;
+    longest_rally = std::max(longest_rally, t.longest_rally);
+    played_secs += t.played_secs;
+  }
+};
+
+// Totals of the matches of one mode that started on one day.
+struct IndexEntry {
+  uint32_t day;
+  uint32_t mode;
+  Totals totals;
+};
+
+struct Query {
+  uint32_t from_day = 0;
+  uint32_t to_day = UINT32_MAX;
+  int32_t mode = -1; // every mode
+
+  bool matches(uint32_t day, uint32_t record_mode) const {
+    return day >= from_day && day <= to_day &&
+           (mode < 0 || record_mode == static_cast<uint32_t>(mode));
+  }
+};
+
+// A whole file mapped read-only.
+class MappedFile {
+public:
+  MappedFile() = default;
+  MappedFile(const MappedFile &) = delete;
+  MappedFile &operator=(const MappedFile &) = delete;
+  ~MappedFile() { close(); }
+
+  bool open(const std::string &path) {
+    close();
+    file = CreateFileA(path.c_str(), GENERIC_READ,
+                       FILE_SHARE_READ | FILE_SHARE_WRITE, nullptr,
+                       OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL, nullptr);
+    if (file == INVALID_HANDLE_VALUE)
+      return false;
+    LARGE_INTEGER file_size;
+    if (!GetFileSizeEx(file, &file_size) || file_size.QuadPart == 0)
+      return false;
+    size = static_cast<size_t>(file_size.QuadPart);
+    mapping = CreateFileMappingA(file, nullptr, PAGE_READONLY, 0, 0, nullptr);
+    if (!mapping)
+      return false;
+    data = MapViewOfFile(mapping, FILE_MAP_READ, 0, 0, 0);
+    return data != nullptr;
+  }
+
+  void close() {
+    if (data)
+      UnmapViewOfFile(data);
+    if (mapping)
+      CloseHandle(mapping);
+    if (file != INVALID_HANDLE_VALUE)
+      CloseHandle(file);
+    mapping = nullptr;
+    file = INVALID_HANDLE_VALUE;
+    data = nullptr;
+    size = 0;
+  }
+
+  const uint8_t *bytes() const { return static_cast<const uint8_t *>(data); }
+  size_t length() const { return size; }
+
+private:
+  HANDLE file = INVALID_HANDLE_VALUE;
+  HANDLE mapping = nullptr;
+  void *data = nullptr;
+  size_t size = 0;
+};
+
+// A read-only mapping of the log. Only whole records after the header are
+// visible; a record torn by a crash can only be the last one and is left
+// out when its checksum does not match.
+class MappedLog {
+public:
+  bool open(const std::string &path) {
+    count = 0;
+    if (!file.open(path) || file.length() < sizeof(FileHeader))
+      return false;
+
+    FileHeader header;
+    std::memcpy(&header, file.bytes(), sizeof(header));
+    if (header.magic != LOG_MAGIC || header.version != VERSION ||
+        header.record_size != sizeof(Record))
+      return false;
+    count = (file.length() - sizeof(FileHeader)) / sizeof(Record);
+    if (count > 0 && checksum(all()[count - 1]) != all()[count - 1].checksum)
+      count--;
+    return true;
+  }
+
+  void close() {
+    file.close();
+    count = 0;
+  }
+
+  std::span<const Record> records() const {
+    if (!file.bytes())
+      return {};
+    return {all(), count};
+  }
+
+private:
+  const Record *all() const {
+    return reinterpret_cast<const Record *>(file.bytes() + sizeof(FileHeader));
+  }
+
+  MappedFile file;
+  size_t count = 0;
+};
+
+inline Totals scan(std::span<const Record> records, const Query &query) {
+  Totals totals;
+  for (const Record &r : records)
+    if (query.matches(day_of(r.start_time), r.mode))
+      totals.add(r);
+  return totals;
+}
+
+inline Totals lookup(const std::vector<IndexEntry> &index,
+                     const Query &query) {
+  Totals totals;
+  for (const IndexEntry &entry : index)
+    if (query.matches(entry.day, entry.mode))
+      totals.add(entry.totals);
+  return totals;
+}
+
+// The append side, owned by the game. Appends are rare (one per match), so
+// each one flushes the record and rewrites the small index file.
+class Store {
+public:
+  explicit Store(const std::string &directory = "stats")
+      : log_path(directory + "/matches.log"),
+        index_path(directory + "/matches.idx"), directory(directory) {}
+
+  // Reads the index and brings it up to date with the log.
+  void open() {
+    if (opened)
+      return;
+    opened = true;
+    load_index();
+    MappedLog log;
+    if (!log.open(log_path)) {
+      // Missing, empty, or not a log this version reads; the latter is
+      // kept aside and a new log started.
+      log.close();
+      std::error_code error;
+      if (std::filesystem::file_size(log_path, error) > 0 && !error)
+        std::filesystem::rename(log_path, log_path + ".bad", error);
+      index.clear();
+      records = 0;
+      return;
+    }
+    std::span<const Record> all = log.records();
+    if (records > all.size()) {
+      index.clear();
+      records = 0;
+    }
+    if (records == all.size())
+      return;
+    for (uint64_t i = records; i < all.size(); ++i)
+      add_to_index(all[i]);
+    records = all.size();
+    save_index();
+  }
+
+  // Runs open() on a thread of its own, so neither startup nor the first
+  // append reads the whole log on the game thread; append() waits for it.
+  void open_async() {
+    if (!opened && !opener.joinable())
+      opener = std::jthread([this] { open(); });
+  }
+
+  bool append(Record record) {
+    if (opener.joinable())
+      opener.join();
+    open();
+    record.checksum = checksum(record);
+    std::filesystem::create_directories(directory);
+    std::error_code error;
+    std::uintmax_t size = std::filesystem::file_size(log_path, error);
+    if (error)
+      size = 0;
+    // Cuts off what is left of an append that a crash interrupted, so the
+    // new record starts on a record boundary.
+    std::uintmax_t valid = sizeof(FileHeader) + records * sizeof(Record);
+    if (size > valid)
+      std::filesystem::resize_file(log_path, valid, error);
+    std::ofstream out(log_path, std::ios::binary | std::ios::app);
+    if (!out)
+      return false;
+    if (size == 0) {
+      FileHeader header = {LOG_MAGIC, VERSION, sizeof(Record), 0};
+      out.write(reinterpret_cast<const char *>(&header), sizeof(header));
+    }
+    out.write(reinterpret_cast<const char *>(&record), sizeof(record));
+    out.flush();
+    if (!out)
+      return false;
+    add_to_index(record);
+    records++;
+    save_index();
+    return true;
+  }
+
+  const std::vector<IndexEntry> &entries() const { return index; }
+  uint64_t size() const { return records; }
+  const std::string &path() const { return log_path; }
+
+private:
+  void add_to_index(const Record &record) {
+    uint32_t day = day_of(record.start_time);
+    auto it = std::lower_bound(
+        index.begin(), index.end(), std::pair(day, uint32_t(record.mode)),
+        [](const IndexEntry &e, const std::pair<uint32_t, uint32_t> &key) {
+          return std::pair(e.day, e.mode) < key;
+        });
+    if (it == index.end() || it->day != day || it->mode != record.mode)
+      it = index.insert(it, {day, record.mode, {}});
+    it->totals.add(record);
+  }
+
+  void load_index() {
+    index.clear();
+    records = 0;
+    std::ifstream in(index_path, std::ios::binary);
+    FileHeader header;
+    uint64_t covered = 0;
+    if (!in.read(reinterpret_cast<char *>(&header), sizeof(header)) ||
+        header.magic != INDEX_MAGIC || header.version != VERSION ||
+        header.record_size != sizeof(IndexEntry) ||
+        !in.read(reinterpret_cast<char *>(&covered), sizeof(covered)))
+      return;
+    IndexEntry entry;
+    while (in.read(reinterpret_cast<char *>(&entry), sizeof(entry)))
+      index.push_back(entry);
+    records = covered;
+  }
+
+  // Written to a new file and renamed over the old one, so a crash leaves
+  // either index whole.
+  void save_index() {
+    std::filesystem::create_directories(directory);
+    std::string temporary = index_path + ".tmp";
+    {
+      std::ofstream out(temporary, std::ios::binary | std::ios::trunc);
+      FileHeader header = {INDEX_MAGIC, VERSION, sizeof(IndexEntry), 0};
+      out.write(reinterpret_cast<const char *>(&header), sizeof(header));
+      out.write(reinterpret_cast<const char *>(&records), sizeof(records));
+      out.write(reinterpret_cast<const char *>(index.data()),
+                static_cast<std::streamsize>(index.size() *
+                                             sizeof(IndexEntry)));
+      if (!out)
+        return;
+    }
+    std::error_code error;
+    std::filesystem::rename(temporary, index_path, error);
+  }
+
+  std::string log_path;
+  std::string index_path;
+  std::string directory;
+  std::vector<IndexEntry> index;
+  uint64_t records = 0;
+  bool opened = false;
+  std::jthread opener;
+};
+
+// "YYYY-MM-DD" as a UTC day number.
+inline bool parse_day(const std::string &text, uint32_t &day) {
+  int y, m, d;
+  if (std::sscanf(text.c_str(), "%d-%d-%d", &y, &m, &d) != 3 || m < 1 ||
+      m > 12 || d < 1 || d > 31)
+    return false;
+  std::chrono::year_month_day date{std::chrono::year(y),
+                                   std::chrono::month(m),
+                                   std::chrono::day(d)};
+  if (!date.ok())
+    return false;
+  auto days = std::chrono::sys_days(date).time_since_epoch().count();
+  if (days < 0)
+    return false;
+  day = static_cast<uint32_t>(days);
+  return true;
+}
+
+inline void print_totals(const char *name, const Totals &t) {
+  if (t.matches == 0)
+    return;
+  double matches = static_cast<double>(t.matches);
+  std::printf("%-12s %10llu %7.1f%% %7.1f%% %7.1f%% %6.2f-%-6.2f %9.2f %8llu "
+              "%9.1f\n",
+              name, static_cast<unsigned long long>(t.matches),
+              100.0 * t.wins1 / matches, 100.0 * t.wins2 / matches,
+              100.0 * t.draws / matches, t.points1 / matches,
+              t.points2 / matches,
+              t.rallies ? static_cast<double>(t.hits) / t.rallies : 0.0,
+              static_cast<unsigned long long>(t.longest_rally),
+              t.played_secs / matches);
+}
+
+// --matches [--from YYYY-MM-DD] [--to YYYY-MM-DD] [--mode name] [--scan]
+//           [--dir stats]
+inline int run(const std::vector<std::string> &args) {
+  Query query;
+  bool full_scan = false;
+  std::string directory = "stats";
+  for (size_t i = 0; i < args.size(); ++i) {
+    bool has_value = i + 1 < args.size();
+    if ((args[i] == "--from" || args[i] == "--to") && has_value) {
+      uint32_t &day = args[i] == "--from" ? query.from_day : query.to_day;
+      if (!parse_day(args[++i], day)) {
+        std::printf("dates are YYYY-MM-DD, not '%s'\n", args[i].c_str());
+        return 1;
+      }
+    } else if (args[i] == "--mode" && has_value) {
+      std::string name = args[++i];
+      for (int32_t m = 0; m < MODE_COUNT; ++m)
+        if (name == mode_names[m])
+          query.mode = m;
+      if (query.mode < 0) {
+        std::printf("unknown mode '%s'\n", name.c_str());
+        return 1;
+      }
+    } else if (args[i] == "--dir" && has_value) {
+      directory = args[++i];
+    } else if (args[i] == "--scan") {
+      full_scan = true;
+    }
+  }
+
+  auto start = std::chrono::steady_clock::now();
+  Totals per_mode[MODE_COUNT];
+  uint64_t records = 0;
+  const char *source;
+  if (full_scan) {
+    MappedLog log;
+    if (!log.open(directory + "/matches.log")) {
+      std::printf("no match log in %s\n", directory.c_str());
+      return 1;
+    }
+    records = log.records().size();
+    for (const Record &r : log.records())
+      if (query.matches(day_of(r.start_time), r.mode))
+        per_mode[std::min<uint32_t>(r.mode, MODE_COUNT - 1)].add(r);
+    source = "scan";
+  } else {
+    Store store(directory);
+    store.open();
+    records = store.size();
+    for (const IndexEntry &entry : store.entries())
+      if (query.matches(entry.day, entry.mode))
+        per_mode[std::min<uint32_t>(entry.mode, MODE_COUNT - 1)].add(
+            entry.totals);
+    source = "index";
+  }
+  std::chrono::duration<double, std::milli> elapsed =
+      std::chrono::steady_clock::now() - start;
+
+  std::printf("%-12s %10s %8s %8s %8s %13s %9s %8s %9s\n", "mode", "matches",
+              "p1 win", "p2 win", "draw", "avg score", "avg rally",
+              "longest", "avg secs");
+  Totals all;
+  for (int32_t m = 0; m < MODE_COUNT; ++m) {
+    print_totals(mode_names[m], per_mode[m]);
+    all.add(per_mode[m]);
+  }
+  print_totals("all", all);
+  std::printf("%llu records, answered from the %s in %.3f ms\n",
+              static_cast<unsigned long long>(records), source,
+              elapsed.count());
+  return 0;
+}
+} // namespace results
+} // namespace game
@@ -0,0 +1,292 @@
+#pragma once
+
+#include <atomic>
+#include <chrono>
+#include <cstddef>
+#include <cstdint>
+#include <format>
+#include <initializer_list>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include <Windows.h>
+#include <winsock.h>
+
+// Counters, gauges and histograms that the game updates with relaxed
+// atomics, served in the Prometheus text format at
+//   http://127.0.0.1:<metrics_port>/metrics
+// when metrics_port is set in the config. The server has its own thread
+// and reads the atomics directly; the game never waits for it.
+
+namespace game {
+namespace metrics {
+enum Kind { KIND_COUNTER, KIND_GAUGE, KIND_HISTOGRAM };
+
+const char *kind_names[] = {"counter", "gauge", "histogram"};
+
+struct Entry {
+  const char *name;
+  const char *help;
+  Kind kind;
+  const void *metric;
+};
+
+// Metrics register themselves while globals are constructed, so the list
+// is fixed before any thread reads it.
+inline std::vector<Entry> &registry() {
+  static std::vector<Entry> entries;
+  return entries;
+}
+
+class Counter {
+public:
+  Counter(const char *name, const char *help) {
+    registry().push_back({name, help, KIND_COUNTER, this});
+  }
+
+  void add(uint64_t n = 1) { count.fetch_add(n, std::memory_order_relaxed); }
+  uint64_t value() const { return count.load(std::memory_order_relaxed); }
+
+private:
+  std::atomic<uint64_t> count = 0;
+};
+
+class Gauge {
+public:
+  Gauge(const char *name, const char *help) {
+    registry().push_back({name, help, KIND_GAUGE, this});
+  }
+
+  void set(double value) { current.store(value, std::memory_order_relaxed); }
+  double value() const { return current.load(std::memory_order_relaxed); }
+
+private:
+  std::atomic<double> current = 0.0;
+};
+
+class Histogram {
+public:
+  static constexpr size_t MAX_BOUNDS = 16;
+
+  Histogram(const char *name, const char *help,
+            std::initializer_list<double> upper_bounds) {
+    for (double bound : upper_bounds)
+      if (count < MAX_BOUNDS)
+        bounds[count++] = bound;
+    registry().push_back({name, help, KIND_HISTOGRAM, this});
+  }
+
+  void observe(double value) {
+    size_t bucket = 0;
+    while (bucket < count && value > bounds[bucket])
+      bucket++;
+    buckets[bucket].fetch_add(1, std::memory_order_relaxed);
+    sum.fetch_add(value, std::memory_order_relaxed);
+  }
+
+  // Buckets are read one at a time, so the total is taken from them rather
+  // than kept on its own and can never disagree with them.
+  void write(std::string &out, const char *name) const {
+    uint64_t total = 0;
+    for (size_t i = 0; i <= count; ++i) {
+      total += buckets[i].load(std::memory_order_relaxed);
+      std::string bound =
+          i < count ? std::format("{}", bounds[i]) : std::string("+Inf");
+      out += std::format("{}_bucket{{le=\"{}\"}} {}\n", name, bound, total);
+    }
+    out += std::format("{}_sum {}\n", name,
+                       sum.load(std::memory_order_relaxed));
+    out += std::format("{}_count {}\n", name, total);
+  }
+
+private:
+  double bounds[MAX_BOUNDS] = {};
+  size_t count = 0;
+  std::atomic<uint64_t> buckets[MAX_BOUNDS + 1] = {};
+  std::atomic<double> sum = 0.0;
+};
+
+Counter frames("pingpong_frames_total", "Frames presented.");
+Histogram frame_seconds("pingpong_frame_seconds",
+                        "Time from one frame to the next.",
+                        {0.004, 0.008, 0.0125, 0.017, 0.025, 0.034, 0.05,
+                         0.1, 0.25});
+Gauge audio_voices("pingpong_audio_voices_active",
+                   "Sounds playing, the music included.");
+Counter matches("pingpong_matches_total",
+                "Matches played until the time ran out.");
+Counter goals("pingpong_goals_total", "Goals scored.");
+Counter config_loads("pingpong_config_loads_total",
+                     "Times the settings were read from a config file.");
+Gauge uptime("pingpong_uptime_seconds",
+             "Seconds since the metrics server started.");
+
+inline std::string scrape() {
+  std::string out;
+  for (const Entry &entry : registry()) {
+    out += std::format("# HELP {} {}\n# TYPE {} {}\n", entry.name, entry.help,
+                       entry.name, kind_names[entry.kind]);
+    switch (entry.kind) {
+    case KIND_COUNTER:
+      out += std::format(
+          "{} {}\n", entry.name,
+          static_cast<const Counter *>(entry.metric)->value());
+      break;
+    case KIND_GAUGE:
+      out += std::format("{} {}\n", entry.name,
+                         static_cast<const Gauge *>(entry.metric)->value());
+      break;
+    case KIND_HISTOGRAM:
+      static_cast<const Histogram *>(entry.metric)->write(out, entry.name);
+      break;
+    }
+  }
+  return out;
+}
+
+using Socket = SOCKET;
+constexpr Socket NO_SOCKET = INVALID_SOCKET;
+inline void close_socket(Socket s) { closesocket(s); }
+inline void set_nonblocking(Socket s) {
+  u_long on = 1;
+  ioctlsocket(s, FIONBIO, &on);
+}
+
+inline bool wait_for(Socket s, bool write, int ms) {
+  fd_set set;
+  FD_ZERO(&set);
+  FD_SET(s, &set);
+  timeval timeout = {0, ms * 1000};
+  return select(0, write ? nullptr : &set, write ? &set : nullptr, nullptr,
+                &timeout) > 0;
+}
+
+// A single-threaded HTTP server on the loopback interface. Every socket is
+// non-blocking and a client gets one second to send its request, so the
+// thread always notices stop() within a tenth of a second.
+class Server {
+public:
+  Server() = default;
+  Server(const Server &) = delete;
+  Server &operator=(const Server &) = delete;
+  ~Server() { stop(); }
+
+  bool start(uint16_t port) {
+    if (worker.joinable())
+      return true;
+    WSADATA wsa;
+    if (WSAStartup(MAKEWORD(2, 2), &wsa) != 0)
+      return false;
+    listener = socket(AF_INET, SOCK_STREAM, IPPROTO_TCP);
+    if (listener == NO_SOCKET) {
+      release();
+      return false;
+    }
+    sockaddr_in address = {};
+    address.sin_family = AF_INET;
+    address.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+    address.sin_port = htons(port);
+    if (bind(listener, reinterpret_cast<sockaddr *>(&address),
+             sizeof(address)) != 0 ||
+        listen(listener, 8) != 0) {
+      release();
+      return false;
+    }
+    set_nonblocking(listener);
+    started = std::chrono::steady_clock::now();
+    stopping = false;
+    worker = std::thread([this] { work(); });
+    return true;
+  }
+
+  void stop() {
+    if (!worker.joinable())
+      return;
+    stopping = true;
+    worker.join();
+    release();
+  }
+
+  uint64_t served() const { return responses.load(); }
+
+private:
+  void release() {
+    if (listener != NO_SOCKET)
+      close_socket(listener);
+    listener = NO_SOCKET;
+    WSACleanup();
+  }
+
+  void work() {
+    while (!stopping) {
+      if (!wait_for(listener, false, 100))
+        continue;
+      Socket client = accept(listener, nullptr, nullptr);
+      if (client == NO_SOCKET)
+        continue;
+      set_nonblocking(client);
+      serve(client);
+      close_socket(client);
+    }
+  }
+
+  void serve(Socket client) {
+    std::string request;
+    auto deadline = std::chrono::steady_clock::now() + std::chrono::seconds(1);
+    while (request.find("\r\n\r\n") == std::string::npos) {
+      if (stopping || request.size() > 8192 ||
+          std::chrono::steady_clock::now() > deadline)
+        return;
+      if (!wait_for(client, false, 100))
+        continue;
+      char buffer[1024];
+      int got = static_cast<int>(recv(client, buffer, sizeof(buffer), 0));
+      if (got <= 0)
+        return;
+      request.append(buffer, static_cast<size_t>(got));
+    }
+
+    std::string status = "200 OK";
+    std::string body;
+    if (request.starts_with("GET /metrics ") ||
+        request.starts_with("GET / ")) {
+      uptime.set(std::chrono::duration<double>(
+                     std::chrono::steady_clock::now() - started)
+                     .count());
+      body = scrape();
+    } else {
+      status = "404 Not Found";
+      body = "Metrics are at /metrics\n";
+    }
+    std::string response = std::format(
+        "HTTP/1.1 {}\r\nContent-Type: text/plain; version=0.0.4; "
+        "charset=utf-8\r\nContent-Length: {}\r\nConnection: close\r\n\r\n{}",
+        status, body.size(), body);
+
+    size_t sent = 0;
+    while (sent < response.size()) {
+      if (stopping || std::chrono::steady_clock::now() > deadline)
+        return;
+      if (!wait_for(client, true, 100))
+        continue;
+      int n = static_cast<int>(
+          send(client, response.data() + sent,
+               static_cast<int>(response.size() - sent), 0));
+      if (n <= 0)
+        return;
+      sent += static_cast<size_t>(n);
+    }
+    responses++;
+  }
+
+  Socket listener = NO_SOCKET;
+  std::thread worker;
+  std::atomic<bool> stopping = false;
+  std::atomic<uint64_t> responses = 0;
+  std::chrono::steady_clock::time_point started;
+};
+
+Server server;
+} // namespace metrics
+} // namespace game
@@ -0,0 +1,204 @@
+#pragma once
+
+#include <array>
+#include <cerrno>
+#include <cstdint>
+#include <cstring>
+#include <string>
+
+#if defined(__linux__)
+#include <linux/perf_event.h>
+#include <sys/ioctl.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+#endif
+
+namespace game {
+namespace perf {
+enum Zone {
+  ZONE_CLEAR_FILL,
+  ZONE_GLYPHS,
+  ZONE_PARTICLES,
+  ZONE_AI,
+  ZONE_BALL,
+
+  ZONE_COUNT
+};
+
+const char *zone_names[ZONE_COUNT] = {"clear_fill", "glyphs", "particles",
+                                      "ai", "ball"};
+
+enum Event {
+  EVENT_CYCLES,
+  EVENT_INSTRUCTIONS,
+  EVENT_CACHE_MISSES,
+  EVENT_BRANCH_MISSES,
+
+  EVENT_COUNT
+};
+
+const char *event_names[EVENT_COUNT] = {"cycles", "instructions",
+                                        "cache_misses", "branch_misses"};
+
+struct Totals {
+  uint64_t calls = 0;
+  std::array<uint64_t, EVENT_COUNT> events = {};
+};
+
+// User-mode hardware counters of the calling thread, opened with
+// perf_event_open as one group so a single read() returns all of them.
+// Counters that the CPU or VM does not offer are left out of the group and
+// read as zero; without cycles nothing is counted. Other platforms compile
+// to the same interface with open() always failing.
+//
+// Zones do not nest: a zone entered inside another is charged to the outer
+// one, so glyph rendering includes the pixels it fills.
+class Counters {
+public:
+  bool enabled = false;
+
+  Counters() { slots.fill(-1); }
+  Counters(const Counters &) = delete;
+  Counters &operator=(const Counters &) = delete;
+  ~Counters() { close(); }
+
+  bool open() {
+#if defined(__linux__)
+    if (leader >= 0)
+      return true;
+    const uint64_t configs[EVENT_COUNT] = {
+        PERF_COUNT_HW_CPU_CYCLES, PERF_COUNT_HW_INSTRUCTIONS,
+        PERF_COUNT_HW_CACHE_MISSES, PERF_COUNT_HW_BRANCH_MISSES};
+    int opened = 0;
+    for (int e = 0; e < EVENT_COUNT; ++e) {
+      perf_event_attr attr;
+      std::memset(&attr, 0, sizeof(attr));
+      attr.size = sizeof(attr);
+      attr.type = PERF_TYPE_HARDWARE;
+      attr.config = configs[e];
+      attr.disabled = leader < 0;
+      attr.exclude_kernel = 1;
+      attr.exclude_hv = 1;
+      attr.read_format = PERF_FORMAT_GROUP;
+      int fd = static_cast<int>(
+          syscall(SYS_perf_event_open, &attr, 0, -1, leader, 0));
+      if (fd < 0) {
+        if (e == EVENT_CYCLES) {
+          error = std::string("perf_event_open: ") + std::strerror(errno);
+          return false;
+        }
+        continue;
+      }
+      if (leader < 0)
+        leader = fd;
+      fds[e] = fd;
+      slots[e] = opened++;
+    }
+    return true;
+#else
+    error = "hardware counters need the Linux build";
+    return false;
+#endif
+  }
+
+  void close() {
+#if defined(__linux__)
+    for (int &fd : fds) {
+      if (fd >= 0)
+        ::close(fd);
+      fd = -1;
+    }
+#endif
+    leader = -1;
+    slots.fill(-1);
+    enabled = false;
+  }
+
+  bool available() const { return leader >= 0; }
+  bool has(Event event) const { return slots[event] >= 0; }
+  const std::string &last_error() const { return error; }
+
+  void start() {
+    if (!available())
+      return;
+#if defined(__linux__)
+    ioctl(leader, PERF_EVENT_IOC_ENABLE, PERF_IOC_FLAG_GROUP);
+#endif
+    depth = 0;
+    enabled = true;
+  }
+
+  void stop() {
+    if (!available())
+      return;
+#if defined(__linux__)
+    ioctl(leader, PERF_EVENT_IOC_DISABLE, PERF_IOC_FLAG_GROUP);
+#endif
+    enabled = false;
+  }
+
+  void reset() { zones.fill({}); }
+
+  const Totals &totals(Zone zone) const { return zones[zone]; }
+
+  void enter() {
+    if (depth++ == 0)
+      read(begin);
+  }
+
+  void leave(Zone zone) {
+    if (--depth != 0)
+      return;
+    std::array<uint64_t, EVENT_COUNT> end;
+    read(end);
+    Totals &totals = zones[zone];
+    totals.calls++;
+    for (int e = 0; e < EVENT_COUNT; ++e)
+      totals.events[e] += end[e] - begin[e];
+  }
+
+private:
+  void read(std::array<uint64_t, EVENT_COUNT> &values) const {
+    values.fill(0);
+#if defined(__linux__)
+    uint64_t buffer[1 + EVENT_COUNT] = {};
+    if (::read(leader, buffer, sizeof(buffer)) <= 0)
+      return;
+    for (int e = 0; e < EVENT_COUNT; ++e)
+      if (slots[e] >= 0 && static_cast<uint64_t>(slots[e]) < buffer[0])
+        values[e] = buffer[1 + slots[e]];
+#endif
+  }
+
+  int leader = -1;
+  std::array<int, EVENT_COUNT> fds = {-1, -1, -1, -1};
+  std::array<int, EVENT_COUNT> slots;
+  int depth = 0;
+  std::array<uint64_t, EVENT_COUNT> begin = {};
+  std::array<Totals, ZONE_COUNT> zones = {};
+  std::string error;
+};
+
+Counters counters;
+
+// Charges the hardware events of its lifetime to `zone` while counting is
+// on; otherwise costs one load and branch.
+class Scope {
+public:
+  explicit Scope(Zone zone) : zone(zone), entered(counters.enabled) {
+    if (entered)
+      counters.enter();
+  }
+  Scope(const Scope &) = delete;
+  Scope &operator=(const Scope &) = delete;
+  ~Scope() {
+    if (entered)
+      counters.leave(zone);
+  }
+
+private:
+  Zone zone;
+  bool entered;
+};
+} // namespace perf
+} // namespace game
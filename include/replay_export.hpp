@@ -0,0 +1,233 @@
+#pragma once
+
+#include "game.hpp"
+
+// Renders a recorded match to an image sequence or a Y4M stream faster than
+// real time, e.g.
+//   pingpong.exe --render-replay replays/match.replay out --format y4m
+//
+// A first pass simulates the whole match without drawing and keeps a
+// snapshot of the match every few hundred ticks. Workers then render
+// disjoint tick ranges in parallel, each from its snapshot, with their own
+// renderer and frame buffer.
+
+namespace game {
+namespace replay_export {
+enum OutputFormat { OUTPUT_BMP, OUTPUT_Y4M };
+
+struct Options {
+  std::string replay;
+  std::string output;
+  i32 width = 1920;
+  i32 height = 1080;
+  i32 fps = 60;
+  OutputFormat format = OUTPUT_BMP;
+  size_t workers = utils::ThreadPool::default_workers();
+};
+
+// Output frame f shows the match after the first tick ending at or after
+// f / fps. A tick that spans several frame times is repeated and a tick
+// that spans none is simulated but not drawn.
+struct Schedule {
+  std::vector<u32> first_frame;
+  std::vector<u32> frame_count;
+  u32 frames = 0;
+};
+
+inline Schedule schedule_frames(const replay::Recording &recording, i32 fps) {
+  Schedule schedule;
+  schedule.first_frame.resize(recording.ticks.size());
+  schedule.frame_count.resize(recording.ticks.size());
+  double end = 0.0;
+  for (size_t i = 0; i < recording.ticks.size(); ++i) {
+    end += recording.ticks[i].dt;
+    u32 last = static_cast<u32>(std::floor(end * fps));
+    schedule.first_frame[i] = schedule.frames;
+    if (last + 1 > schedule.frames) {
+      schedule.frame_count[i] = last + 1 - schedule.frames;
+      schedule.frames = last + 1;
+    }
+  }
+  return schedule;
+}
+
+inline void put_u16(u8 *at, u16 value) { std::memcpy(at, &value, 2); }
+inline void put_u32(u8 *at, u32 value) { std::memcpy(at, &value, 4); }
+
+// 32-bit top-down BMP, which GDI and every image viewer read as is.
+inline bool write_bmp(const std::string &path, const u32 *pixels, i32 width,
+                      i32 height) {
+  const u32 header_size = 14 + 40;
+  const u32 image_size = static_cast<u32>(width) * height * 4;
+  u8 header[header_size] = {'B', 'M'};
+  put_u32(header + 2, header_size + image_size);
+  put_u32(header + 10, header_size);
+  put_u32(header + 14, 40);
+  put_u32(header + 18, static_cast<u32>(width));
+  put_u32(header + 22, static_cast<u32>(-height));
+  put_u16(header + 26, 1);
+  put_u16(header + 28, 32);
+  put_u32(header + 34, image_size);
+
+  std::ofstream out(path, std::ios::binary | std::ios::trunc);
+  out.write(reinterpret_cast<const char *>(header), header_size);
+  out.write(reinterpret_cast<const char *>(pixels), image_size);
+  return static_cast<bool>(out);
+}
+
+inline std::string y4m_header(i32 width, i32 height, i32 fps) {
+  return std::format("YUV4MPEG2 W{} H{} F{}:1 Ip A1:1 C420jpeg "
+                     "XCOLORRANGE=LIMITED\n",
+                     width, height, fps);
+}
+
+inline i32 export_replay(const Options &options) {
+  replay::Recording recording;
+  if (!recording.load(options.replay)) {
+    std::printf("cannot read replay %s\n", options.replay.c_str());
+    return 1;
+  }
+  if (recording.ticks.empty())
+    return 0;
+
+  Schedule schedule = schedule_frames(recording, options.fps);
+  utils::ThreadPool pool(options.workers);
+
+  // A chunk per checkpoint, several per thread so uneven chunks (busy
+  // rallies, long celebrations) still balance out.
+  size_t chunk_ticks = std::max<size_t>(
+      1, recording.ticks.size() / (pool.concurrency() * 8));
+  size_t chunks = (recording.ticks.size() + chunk_ticks - 1) / chunk_ticks;
+
+  i64 begin = utils::query_counter();
+  render::Renderer headless;
+  Match match(headless);
+  match.start(recording.settings);
+  std::vector<Match> checkpoints;
+  checkpoints.reserve(chunks);
+  for (size_t i = 0; i < recording.ticks.size(); ++i) {
+    if (i % chunk_ticks == 0)
+      checkpoints.push_back(match);
+    recording.apply(i);
+    match.tick(recording.ticks[i].dt);
+  }
+  i64 simulated = utils::query_counter();
+
+  const i32 width = options.width & ~1;
+  const i32 height = options.height & ~1;
+  const size_t yuv_size = static_cast<size_t>(width) * height * 3 / 2;
+  std::string header = y4m_header(width, height, options.fps);
+  if (options.format == OUTPUT_Y4M) {
+    std::ofstream out(options.output, std::ios::binary | std::ios::trunc);
+    out << header;
+  } else {
+    std::filesystem::create_directories(options.output);
+  }
+
+  std::atomic<bool> failed = false;
+  pool.parallel_for(chunks, [&](size_t chunk) {
+    std::vector<u32> pixels(static_cast<size_t>(width) * height);
+    std::vector<u8> yuv;
+    std::ofstream stream;
+    if (options.format == OUTPUT_Y4M) {
+      yuv.resize(yuv_size);
+      stream.open(options.output,
+                  std::ios::binary | std::ios::in | std::ios::out);
+    }
+
+    render::RenderState target;
+    target.memory = pixels.data();
+    target.width = width;
+    target.height = height;
+    target.pitch = width;
+
+    render::Renderer renderer;
+    Match local = checkpoints[chunk];
+    local.bind(renderer);
+
+    size_t end = std::min(recording.ticks.size(), (chunk + 1) * chunk_ticks);
+    for (size_t i = chunk * chunk_ticks; i < end; ++i) {
+      bool shown = schedule.frame_count[i] > 0;
+      renderer.render_state = shown ? target : render::RenderState{};
+      renderer.begin_frame();
+      recording.apply(i);
+      local.tick(recording.ticks[i].dt);
+      if (!shown)
+        continue;
+      renderer.flush();
+
+      if (options.format == OUTPUT_Y4M)
+        capture::rgb_to_i420(pixels.data(), width, width, height, yuv.data());
+      for (u32 k = 0; k < schedule.frame_count[i]; ++k) {
+        u32 frame = schedule.first_frame[i] + k;
+        if (options.format == OUTPUT_BMP) {
+          std::string path =
+              std::format("{}/frame_{:06}.bmp", options.output, frame);
+          if (!write_bmp(path, pixels.data(), width, height))
+            failed = true;
+          continue;
+        }
+        stream.seekp(static_cast<std::streamoff>(header.size() +
+                                                 frame * (6 + yuv_size)));
+        stream.write("FRAME\n", 6);
+        stream.write(reinterpret_cast<const char *>(yuv.data()), yuv_size);
+        if (!stream)
+          failed = true;
+      }
+    }
+  });
+  i64 rendered = utils::query_counter();
+
+  double frequency = static_cast<double>(utils::counter_frequency());
+  double simulate_s = (simulated - begin) / frequency;
+  double render_s = (rendered - simulated) / frequency;
+  double match_s = recording.duration();
+  std::printf("%zu ticks, %u frames (%.1f s of play) at %dx%d\n",
+              recording.ticks.size(), schedule.frames, match_s, width, height);
+  std::printf("checkpoint pass: %.1f ms, %zu checkpoints\n",
+              simulate_s * 1000.0, checkpoints.size());
+  std::printf("render pass:     %.1f ms on %zu threads, %.0f fps, %.1fx "
+              "real time\n",
+              render_s * 1000.0, pool.concurrency(),
+              schedule.frames / render_s, match_s / (simulate_s + render_s));
+  if (failed) {
+    std::printf("failed to write %s\n", options.output.c_str());
+    return 1;
+  }
+  return 0;
+}
+
+// --render-replay <replay> <output> [--size WxH] [--fps N]
+//                 [--format bmp|y4m] [--threads N]
+inline i32 run(const std::vector<std::string> &args) {
+  utils::attach_console();
+
+  if (args.size() < 2) {
+    std::printf("usage: --render-replay <replay> <output> [--size WxH] "
+                "[--fps N] [--format bmp|y4m] [--threads N]\n");
+    return 1;
+  }
+
+  Options options;
+  options.replay = args[0];
+  options.output = args[1];
+  for (size_t i = 2; i + 1 < args.size(); i += 2) {
+    const std::string &flag = args[i];
+    const std::string &value = args[i + 1];
+    if (flag == "--size")
+      std::sscanf(value.c_str(), "%dx%d", &options.width, &options.height);
+    else if (flag == "--fps")
+      options.fps = std::atoi(value.c_str());
+    else if (flag == "--format")
+      options.format = value == "y4m" ? OUTPUT_Y4M : OUTPUT_BMP;
+    else if (flag == "--threads")
+      options.workers = std::max(1, std::atoi(value.c_str())) - 1;
+  }
+  if (options.width < 2 || options.height < 2 || options.fps <= 0) {
+    std::printf("invalid --size or --fps\n");
+    return 1;
+  }
+  return export_replay(options);
+}
+} // namespace replay_export
+} // namespace game
@@ -0,0 +1,125 @@
+#pragma once
+
+#include <algorithm>
+#include <atomic>
+#include <condition_variable>
+#include <cstddef>
+#include <functional>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+namespace game {
+namespace utils {
+// Persistent workers for splitting one pass into tiles. The calling thread
+// takes tiles too, so a pool of size 0 simply runs everything inline.
+class ThreadPool {
+public:
+  explicit ThreadPool(size_t workers = default_workers()) {
+    for (size_t i = 0; i < workers; ++i)
+      threads.emplace_back([this] { work(); });
+  }
+
+  ~ThreadPool() {
+    {
+      std::lock_guard<std::mutex> lock(mutex);
+      stopping = true;
+    }
+    wake.notify_all();
+    for (std::thread &thread : threads)
+      thread.join();
+  }
+
+  ThreadPool(const ThreadPool &) = delete;
+  ThreadPool &operator=(const ThreadPool &) = delete;
+
+  static size_t default_workers() {
+    unsigned cores = std::thread::hardware_concurrency();
+    return cores > 1 ? cores - 1 : 0;
+  }
+
+  size_t concurrency() const { return threads.size() + 1; }
+
+  // Runs body(i) for every i in [0, count) and returns once all are done.
+  void parallel_for(size_t count, const std::function<void(size_t)> &body) {
+    if (count == 0)
+      return;
+    if (threads.empty() || count == 1) {
+      for (size_t i = 0; i < count; ++i)
+        body(i);
+      return;
+    }
+
+    {
+      std::lock_guard<std::mutex> lock(mutex);
+      job = &body;
+      job_count = count;
+      next.store(0, std::memory_order_relaxed);
+      remaining = count;
+      generation++;
+    }
+    wake.notify_all();
+
+    size_t completed = drain(body, count);
+
+    std::unique_lock<std::mutex> lock(mutex);
+    remaining -= completed;
+    done.wait(lock, [this] { return remaining == 0 && active == 0; });
+    job = nullptr;
+  }
+
+private:
+  size_t drain(const std::function<void(size_t)> &body, size_t count) {
+    size_t completed = 0;
+    for (;;) {
+      size_t i = next.fetch_add(1, std::memory_order_relaxed);
+      if (i >= count)
+        return completed;
+      body(i);
+      completed++;
+    }
+  }
+
+  void work() {
+    size_t seen = 0;
+    for (;;) {
+      const std::function<void(size_t)> *body = nullptr;
+      size_t count = 0;
+      {
+        std::unique_lock<std::mutex> lock(mutex);
+        wake.wait(lock, [&] { return stopping || generation != seen; });
+        if (stopping)
+          return;
+        seen = generation;
+        if (!job)
+          continue;
+        body = job;
+        count = job_count;
+        active++;
+      }
+
+      size_t completed = drain(*body, count);
+
+      std::lock_guard<std::mutex> lock(mutex);
+      remaining -= completed;
+      active--;
+      if (remaining == 0 && active == 0)
+        done.notify_one();
+    }
+  }
+
+  std::vector<std::thread> threads;
+  std::mutex mutex;
+  std::condition_variable wake;
+  std::condition_variable done;
+
+  const std::function<void(size_t)> *job = nullptr;
+  size_t job_count = 0;
+  std::atomic<size_t> next = 0;
+  size_t remaining = 0;
+  size_t active = 0;
+  size_t generation = 0;
+  bool stopping = false;
+};
+} // namespace utils
+} // namespace game
@@ -0,0 +1,737 @@
+#pragma once
+
+#include "game.hpp"
+
+// A columnar archive of per-tick match state for bulk analysis of
+// simulated matches. Rows are written in chunks of CHUNK_TICKS. Within a
+// chunk every column is stored on its own, as fixed-point integers that
+// are bit-packed either relative to the chunk's minimum or as zigzagged
+// differences from the previous tick, whichever is smaller. The few values
+// too wide for the chosen bit width (a goal's reset, a new match) are
+// stored whole after the packed ones. Each chunk keeps every column's
+// minimum and maximum, so a query skips the chunks that cannot match
+// without decoding them.
+//   pingpong.exe --analytics --simulate 500 --ticks hard.ticks
+//   pingpong.exe --scan-ticks hard.ticks [--speed-above 300]
+//                [--near-paddle 8] [--where column min max] [--show 10]
+
+namespace game {
+namespace ticks {
+enum Column {
+  COLUMN_MATCH,
+  COLUMN_TICK,
+  COLUMN_BALL_X,
+  COLUMN_BALL_Y,
+  COLUMN_BALL_VX,
+  COLUMN_BALL_VY,
+  COLUMN_P1_Y,
+  COLUMN_P1_DP,
+  COLUMN_P2_Y,
+  COLUMN_P2_DP,
+  COLUMN_INPUTS,
+
+  COLUMN_COUNT
+};
+
+const char *column_names[COLUMN_COUNT] = {
+    "match", "tick",  "ball_x", "ball_y", "ball_vx", "ball_vy",
+    "p1_y",  "p1_dp", "p2_y",   "p2_dp",  "inputs"};
+
+// Fixed-point steps per unit: 1/256 of a world unit for positions and 1/16
+// of a unit per second for speeds.
+const float column_scales[COLUMN_COUNT] = {1.0f,  1.0f,   256.0f, 256.0f,
+                                           16.0f, 16.0f,  256.0f, 16.0f,
+                                           256.0f, 16.0f, 1.0f};
+
+// Bits of the inputs column.
+enum Input : u8 { P1_UP = 1, P1_DOWN = 2, P2_UP = 4, P2_DOWN = 8 };
+
+constexpr float PADDLE_X = 70.0f;
+constexpr u32 CHUNK_TICKS = 8192;
+constexpr u32 MAGIC = 0x4B545050; // "PPTK"
+constexpr u32 VERSION = 1;
+
+struct Tick {
+  i32 values[COLUMN_COUNT];
+};
+
+inline i32 quantize(Column column, float value) {
+  double scaled =
+      std::round(static_cast<double>(value) * column_scales[column]);
+  return static_cast<i32>(std::clamp(scaled, -2147483647.0, 2147483647.0));
+}
+
+inline float dequantize(Column column, i32 value) {
+  return static_cast<float>(value) / column_scales[column];
+}
+
+inline u8 inputs_of(const objects::PlayerController &p1,
+                    const objects::PlayerController &p2) {
+  auto bits = [](i8 push, u8 up, u8 down) -> u8 {
+    return push < 0 ? up : push > 0 ? down : 0;
+  };
+  return bits(p1.push, P1_UP, P1_DOWN) | bits(p2.push, P2_UP, P2_DOWN);
+}
+
+inline Tick sample(const Match &match, u32 id, u32 tick) {
+  const objects::BallController &ball = match.ball.controller;
+  const objects::PlayerController &p1 = match.player1.controller;
+  const objects::PlayerController &p2 = match.player2.controller;
+  Tick t;
+  t.values[COLUMN_MATCH] = static_cast<i32>(id);
+  t.values[COLUMN_TICK] = static_cast<i32>(tick);
+  t.values[COLUMN_BALL_X] = quantize(COLUMN_BALL_X, ball.pos.x);
+  t.values[COLUMN_BALL_Y] = quantize(COLUMN_BALL_Y, ball.pos.y);
+  t.values[COLUMN_BALL_VX] = quantize(COLUMN_BALL_VX, ball.vel.x);
+  t.values[COLUMN_BALL_VY] = quantize(COLUMN_BALL_VY, ball.vel.y);
+  t.values[COLUMN_P1_Y] = quantize(COLUMN_P1_Y, p1.pos.y);
+  t.values[COLUMN_P1_DP] = quantize(COLUMN_P1_DP, p1.dp);
+  t.values[COLUMN_P2_Y] = quantize(COLUMN_P2_Y, p2.pos.y);
+  t.values[COLUMN_P2_DP] = quantize(COLUMN_P2_DP, p2.dp);
+  t.values[COLUMN_INPUTS] = inputs_of(p1, p2);
+  return t;
+}
+
+enum Encoding : u8 { ENCODE_FRAME, ENCODE_DELTA };
+
+struct FileHeader {
+  u32 magic;
+  u32 version;
+  u32 column_count;
+  u32 chunk_ticks;
+};
+
+struct ColumnInfo {
+  i32 min;
+  i32 max;
+  i32 base; // ENCODE_FRAME: the minimum; ENCODE_DELTA: the first value
+  u8 encoding;
+  u8 bits;
+  u16 exceptions; // values wider than `bits`, after the packed ones
+  u32 offset;     // from the start of the chunk's data
+};
+
+// A value that did not fit, at `index` of the chunk.
+struct Exception {
+  u32 index;
+  u32 value;
+};
+
+struct ChunkHeader {
+  u32 ticks;
+  u32 bytes; // of data after this header
+  u64 first_row;
+  ColumnInfo columns[COLUMN_COUNT];
+};
+
+// Decoding reads each value with one unaligned 8-byte load, which may run
+// up to 7 bytes past the last packed byte; every chunk ends with this much
+// padding.
+constexpr u32 CHUNK_SLACK = 8;
+
+inline u32 zigzag(u32 delta) {
+  return (delta << 1) ^ static_cast<u32>(static_cast<i32>(delta) >> 31);
+}
+
+inline u32 unzigzag(u32 value) { return (value >> 1) ^ (0u - (value & 1)); }
+
+// Packs `count` values of `bits` bits each, lowest bits first, padded to
+// whole 8-byte words.
+inline void pack(const u32 *values, size_t count, u32 bits,
+                 std::vector<u8> &out) {
+  u64 word = 0;
+  u32 used = 0;
+  auto emit = [&] {
+    for (i32 i = 0; i < 8; ++i)
+      out.push_back(static_cast<u8>(word >> (i * 8)));
+  };
+  for (size_t i = 0; bits > 0 && i < count; ++i) {
+    word |= static_cast<u64>(values[i]) << used;
+    used += bits;
+    if (used >= 64) {
+      emit();
+      used -= 64;
+      word = used > 0 ? static_cast<u64>(values[i]) >> (bits - used) : 0;
+    }
+  }
+  if (used > 0)
+    emit();
+}
+
+inline size_t packed_bytes(size_t count, u32 bits) {
+  return (count * bits + 63) / 64 * 8;
+}
+
+// The bit width that makes `count` values smallest with the wider ones as
+// exceptions, from a histogram of their widths. Returns the size in bits.
+inline size_t best_width(const size_t (&widths)[33], size_t count,
+                         u32 &bits) {
+  size_t best = SIZE_MAX;
+  size_t wider = count;
+  for (u32 b = 0; b <= 32; ++b) {
+    wider -= widths[b];
+    size_t size = packed_bytes(count, b) * 8 + wider * sizeof(Exception) * 8;
+    if (size < best) {
+      best = size;
+      bits = b;
+    }
+  }
+  return best;
+}
+
+inline void encode_column(const i32 *values, size_t count, ColumnInfo &info,
+                          std::vector<u8> &out) {
+  i32 min = values[0];
+  i32 max = values[0];
+  for (size_t i = 1; i < count; ++i) {
+    min = std::min(min, values[i]);
+    max = std::max(max, values[i]);
+  }
+  std::vector<u32> frame(count);
+  std::vector<u32> delta(count);
+  size_t frame_widths[33] = {};
+  size_t delta_widths[33] = {};
+  for (size_t i = 0; i < count; ++i) {
+    frame[i] = static_cast<u32>(values[i]) - static_cast<u32>(min);
+    delta[i] = i == 0 ? 0
+                      : zigzag(static_cast<u32>(values[i]) -
+                               static_cast<u32>(values[i - 1]));
+    frame_widths[std::bit_width(frame[i])]++;
+    delta_widths[std::bit_width(delta[i])]++;
+  }
+  u32 frame_bits = 0;
+  u32 delta_bits = 0;
+  size_t frame_size = best_width(frame_widths, count, frame_bits);
+  size_t delta_size = best_width(delta_widths, count, delta_bits);
+
+  bool use_delta = delta_size < frame_size;
+  std::vector<u32> &packed = use_delta ? delta : frame;
+  info.min = min;
+  info.max = max;
+  info.encoding = use_delta ? ENCODE_DELTA : ENCODE_FRAME;
+  info.bits = static_cast<u8>(use_delta ? delta_bits : frame_bits);
+  info.base = use_delta ? values[0] : min;
+  info.offset = static_cast<u32>(out.size());
+  std::vector<Exception> exceptions;
+  for (size_t i = 0; i < count; ++i)
+    if (std::bit_width(packed[i]) > info.bits) {
+      exceptions.push_back({static_cast<u32>(i), packed[i]});
+      packed[i] = 0;
+    }
+  info.exceptions = static_cast<u16>(exceptions.size());
+  pack(packed.data(), count, info.bits, out);
+  const u8 *bytes = reinterpret_cast<const u8 *>(exceptions.data());
+  out.insert(out.end(), bytes, bytes + exceptions.size() * sizeof(Exception));
+}
+
+// `count` is the chunk's number of ticks: the exceptions follow the packed
+// values of all of them.
+inline void decode_column(const u8 *data, const ColumnInfo &info,
+                          size_t count, i32 *out) {
+  const u8 *packed = data + info.offset;
+  const u32 bits = info.bits;
+  const u64 mask = (1ull << bits) - 1;
+  u32 *values = reinterpret_cast<u32 *>(out);
+  for (size_t i = 0; i < count; ++i) {
+    size_t bit = i * bits;
+    u64 word;
+    std::memcpy(&word, packed + bit / 8, sizeof(word));
+    values[i] = static_cast<u32>((word >> (bit % 8)) & mask);
+  }
+  const u8 *patches = packed + packed_bytes(count, bits);
+  for (u32 e = 0; e < info.exceptions; ++e) {
+    Exception exception;
+    std::memcpy(&exception, patches + e * sizeof(Exception),
+                sizeof(exception));
+    if (exception.index < count)
+      values[exception.index] = exception.value;
+  }
+  u32 value = static_cast<u32>(info.base);
+  if (info.encoding == ENCODE_FRAME) {
+    for (size_t i = 0; i < count; ++i)
+      values[i] += value;
+  } else {
+    for (size_t i = 0; i < count; ++i) {
+      value += unzigzag(values[i]);
+      values[i] = value;
+    }
+  }
+}
+
+// Buffers a chunk of ticks, then encodes and appends it.
+class Writer {
+public:
+  Writer() = default;
+  Writer(const Writer &) = delete;
+  Writer &operator=(const Writer &) = delete;
+  ~Writer() { close(); }
+
+  bool open(const std::string &path) {
+    close();
+    std::filesystem::path file(path);
+    if (file.has_parent_path())
+      std::filesystem::create_directories(file.parent_path());
+    out.open(file, std::ios::binary | std::ios::trunc);
+    if (!out)
+      return false;
+    FileHeader header = {MAGIC, VERSION, COLUMN_COUNT, CHUNK_TICKS};
+    out.write(reinterpret_cast<const char *>(&header), sizeof(header));
+    written = sizeof(header);
+    for (std::vector<i32> &column : pending)
+      column.reserve(CHUNK_TICKS);
+    return static_cast<bool>(out);
+  }
+
+  void add(const Tick &tick) {
+    for (i32 c = 0; c < COLUMN_COUNT; ++c)
+      pending[c].push_back(tick.values[c]);
+    if (pending[0].size() == CHUNK_TICKS)
+      flush();
+  }
+
+  bool close() {
+    if (!out.is_open())
+      return true;
+    flush();
+    bool ok = static_cast<bool>(out);
+    out.close();
+    return ok;
+  }
+
+  u64 rows() const { return total; }
+  u64 bytes() const { return written; }
+
+private:
+  void flush() {
+    u32 count = static_cast<u32>(pending[0].size());
+    if (count == 0)
+      return;
+    ChunkHeader header = {};
+    header.ticks = count;
+    header.first_row = total;
+    data.clear();
+    for (i32 c = 0; c < COLUMN_COUNT; ++c) {
+      encode_column(pending[c].data(), count, header.columns[c], data);
+      pending[c].clear();
+    }
+    data.resize(data.size() + CHUNK_SLACK);
+    header.bytes = static_cast<u32>(data.size());
+    out.write(reinterpret_cast<const char *>(&header), sizeof(header));
+    out.write(reinterpret_cast<const char *>(data.data()),
+              static_cast<std::streamsize>(data.size()));
+    total += count;
+    written += sizeof(header) + data.size();
+  }
+
+  std::ofstream out;
+  std::vector<i32> pending[COLUMN_COUNT];
+  std::vector<u8> data;
+  u64 total = 0;
+  u64 written = 0;
+};
+
+// Inclusive bounds on fixed-point columns, compared against the absolute
+// value for columns marked so, and a minimum ball speed.
+struct Query {
+  bool active[COLUMN_COUNT] = {};
+  bool absolute[COLUMN_COUNT] = {};
+  i32 lo[COLUMN_COUNT] = {};
+  i32 hi[COLUMN_COUNT] = {};
+  float min_speed = -1.0f; // world units per second; negative for any
+
+  void where(Column column, float min, float max, bool abs = false) {
+    active[column] = true;
+    absolute[column] = abs;
+    lo[column] = quantize(column, min);
+    hi[column] = quantize(column, max);
+  }
+
+  // The ball within `distance` of either paddle's line.
+  void near_paddle(float distance) {
+    where(COLUMN_BALL_X, PADDLE_X - distance, 1e6f, true);
+  }
+
+  bool uses(Column column) const {
+    return active[column] || (min_speed >= 0.0f && (column == COLUMN_BALL_VX ||
+                                                    column == COLUMN_BALL_VY));
+  }
+
+  // Squared speed in the fixed-point units of the velocity columns.
+  float speed_threshold() const {
+    float s = min_speed * column_scales[COLUMN_BALL_VX];
+    return min_speed < 0.0f ? -1.0f : s * s;
+  }
+
+  // False if no row of the chunk can match, from its minimums and maximums.
+  bool may_match(const ChunkHeader &chunk) const {
+    for (i32 c = 0; c < COLUMN_COUNT; ++c) {
+      if (!active[c])
+        continue;
+      i64 min = chunk.columns[c].min;
+      i64 max = chunk.columns[c].max;
+      if (absolute[c]) {
+        i64 far = std::max(-min, max);
+        min = min > 0 ? min : max < 0 ? -max : 0;
+        max = far;
+      }
+      if (max < lo[c] || min > hi[c])
+        return false;
+    }
+    if (min_speed >= 0.0f) {
+      auto peak = [&](Column c) {
+        double a = chunk.columns[c].min;
+        double b = chunk.columns[c].max;
+        return std::max(a * a, b * b);
+      };
+      if (peak(COLUMN_BALL_VX) + peak(COLUMN_BALL_VY) <= speed_threshold())
+        return false;
+    }
+    return true;
+  }
+};
+
+// Filter kernels: row i of the decoded columns matches when bit i % 8 of
+// mask[i / 8] is set. Only the columns the query uses need to be decoded.
+// Each returns the number of matching rows.
+using FilterKernel = size_t (*)(const Query &query, const i32 *const *columns,
+                                size_t count, u8 *mask);
+
+inline size_t filter_rows_scalar(const Query &query, const i32 *const *columns,
+                                 size_t begin, size_t count, u8 *mask) {
+  const float threshold = query.speed_threshold();
+  size_t matches = 0;
+  for (size_t i = begin; i < count; ++i) {
+    bool ok = true;
+    for (i32 c = 0; c < COLUMN_COUNT; ++c) {
+      if (!query.active[c])
+        continue;
+      i64 v = columns[c][i];
+      if (query.absolute[c])
+        v = v < 0 ? -v : v;
+      ok = ok && v >= query.lo[c] && v <= query.hi[c];
+    }
+    if (threshold >= 0.0f) {
+      float vx = static_cast<float>(columns[COLUMN_BALL_VX][i]);
+      float vy = static_cast<float>(columns[COLUMN_BALL_VY][i]);
+      ok = ok && vx * vx + vy * vy > threshold;
+    }
+    if (i % 8 == 0)
+      mask[i / 8] = 0;
+    mask[i / 8] |= static_cast<u8>(ok) << (i % 8);
+    matches += ok;
+  }
+  return matches;
+}
+
+inline size_t filter_scalar(const Query &query, const i32 *const *columns,
+                            size_t count, u8 *mask) {
+  return filter_rows_scalar(query, columns, 0, count, mask);
+}
+
+// The columns the query bounds, listed once so the SIMD loops do not test
+// every column for every block of rows.
+struct ActiveColumns {
+  i32 list[COLUMN_COUNT];
+  i32 count = 0;
+
+  explicit ActiveColumns(const Query &query) {
+    for (i32 c = 0; c < COLUMN_COUNT; ++c)
+      if (query.active[c])
+        list[count++] = c;
+  }
+};
+
+inline size_t filter_sse2(const Query &query, const i32 *const *columns,
+                          size_t count, u8 *mask) {
+  const ActiveColumns active(query);
+  const float threshold = query.speed_threshold();
+  const __m128 limit = _mm_set1_ps(threshold);
+  size_t matches = 0;
+  size_t i = 0;
+  for (; i + 8 <= count; i += 8) {
+    i32 bits = 0;
+    for (size_t half = 0; half < 8; half += 4) {
+      __m128i keep = _mm_set1_epi32(-1);
+      for (i32 k = 0; k < active.count; ++k) {
+        i32 c = active.list[k];
+        __m128i v = _mm_loadu_si128(
+            reinterpret_cast<const __m128i *>(columns[c] + i + half));
+        if (query.absolute[c]) {
+          __m128i sign = _mm_srai_epi32(v, 31);
+          v = _mm_sub_epi32(_mm_xor_si128(v, sign), sign);
+        }
+        __m128i out =
+            _mm_or_si128(_mm_cmplt_epi32(v, _mm_set1_epi32(query.lo[c])),
+                         _mm_cmpgt_epi32(v, _mm_set1_epi32(query.hi[c])));
+        keep = _mm_andnot_si128(out, keep);
+      }
+      __m128 ok = _mm_castsi128_ps(keep);
+      if (threshold >= 0.0f) {
+        __m128 vx = _mm_cvtepi32_ps(_mm_loadu_si128(
+            reinterpret_cast<const __m128i *>(columns[COLUMN_BALL_VX] + i +
+                                              half)));
+        __m128 vy = _mm_cvtepi32_ps(_mm_loadu_si128(
+            reinterpret_cast<const __m128i *>(columns[COLUMN_BALL_VY] + i +
+                                              half)));
+        __m128 speed = _mm_add_ps(_mm_mul_ps(vx, vx), _mm_mul_ps(vy, vy));
+        ok = _mm_and_ps(ok, _mm_cmpgt_ps(speed, limit));
+      }
+      bits |= _mm_movemask_ps(ok) << half;
+    }
+    mask[i / 8] = static_cast<u8>(bits);
+    matches += std::popcount(static_cast<u32>(bits));
+  }
+  return matches + filter_rows_scalar(query, columns, i, count, mask);
+}
+
+GAME_TARGET_AVX2 inline size_t filter_avx2(const Query &query,
+                                           const i32 *const *columns,
+                                           size_t count, u8 *mask) {
+  const ActiveColumns active(query);
+  const float threshold = query.speed_threshold();
+  const __m256 limit = _mm256_set1_ps(threshold);
+  size_t matches = 0;
+  size_t i = 0;
+  for (; i + 8 <= count; i += 8) {
+    __m256i keep = _mm256_set1_epi32(-1);
+    for (i32 k = 0; k < active.count; ++k) {
+      i32 c = active.list[k];
+      __m256i v = _mm256_loadu_si256(
+          reinterpret_cast<const __m256i *>(columns[c] + i));
+      if (query.absolute[c])
+        v = _mm256_abs_epi32(v);
+      __m256i out = _mm256_or_si256(
+          _mm256_cmpgt_epi32(_mm256_set1_epi32(query.lo[c]), v),
+          _mm256_cmpgt_epi32(v, _mm256_set1_epi32(query.hi[c])));
+      keep = _mm256_andnot_si256(out, keep);
+    }
+    __m256 ok = _mm256_castsi256_ps(keep);
+    if (threshold >= 0.0f) {
+      __m256 vx = _mm256_cvtepi32_ps(_mm256_loadu_si256(
+          reinterpret_cast<const __m256i *>(columns[COLUMN_BALL_VX] + i)));
+      __m256 vy = _mm256_cvtepi32_ps(_mm256_loadu_si256(
+          reinterpret_cast<const __m256i *>(columns[COLUMN_BALL_VY] + i)));
+      __m256 speed =
+          _mm256_add_ps(_mm256_mul_ps(vx, vx), _mm256_mul_ps(vy, vy));
+      ok = _mm256_and_ps(ok, _mm256_cmp_ps(speed, limit, _CMP_GT_OQ));
+    }
+    i32 bits = _mm256_movemask_ps(ok);
+    mask[i / 8] = static_cast<u8>(bits);
+    matches += std::popcount(static_cast<u32>(bits));
+  }
+  return matches + filter_rows_scalar(query, columns, i, count, mask);
+}
+
+inline size_t filter(const Query &query, const i32 *const *columns,
+                     size_t count, u8 *mask) {
+  if (utils::cpu_has_avx2())
+    return filter_avx2(query, columns, count, mask);
+  return filter_sse2(query, columns, count, mask);
+}
+
+// Whether every column of a chunk decodes inside its data, slack included.
+inline bool columns_fit(const ChunkHeader &chunk) {
+  for (const ColumnInfo &info : chunk.columns) {
+    if (info.bits > 32 || info.encoding > ENCODE_DELTA)
+      return false;
+    u64 end = static_cast<u64>(info.offset) +
+              packed_bytes(chunk.ticks, info.bits) +
+              static_cast<u64>(info.exceptions) * sizeof(Exception) +
+              CHUNK_SLACK;
+    if (end > chunk.bytes)
+      return false;
+  }
+  return true;
+}
+
+// A mapped archive. Chunks are found by walking their headers once; a chunk
+// torn by a crash can only be the last one and is left out, as is anything
+// from a chunk whose columns do not fit its data onwards.
+class Archive {
+public:
+  struct Chunk {
+    ChunkHeader header;
+    const u8 *data;
+  };
+
+  bool open(const std::string &path) {
+    chunks.clear();
+    rows = 0;
+    if (!file.open(path) || file.length() < sizeof(FileHeader))
+      return false;
+    FileHeader header;
+    std::memcpy(&header, file.bytes(), sizeof(header));
+    if (header.magic != MAGIC || header.version != VERSION ||
+        header.column_count != COLUMN_COUNT ||
+        header.chunk_ticks != CHUNK_TICKS)
+      return false;
+    size_t at = sizeof(FileHeader);
+    while (at + sizeof(ChunkHeader) <= file.length()) {
+      ChunkHeader chunk;
+      std::memcpy(&chunk, file.bytes() + at, sizeof(chunk));
+      size_t end = at + sizeof(ChunkHeader) + chunk.bytes;
+      if (chunk.ticks == 0 || chunk.ticks > CHUNK_TICKS ||
+          end > file.length() || !columns_fit(chunk))
+        break;
+      chunks.push_back({chunk, file.bytes() + at + sizeof(ChunkHeader)});
+      rows += chunk.ticks;
+      at = end;
+    }
+    return true;
+  }
+
+  size_t size() const { return file.length(); }
+
+  std::vector<Chunk> chunks;
+  u64 rows = 0;
+
+private:
+  results::MappedFile file;
+};
+
+struct ChunkResult {
+  bool skipped = false;
+  size_t matches = 0;
+  std::vector<u32> rows; // the first matches, as offsets into the chunk
+};
+
+struct ScanResult {
+  u64 matches = 0;
+  u64 rows = 0;
+  size_t chunks_skipped = 0;
+  std::vector<u64> first; // the first matching rows of the archive
+};
+
+inline ChunkResult scan_chunk(const Archive::Chunk &chunk, const Query &query,
+                              size_t keep) {
+  ChunkResult result;
+  result.skipped = !query.may_match(chunk.header);
+  if (result.skipped)
+    return result;
+  const size_t count = chunk.header.ticks;
+  thread_local std::vector<i32> decoded(static_cast<size_t>(COLUMN_COUNT) *
+                                        CHUNK_TICKS);
+  const i32 *columns[COLUMN_COUNT] = {};
+  for (i32 c = 0; c < COLUMN_COUNT; ++c) {
+    if (!query.uses(static_cast<Column>(c)))
+      continue;
+    i32 *column = decoded.data() + static_cast<size_t>(c) * CHUNK_TICKS;
+    decode_column(chunk.data, chunk.header.columns[c], count, column);
+    columns[c] = column;
+  }
+  u8 mask[CHUNK_TICKS / 8];
+  result.matches = filter(query, columns, count, mask);
+  for (size_t i = 0; i < count && result.rows.size() < keep; ++i)
+    if (mask[i / 8] >> (i % 8) & 1)
+      result.rows.push_back(static_cast<u32>(i));
+  return result;
+}
+
+// Chunks are scanned in parallel; `keep` is how many matching rows to
+// return.
+inline ScanResult scan(const Archive &archive, const Query &query,
+                       utils::ThreadPool &pool, size_t keep = 0) {
+  std::vector<ChunkResult> results(archive.chunks.size());
+  pool.parallel_for(archive.chunks.size(), [&](size_t i) {
+    results[i] = scan_chunk(archive.chunks[i], query, keep);
+  });
+  ScanResult total;
+  total.rows = archive.rows;
+  for (size_t i = 0; i < results.size(); ++i) {
+    total.matches += results[i].matches;
+    total.chunks_skipped += results[i].skipped;
+    for (u32 row : results[i].rows)
+      if (total.first.size() < keep)
+        total.first.push_back(archive.chunks[i].header.first_row + row);
+  }
+  return total;
+}
+
+inline Tick read_row(const Archive &archive, u64 row) {
+  Tick tick = {};
+  for (const Archive::Chunk &chunk : archive.chunks) {
+    if (row >= chunk.header.first_row + chunk.header.ticks)
+      continue;
+    size_t offset = static_cast<size_t>(row - chunk.header.first_row);
+    std::vector<i32> column(chunk.header.ticks);
+    for (i32 c = 0; c < COLUMN_COUNT; ++c) {
+      decode_column(chunk.data, chunk.header.columns[c], chunk.header.ticks,
+                    column.data());
+      tick.values[c] = column[offset];
+    }
+    break;
+  }
+  return tick;
+}
+
+inline i32 column_named(const std::string &name) {
+  for (i32 c = 0; c < COLUMN_COUNT; ++c)
+    if (name == column_names[c])
+      return c;
+  return -1;
+}
+
+// --scan-ticks file [--speed-above S] [--near-paddle D]
+//              [--where column min max] [--show N]
+inline i32 run(const std::vector<std::string> &args) {
+  utils::attach_console();
+  if (args.empty()) {
+    std::printf("usage: --scan-ticks file [--speed-above S] [--near-paddle "
+                "D] [--where column min max] [--show N]\n");
+    return 1;
+  }
+  Query query;
+  size_t show = 10;
+  for (size_t i = 1; i < args.size(); ++i) {
+    bool has_value = i + 1 < args.size();
+    if (args[i] == "--speed-above" && has_value) {
+      query.min_speed = std::stof(args[++i]);
+    } else if (args[i] == "--near-paddle" && has_value) {
+      query.near_paddle(std::stof(args[++i]));
+    } else if (args[i] == "--show" && has_value) {
+      show = std::stoul(args[++i]);
+    } else if (args[i] == "--where" && i + 3 < args.size()) {
+      i32 c = column_named(args[i + 1]);
+      if (c < 0) {
+        std::printf("unknown column '%s'\n", args[i + 1].c_str());
+        return 1;
+      }
+      query.where(static_cast<Column>(c), std::stof(args[i + 2]),
+                  std::stof(args[i + 3]));
+      i += 3;
+    }
+  }
+
+  Archive archive;
+  if (!archive.open(args[0])) {
+    std::printf("%s is not a tick archive\n", args[0].c_str());
+    return 1;
+  }
+  utils::ThreadPool pool;
+  i64 start = utils::query_counter();
+  ScanResult result = scan(archive, query, pool, show);
+  double elapsed = static_cast<double>(utils::query_counter() - start) /
+                   utils::counter_frequency();
+
+  std::printf("%-6s %6s %8s %8s %8s %8s %8s %8s %8s %8s %6s\n", "match",
+              "tick", "ball_x", "ball_y", "ball_vx", "ball_vy", "p1_y",
+              "p1_dp", "p2_y", "p2_dp", "inputs");
+  for (u64 row : result.first) {
+    Tick t = read_row(archive, row);
+    std::printf("%-6d %6d", t.values[COLUMN_MATCH], t.values[COLUMN_TICK]);
+    for (i32 c = COLUMN_BALL_X; c < COLUMN_INPUTS; ++c)
+      std::printf(" %8.2f", dequantize(static_cast<Column>(c), t.values[c]));
+    std::printf(" %6x\n", t.values[COLUMN_INPUTS]);
+  }
+  double raw = static_cast<double>(archive.rows) * sizeof(Tick);
+  std::printf("%llu of %llu ticks match (%.3f%%), %zu of %zu chunks skipped, "
+              "%.2f ms (%.2f GB/s of raw ticks, %.1f MB on disk)\n",
+              static_cast<unsigned long long>(result.matches),
+              static_cast<unsigned long long>(result.rows),
+              100.0 * result.matches / std::max<u64>(result.rows, 1),
+              result.chunks_skipped, archive.chunks.size(), elapsed * 1000.0,
+              raw / std::max(elapsed, 1e-9) / 1e9, archive.size() / 1e6);
+  return 0;
+}
+} // namespace ticks
+} // namespace game
@@ -4,8 +4,42 @@
 
 #include "include/game.hpp"
 
+#include "include/analytics.hpp"
+#include "include/assets.hpp"
+#include "include/bench.hpp"
+#include "include/golden.hpp"
+#include "include/replay_export.hpp"
+
 i32 WINAPI WinMain(HINSTANCE hInstance, HINSTANCE hPrevInstance,
                    LPSTR lpCmdLine, i32 nCmdShow) {
+  std::vector<std::string> args = game::utils::split_command_line(lpCmdLine);
+  if (!args.empty() && args[0] == "--bench")
+    return game::bench::run({args.begin() + 1, args.end()});
+  if (!args.empty() && args[0] == "--render-replay")
+    return game::replay_export::run({args.begin() + 1, args.end()});
+  if (!args.empty() && args[0] == "--golden")
+    return game::golden::run({args.begin() + 1, args.end()});
+  if (!args.empty() && args[0] == "--analytics")
+    return game::analytics::run({args.begin() + 1, args.end()});
+  if (!args.empty() && args[0] == "--scan-ticks")
+    return game::ticks::run({args.begin() + 1, args.end()});
+  if (!args.empty() && args[0] == "--matches") {
+    game::utils::attach_console();
+    return game::results::run({args.begin() + 1, args.end()});
+  }
+  if (!args.empty() && args[0] == "--pack-assets") {
+    game::utils::attach_console();
+    return game::assets::run({args.begin() + 1, args.end()});
+  }
+  if (!args.empty() && args[0] == "--decode-log") {
+    game::utils::attach_console();
+    return game::events::run({args.begin() + 1, args.end()});
+  }
+  if (!args.empty() && args[0] == "--crash-report") {
+    game::utils::attach_console();
+    return game::flight::run({args.begin() + 1, args.end()});
+  }
+
   game::window::Window game_window = {};
   game_window.mainloop();
 
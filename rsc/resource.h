@@ -1,2 +1,3 @@
 #pragma once
 #define IDI_APP_ICON 101
+#define IDR_ASSETS 102